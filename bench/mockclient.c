@@ -0,0 +1,1160 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup mockclient mockclient
+ * @brief In-process iotclient transport for benchmarking
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file mockclient.c
+
+    In-process iotclient transport for benchmarking
+
+    The mockclient module replaces libiotclient in the iotexec_bench
+    executable, so the complete command path of iotexec (dispatcher,
+    executor, launcher and response) can be measured without an IoT
+    Hub.  IOTCLIENT_Receive replays a mix of commands at a target rate,
+    and IOTCLIENT_Send and IOTCLIENT_Stream consume the responses,
+    recording the latency of each command from its receipt to the
+    final message carrying its exit code.
+
+    The benchmark is configured with environment variables, so all of
+    the normal iotexec command line options remain available:
+
+        IOTEXEC_BENCH_MIX    file of commands, one per line, optionally
+                             preceded by a weight and a tab
+        IOTEXEC_BENCH_RATE   commands received per second, 0 for as
+                             fast as the receive queue allows (default 0)
+        IOTEXEC_BENCH_COUNT  number of commands to send (default 1000)
+        IOTEXEC_BENCH_SEND   time in microseconds taken to send each
+                             response message, simulating a slow
+                             uplink (default 0)
+        IOTEXEC_BENCH_START  wall clock time in nanoseconds at which
+                             iotexec was started, eg. $(date +%s%N),
+                             to report its startup latency
+
+    The commands are received by the first thread to call
+    IOTCLIENT_Receive, so with several receiver targets only one is fed
+    and the others wait indefinitely.
+
+    No more commands are outstanding than the receive queue depth given
+    to IOTCLIENT_CreateReceiver, so commands are never rejected for a
+    full queue: a rate which iotexec cannot sustain shows as a lower
+    achieved rate.  Once every command has completed, or no command has
+    completed for BENCH_STALL_SECONDS, the throughput and latency
+    percentiles are reported and the process exits, along with the
+    resident set size of iotexec once it was ready to receive, and its
+    peak.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <iotclient/iotclient.h>
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+/*! default number of commands sent */
+#define DEFAULT_COUNT 1000
+
+/*! maximum number of commands in the mix */
+#define MAX_MIX 64
+
+/*! maximum length of a command in the mix */
+#define MAX_COMMAND_LENGTH 1024
+
+/*! prefix of the message identifiers of the benchmark commands */
+#define MSGID_PREFIX "bench-"
+
+/*! time without a completed command after which the benchmark ends */
+#define BENCH_STALL_SECONDS 30
+
+/*! a command of the benchmark mix */
+typedef struct _mixEntry
+{
+    /*! NUL terminated command */
+    char command[MAX_COMMAND_LENGTH];
+
+    /*! relative frequency of the command */
+    unsigned int weight;
+
+} MixEntry;
+
+/*! benchmark state */
+typedef struct _bench
+{
+    /*! serializes the benchmark state between iotexec's threads */
+    pthread_mutex_t lock;
+
+    /*! signalled when a command completes */
+    pthread_cond_t completed;
+
+    /*! the commands of the mix */
+    MixEntry mix[MAX_MIX];
+
+    /*! number of commands in the mix */
+    size_t mixSize;
+
+    /*! total weight of the commands in the mix */
+    unsigned int totalWeight;
+
+    /*! true once the benchmark has been configured */
+    bool configured;
+
+    /*! true once the thread receiving the commands is known */
+    bool hasReceiver;
+
+    /*! the thread receiving the commands */
+    pthread_t receiver;
+
+    /*! number of commands to send */
+    size_t count;
+
+    /*! simulated time (us) to send a response message */
+    unsigned long sendUs;
+
+    /*! target receive rate in commands per second, 0 for unpaced */
+    double rate;
+
+    /*! maximum number of outstanding commands */
+    size_t maxOutstanding;
+
+    /*! number of commands sent */
+    size_t sent;
+
+    /*! number of commands completed */
+    size_t done;
+
+    /*! receive time (us) of each command */
+    uint64_t *pReceived;
+
+    /*! latency (us) of each completed command */
+    uint64_t *pLatency;
+
+    /*! response body bytes received */
+    uint64_t bytes;
+
+    /*! time (us) the first command was received */
+    uint64_t startTime;
+
+    /*! time (us) the last command completed */
+    uint64_t endTime;
+
+    /*! wall clock time (us) at which iotexec was started, or 0 */
+    uint64_t execTime;
+
+    /*! time (us) from starting iotexec to its first receive, or 0 */
+    uint64_t startupUs;
+
+    /*! resident set size (KB) at the first receive */
+    long startupRss;
+
+    /*! receive buffer for the current message */
+    char rxBuf[MAX_COMMAND_LENGTH + 64];
+
+} Bench;
+
+/*==============================================================================
+        Private file scoped variables
+==============================================================================*/
+
+/*! the benchmark state */
+static Bench bench =
+{
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .completed = PTHREAD_COND_INITIALIZER
+};
+
+/*! commands used when no mix file is given */
+static const char *defaultMix[] =
+{
+    "true",
+    "echo hello",
+    "cat /proc/uptime",
+    "head -c 65536 /dev/zero",
+    "ls -l /usr/bin | wc -l"
+};
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static bool Configure( Bench *pBench );
+static int LoadMix( Bench *pBench, const char *path );
+static void AddCommand( Bench *pBench, const char *command, unsigned weight );
+static const char *PickCommand( Bench *pBench, size_t n );
+static int GetHeader( const char *headers,
+                      const char *name,
+                      char *buf,
+                      size_t len );
+static void Complete( Bench *pBench, const char *headers );
+static void Report( Bench *pBench );
+static int CompareLatency( const void *a, const void *b );
+static uint64_t Percentile( Bench *pBench, double p );
+static uint64_t NowUs( void );
+static uint64_t WallUs( void );
+static long GetMemory( const char *name );
+static void SleepUntil( uint64_t us );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  IOTCLIENT_Create                                                          */
+/*!
+    Create the mock iotclient connection
+
+    Every connection created by iotexec (the dispatcher's, and those
+    of the workers, reactor and response sender) shares the benchmark
+    state, which is configured from the environment by the first.
+
+    @retval handle to the mock connection
+    @retval NULL the benchmark could not be configured
+
+==============================================================================*/
+IOTCLIENT_HANDLE IOTCLIENT_Create( void )
+{
+    IOTCLIENT_HANDLE hIoTClient = NULL;
+    bool ok;
+
+    pthread_mutex_lock( &bench.lock );
+    ok = bench.configured ? ( bench.pLatency != NULL ) : Configure( &bench );
+    pthread_mutex_unlock( &bench.lock );
+
+    if( ok )
+    {
+        hIoTClient = &bench;
+    }
+
+    return hIoTClient;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_Close                                                           */
+/*!
+    Close the mock iotclient connection
+
+    @param[in]
+        hIoTClient
+            handle to the mock connection
+
+    @retval EOK the connection was closed
+
+==============================================================================*/
+int IOTCLIENT_Close( IOTCLIENT_HANDLE hIoTClient )
+{
+    (void)hIoTClient;
+
+    return EOK;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_SetVerbose                                                      */
+/*!
+    Set the verbosity of the mock connection
+
+    @param[in]
+        hIoTClient
+            handle to the mock connection
+
+    @param[in]
+        verbose
+            ignored
+
+    @retval EOK the verbosity was set
+
+==============================================================================*/
+int IOTCLIENT_SetVerbose( IOTCLIENT_HANDLE hIoTClient, bool verbose )
+{
+    (void)hIoTClient;
+    (void)verbose;
+
+    return EOK;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_CreateReceiver                                                  */
+/*!
+    Create the mock message receiver
+
+    The receive queue depth bounds the number of outstanding commands.
+
+    @param[in]
+        hIoTClient
+            handle to the mock connection
+
+    @param[in]
+        target
+            ignored
+
+    @param[in]
+        numMessages
+            depth of the receive queue
+
+    @param[in]
+        messageSize
+            ignored
+
+    @retval EOK the receiver was created
+
+==============================================================================*/
+int IOTCLIENT_CreateReceiver( IOTCLIENT_HANDLE hIoTClient,
+                              char *target,
+                              size_t numMessages,
+                              size_t messageSize )
+{
+    (void)hIoTClient;
+    (void)target;
+    (void)messageSize;
+
+    bench.maxOutstanding = ( numMessages > 0 ) ? numMessages : 1;
+
+    return EOK;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_Receive                                                         */
+/*!
+    Receive the next benchmark command
+
+    The IOTCLIENT_Receive function waits for the next command's slot in
+    the target rate, and until fewer commands than the receive queue
+    depth are outstanding.  After the last command it waits for the
+    responses and reports the results.
+
+    @param[in]
+        hIoTClient
+            handle to the mock connection
+
+    @param[out]
+        ppHeader
+            receives a pointer to the message header
+
+    @param[out]
+        ppBody
+            receives a pointer to the message body
+
+    @param[out]
+        pHeaderLength
+            receives the length of the message header
+
+    @param[out]
+        pBodyLength
+            receives the length of the message body
+
+    @retval EOK a command was received
+
+==============================================================================*/
+int IOTCLIENT_Receive( IOTCLIENT_HANDLE hIoTClient,
+                       char **ppHeader,
+                       char **ppBody,
+                       size_t *pHeaderLength,
+                       size_t *pBodyLength )
+{
+    Bench *pBench = (Bench *)hIoTClient;
+    struct timespec deadline;
+    const char *command;
+    bool stalled = false;
+    size_t done;
+    size_t n;
+    int len;
+
+    pthread_mutex_lock( &pBench->lock );
+
+    if( pBench->hasReceiver == false )
+    {
+        pBench->receiver = pthread_self();
+        pBench->hasReceiver = true;
+    }
+
+    if( pthread_equal( pBench->receiver, pthread_self() ) == 0 )
+    {
+        /* the commands are sent to another receiver */
+        pthread_mutex_unlock( &pBench->lock );
+        while( true )
+        {
+            pause();
+        }
+    }
+
+    if( pBench->sent == 0 )
+    {
+        pBench->startTime = NowUs();
+        pBench->startupRss = GetMemory( "VmRSS" );
+        if( pBench->execTime != 0 )
+        {
+            pBench->startupUs = WallUs() - pBench->execTime;
+        }
+    }
+
+    /* wait for a free slot, or for the last responses */
+    while( ( pBench->done < pBench->count ) &&
+           ( ( pBench->sent == pBench->count ) ||
+             ( pBench->sent - pBench->done >= pBench->maxOutstanding ) ) &&
+           ( stalled == false ) )
+    {
+        done = pBench->done;
+        clock_gettime( CLOCK_REALTIME, &deadline );
+        deadline.tv_sec += BENCH_STALL_SECONDS;
+
+        if( ( pthread_cond_timedwait( &pBench->completed,
+                                      &pBench->lock,
+                                      &deadline ) == ETIMEDOUT ) &&
+            ( pBench->done == done ) )
+        {
+            fprintf( stderr,
+                     "no command completed in %d seconds\n",
+                     BENCH_STALL_SECONDS );
+            stalled = true;
+        }
+    }
+
+    if( ( pBench->done == pBench->count ) || ( stalled == true ) )
+    {
+        Report( pBench );
+        exit( 0 );
+    }
+
+    n = pBench->sent++;
+    pthread_mutex_unlock( &pBench->lock );
+
+    if( pBench->rate > 0.0 )
+    {
+        SleepUntil( pBench->startTime + (uint64_t)( n * 1e6 / pBench->rate ) );
+    }
+
+    command = PickCommand( pBench, n );
+    len = snprintf( pBench->rxBuf,
+                    sizeof( pBench->rxBuf ),
+                    "messageId:" MSGID_PREFIX "%zu",
+                    n );
+
+    *ppHeader = pBench->rxBuf;
+    *pHeaderLength = len;
+    *ppBody = &pBench->rxBuf[len + 1];
+    *pBodyLength = strlen( command );
+    strcpy( *ppBody, command );
+
+    pthread_mutex_lock( &pBench->lock );
+    pBench->pReceived[n] = NowUs();
+    pthread_mutex_unlock( &pBench->lock );
+
+    return EOK;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_GetProperty                                                     */
+/*!
+    Get a property from a message header
+
+    @param[in]
+        header
+            pointer to the NUL terminated name:value message header
+
+    @param[in]
+        property
+            pointer to the NUL terminated property name
+
+    @param[out]
+        buf
+            receives the NUL terminated property value
+
+    @param[in]
+        len
+            size of the value buffer
+
+    @retval EOK the property was found
+    @retval ENOENT the property was not found
+    @retval E2BIG the value does not fit in the buffer
+
+==============================================================================*/
+int IOTCLIENT_GetProperty( char *header,
+                           char *property,
+                           char *buf,
+                           size_t len )
+{
+    return GetHeader( header, property, buf, len );
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_Send                                                            */
+/*!
+    Consume a response message
+
+    The IOTCLIENT_Send function counts the response body, and completes
+    the command when the message carries its exit code.
+
+    @param[in]
+        hIoTClient
+            handle to the mock connection
+
+    @param[in]
+        headers
+            pointer to the NUL terminated response headers
+
+    @param[in]
+        body
+            pointer to the response body
+
+    @param[in]
+        length
+            length of the response body
+
+    @retval EOK the message was consumed
+
+==============================================================================*/
+int IOTCLIENT_Send( IOTCLIENT_HANDLE hIoTClient,
+                    const char *headers,
+                    const char *body,
+                    size_t length )
+{
+    Bench *pBench = (Bench *)hIoTClient;
+
+    (void)body;
+
+    if( pBench->sendUs > 0 )
+    {
+        usleep( pBench->sendUs );
+    }
+
+    pthread_mutex_lock( &pBench->lock );
+    pBench->bytes += length;
+    Complete( pBench, headers );
+    pthread_mutex_unlock( &pBench->lock );
+
+    return EOK;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_Stream                                                          */
+/*!
+    Consume a streamed response
+
+    The IOTCLIENT_Stream function reads the command output until the end
+    of file, counting the bytes.  Each read stands for a message of the
+    simulated uplink.
+
+    @param[in]
+        hIoTClient
+            handle to the mock connection
+
+    @param[in]
+        headers
+            pointer to the NUL terminated response headers
+
+    @param[in]
+        fd
+            the command output file descriptor
+
+    @retval EOK the output was consumed
+    @retval error as returned by read
+
+==============================================================================*/
+int IOTCLIENT_Stream( IOTCLIENT_HANDLE hIoTClient,
+                      const char *headers,
+                      int fd )
+{
+    Bench *pBench = (Bench *)hIoTClient;
+    int result = EOK;
+    char buf[BUFSIZ];
+    uint64_t total = 0;
+    ssize_t n;
+
+    (void)headers;
+
+    while( ( n = read( fd, buf, sizeof( buf ) ) ) != 0 )
+    {
+        if( n > 0 )
+        {
+            total += n;
+            if( pBench->sendUs > 0 )
+            {
+                usleep( pBench->sendUs );
+            }
+        }
+        else if( errno != EINTR )
+        {
+            result = errno;
+            break;
+        }
+    }
+
+    pthread_mutex_lock( &pBench->lock );
+    pBench->bytes += total;
+    pthread_mutex_unlock( &pBench->lock );
+
+    return result;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  Configure                                                                 */
+/*!
+    Configure the benchmark from the environment
+
+    @param[in]
+        pBench
+            pointer to the benchmark state, which is locked
+
+    @retval true the benchmark was configured
+    @retval false the benchmark has no commands or could not allocate
+            its latency samples
+
+==============================================================================*/
+static bool Configure( Bench *pBench )
+{
+    const char *mix = getenv( "IOTEXEC_BENCH_MIX" );
+    const char *rate = getenv( "IOTEXEC_BENCH_RATE" );
+    const char *count = getenv( "IOTEXEC_BENCH_COUNT" );
+    const char *send = getenv( "IOTEXEC_BENCH_SEND" );
+    const char *start = getenv( "IOTEXEC_BENCH_START" );
+    size_t i;
+
+    pBench->configured = true;
+    pBench->count = ( count != NULL ) ? strtoul( count, NULL, 0 )
+                                      : DEFAULT_COUNT;
+    pBench->rate = ( rate != NULL ) ? strtod( rate, NULL ) : 0.0;
+    pBench->sendUs = ( send != NULL ) ? strtoul( send, NULL, 0 ) : 0;
+    pBench->execTime = ( start != NULL )
+                        ? strtoull( start, NULL, 10 ) / 1000
+                        : 0;
+
+    if( mix != NULL )
+    {
+        if( LoadMix( pBench, mix ) != EOK )
+        {
+            fprintf( stderr, "cannot load command mix: %s\n", mix );
+        }
+    }
+    else
+    {
+        for( i = 0; i < sizeof( defaultMix ) / sizeof( defaultMix[0] ); i++ )
+        {
+            AddCommand( pBench, defaultMix[i], 1 );
+        }
+    }
+
+    if( ( pBench->mixSize > 0 ) && ( pBench->count > 0 ) )
+    {
+        pBench->pReceived = calloc( pBench->count, sizeof( uint64_t ) );
+        pBench->pLatency = calloc( pBench->count, sizeof( uint64_t ) );
+        if( ( pBench->pReceived == NULL ) || ( pBench->pLatency == NULL ) )
+        {
+            free( pBench->pReceived );
+            free( pBench->pLatency );
+            pBench->pReceived = NULL;
+            pBench->pLatency = NULL;
+        }
+    }
+
+    return ( pBench->pLatency != NULL );
+}
+
+/*============================================================================*/
+/*  LoadMix                                                                   */
+/*!
+    Load the benchmark command mix
+
+    Each line of the mix file holds a command, optionally preceded by
+    its weight and a tab.  Empty lines and lines starting with # are
+    ignored.
+
+    @param[in]
+        pBench
+            pointer to the benchmark state
+
+    @param[in]
+        path
+            pointer to the NUL terminated path of the mix file
+
+    @retval EOK the mix was loaded
+    @retval ENOENT the mix file holds no commands
+    @retval error as returned by fopen
+
+==============================================================================*/
+static int LoadMix( Bench *pBench, const char *path )
+{
+    int result;
+    char line[MAX_COMMAND_LENGTH + 16];
+    unsigned long weight;
+    char *command;
+    char *end;
+    FILE *fp;
+
+    fp = fopen( path, "r" );
+    if( fp != NULL )
+    {
+        while( fgets( line, sizeof( line ), fp ) != NULL )
+        {
+            line[strcspn( line, "\r\n" )] = '\0';
+            if( ( line[0] == '\0' ) || ( line[0] == '#' ) )
+            {
+                continue;
+            }
+
+            command = line;
+            weight = strtoul( line, &end, 10 );
+            if( ( end != line ) && ( *end == '\t' ) )
+            {
+                command = end + 1;
+            }
+            else
+            {
+                weight = 1;
+            }
+
+            AddCommand( pBench, command, weight );
+        }
+
+        fclose( fp );
+        result = ( pBench->mixSize > 0 ) ? EOK : ENOENT;
+    }
+    else
+    {
+        result = errno;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  AddCommand                                                                */
+/*!
+    Add a command to the benchmark mix
+
+    @param[in]
+        pBench
+            pointer to the benchmark state
+
+    @param[in]
+        command
+            pointer to the NUL terminated command
+
+    @param[in]
+        weight
+            relative frequency of the command
+
+==============================================================================*/
+static void AddCommand( Bench *pBench, const char *command, unsigned weight )
+{
+    MixEntry *pEntry;
+
+    if( ( pBench->mixSize < MAX_MIX ) &&
+        ( weight > 0 ) &&
+        ( strlen( command ) < MAX_COMMAND_LENGTH ) )
+    {
+        pEntry = &pBench->mix[pBench->mixSize++];
+        strcpy( pEntry->command, command );
+        pEntry->weight = weight;
+        pBench->totalWeight += weight;
+    }
+}
+
+/*============================================================================*/
+/*  PickCommand                                                               */
+/*!
+    Select the command to send
+
+    The PickCommand function spreads the commands of the mix evenly,
+    in proportion to their weights, over the sequence of commands sent.
+    The selection is deterministic so runs can be compared.
+
+    @param[in]
+        pBench
+            pointer to the benchmark state
+
+    @param[in]
+        n
+            sequence number of the command
+
+    @retval pointer to the NUL terminated command
+
+==============================================================================*/
+static const char *PickCommand( Bench *pBench, size_t n )
+{
+    unsigned int slot;
+    size_t i;
+
+    /* a multiplicative hash scatters the weighted slots */
+    slot = (unsigned int)( ( n * 2654435761u ) % pBench->totalWeight );
+
+    for( i = 0; i < pBench->mixSize - 1; i++ )
+    {
+        if( slot < pBench->mix[i].weight )
+        {
+            break;
+        }
+
+        slot -= pBench->mix[i].weight;
+    }
+
+    return pBench->mix[i].command;
+}
+
+/*============================================================================*/
+/*  GetHeader                                                                 */
+/*!
+    Find a name:value header
+
+    @param[in]
+        headers
+            pointer to the NUL terminated newline separated headers
+
+    @param[in]
+        name
+            pointer to the NUL terminated header name
+
+    @param[out]
+        buf
+            receives the NUL terminated header value
+
+    @param[in]
+        len
+            size of the value buffer
+
+    @retval EOK the header was found
+    @retval ENOENT the header was not found
+    @retval E2BIG the value does not fit in the buffer
+
+==============================================================================*/
+static int GetHeader( const char *headers,
+                      const char *name,
+                      char *buf,
+                      size_t len )
+{
+    int result = ENOENT;
+    size_t nameLength = strlen( name );
+    const char *p = headers;
+    size_t n;
+
+    while( ( p != NULL ) && ( *p != '\0' ) && ( result == ENOENT ) )
+    {
+        if( ( strncmp( p, name, nameLength ) == 0 ) &&
+            ( p[nameLength] == ':' ) )
+        {
+            p += nameLength + 1;
+            n = strcspn( p, "\n" );
+            if( n < len )
+            {
+                memcpy( buf, p, n );
+                buf[n] = '\0';
+                result = EOK;
+            }
+            else
+            {
+                result = E2BIG;
+            }
+        }
+        else
+        {
+            p = strchr( p, '\n' );
+            if( p != NULL )
+            {
+                p++;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  Complete                                                                  */
+/*!
+    Complete a command when its final response message is consumed
+
+    @param[in]
+        pBench
+            pointer to the benchmark state, which is locked
+
+    @param[in]
+        headers
+            pointer to the NUL terminated response headers
+
+==============================================================================*/
+static void Complete( Bench *pBench, const char *headers )
+{
+    char value[64];
+    size_t n;
+
+    if( ( GetHeader( headers, "exitCode", value, sizeof( value ) ) == EOK ) &&
+        ( GetHeader( headers,
+                     "correlationId",
+                     value,
+                     sizeof( value ) ) == EOK ) &&
+        ( strncmp( value, MSGID_PREFIX, strlen( MSGID_PREFIX ) ) == 0 ) )
+    {
+        n = strtoul( &value[strlen( MSGID_PREFIX )], NULL, 10 );
+        if( ( n < pBench->sent ) && ( pBench->pLatency[n] == 0 ) )
+        {
+            pBench->endTime = NowUs();
+            pBench->pLatency[n] = pBench->endTime - pBench->pReceived[n];
+            if( pBench->pLatency[n] == 0 )
+            {
+                /* zero marks a command which has not completed */
+                pBench->pLatency[n] = 1;
+            }
+
+            pBench->done++;
+            pthread_cond_signal( &pBench->completed );
+        }
+    }
+}
+
+/*============================================================================*/
+/*  Report                                                                    */
+/*!
+    Report the benchmark results
+
+    @param[in]
+        pBench
+            pointer to the benchmark state, which is locked
+
+==============================================================================*/
+static void Report( Bench *pBench )
+{
+    double elapsed;
+    size_t i;
+    size_t n = 0;
+
+    /* keep the latencies of the completed commands */
+    for( i = 0; i < pBench->sent; i++ )
+    {
+        if( pBench->pLatency[i] != 0 )
+        {
+            pBench->pLatency[n++] = pBench->pLatency[i];
+        }
+    }
+
+    qsort( pBench->pLatency, n, sizeof( uint64_t ), CompareLatency );
+
+    pBench->done = n;
+
+    elapsed = ( pBench->endTime > pBench->startTime )
+                ? ( pBench->endTime - pBench->startTime ) / 1e6
+                : 0.0;
+
+    printf( "commands:     %zu of %zu completed\n", n, pBench->count );
+    printf( "elapsed:      %.3f s\n", elapsed );
+    if( ( n > 0 ) && ( elapsed > 0.0 ) )
+    {
+        printf( "throughput:   %.1f commands/s\n", n / elapsed );
+        printf( "output:       %.1f KB/s\n",
+                pBench->bytes / elapsed / 1024.0 );
+        printf( "latency p50:  %.3f ms\n",
+                Percentile( pBench, 0.50 ) / 1e3 );
+        printf( "latency p90:  %.3f ms\n",
+                Percentile( pBench, 0.90 ) / 1e3 );
+        printf( "latency p99:  %.3f ms\n",
+                Percentile( pBench, 0.99 ) / 1e3 );
+        printf( "latency max:  %.3f ms\n",
+                pBench->pLatency[n - 1] / 1e3 );
+    }
+
+    if( pBench->startupUs != 0 )
+    {
+        printf( "startup:      %.3f ms\n", pBench->startupUs / 1e3 );
+    }
+
+    printf( "startup RSS:  %ld KB\n", pBench->startupRss );
+    printf( "peak RSS:     %ld KB\n", GetMemory( "VmHWM" ) );
+
+    fflush( stdout );
+}
+
+/*============================================================================*/
+/*  CompareLatency                                                            */
+/*!
+    Order latency samples for qsort
+
+    @param[in]
+        a
+            pointer to the first sample
+
+    @param[in]
+        b
+            pointer to the second sample
+
+    @retval -1, 0 or 1 as the first sample is less than, equal to or
+            greater than the second
+
+==============================================================================*/
+static int CompareLatency( const void *a, const void *b )
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return ( x > y ) - ( x < y );
+}
+
+/*============================================================================*/
+/*  Percentile                                                                */
+/*!
+    Get a latency percentile
+
+    @param[in]
+        pBench
+            pointer to the benchmark state with sorted latencies of its
+            completed commands
+
+    @param[in]
+        p
+            the percentile, between 0 and 1
+
+    @retval the latency (us) at the percentile
+
+==============================================================================*/
+static uint64_t Percentile( Bench *pBench, double p )
+{
+    size_t index = (size_t)( p * ( pBench->done - 1 ) + 0.5 );
+
+    return pBench->pLatency[index];
+}
+
+/*============================================================================*/
+/*  NowUs                                                                     */
+/*!
+    Get the current monotonic time
+
+    @retval the monotonic time in microseconds
+
+==============================================================================*/
+static uint64_t NowUs( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ( (uint64_t)ts.tv_sec * 1000000 ) + ( ts.tv_nsec / 1000 );
+}
+
+/*============================================================================*/
+/*  WallUs                                                                    */
+/*!
+    Get the current wall clock time
+
+    @retval the wall clock time in microseconds
+
+==============================================================================*/
+static uint64_t WallUs( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_REALTIME, &ts );
+
+    return ( (uint64_t)ts.tv_sec * 1000000 ) + ( ts.tv_nsec / 1000 );
+}
+
+/*============================================================================*/
+/*  GetMemory                                                                 */
+/*!
+    Get a memory size of the process
+
+    The size is read from /proc/self/status rather than getrusage,
+    whose peak resident set size is carried over from the process
+    which executed iotexec.
+
+    @param[in]
+        name
+            pointer to the NUL terminated name of the size, eg. VmRSS
+
+    @retval the size in kilobytes
+    @retval 0 the size is not available
+
+==============================================================================*/
+static long GetMemory( const char *name )
+{
+    char line[128];
+    size_t len = strlen( name );
+    long size = 0;
+    FILE *fp;
+
+    fp = fopen( "/proc/self/status", "r" );
+    if( fp != NULL )
+    {
+        while( ( size == 0 ) && ( fgets( line, sizeof( line ), fp ) != NULL ) )
+        {
+            if( ( strncmp( line, name, len ) == 0 ) && ( line[len] == ':' ) )
+            {
+                size = strtol( &line[len + 1], NULL, 10 );
+            }
+        }
+
+        fclose( fp );
+    }
+
+    return size;
+}
+
+/*============================================================================*/
+/*  SleepUntil                                                                */
+/*!
+    Wait for a point in monotonic time
+
+    @param[in]
+        us
+            the monotonic time in microseconds to wait for
+
+==============================================================================*/
+static void SleepUntil( uint64_t us )
+{
+    struct timespec ts;
+
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = ( us % 1000000 ) * 1000;
+
+    while( clock_nanosleep( CLOCK_MONOTONIC,
+                            TIMER_ABSTIME,
+                            &ts,
+                            NULL ) == EINTR )
+    {
+        /* interrupted by a signal */
+    }
+}
+
+/*! @}
+ * end of mockclient group */
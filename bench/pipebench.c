@@ -0,0 +1,402 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup pipebench pipebench
+ * @brief Command output transfer benchmark
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file pipebench.c
+
+    Command output transfer benchmark
+
+    The pipebench utility measures the throughput of moving a large
+    command output from a child's stdout pipe to a transport pipe.
+    It compares a read/write copy through a user space buffer (the
+    path taken by coalesced output) with splice, which moves the pipe
+    pages without copying them through user space, at the default and
+    an enlarged pipe capacity.
+
+    The transport pipe is drained into /dev/null by a separate thread,
+    standing in for the iotclient transport.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+/*! default number of bytes transferred per run */
+#define DEFAULT_BYTES ( 64 * 1024 * 1024 )
+
+/*! default number of runs per configuration */
+#define DEFAULT_RUNS 5
+
+/*! enlarged pipe capacity */
+#define LARGE_PIPE_SIZE ( 1024 * 1024 )
+
+/*! size of the child's write buffer */
+#define WRITE_SIZE ( 64 * 1024 )
+
+/*! maximum bytes moved per splice call */
+#define SPLICE_SIZE ( 1024 * 1024 )
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+int main( int argc, char **argv );
+static double Run( bool useSplice, int pipeSize, size_t bytes );
+static pid_t StartWriter( int fd, size_t bytes );
+static void *Drain( void *arg );
+static size_t CopyData( int in, int out );
+static size_t SpliceData( int in, int out );
+static double Now( void );
+
+/*==============================================================================
+        Function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  main                                                                      */
+/*!
+    Main entry point for the pipebench application
+
+    @param[in]
+        argc
+            number of arguments on the command line
+
+    @param[in]
+        argv
+            array of pointers to the command line arguments
+
+    @retval 0 the benchmark completed
+
+==============================================================================*/
+int main( int argc, char **argv )
+{
+    size_t bytes = DEFAULT_BYTES;
+    int runs = DEFAULT_RUNS;
+    int sizes[] = { 0, LARGE_PIPE_SIZE };
+    bool modes[] = { false, true };
+    double total;
+    int c;
+    int i;
+    int j;
+    int k;
+
+    while( ( c = getopt( argc, argv, "n:r:h" ) ) != -1 )
+    {
+        switch( c )
+        {
+            case 'n':
+                bytes = strtoul( optarg, NULL, 0 );
+                break;
+
+            case 'r':
+                runs = atoi( optarg );
+                break;
+
+            default:
+                fprintf( stderr,
+                         "usage: %s [-n bytes] [-r runs]\n",
+                         argv[0] );
+                return 1;
+        }
+    }
+
+    printf( "%-8s %-10s %12s\n", "mode", "pipe size", "MB/s" );
+
+    for( i = 0; i < 2; i++ )
+    {
+        for( j = 0; j < 2; j++ )
+        {
+            total = 0.0;
+            for( k = 0; k < runs; k++ )
+            {
+                total += Run( modes[i], sizes[j], bytes );
+            }
+
+            printf( "%-8s %-10d %12.1f\n",
+                    modes[i] ? "splice" : "copy",
+                    sizes[j],
+                    ( bytes * (double)runs ) / ( total * 1024 * 1024 ) );
+        }
+    }
+
+    return 0;
+}
+
+/*============================================================================*/
+/*  Run                                                                       */
+/*!
+    Time the transfer of a command output
+
+    @param[in]
+        useSplice
+            true to move the data with splice, false to copy it
+
+    @param[in]
+        pipeSize
+            capacity of the command output pipe, 0 for the default
+
+    @param[in]
+        bytes
+            number of bytes written by the command
+
+    @retval elapsed time in seconds
+
+==============================================================================*/
+static double Run( bool useSplice, int pipeSize, size_t bytes )
+{
+    int cmd[2];
+    int transport[2];
+    pthread_t drain;
+    pid_t pid;
+    double start;
+    double elapsed;
+    size_t n;
+
+    if( ( pipe( cmd ) != 0 ) || ( pipe( transport ) != 0 ) )
+    {
+        perror( "pipe" );
+        exit( 1 );
+    }
+
+    if( pipeSize > 0 )
+    {
+        fcntl( cmd[0], F_SETPIPE_SZ, pipeSize );
+    }
+
+    pthread_create( &drain, NULL, Drain, &transport[0] );
+
+    start = Now();
+
+    pid = StartWriter( cmd[1], bytes );
+    close( cmd[1] );
+
+    n = useSplice ? SpliceData( cmd[0], transport[1] )
+                  : CopyData( cmd[0], transport[1] );
+
+    close( transport[1] );
+    pthread_join( drain, NULL );
+    waitpid( pid, NULL, 0 );
+
+    elapsed = Now() - start;
+
+    close( cmd[0] );
+    close( transport[0] );
+
+    if( n != bytes )
+    {
+        fprintf( stderr, "short transfer: %zu of %zu\n", n, bytes );
+    }
+
+    return elapsed;
+}
+
+/*============================================================================*/
+/*  StartWriter                                                               */
+/*!
+    Start a child process which writes the command output
+
+    @param[in]
+        fd
+            write end of the command output pipe
+
+    @param[in]
+        bytes
+            number of bytes to write
+
+    @retval process identifier of the child
+
+==============================================================================*/
+static pid_t StartWriter( int fd, size_t bytes )
+{
+    static char buf[WRITE_SIZE];
+    pid_t pid;
+    size_t len;
+    ssize_t n;
+
+    pid = fork();
+    if( pid == 0 )
+    {
+        memset( buf, 'x', sizeof( buf ) );
+        while( bytes > 0 )
+        {
+            len = ( bytes < sizeof( buf ) ) ? bytes : sizeof( buf );
+            n = write( fd, buf, len );
+            if( n <= 0 )
+            {
+                _exit( 1 );
+            }
+
+            bytes -= n;
+        }
+
+        _exit( 0 );
+    }
+
+    return pid;
+}
+
+/*============================================================================*/
+/*  Drain                                                                     */
+/*!
+    Transport drain thread
+
+    The Drain thread empties the transport pipe into /dev/null.
+
+    @param[in]
+        arg
+            pointer to the read end of the transport pipe
+
+    @retval NULL
+
+==============================================================================*/
+static void *Drain( void *arg )
+{
+    int fd = *(int *)arg;
+    int null;
+
+    null = open( "/dev/null", O_WRONLY );
+    if( null != -1 )
+    {
+        SpliceData( fd, null );
+        close( null );
+    }
+
+    return NULL;
+}
+
+/*============================================================================*/
+/*  CopyData                                                                  */
+/*!
+    Copy data between file descriptors through a user space buffer
+
+    @param[in]
+        in
+            file descriptor to read from
+
+    @param[in]
+        out
+            file descriptor to write to
+
+    @retval number of bytes copied
+
+==============================================================================*/
+static size_t CopyData( int in, int out )
+{
+    char buf[BUFSIZ];
+    size_t total = 0;
+    ssize_t n;
+
+    while( ( n = read( in, buf, sizeof( buf ) ) ) > 0 )
+    {
+        if( write( out, buf, n ) != n )
+        {
+            break;
+        }
+
+        total += n;
+    }
+
+    return total;
+}
+
+/*============================================================================*/
+/*  SpliceData                                                                */
+/*!
+    Move data between file descriptors with splice
+
+    @param[in]
+        in
+            file descriptor to read from (must be a pipe)
+
+    @param[in]
+        out
+            file descriptor to write to
+
+    @retval number of bytes moved
+
+==============================================================================*/
+static size_t SpliceData( int in, int out )
+{
+    size_t total = 0;
+    ssize_t n;
+
+    while( ( n = splice( in,
+                         NULL,
+                         out,
+                         NULL,
+                         SPLICE_SIZE,
+                         SPLICE_F_MOVE ) ) > 0 )
+    {
+        total += n;
+    }
+
+    return total;
+}
+
+/*============================================================================*/
+/*  Now                                                                       */
+/*!
+    Get the current monotonic time
+
+    @retval the current monotonic time in seconds
+
+==============================================================================*/
+static double Now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec + ( ts.tv_nsec / 1e9 );
+}
+
+/*! @}
+ * end of pipebench group */
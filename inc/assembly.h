@@ -0,0 +1,94 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef ASSEMBLY_H
+#define ASSEMBLY_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include "job.h"
+
+/*==============================================================================
+        Public definitions
+==============================================================================*/
+
+/*! a multi-part command being reassembled */
+typedef struct _assemblyEntry
+{
+    /*! pointer to the next entry being reassembled */
+    struct _assemblyEntry *pNext;
+
+    /*! the first part, whose header is used for the command */
+    Job *pFirst;
+
+    /*! total number of parts */
+    unsigned long parts;
+
+    /*! number of parts received */
+    unsigned long received;
+
+    /*! growable buffer holding the command received so far */
+    char *pBuf;
+
+    /*! length of the command received so far */
+    size_t length;
+
+    /*! size of the buffer */
+    size_t size;
+
+    /*! monotonic time (ms) at which the first part was received */
+    uint64_t started;
+
+} AssemblyEntry;
+
+/*! reassembly of multi-part commands */
+typedef struct _assembly
+{
+    /*! commands being reassembled */
+    AssemblyEntry *pEntries;
+
+    /*! number of commands being reassembled */
+    size_t numEntries;
+
+    /*! maximum length of a reassembled command */
+    size_t maxLength;
+
+    /*! time (ms) allowed for all the parts of a command to arrive */
+    uint64_t timeoutMs;
+
+} Assembly;
+
+/*==============================================================================
+        Public function declarations
+==============================================================================*/
+
+int ASSEMBLY_Init( Assembly *pAssembly, size_t maxLength, uint64_t timeoutMs );
+
+int ASSEMBLY_Add( Assembly *pAssembly, Job **ppJob, uint64_t now );
+
+#endif
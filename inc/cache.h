@@ -0,0 +1,98 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef CACHE_H
+#define CACHE_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/*==============================================================================
+        Public definitions
+==============================================================================*/
+
+/*! maximum size of a cached command output */
+#define CACHE_MAX_OUTPUT ( 64 * 1024 )
+
+/*! a cacheable command and its most recent output */
+typedef struct _cacheEntry
+{
+    /*! pointer to the next entry in the cache */
+    struct _cacheEntry *pNext;
+
+    /*! time (seconds) for which the command output remains valid */
+    unsigned int ttl;
+
+    /*! monotonic time (ms) at which the cached output expires */
+    uint64_t expiry;
+
+    /*! cached command output, or NULL if none is cached */
+    char *pData;
+
+    /*! length of the cached command output */
+    size_t length;
+
+    /*! NUL terminated command */
+    char command[];
+
+} CacheEntry;
+
+/*! result cache for read-only commands */
+typedef struct _cache
+{
+    /*! mutex protecting the cached outputs */
+    pthread_mutex_t lock;
+
+    /*! list of cacheable commands */
+    CacheEntry *pEntries;
+
+    /*! number of cacheable commands */
+    size_t numEntries;
+
+} Cache;
+
+/*==============================================================================
+        Public function declarations
+==============================================================================*/
+
+int CACHE_Load( Cache *pCache, const char *filename );
+
+CacheEntry *CACHE_Find( Cache *pCache, const char *command );
+
+int CACHE_Get( Cache *pCache,
+               CacheEntry *pEntry,
+               char **ppData,
+               size_t *pLength );
+
+int CACHE_Put( Cache *pCache,
+               CacheEntry *pEntry,
+               const char *pData,
+               size_t length );
+
+#endif
@@ -0,0 +1,126 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef CLASS_H
+#define CLASS_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*==============================================================================
+        Public definitions
+==============================================================================*/
+
+/*! maximum length of an execution class name */
+#define MAX_CLASS_NAME_LENGTH 32
+
+/*! maximum number of devices with an io limit in an execution class */
+#define MAX_CLASS_IO_LIMITS 4
+
+/*! maximum length of a cgroup directory path */
+#define MAX_CGROUP_PATH_LENGTH 256
+
+/*! io bandwidth limit of a block device */
+typedef struct _classIoLimit
+{
+    /*! NUL terminated major:minor number of the device */
+    char device[16];
+
+    /*! maximum read and write bandwidth in bytes per second */
+    uint64_t bps;
+
+} ClassIoLimit;
+
+/*! resource limits applied to the commands of an execution class */
+typedef struct _execClass
+{
+    /*! pointer to the next execution class */
+    struct _execClass *pNext;
+
+    /*! NUL terminated class name, selected by the class header */
+    char name[MAX_CLASS_NAME_LENGTH];
+
+    /*! CPU bandwidth in percent of one CPU, 0 for no limit */
+    unsigned int cpuPercent;
+
+    /*! memory limit in bytes, 0 for no limit */
+    uint64_t memoryMax;
+
+    /*! io bandwidth limits */
+    ClassIoLimit io[MAX_CLASS_IO_LIMITS];
+
+    /*! number of io bandwidth limits */
+    size_t numIo;
+
+    /*! CPU time limit in seconds, 0 for no limit */
+    uint64_t cpuTime;
+
+    /*! true if the commands are given the nice value */
+    bool hasNice;
+
+    /*! nice value of the commands */
+    int nice;
+
+    /*! io priority of the commands, or -1 to inherit iotexec's */
+    int ioPriority;
+
+    /*! directory of the class cgroup, under which each command is
+        given a leaf cgroup, or -1 if the class has no cgroup */
+    int cgroupFd;
+
+} ExecClass;
+
+/*! execution classes */
+typedef struct _classTable
+{
+    /*! list of execution classes */
+    ExecClass *pClasses;
+
+    /*! NUL terminated cgroup under which the class cgroups are created,
+        or empty if cgroups are not used */
+    char cgroupDir[MAX_CGROUP_PATH_LENGTH];
+
+} ClassTable;
+
+/*==============================================================================
+        Public function declarations
+==============================================================================*/
+
+int CLASS_Load( ClassTable *pTable, const char *filename );
+
+int CLASS_Setup( ClassTable *pTable, const char *cgroupDir );
+
+const ExecClass *CLASS_Find( ClassTable *pTable, const char *name );
+
+int CLASS_Apply( const ExecClass *pClass );
+
+int CLASS_Release( const ExecClass *pClass, pid_t pid );
+
+#endif
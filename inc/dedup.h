@@ -0,0 +1,88 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "job.h"
+
+/*==============================================================================
+        Public definitions
+==============================================================================*/
+
+/*! a recently received message identifier */
+typedef struct _dedupEntry
+{
+    /*! NUL terminated message identifier, empty if the entry is unused */
+    char msgId[MAX_MSGID_LENGTH];
+
+    /*! monotonic time (ms) at which the message was received */
+    uint64_t time;
+
+    /*! index of the next entry in the same hash bucket, or -1 */
+    int next;
+
+} DedupEntry;
+
+/*! bounded, time windowed set of recently received message identifiers */
+typedef struct _dedup
+{
+    /*! ring of recently received message identifiers */
+    DedupEntry *pEntries;
+
+    /*! number of entries in the ring */
+    size_t size;
+
+    /*! index of the ring entry to be replaced next */
+    size_t next;
+
+    /*! hash buckets holding the index of their first entry, or -1 */
+    int *pBuckets;
+
+    /*! number of hash buckets (a power of 2) */
+    size_t numBuckets;
+
+    /*! time (ms) for which a message identifier is remembered */
+    uint64_t windowMs;
+
+} Dedup;
+
+/*==============================================================================
+        Public function declarations
+==============================================================================*/
+
+int DEDUP_Init( Dedup *pDedup, size_t size, unsigned int windowMs );
+
+bool DEDUP_Check( Dedup *pDedup, const char *msgId, uint64_t now );
+
+void DEDUP_Remove( Dedup *pDedup, const char *msgId );
+
+#endif
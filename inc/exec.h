@@ -0,0 +1,208 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef EXEC_H
+#define EXEC_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <iotclient/iotclient.h>
+#include "job.h"
+#include "launcher.h"
+#include "response.h"
+#include "cache.h"
+#include "builtin.h"
+#include "session.h"
+#include "class.h"
+#include "inflight.h"
+#include "template.h"
+#include "limiter.h"
+#include "receiver.h"
+
+/*==============================================================================
+        Public definitions
+==============================================================================*/
+
+/*! service wide command execution options */
+typedef struct _execOptions
+{
+    /*! command launcher backend */
+    LauncherBackend backend;
+
+    /*! command response options */
+    ResponseOptions response;
+
+    /*! default command timeout in seconds, 0 for no timeout */
+    unsigned int timeout;
+
+    /*! default command output limit in bytes, 0 for no limit */
+    size_t maxOutputBytes;
+
+    /*! command result cache, or NULL if results are not cached */
+    Cache *pCache;
+
+    /*! shell sessions, or NULL if sessions are disabled */
+    SessionTable *pSessions;
+
+    /*! execution classes, or NULL if classes are not used */
+    ClassTable *pClasses;
+
+    /*! running commands, or NULL if they are not recorded */
+    InflightTable *pInflight;
+
+    /*! command templates, or NULL if templates are not used */
+    TemplateTable *pTemplates;
+
+    /*! true if only template commands may be executed */
+    bool templatesOnly;
+
+    /*! adaptive concurrency limiter, or NULL if the concurrency is fixed */
+    Limiter *pLimiter;
+
+    /*! receivers whose defaults apply to the commands received for
+        their targets, or NULL to use the service wide defaults */
+    ReceiverTable *pReceivers;
+
+    /*! maximum output messages per second of a subscription,
+        0 for no limit */
+    unsigned int subscriptionRate;
+
+    /*! execute commands with in-process builtins where possible */
+    bool builtins;
+
+    /*! verbose flag */
+    bool verbose;
+
+} ExecOptions;
+
+/*! a command being executed */
+typedef struct _exec
+{
+    /*! the job being executed */
+    Job *pJob;
+
+    /*! the service wide execution options */
+    const ExecOptions *pOptions;
+
+    /*! the launched command */
+    Child child;
+
+    /*! pidfd used to wait for the command to exit, or -1 */
+    int pidfd;
+
+    /*! the command response */
+    Response response;
+
+    /*! the response carrying the command's stderr stream */
+    Response errResponse;
+
+    /*! true if stderr is forwarded as a stream of its own */
+    bool stderrStream;
+
+    /*! true once the end of the stdout stream has been read */
+    bool outputEnded;
+
+    /*! true once the end of the stderr stream has been read */
+    bool errorEnded;
+
+    /*! monotonic time (ms) at which the command was started */
+    uint64_t startTime;
+
+    /*! monotonic time (us) at which the command was started */
+    uint64_t startTimeUs;
+
+    /*! monotonic time (us) of the command's first output, 0 if none yet */
+    uint64_t firstByteUs;
+
+    /*! monotonic time (ms) at which the command is killed, 0 for never */
+    uint64_t killTime;
+
+    /*! reason the command was terminated by iotexec, or NULL */
+    const char *terminated;
+
+    /*! wait status of the command, or -1 if it has not been reaped */
+    int status;
+
+    /*! cache entry which receives the command output, or NULL */
+    CacheEntry *pCacheEntry;
+
+    /*! execution class of the command, or NULL */
+    const ExecClass *pClass;
+
+    /*! command template executed by the command, or NULL */
+    const CommandTemplate *pTemplate;
+
+    /*! true if the command is a subscription */
+    bool subscription;
+
+    /*! maximum output messages per second of the subscription */
+    unsigned int rate;
+
+    /*! record of the command in the in-flight job table */
+    InflightJob inflight;
+
+    /*! true if the command was completed by an in-process builtin */
+    bool builtin;
+
+    /*! shell session executing the command, or NULL */
+    Session *pSession;
+
+    /*! job which was waiting for the session and may now be executed */
+    Job *pResume;
+
+} Exec;
+
+/*==============================================================================
+        Public function declarations
+==============================================================================*/
+
+int EXEC_Start( Exec *pExec,
+                IOTCLIENT_HANDLE hIoTClient,
+                Job *pJob,
+                const ExecOptions *pOptions );
+
+int EXEC_Cached( IOTCLIENT_HANDLE hIoTClient,
+                 Job *pJob,
+                 const ExecOptions *pOptions );
+
+int EXEC_Run( Exec *pExec );
+
+int EXEC_Read( Exec *pExec, char *pBuf, size_t size );
+
+int EXEC_Timer( Exec *pExec );
+
+int EXEC_Timeout( Exec *pExec );
+
+int EXEC_EndOutput( Exec *pExec );
+
+int EXEC_Wait( Exec *pExec );
+
+int EXEC_Finish( Exec *pExec );
+
+#endif
@@ -0,0 +1,143 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+
+#ifndef INFLIGHT_H
+#define INFLIGHT_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "launcher.h"
+#include "response.h"
+
+/*==============================================================================
+        Public definitions
+==============================================================================*/
+
+/*! number of message identifier hash buckets of the in-flight job table */
+#define INFLIGHT_BUCKETS 64
+
+/*! the job was cancelled by a cancel control message */
+#define INFLIGHT_CANCELLED 1
+
+/*! the job was killed when the service shut down */
+#define INFLIGHT_SHUTDOWN 2
+
+/*! a running command, embedded in the Exec which executes it */
+typedef struct _inflightJob
+{
+    /*! pointer to the next job in the same hash bucket */
+    struct _inflightJob *pNext;
+
+    /*! true while the job is recorded in the table */
+    bool linked;
+
+    /*! NUL terminated message identifier of the job, may be empty */
+    const char *msgId;
+
+    /*! NUL terminated command being executed */
+    const char *cmd;
+
+    /*! the launched command, which is signalled to cancel the job */
+    Child *pChild;
+
+    /*! process identifier of the launched command */
+    pid_t pid;
+
+    /*! wall clock time at which the job was started */
+    time_t started;
+
+    /*! monotonic time (ms) at which the job was started */
+    uint64_t startTime;
+
+    /*! the responses whose bytesSent are reported, either may be NULL */
+    const Response *pResponses[2];
+
+    /*! true if the job is a subscription */
+    bool subscription;
+
+    /*! set (atomically) to INFLIGHT_CANCELLED or INFLIGHT_SHUTDOWN when
+        the job is killed by the table */
+    int cancelled;
+
+} InflightJob;
+
+/*! table of the running commands indexed by message identifier */
+typedef struct _inflightTable
+{
+    /*! mutex protecting the table */
+    pthread_mutex_t lock;
+
+    /*! signalled when the last job is removed */
+    pthread_cond_t empty;
+
+    /*! message identifier hash buckets */
+    InflightJob *pBuckets[INFLIGHT_BUCKETS];
+
+    /*! number of running jobs */
+    size_t numJobs;
+
+    /*! number of running subscriptions */
+    size_t numSubscriptions;
+
+    /*! maximum number of running subscriptions, 0 to disable them */
+    size_t maxSubscriptions;
+
+    /*! true once the table is closed to new jobs */
+    bool closed;
+
+} InflightTable;
+
+/*==============================================================================
+        Public function declarations
+==============================================================================*/
+
+int INFLIGHT_Init( InflightTable *pTable, size_t maxSubscriptions );
+
+int INFLIGHT_Add( InflightTable *pTable, InflightJob *pJob );
+
+void INFLIGHT_Remove( InflightTable *pTable, InflightJob *pJob );
+
+int INFLIGHT_Cancel( InflightTable *pTable, const char *msgId );
+
+int INFLIGHT_Status( InflightTable *pTable,
+                     const char *msgId,
+                     char *pBuf,
+                     size_t size );
+
+int INFLIGHT_List( InflightTable *pTable, char *pBuf, size_t size );
+
+int INFLIGHT_Drain( InflightTable *pTable, unsigned int timeoutMs );
+
+int INFLIGHT_KillAll( InflightTable *pTable );
+
+#endif
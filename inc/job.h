@@ -0,0 +1,261 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef JOB_H
+#define JOB_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*==============================================================================
+        Public definitions
+==============================================================================*/
+
+/*! Maximum message identifier length, including the NUL terminator
+    (IoT Hub message identifiers have up to 128 characters) */
+#define MAX_MSGID_LENGTH 129
+
+/*! Maximum session identifier length */
+#define MAX_SESSION_ID_LENGTH 64
+
+/*! Maximum originator (userId or source) length */
+#define MAX_ORIGINATOR_LENGTH 64
+
+/*! Maximum number of commands in a batch message */
+#define MAX_BATCH_STEPS 64
+
+/*! Maximum number of receiver targets whose jobs are distinguished */
+#define JOB_MAX_TARGETS 8
+
+/*! job scheduling priority, in the order jobs are scheduled */
+typedef enum _jobPriority
+{
+    /*! urgent commands such as health probes or reboot */
+    JOB_PRIORITY_HIGH = 0,
+
+    /*! commands without a priority header */
+    JOB_PRIORITY_NORMAL,
+
+    /*! bulk commands such as log uploads */
+    JOB_PRIORITY_LOW,
+
+    /*! number of priority levels */
+    JOB_PRIORITY_LEVELS
+
+} JobPriority;
+
+/*! received message headers which are parsed into the property table */
+typedef enum _jobProperty
+{
+    /*! messageId: identifier of the message */
+    JOB_PROPERTY_MESSAGE_ID = 0,
+
+    /*! priority: scheduling priority of the command */
+    JOB_PROPERTY_PRIORITY,
+
+    /*! session: shell session which executes the command */
+    JOB_PROPERTY_SESSION,
+
+    /*! timeout: command timeout in seconds */
+    JOB_PROPERTY_TIMEOUT,
+
+    /*! maxOutputBytes: command output limit */
+    JOB_PROPERTY_MAX_OUTPUT_BYTES,
+
+    /*! acceptEncoding: content encodings accepted for the response */
+    JOB_PROPERTY_ACCEPT_ENCODING,
+
+    /*! class: execution class of the command */
+    JOB_PROPERTY_CLASS,
+
+    /*! subscribe: true if the command is a subscription */
+    JOB_PROPERTY_SUBSCRIBE,
+
+    /*! rate: maximum messages per second of a subscription */
+    JOB_PROPERTY_RATE,
+
+    /*! batch: true if the body holds one command per line */
+    JOB_PROPERTY_BATCH,
+
+    /*! parallel: true if batch steps may execute concurrently */
+    JOB_PROPERTY_PARALLEL,
+
+    /*! stdin: true if the command reads an uploaded stdin */
+    JOB_PROPERTY_STDIN,
+
+    /*! input: messageId of the command the upload data is for */
+    JOB_PROPERTY_INPUT,
+
+    /*! eof: true if the upload data is the last for the command */
+    JOB_PROPERTY_EOF,
+
+    /*! part: position (from 1) of a part of a multi-part command */
+    JOB_PROPERTY_PART,
+
+    /*! parts: number of parts of a multi-part command */
+    JOB_PROPERTY_PARTS,
+
+    /*! cancel: messageId of the commands to cancel */
+    JOB_PROPERTY_CANCEL,
+
+    /*! status: messageId of the commands to report on */
+    JOB_PROPERTY_STATUS,
+
+    /*! list: true to report on all the running commands */
+    JOB_PROPERTY_LIST,
+
+    /*! template: name of the command template to execute */
+    JOB_PROPERTY_TEMPLATE,
+
+    /*! chunked: true to send the output in numbered fixed size chunks */
+    JOB_PROPERTY_CHUNKED,
+
+    /*! resend: messageId of the chunked response to send again */
+    JOB_PROPERTY_RESEND,
+
+    /*! chunks: list of the chunks to send again, such as 3,7-9 */
+    JOB_PROPERTY_CHUNKS,
+
+    /*! userId: identity of the user which sent the message */
+    JOB_PROPERTY_USER_ID,
+
+    /*! source: name of the script or service which sent the message */
+    JOB_PROPERTY_SOURCE,
+
+    /*! number of properties */
+    JOB_PROPERTIES
+
+} JobProperty;
+
+/*! offset of a property which is absent from the message header */
+#define JOB_PROPERTY_ABSENT UINT32_MAX
+
+/*! location of a property value in the message header */
+typedef struct _jobValue
+{
+    /*! offset of the value in the header, or JOB_PROPERTY_ABSENT */
+    uint32_t offset;
+
+    /*! length of the value */
+    uint32_t length;
+
+} JobValue;
+
+/*! A received cloud-to-device command waiting to be executed */
+typedef struct _job
+{
+    /*! pointer to the next job in the queue, or the next follower */
+    struct _job *pNext;
+
+    /*! identical jobs which share this job's execution */
+    struct _job *pFollowers;
+
+    /*! NUL terminated message identifier, empty if none was received */
+    char msgId[MAX_MSGID_LENGTH];
+
+    /*! NUL terminated shell session identifier, empty if none */
+    char session[MAX_SESSION_ID_LENGTH];
+
+    /*! NUL terminated originator of the message, empty if anonymous */
+    char originator[MAX_ORIGINATOR_LENGTH];
+
+    /*! scheduling priority */
+    JobPriority priority;
+
+    /*! index of the job queue's originator entry which counts the job,
+        or -1 if the job is not counted against its originator */
+    int originatorEntry;
+
+    /*! index (below JOB_MAX_TARGETS) of the receiver target the message
+        was received for */
+    unsigned int target;
+
+    /*! position (from 1) of the command in its batch, 0 if not a batch step */
+    unsigned int step;
+
+    /*! next command of a sequential batch, executed after this one */
+    struct _job *pNextStep;
+
+    /*! true for the later steps of an admitted parallel batch, which
+        wait for room in the queue but are never refused to keep it fair */
+    bool admitted;
+
+    /*! read end of the command's stdin upload pipe, or -1 if none */
+    int fdIn;
+
+    /*! monotonic time (us) at which the command was received, 0 if unknown */
+    uint64_t receivedUs;
+
+    /*! pointer to the NUL terminated message header */
+    char *pHeader;
+
+    /*! length of the message header */
+    size_t headerLength;
+
+    /*! values of the parsed message header properties */
+    JobValue properties[JOB_PROPERTIES];
+
+    /*! pointer to the NUL terminated message body (command) */
+    char *pBody;
+
+    /*! length of the message body */
+    size_t bodyLength;
+
+    /*! storage for the message header and body */
+    char data[];
+
+} Job;
+
+/*==============================================================================
+        Public function declarations
+==============================================================================*/
+
+Job *JOB_New( const char *pHeader,
+              size_t headerLength,
+              const char *pBody,
+              size_t bodyLength );
+
+void JOB_Free( Job *pJob );
+
+int JOB_GetProperty( Job *pJob,
+                     JobProperty property,
+                     char *pBuf,
+                     size_t size );
+
+bool JOB_IsTrue( Job *pJob, JobProperty property );
+
+bool JOB_HasProperty( Job *pJob, JobProperty property );
+
+int JOB_ParsePriority( const char *name, JobPriority *pPriority );
+
+bool JOB_IsSame( Job *pJob, Job *pOther );
+
+Job *JOB_SplitBatch( Job *pJob );
+
+#endif
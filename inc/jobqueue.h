@@ -0,0 +1,151 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef JOBQUEUE_H
+#define JOBQUEUE_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "job.h"
+
+/*==============================================================================
+        Public definitions
+==============================================================================*/
+
+/*! Maximum number of originators whose jobs are tracked by a job queue */
+#define JOBQUEUE_MAX_ORIGINATORS 32
+
+/*! the queued and executing jobs of an originator */
+typedef struct _jobOriginator
+{
+    /*! NUL terminated originator, empty if anonymous */
+    char name[MAX_ORIGINATOR_LENGTH];
+
+    /*! number of queued jobs of the originator */
+    size_t queued;
+
+    /*! number of executing jobs of the originator */
+    size_t running;
+
+} JobOriginator;
+
+/*! the execution slot of a job, recorded so the slot can be released
+    after the job has been handed on */
+typedef struct _jobSlot
+{
+    /*! scheduling priority of the job */
+    JobPriority priority;
+
+    /*! index of the receiver target of the job */
+    unsigned int target;
+
+    /*! index of the originator entry which counts the job, or -1 */
+    int originatorEntry;
+
+} JobSlot;
+
+/*! bounded priority queue of jobs waiting for an execution slot */
+typedef struct _jobQueue
+{
+    /*! first job in the queue at each priority */
+    Job *pHead[JOB_PRIORITY_LEVELS];
+
+    /*! last job in the queue at each priority */
+    Job *pTail[JOB_PRIORITY_LEVELS];
+
+    /*! number of jobs in the queue */
+    size_t depth;
+
+    /*! maximum number of jobs in the queue */
+    size_t maxDepth;
+
+    /*! number of executing jobs at each priority */
+    size_t running[JOB_PRIORITY_LEVELS];
+
+    /*! maximum number of concurrently executing low priority jobs */
+    size_t lowSlots;
+
+    /*! maximum number of concurrently executing jobs before normal and
+        low priority jobs are held back, 0 for no limit */
+    size_t limit;
+
+    /*! originators with queued or executing jobs, unused if both their
+        counts are 0 */
+    JobOriginator originators[JOBQUEUE_MAX_ORIGINATORS];
+
+    /*! maximum number of concurrently executing jobs of each receiver
+        target, 0 for no limit */
+    size_t share[JOB_MAX_TARGETS];
+
+    /*! number of executing jobs of each receiver target */
+    size_t targetRunning[JOB_MAX_TARGETS];
+
+    /*! maximum number of queued jobs of each receiver target, 0 for no
+        limit other than the depth of the queue */
+    size_t targetDepth[JOB_MAX_TARGETS];
+
+    /*! number of queued jobs of each receiver target */
+    size_t targetQueued[JOB_MAX_TARGETS];
+
+} JobQueue;
+
+/*==============================================================================
+        Public function declarations
+==============================================================================*/
+
+void JOBQUEUE_Init( JobQueue *pQueue,
+                    size_t maxDepth,
+                    size_t slots,
+                    size_t reserved );
+
+bool JOBQUEUE_IsFull( JobQueue *pQueue, Job *pJob );
+
+bool JOBQUEUE_IsOverShare( JobQueue *pQueue, Job *pJob );
+
+bool JOBQUEUE_Put( JobQueue *pQueue, Job *pJob );
+
+Job *JOBQUEUE_Get( JobQueue *pQueue );
+
+void JOBQUEUE_Resume( JobQueue *pQueue, Job *pJob );
+
+bool JOBQUEUE_SetLimit( JobQueue *pQueue, size_t limit );
+
+void JOBQUEUE_SetShare( JobQueue *pQueue,
+                        unsigned int target,
+                        size_t share,
+                        size_t depth );
+
+bool JOBQUEUE_Done( JobQueue *pQueue, Job *pJob );
+
+void JOBQUEUE_GetSlot( Job *pJob, JobSlot *pSlot );
+
+bool JOBQUEUE_Release( JobQueue *pQueue, const JobSlot *pSlot );
+
+Job *JOBQUEUE_Remove( JobQueue *pQueue );
+
+#endif
@@ -0,0 +1,115 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include "class.h"
+
+/*==============================================================================
+        Public definitions
+==============================================================================*/
+
+/*! command launcher backends */
+typedef enum _launcherBackend
+{
+    /*! posix_spawn, bypassing the shell when the command allows it */
+    LAUNCHER_BACKEND_SPAWN = 0,
+
+    /*! posix_spawn of /bin/sh -c for every command */
+    LAUNCHER_BACKEND_SHELL,
+
+    /*! popen */
+    LAUNCHER_BACKEND_POPEN
+
+} LauncherBackend;
+
+/*! a launched command */
+typedef struct _child
+{
+    /*! process identifier of the child, or -1 when launched by popen */
+    pid_t pid;
+
+    /*! read end of the child's stdout pipe */
+    int fdOut;
+
+    /*! non-blocking read end of the child's stderr pipe, or -1 if the
+        child's stderr is not captured */
+    int fdErr;
+
+    /*! command output stream (popen backend only) */
+    FILE *fp;
+
+    /*! resource usage of the command, valid once hasUsage is set */
+    struct rusage usage;
+
+    /*! true if the command was reaped with its resource usage */
+    bool hasUsage;
+
+    /*! execution class whose cgroup holds the command's leaf cgroup,
+        or NULL */
+    const ExecClass *pClass;
+
+} Child;
+
+/*==============================================================================
+        Public function declarations
+==============================================================================*/
+
+int LAUNCHER_ParseBackend( const char *name, LauncherBackend *pBackend );
+
+int LAUNCHER_SetPipeSize( int size );
+
+void LAUNCHER_SetStderr( bool capture );
+
+int LAUNCHER_Command( LauncherBackend backend,
+                      const char *cmd,
+                      int fdIn,
+                      const ExecClass *pClass,
+                      Child *pChild );
+
+int LAUNCHER_Argv( char * const argv[],
+                   int fdIn,
+                   const ExecClass *pClass,
+                   Child *pChild );
+
+int LAUNCHER_Shell( Child *pChild, int *pFdIn );
+
+int LAUNCHER_Wait( Child *pChild, int *pStatus );
+
+int LAUNCHER_Poll( Child *pChild, int *pStatus );
+
+int LAUNCHER_Kill( Child *pChild, int signum );
+
+bool LAUNCHER_NeedsShell( const char *cmd );
+
+#endif
@@ -0,0 +1,100 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef LIMITER_H
+#define LIMITER_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/*==============================================================================
+        Public definitions
+==============================================================================*/
+
+/*! Interval (ms) between updates of the concurrency limit */
+#define LIMITER_INTERVAL_MS 1000
+
+/*! adaptive limit on the number of concurrently executing commands */
+typedef struct _limiter
+{
+    /*! mutex protecting the launch latency samples */
+    pthread_mutex_t lock;
+
+    /*! lowest concurrency limit */
+    size_t minLimit;
+
+    /*! highest concurrency limit */
+    size_t maxLimit;
+
+    /*! current concurrency limit */
+    double limit;
+
+    /*! 1 minute load average per CPU above which the device is loaded */
+    double maxLoad;
+
+    /*! CPU or memory pressure (%) above which the device is loaded */
+    double maxPressure;
+
+    /*! number of online CPUs */
+    long cpus;
+
+    /*! monotonic time (ms) of the next update of the limit */
+    uint64_t nextUpdate;
+
+    /*! number of updates before the limit may be decreased again */
+    unsigned int hold;
+
+    /*! sum of the launch latencies (us) observed since the last update */
+    uint64_t latencySumUs;
+
+    /*! number of launch latencies observed since the last update */
+    uint64_t latencyCount;
+
+    /*! long term average launch latency (us), 0 if none yet */
+    double baselineUs;
+
+} Limiter;
+
+/*==============================================================================
+        Public function declarations
+==============================================================================*/
+
+int LIMITER_Init( Limiter *pLimiter,
+                  size_t maxLimit,
+                  double maxLoad,
+                  double maxPressure );
+
+void LIMITER_Observe( Limiter *pLimiter, uint64_t latencyUs );
+
+bool LIMITER_Update( Limiter *pLimiter, size_t *pLimit );
+
+int LIMITER_Timeout( Limiter *pLimiter );
+
+#endif
@@ -0,0 +1,112 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*==============================================================================
+        Public definitions
+==============================================================================*/
+
+/*! event counters */
+typedef enum _metricsCounter
+{
+    /*! cloud-to-device messages received */
+    METRICS_MESSAGES = 0,
+    /*! repeated messages which were discarded */
+    METRICS_DUPLICATES,
+    /*! commands whose execution was completed */
+    METRICS_COMMANDS,
+    /*! commands answered from the result cache */
+    METRICS_CACHE_HITS,
+    /*! commands terminated for exceeding a limit */
+    METRICS_TERMINATED,
+    /*! response body bytes sent */
+    METRICS_BYTES_SENT,
+    /*! response messages retried after a transient error */
+    METRICS_RETRIES,
+    /*! response body bytes written to the spill file */
+    METRICS_SPILLED,
+    /*! commands refused with a busy response */
+    METRICS_BUSY,
+    /*! number of counters */
+    METRICS_COUNTERS
+} MetricsCounter;
+
+/*! latency histograms */
+typedef enum _metricsHistogram
+{
+    /*! time from receiving a command to launching it */
+    METRICS_RECEIVE_TO_SPAWN = 0,
+    /*! time from launching a command to its first output */
+    METRICS_SPAWN_TO_FIRST_BYTE,
+    /*! time from receiving a command to completing its response */
+    METRICS_COMMAND_LATENCY,
+    /*! number of histograms */
+    METRICS_HISTOGRAMS
+} MetricsHistogram;
+
+#ifdef IOTEXEC_METRICS
+
+/*==============================================================================
+        Public function declarations
+==============================================================================*/
+
+void METRICS_Count( MetricsCounter counter, uint64_t n );
+
+void METRICS_Record( MetricsHistogram histogram, uint64_t us );
+
+void METRICS_Failure( int error );
+
+void METRICS_QueueDepth( size_t depth );
+
+void METRICS_ConcurrencyLimit( size_t limit );
+
+uint64_t METRICS_Now( void );
+
+int METRICS_Write( int fd );
+
+int METRICS_Listen( const char *path );
+
+#else
+
+/* metrics are compiled out */
+#define METRICS_Count( counter, n ) ( (void)0 )
+#define METRICS_Record( histogram, us ) ( (void)0 )
+#define METRICS_Failure( error ) ( (void)0 )
+#define METRICS_QueueDepth( depth ) ( (void)0 )
+#define METRICS_ConcurrencyLimit( limit ) ( (void)0 )
+#define METRICS_Now() ( (uint64_t)0 )
+#define METRICS_Listen( path ) ( ENOTSUP )
+
+#endif
+
+#endif
@@ -0,0 +1,122 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef OUTBOX_H
+#define OUTBOX_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <iotclient/iotclient.h>
+
+/*==============================================================================
+        Public definitions
+==============================================================================*/
+
+/*! a response message waiting to be sent */
+typedef struct _outboxMessage
+{
+    /*! pointer to the next message in the queue */
+    struct _outboxMessage *pNext;
+
+    /*! length of the message headers, excluding the NUL terminator */
+    size_t headerLength;
+
+    /*! length of the message body */
+    size_t length;
+
+    /*! offset of the message in the spill file, or -1 if it is in data */
+    off_t offset;
+
+    /*! NUL terminated headers followed by the body, if not spilled */
+    char data[];
+
+} OutboxMessage;
+
+/*! bounded queue of response messages with its own sender thread */
+typedef struct _outbox
+{
+    /*! iotclient connection used by the sender thread */
+    IOTCLIENT_HANDLE hIoTClient;
+
+    /*! sender thread identifier */
+    pthread_t thread;
+
+    /*! mutex protecting the queue */
+    pthread_mutex_t lock;
+
+    /*! signalled when a message is queued */
+    pthread_cond_t ready;
+
+    /*! signalled when a message has been sent */
+    pthread_cond_t space;
+
+    /*! oldest queued message */
+    OutboxMessage *pHead;
+
+    /*! newest queued message */
+    OutboxMessage *pTail;
+
+    /*! bytes of queued and in-flight messages held in memory */
+    size_t bytes;
+
+    /*! maximum bytes of messages held in memory */
+    size_t maxBytes;
+
+    /*! spill file for messages which do not fit in memory, or -1 */
+    int spillFd;
+
+    /*! length of the spill file */
+    off_t spillLength;
+
+    /*! number of queued and in-flight messages in the spill file */
+    size_t numSpilled;
+
+    /*! verbose flag */
+    bool verbose;
+
+} Outbox;
+
+/*==============================================================================
+        Public function declarations
+==============================================================================*/
+
+int OUTBOX_Create( Outbox *pOutbox,
+                   size_t maxBytes,
+                   const char *spillDir,
+                   bool verbose );
+
+int OUTBOX_Send( Outbox *pOutbox,
+                 const char *headers,
+                 const char *pData,
+                 size_t length );
+
+int OUTBOX_Flush( Outbox *pOutbox, unsigned int timeoutMs );
+
+#endif
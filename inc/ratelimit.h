@@ -0,0 +1,89 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "job.h"
+
+/*==============================================================================
+        Public definitions
+==============================================================================*/
+
+/*! token bucket of an originator */
+typedef struct _rateBucket
+{
+    /*! NUL terminated originator, empty if anonymous */
+    char originator[MAX_ORIGINATOR_LENGTH];
+
+    /*! number of commands the originator may send immediately */
+    double tokens;
+
+    /*! monotonic time (ms) at which the tokens were last refilled */
+    uint64_t time;
+
+    /*! true if the bucket is assigned to an originator */
+    bool used;
+
+} RateBucket;
+
+/*! per-originator command rate limit */
+typedef struct _rateLimit
+{
+    /*! token buckets of the recently seen originators */
+    RateBucket *pBuckets;
+
+    /*! number of token buckets */
+    size_t size;
+
+    /*! commands per second allowed to each originator */
+    double rate;
+
+    /*! number of commands an idle originator may send at once */
+    double burst;
+
+} RateLimit;
+
+/*==============================================================================
+        Public function declarations
+==============================================================================*/
+
+int RATELIMIT_Init( RateLimit *pLimit,
+                    size_t size,
+                    double rate,
+                    double burst );
+
+bool RATELIMIT_Take( RateLimit *pLimit,
+                     const char *originator,
+                     uint64_t now,
+                     unsigned long *pRetryMs );
+
+#endif
@@ -0,0 +1,104 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <iotclient/iotclient.h>
+#include "job.h"
+#include "jobqueue.h"
+#include "exec.h"
+
+/*==============================================================================
+        Public definitions
+==============================================================================*/
+
+/*! single threaded event driven command executor */
+typedef struct _reactor
+{
+    /*! epoll instance watching the job queue and command pipes */
+    int epfd;
+
+    /*! eventfd signalled when a job is added to the job queue */
+    int evfd;
+
+    /*! iotclient connection used to send command responses */
+    IOTCLIENT_HANDLE hIoTClient;
+
+    /*! mutex protecting the job queue */
+    pthread_mutex_t lock;
+
+    /*! broadcast when a job is removed from the job queue */
+    pthread_cond_t notFull;
+
+    /*! jobs waiting to be executed */
+    JobQueue queue;
+
+    /*! maximum number of concurrently executing commands */
+    size_t maxCommands;
+
+    /*! number of executing commands */
+    size_t numCommands;
+
+    /*! service wide command execution options */
+    const ExecOptions *pOptions;
+
+    /*! list of executing commands */
+    struct _command *pCommands;
+
+    /*! command output read buffer shared by all commands */
+    char buf[BUFSIZ];
+
+} Reactor;
+
+/*==============================================================================
+        Public function declarations
+==============================================================================*/
+
+int REACTOR_Create( Reactor *pReactor,
+                    size_t maxCommands,
+                    size_t maxDepth,
+                    size_t reserved,
+                    const ExecOptions *pOptions );
+
+int REACTOR_Wait( Reactor *pReactor, Job *pJob );
+
+int REACTOR_Submit( Reactor *pReactor, Job *pJob );
+
+int REACTOR_SetShare( Reactor *pReactor,
+                      unsigned int target,
+                      size_t share,
+                      size_t depth );
+
+int REACTOR_Run( Reactor *pReactor );
+
+#endif
@@ -0,0 +1,137 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef RECEIVER_H
+#define RECEIVER_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <iotclient/iotclient.h>
+#include "job.h"
+#include "class.h"
+
+/*==============================================================================
+        Public definitions
+==============================================================================*/
+
+/*! Maximum length of a receiver target name, including the NUL */
+#define MAX_TARGET_LENGTH 32
+
+struct _receiver;
+
+/*! function invoked repeatedly by a receiver to receive and dispatch
+    the next message for its target */
+typedef int (*ReceiverHandler)( struct _receiver *pReceiver, void *arg );
+
+/*! a cloud-to-device message receiver for a target */
+typedef struct _receiver
+{
+    /*! NUL terminated target (service name) of the received messages */
+    char target[MAX_TARGET_LENGTH];
+
+    /*! index of the receiver in its table, recorded in its jobs */
+    unsigned int index;
+
+    /*! maximum number of pending received messages */
+    size_t maxPending;
+
+    /*! maximum received message length */
+    size_t maxMessageLength;
+
+    /*! maximum number of the target's commands executing at once,
+        0 for no limit */
+    size_t workers;
+
+    /*! priority of the commands without a priority header */
+    JobPriority priority;
+
+    /*! timeout in seconds of the commands without a timeout header,
+        0 for no timeout */
+    unsigned int timeout;
+
+    /*! output limit in bytes of the commands without a maxOutputBytes
+        header, 0 for no limit */
+    size_t maxOutputBytes;
+
+    /*! NUL terminated execution class of the commands without a class
+        header, empty for none */
+    char className[MAX_CLASS_NAME_LENGTH];
+
+    /*! iotclient connection the target's messages are received on */
+    IOTCLIENT_HANDLE hIoTClient;
+
+    /*! true if the connection was created by the receiver */
+    bool connected;
+
+    /*! function invoked to receive and dispatch each message */
+    ReceiverHandler handler;
+
+    /*! opaque argument passed to the handler */
+    void *arg;
+
+    /*! receive thread, for the receivers other than the first */
+    pthread_t thread;
+
+} Receiver;
+
+/*! the receivers of an iotexec instance */
+typedef struct _receiverTable
+{
+    /*! settings of a receiver which are not given in its definition */
+    Receiver defaults;
+
+    /*! the receivers */
+    Receiver receivers[JOB_MAX_TARGETS];
+
+    /*! number of receivers */
+    size_t count;
+
+} ReceiverTable;
+
+/*==============================================================================
+        Public function declarations
+==============================================================================*/
+
+void RECEIVER_Init( ReceiverTable *pTable, const Receiver *pDefaults );
+
+int RECEIVER_Load( ReceiverTable *pTable, const char *filename );
+
+int RECEIVER_Add( ReceiverTable *pTable, const char *target );
+
+Receiver *RECEIVER_Get( ReceiverTable *pTable, unsigned int index );
+
+int RECEIVER_Open( ReceiverTable *pTable,
+                   IOTCLIENT_HANDLE hIoTClient,
+                   bool verbose );
+
+int RECEIVER_Run( ReceiverTable *pTable, ReceiverHandler handler, void *arg );
+
+void RECEIVER_Close( ReceiverTable *pTable );
+
+#endif
@@ -0,0 +1,275 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef RESPONSE_H
+#define RESPONSE_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <iotclient/iotclient.h>
+#include "job.h"
+#include "outbox.h"
+#include "spool.h"
+
+/*==============================================================================
+        Public definitions
+==============================================================================*/
+
+/*! size of the response header buffer, which holds the base headers, a
+    correlationId of up to MAX_MSGID_LENGTH and the status headers */
+#define RESPONSE_HEADER_SIZE 512
+
+/*! coalescing buffer size used for compressed responses if none is set */
+#define RESPONSE_DEFAULT_BATCH_SIZE 4096
+
+/*! response content encodings */
+typedef enum _responseEncoding
+{
+    /*! uncompressed */
+    RESPONSE_ENCODING_NONE = 0,
+
+    /*! zlib (RFC 1950) wrapped deflate stream */
+    RESPONSE_ENCODING_DEFLATE,
+
+    /*! gzip (RFC 1952) wrapped deflate stream */
+    RESPONSE_ENCODING_GZIP
+
+} ResponseEncoding;
+
+/*! service wide response options */
+typedef struct _responseOptions
+{
+    /*! output coalescing buffer size, 0 if output coalescing is disabled */
+    size_t batchSize;
+
+    /*! output coalescing flush deadline in milliseconds */
+    unsigned int flushMs;
+
+    /*! minimum output size before a response is compressed */
+    size_t compressMin;
+
+    /*! output size after which coalescing is bypassed, 0 to never bypass */
+    size_t directThreshold;
+
+    /*! asynchronous response sender, or NULL to send synchronously */
+    Outbox *pOutbox;
+
+    /*! size of the chunks of a chunked response */
+    size_t chunkSize;
+
+    /*! spool of chunked responses, or NULL if they are not spooled */
+    Spool *pSpool;
+
+} ResponseOptions;
+
+/*! an additional recipient of a response */
+typedef struct _responseFollower
+{
+    /*! pointer to the next follower */
+    struct _responseFollower *pNext;
+
+    /*! NUL terminated response headers for the follower */
+    char headers[RESPONSE_HEADER_SIZE];
+
+    /*! length of the follower's response headers */
+    size_t headerLength;
+
+} ResponseFollower;
+
+/*! command response sent to the cloud */
+typedef struct _response
+{
+    /*! iotclient connection used to send the response */
+    IOTCLIENT_HANDLE hIoTClient;
+
+    /*! asynchronous sender which sends the response, or NULL */
+    Outbox *pOutbox;
+
+    /*! NUL terminated response headers */
+    char headers[RESPONSE_HEADER_SIZE];
+
+    /*! length of the response headers */
+    size_t headerLength;
+
+    /*! number of response body bytes sent */
+    size_t bytesSent;
+
+    /*! number of command output bytes read */
+    size_t bytesRead;
+
+    /*! output size after which coalescing is bypassed, 0 to never bypass */
+    size_t directThreshold;
+
+    /*! maximum number of command output bytes to send, 0 for no limit */
+    size_t maxBytes;
+
+    /*! first error encountered sending the response */
+    int error;
+
+    /*! output coalescing buffer, or NULL if output is not batched */
+    char *pBatch;
+
+    /*! size of the output coalescing buffer */
+    size_t batchSize;
+
+    /*! number of bytes waiting in the output coalescing buffer */
+    size_t batchLength;
+
+    /*! maximum time output may wait in the coalescing buffer */
+    unsigned int flushMs;
+
+    /*! monotonic time (ms) at which the coalescing buffer must be sent */
+    uint64_t flushTime;
+
+    /*! content encoding requested for the response */
+    ResponseEncoding encoding;
+
+    /*! minimum output size before the response is compressed */
+    size_t compressMin;
+
+    /*! true once the response output is being compressed */
+    bool compressing;
+
+    /*! compression stream state */
+    void *pZStream;
+
+    /*! compressed output buffer */
+    char *pZBuf;
+
+    /*! size of the compressed output buffer */
+    size_t zBufSize;
+
+    /*! copy of the command output, or NULL if output is not captured */
+    char *pCapture;
+
+    /*! maximum number of bytes which may be captured */
+    size_t captureSize;
+
+    /*! number of bytes captured */
+    size_t captureLength;
+
+    /*! true if the output was larger than the capture buffer */
+    bool captureOverflow;
+
+    /*! other requests which receive a copy of the response */
+    ResponseFollower *pFollowers;
+
+    /*! true if every message carries a seq header */
+    bool sequenced;
+
+    /*! sequence number of the next message */
+    unsigned long seq;
+
+    /*! minimum interval (ms) between output messages, 0 for none */
+    unsigned int intervalMs;
+
+    /*! monotonic time (ms) before which no output message is sent */
+    uint64_t nextSendTime;
+
+    /*! true if the output is sent in fixed size chunks */
+    bool chunked;
+
+    /*! size of every chunk of a chunked response but the last */
+    size_t chunkSize;
+
+    /*! spool which keeps the chunks of the response, or NULL */
+    Spool *pSpool;
+
+    /*! spool entry receiving the chunks of the response, or NULL */
+    SpoolEntry *pSpoolEntry;
+
+} Response;
+
+/*==============================================================================
+        Public function declarations
+==============================================================================*/
+
+int RESPONSE_Init( Response *pResponse,
+                   IOTCLIENT_HANDLE hIoTClient,
+                   const char *msgId );
+
+int RESPONSE_Setup( Response *pResponse,
+                    IOTCLIENT_HANDLE hIoTClient,
+                    Job *pJob,
+                    const ResponseOptions *pOptions );
+
+int RESPONSE_AddHeader( Response *pResponse,
+                        const char *name,
+                        const char *value );
+
+int RESPONSE_Follow( Response *pResponse, const char *msgId );
+
+int RESPONSE_Write( Response *pResponse, const char *pData, size_t length );
+
+int RESPONSE_Stream( Response *pResponse, int fd );
+
+int RESPONSE_SetBatch( Response *pResponse,
+                       size_t batchSize,
+                       unsigned int flushMs );
+
+int RESPONSE_Read( Response *pResponse, int fd );
+
+int RESPONSE_SetCapture( Response *pResponse, size_t size );
+
+int RESPONSE_Subscribe( Response *pResponse, unsigned int rate );
+
+int RESPONSE_Chunk( Response *pResponse,
+                    Spool *pSpool,
+                    const char *msgId,
+                    size_t chunkSize );
+
+int RESPONSE_Resend( Response *pResponse,
+                     Spool *pSpool,
+                     const char *msgId,
+                     const char *chunks,
+                     unsigned long *pCount,
+                     unsigned long *pTotal );
+
+bool RESPONSE_Held( Response *pResponse );
+
+int RESPONSE_Output( Response *pResponse, const char *pData, size_t length );
+
+int RESPONSE_ReadBuffer( Response *pResponse,
+                         int fd,
+                         char *pBuf,
+                         size_t size );
+
+int RESPONSE_Flush( Response *pResponse );
+
+int RESPONSE_Timeout( Response *pResponse );
+
+int RESPONSE_Forward( Response *pResponse, int fd );
+
+void RESPONSE_End( Response *pResponse );
+
+void RESPONSE_Close( Response *pResponse );
+
+uint64_t RESPONSE_Now( void );
+
+#endif
@@ -0,0 +1,144 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef SESSION_H
+#define SESSION_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "job.h"
+#include "launcher.h"
+
+/*==============================================================================
+        Public definitions
+==============================================================================*/
+
+/*! length of the token which identifies the end of a command's output */
+#define SESSION_TOKEN_LENGTH 24
+
+/*! maximum number of exit status digits following the token */
+#define SESSION_MAX_CODE_LENGTH 8
+
+/*! size of the buffer used to read the session shell's output */
+#define SESSION_BUFFER_SIZE 4096
+
+/*! a long-lived shell which executes the commands of a session */
+typedef struct _session
+{
+    /*! pointer to the next session in the session table */
+    struct _session *pNext;
+
+    /*! NUL terminated session identifier */
+    char id[MAX_SESSION_ID_LENGTH];
+
+    /*! the session shell, or pid -1 if it is not running */
+    Child child;
+
+    /*! write end of the session shell's stdin pipe, or -1 */
+    int fdIn;
+
+    /*! NUL terminated token written after the output of each command */
+    char token[SESSION_TOKEN_LENGTH + 1];
+
+    /*! number of token characters matched at the end of the output */
+    size_t matched;
+
+    /*! exit status digits received after the token */
+    char code[SESSION_MAX_CODE_LENGTH + 1];
+
+    /*! number of exit status digits received */
+    size_t codeLength;
+
+    /*! true once the current command's output is complete */
+    bool complete;
+
+    /*! job executing in the session, or NULL if the session is idle */
+    Job *pOwner;
+
+    /*! first job waiting for the session */
+    Job *pHead;
+
+    /*! last job waiting for the session */
+    Job *pTail;
+
+    /*! monotonic time (ms) at which the session was last used */
+    uint64_t lastUsed;
+
+    /*! buffer used to read the session shell's output */
+    char buf[SESSION_BUFFER_SIZE];
+
+} Session;
+
+/*! table of shell sessions */
+typedef struct _sessionTable
+{
+    /*! mutex protecting the session table */
+    pthread_mutex_t lock;
+
+    /*! list of sessions */
+    Session *pSessions;
+
+    /*! number of sessions */
+    size_t numSessions;
+
+    /*! maximum number of sessions */
+    size_t maxSessions;
+
+    /*! time (seconds) after which an idle session is evicted, 0 for never */
+    unsigned int idleTimeout;
+
+} SessionTable;
+
+/*==============================================================================
+        Public function declarations
+==============================================================================*/
+
+int SESSION_Init( SessionTable *pTable,
+                  size_t maxSessions,
+                  unsigned int idleTimeout );
+
+int SESSION_Begin( SessionTable *pTable, Job *pJob, Session **ppSession );
+
+int SESSION_Command( Session *pSession, const char *cmd );
+
+int SESSION_Read( Session *pSession,
+                  char *pBuf,
+                  size_t size,
+                  size_t *pLength,
+                  int *pStatus );
+
+int SESSION_Kill( Session *pSession );
+
+Job *SESSION_End( SessionTable *pTable,
+                  Session *pSession,
+                  bool discard,
+                  Job *pNext );
+
+#endif
@@ -0,0 +1,149 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+
+#ifndef SPOOL_H
+#define SPOOL_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "job.h"
+
+/*==============================================================================
+        Public definitions
+==============================================================================*/
+
+/*! maximum length of the spool directory path */
+#define SPOOL_MAX_PATH 256
+
+/*! maximum number of responses held in the spool */
+#define SPOOL_MAX_ENTRIES 64
+
+/*! sends a chunk of a spooled response */
+typedef int (*SpoolSendFn)( void *arg,
+                            unsigned long seq,
+                            size_t offset,
+                            const char *pData,
+                            size_t length );
+
+/*! the chunks of a response held in the spool */
+typedef struct _spoolEntry
+{
+    /*! pointer to the next (older) spooled response */
+    struct _spoolEntry *pNext;
+
+    /*! NUL terminated messageId of the request */
+    char msgId[MAX_MSGID_LENGTH];
+
+    /*! unnamed file holding the chunks */
+    int fd;
+
+    /*! size of every chunk but the last */
+    size_t chunkSize;
+
+    /*! number of bytes spooled */
+    size_t length;
+
+    /*! number of chunks spooled */
+    unsigned long numChunks;
+
+    /*! number of users of the entry: its writer and any resends */
+    unsigned int refs;
+
+    /*! true once the response is complete */
+    bool complete;
+
+    /*! true if the spool ran out of room for the response */
+    bool truncated;
+
+    /*! true once the entry has been evicted from the spool */
+    bool evicted;
+
+    /*! monotonic time (ms) after which a complete response is evicted */
+    uint64_t expires;
+
+} SpoolEntry;
+
+/*! bounded store of recently sent chunked responses */
+typedef struct _spool
+{
+    /*! mutex protecting the spool */
+    pthread_mutex_t lock;
+
+    /*! NUL terminated directory holding the spool files */
+    char dir[SPOOL_MAX_PATH];
+
+    /*! spooled responses, newest first */
+    SpoolEntry *pEntries;
+
+    /*! number of spooled responses */
+    size_t numEntries;
+
+    /*! number of bytes spooled */
+    size_t bytes;
+
+    /*! maximum number of bytes spooled */
+    size_t maxBytes;
+
+    /*! time (ms) a complete response is kept */
+    unsigned int retentionMs;
+
+} Spool;
+
+/*==============================================================================
+        Public function declarations
+==============================================================================*/
+
+int SPOOL_Init( Spool *pSpool,
+                const char *dir,
+                size_t maxBytes,
+                unsigned int retentionMs );
+
+int SPOOL_Open( Spool *pSpool,
+                const char *msgId,
+                size_t chunkSize,
+                SpoolEntry **ppEntry );
+
+int SPOOL_Write( Spool *pSpool,
+                 SpoolEntry *pEntry,
+                 const char *pData,
+                 size_t length );
+
+void SPOOL_Close( Spool *pSpool, SpoolEntry *pEntry );
+
+int SPOOL_Resend( Spool *pSpool,
+                  const char *msgId,
+                  const char *chunks,
+                  SpoolSendFn send,
+                  void *arg,
+                  unsigned long *pCount,
+                  unsigned long *pTotal );
+
+#endif
@@ -0,0 +1,164 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+
+#ifndef TEMPLATE_H
+#define TEMPLATE_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stddef.h>
+
+/*==============================================================================
+        Public definitions
+==============================================================================*/
+
+/*! maximum length of a template or parameter name */
+#define MAX_TEMPLATE_NAME_LENGTH 32
+
+/*! maximum length of the resolved path of a template's program */
+#define MAX_TEMPLATE_PATH_LENGTH 256
+
+/*! maximum number of arguments of a template, including the program */
+#define MAX_TEMPLATE_ARGS 32
+
+/*! maximum number of parameters of a template */
+#define MAX_TEMPLATE_PARAMS 8
+
+/*! maximum length of a parameter value */
+#define MAX_TEMPLATE_VALUE_LENGTH 128
+
+/*! size of the buffer holding the literal text of a template */
+#define MAX_TEMPLATE_TEXT_LENGTH 1024
+
+/*! size of a buffer which receives the substituted arguments of a
+    template */
+#define TEMPLATE_ARGS_SIZE 4096
+
+/*! types of template parameter */
+typedef enum _templateParamType
+{
+    /*! name: letters, digits and ._@:- not starting with - or . */
+    TEMPLATE_PARAM_NAME = 0,
+
+    /*! unsigned decimal integer within a range */
+    TEMPLATE_PARAM_UINT,
+
+    /*! one of a list of values */
+    TEMPLATE_PARAM_ENUM
+
+} TemplateParamType;
+
+/*! a typed parameter of a command template */
+typedef struct _templateParam
+{
+    /*! NUL terminated parameter name */
+    char name[MAX_TEMPLATE_NAME_LENGTH];
+
+    /*! type of the parameter */
+    TemplateParamType type;
+
+    /*! minimum value of a uint parameter */
+    unsigned long min;
+
+    /*! maximum value of a uint parameter */
+    unsigned long max;
+
+    /*! NUL terminated | separated values of an enum parameter */
+    const char *choices;
+
+} TemplateParam;
+
+/*! a pre-split argument of a command template */
+typedef struct _templateArg
+{
+    /*! NUL terminated literal text of the argument */
+    char *text;
+
+    /*! index of the parameter substituted in the argument, or -1 */
+    int param;
+
+    /*! offset in the text at which the parameter value is inserted */
+    size_t offset;
+
+} TemplateArg;
+
+/*! a named command template */
+typedef struct _commandTemplate
+{
+    /*! pointer to the next command template */
+    struct _commandTemplate *pNext;
+
+    /*! NUL terminated template name, selected by the template header */
+    char name[MAX_TEMPLATE_NAME_LENGTH];
+
+    /*! NUL terminated absolute path of the program, resolved on load */
+    char path[MAX_TEMPLATE_PATH_LENGTH];
+
+    /*! parameters of the template */
+    TemplateParam params[MAX_TEMPLATE_PARAMS];
+
+    /*! number of parameters */
+    size_t numParams;
+
+    /*! arguments of the template, starting with the program path */
+    TemplateArg args[MAX_TEMPLATE_ARGS];
+
+    /*! number of arguments */
+    size_t numArgs;
+
+    /*! literal text of the arguments and enum values */
+    char text[MAX_TEMPLATE_TEXT_LENGTH];
+
+    /*! number of bytes of the literal text buffer in use */
+    size_t textLength;
+
+} CommandTemplate;
+
+/*! command templates */
+typedef struct _templateTable
+{
+    /*! list of command templates */
+    CommandTemplate *pTemplates;
+
+} TemplateTable;
+
+/*==============================================================================
+        Public function declarations
+==============================================================================*/
+
+int TEMPLATE_Load( TemplateTable *pTable, const char *filename );
+
+const CommandTemplate *TEMPLATE_Find( TemplateTable *pTable,
+                                      const char *name );
+
+int TEMPLATE_Expand( const CommandTemplate *pTemplate,
+                     const char *args,
+                     char *pBuf,
+                     size_t size,
+                     char *argv[] );
+
+#endif
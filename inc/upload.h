@@ -0,0 +1,88 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include "job.h"
+
+/*==============================================================================
+        Public definitions
+==============================================================================*/
+
+/*! a stream of uploaded data feeding the stdin of a command */
+typedef struct _uploadStream
+{
+    /*! pointer to the next stream */
+    struct _uploadStream *pNext;
+
+    /*! NUL terminated message identifier of the command */
+    char msgId[MAX_MSGID_LENGTH];
+
+    /*! non-blocking write end of the command's stdin pipe */
+    int fd;
+
+    /*! monotonic time (ms) at which data was last written */
+    uint64_t lastUsed;
+
+} UploadStream;
+
+/*! stdin upload streams of the received commands */
+typedef struct _uploadTable
+{
+    /*! open upload streams */
+    UploadStream *pStreams;
+
+    /*! number of open upload streams */
+    size_t numStreams;
+
+    /*! maximum number of open upload streams */
+    size_t maxStreams;
+
+    /*! time (ms) after which an unused stream is closed */
+    uint64_t idleMs;
+
+    /*! time (ms) to wait for a command to accept more data */
+    uint64_t writeTimeoutMs;
+
+} UploadTable;
+
+/*==============================================================================
+        Public function declarations
+==============================================================================*/
+
+int UPLOAD_Init( UploadTable *pTable,
+                 size_t maxStreams,
+                 uint64_t idleMs,
+                 uint64_t writeTimeoutMs );
+
+int UPLOAD_Add( UploadTable *pTable, Job **ppJob, uint64_t now );
+
+#endif
@@ -0,0 +1,129 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef WORKERS_H
+#define WORKERS_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <iotclient/iotclient.h>
+#include "job.h"
+#include "jobqueue.h"
+#include "limiter.h"
+
+/*==============================================================================
+        Public definitions
+==============================================================================*/
+
+/*! Maximum number of executor worker threads */
+#define MAX_WORKERS 32
+
+/*! function invoked by a worker to execute a job, returning EINPROGRESS
+    if the job was retained and must not be freed by the worker.  A job
+    to be executed next by the worker, such as the next job waiting for
+    the session of the executed job, is returned in ppResume */
+typedef int (*WorkerHandler)( IOTCLIENT_HANDLE hIoTClient,
+                              Job *pJob,
+                              Job **ppResume,
+                              void *arg );
+
+/*! executor worker thread */
+typedef struct _worker
+{
+    /*! worker thread identifier */
+    pthread_t thread;
+
+    /*! iotclient connection used to send this worker's responses */
+    IOTCLIENT_HANDLE hIoTClient;
+
+    /*! pointer to the pool which owns this worker */
+    struct _workerPool *pPool;
+
+} Worker;
+
+/*! pool of executor workers fed from a bounded priority job queue */
+typedef struct _workerPool
+{
+    /*! mutex protecting the job queue */
+    pthread_mutex_t lock;
+
+    /*! signalled when a job is added to the queue */
+    pthread_cond_t notEmpty;
+
+    /*! broadcast when a job is removed from the queue */
+    pthread_cond_t notFull;
+
+    /*! jobs waiting for a worker */
+    JobQueue queue;
+
+    /*! adaptive concurrency limiter, or NULL if every worker is used */
+    Limiter *pLimiter;
+
+    /*! number of workers in the pool */
+    size_t numWorkers;
+
+    /*! the worker threads */
+    Worker workers[MAX_WORKERS];
+
+    /*! function used to execute jobs */
+    WorkerHandler handler;
+
+    /*! opaque argument passed to the handler */
+    void *arg;
+
+    /*! set when the pool is shutting down */
+    bool shutdown;
+
+} WorkerPool;
+
+/*==============================================================================
+        Public function declarations
+==============================================================================*/
+
+int WORKERS_Create( WorkerPool *pPool,
+                    size_t numWorkers,
+                    size_t maxDepth,
+                    size_t reserved,
+                    Limiter *pLimiter,
+                    WorkerHandler handler,
+                    void *arg,
+                    bool verbose );
+
+int WORKERS_Wait( WorkerPool *pPool, Job *pJob );
+
+int WORKERS_Submit( WorkerPool *pPool, Job *pJob );
+
+int WORKERS_SetShare( WorkerPool *pPool,
+                      unsigned int target,
+                      size_t share,
+                      size_t depth );
+
+int WORKERS_Shutdown( WorkerPool *pPool );
+
+#endif
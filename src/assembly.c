@@ -0,0 +1,616 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup assembly assembly
+ * @brief Multi-part command reassembly
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file assembly.c
+
+    Multi-part command reassembly
+
+    The assembly module rebuilds commands which are too large for a
+    single cloud-to-device message, such as scripts.  Each part of such
+    a command is sent as a message with the same messageId, and part
+    and parts headers giving its position (from 1) and the total number
+    of parts:
+
+        messageId:7d4c...
+        part:2
+        parts:3
+
+    The parts must be sent in order.  The body of each part is appended
+    to a growable buffer, and when the last part arrives a job is
+    created with the header of the first part and the whole command as
+    its body.  A redelivered part is ignored, while a missing or out of
+    order part abandons the command.  Commands whose parts do not all
+    arrive within the reassembly timeout are discarded.
+
+    Messages without a part header are passed through untouched.
+
+    The module is used only by the message dispatcher, so it performs
+    no locking.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "assembly.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+#ifndef EOK
+/*! success response */
+#define EOK 0
+#endif
+
+/*! maximum number of commands reassembled at the same time */
+#define ASSEMBLY_MAX_ENTRIES 16
+
+/*! initial size of a reassembly buffer */
+#define ASSEMBLY_INITIAL_SIZE 8192
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static int AddPart( Assembly *pAssembly,
+                    Job *pJob,
+                    unsigned long part,
+                    unsigned long parts,
+                    uint64_t now,
+                    Job **ppJob );
+static AssemblyEntry *FindEntry( Assembly *pAssembly, const char *msgId );
+static AssemblyEntry *NewEntry( Assembly *pAssembly,
+                                Job *pJob,
+                                unsigned long parts,
+                                uint64_t now );
+static void RemoveEntry( Assembly *pAssembly, AssemblyEntry *pEntry );
+static void Expire( Assembly *pAssembly, uint64_t now );
+static int Append( Assembly *pAssembly,
+                   AssemblyEntry *pEntry,
+                   const char *pData,
+                   size_t length );
+static unsigned long GetNumber( Job *pJob, JobProperty property );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  ASSEMBLY_Init                                                             */
+/*!
+    Initialize multi-part command reassembly
+
+    @param[in]
+        pAssembly
+            pointer to the Assembly to initialize
+
+    @param[in]
+        maxLength
+            maximum length of a reassembled command
+
+    @param[in]
+        timeoutMs
+            time (ms) allowed for all the parts of a command to arrive
+
+    @retval EOK the Assembly was initialized
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int ASSEMBLY_Init( Assembly *pAssembly, size_t maxLength, uint64_t timeoutMs )
+{
+    int result = EINVAL;
+
+    if( ( pAssembly != NULL ) &&
+        ( maxLength > 0 ) )
+    {
+        memset( pAssembly, 0, sizeof( Assembly ) );
+        pAssembly->maxLength = maxLength;
+        pAssembly->timeoutMs = timeoutMs;
+
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  ASSEMBLY_Add                                                              */
+/*!
+    Pass a received job through multi-part reassembly
+
+    The ASSEMBLY_Add function leaves a job without a part header in
+    place.  A job which is a part of a multi-part command is consumed,
+    and replaced by the reassembled command once its last part has
+    been received.
+
+    @param[in]
+        pAssembly
+            pointer to the Assembly
+
+    @param[in,out]
+        ppJob
+            pointer to the received job, which is replaced by the
+            reassembled command, or NULL if there is no command to
+            execute yet
+
+    @param[in]
+        now
+            the current monotonic time (ms)
+
+    @retval EOK the job is a complete command
+    @retval EINPROGRESS the part was stored, more parts are expected
+    @retval EALREADY the part was already received
+    @retval EPROTO the part is out of order and the command was abandoned
+    @retval EMSGSIZE the command is too long and was abandoned
+    @retval ENOMEM could not allocate the reassembly buffer
+    @retval EINVAL invalid arguments or part headers
+
+==============================================================================*/
+int ASSEMBLY_Add( Assembly *pAssembly, Job **ppJob, uint64_t now )
+{
+    int result = EINVAL;
+    unsigned long part;
+    unsigned long parts;
+    Job *pJob;
+
+    if( ( pAssembly != NULL ) &&
+        ( ppJob != NULL ) &&
+        ( *ppJob != NULL ) )
+    {
+        pJob = *ppJob;
+
+        part = GetNumber( pJob, JOB_PROPERTY_PART );
+        if( part == 0 )
+        {
+            /* not a multi-part command */
+            result = EOK;
+        }
+        else
+        {
+            *ppJob = NULL;
+
+            Expire( pAssembly, now );
+
+            parts = GetNumber( pJob, JOB_PROPERTY_PARTS );
+            if( ( pJob->msgId[0] != '\0' ) &&
+                ( part <= parts ) )
+            {
+                result = AddPart( pAssembly, pJob, part, parts, now, ppJob );
+            }
+            else
+            {
+                JOB_Free( pJob );
+            }
+        }
+    }
+
+    return result;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  AddPart                                                                   */
+/*!
+    Add a part to the command it belongs to
+
+    The AddPart function starts the reassembly of a command with its
+    first part, or appends a subsequent part.  The part's job is
+    released unless it is the first part, which is kept for its header.
+
+    @param[in]
+        pAssembly
+            pointer to the Assembly
+
+    @param[in]
+        pJob
+            pointer to the job containing the part
+
+    @param[in]
+        part
+            position of the part (from 1)
+
+    @param[in]
+        parts
+            total number of parts
+
+    @param[in]
+        now
+            the current monotonic time (ms)
+
+    @param[out]
+        ppJob
+            pointer to a location to store the reassembled command
+
+    @retval EOK the command is complete
+    @retval EINPROGRESS more parts are expected
+    @retval EALREADY the part was already received
+    @retval EPROTO the part is out of order
+    @retval EMSGSIZE the command is too long
+    @retval ENOMEM out of memory
+
+==============================================================================*/
+static int AddPart( Assembly *pAssembly,
+                    Job *pJob,
+                    unsigned long part,
+                    unsigned long parts,
+                    uint64_t now,
+                    Job **ppJob )
+{
+    int result;
+    AssemblyEntry *pEntry;
+    Job *pFirst;
+
+    pEntry = FindEntry( pAssembly, pJob->msgId );
+    if( ( pEntry == NULL ) && ( part == 1 ) )
+    {
+        pEntry = NewEntry( pAssembly, pJob, parts, now );
+        result = ( pEntry != NULL ) ? EOK : ENOMEM;
+    }
+    else if( ( pEntry != NULL ) &&
+             ( pEntry->parts == parts ) &&
+             ( part <= pEntry->received ) )
+    {
+        /* redelivered part */
+        result = EALREADY;
+    }
+    else if( ( pEntry != NULL ) &&
+             ( pEntry->parts == parts ) &&
+             ( part == pEntry->received + 1 ) )
+    {
+        result = EOK;
+    }
+    else
+    {
+        result = EPROTO;
+    }
+
+    if( result == EOK )
+    {
+        result = Append( pAssembly, pEntry, pJob->pBody, pJob->bodyLength );
+        if( result == EOK )
+        {
+            pEntry->received = part;
+        }
+    }
+
+    if( ( pEntry == NULL ) || ( pEntry->pFirst != pJob ) )
+    {
+        JOB_Free( pJob );
+    }
+
+    if( ( result == EOK ) && ( pEntry->received == pEntry->parts ) )
+    {
+        /* the command is complete */
+        pFirst = pEntry->pFirst;
+        *ppJob = JOB_New( pFirst->pHeader,
+                          pFirst->headerLength,
+                          pEntry->pBuf,
+                          pEntry->length );
+        if( *ppJob != NULL )
+        {
+            memcpy( (*ppJob)->msgId, pFirst->msgId, sizeof( pFirst->msgId ) );
+            (*ppJob)->target = pFirst->target;
+        }
+        else
+        {
+            result = ENOMEM;
+        }
+
+        RemoveEntry( pAssembly, pEntry );
+    }
+    else if( result == EOK )
+    {
+        result = EINPROGRESS;
+    }
+    else if( ( result != EALREADY ) && ( pEntry != NULL ) )
+    {
+        /* abandon the command */
+        RemoveEntry( pAssembly, pEntry );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  FindEntry                                                                 */
+/*!
+    Find the command being reassembled for a message identifier
+
+    @param[in]
+        pAssembly
+            pointer to the Assembly
+
+    @param[in]
+        msgId
+            pointer to the NUL terminated message identifier
+
+    @retval pointer to the AssemblyEntry
+    @retval NULL no command is being reassembled for the identifier
+
+==============================================================================*/
+static AssemblyEntry *FindEntry( Assembly *pAssembly, const char *msgId )
+{
+    AssemblyEntry *pEntry = pAssembly->pEntries;
+
+    while( ( pEntry != NULL ) &&
+           ( strcmp( pEntry->pFirst->msgId, msgId ) != 0 ) )
+    {
+        pEntry = pEntry->pNext;
+    }
+
+    return pEntry;
+}
+
+/*============================================================================*/
+/*  NewEntry                                                                  */
+/*!
+    Start the reassembly of a command
+
+    The NewEntry function creates a reassembly entry which owns the
+    first part of the command.  If the maximum number of commands are
+    already being reassembled, the oldest is abandoned.
+
+    @param[in]
+        pAssembly
+            pointer to the Assembly
+
+    @param[in]
+        pJob
+            pointer to the job containing the first part
+
+    @param[in]
+        parts
+            total number of parts
+
+    @param[in]
+        now
+            the current monotonic time (ms)
+
+    @retval pointer to the new AssemblyEntry
+    @retval NULL out of memory
+
+==============================================================================*/
+static AssemblyEntry *NewEntry( Assembly *pAssembly,
+                                Job *pJob,
+                                unsigned long parts,
+                                uint64_t now )
+{
+    AssemblyEntry *pEntry;
+    AssemblyEntry *pOldest = pAssembly->pEntries;
+
+    if( pAssembly->numEntries >= ASSEMBLY_MAX_ENTRIES )
+    {
+        for( pEntry = pAssembly->pEntries;
+             pEntry != NULL;
+             pEntry = pEntry->pNext )
+        {
+            if( pEntry->started < pOldest->started )
+            {
+                pOldest = pEntry;
+            }
+        }
+
+        RemoveEntry( pAssembly, pOldest );
+    }
+
+    pEntry = calloc( 1, sizeof( AssemblyEntry ) );
+    if( pEntry != NULL )
+    {
+        pEntry->pFirst = pJob;
+        pEntry->parts = parts;
+        pEntry->started = now;
+
+        pEntry->pNext = pAssembly->pEntries;
+        pAssembly->pEntries = pEntry;
+        pAssembly->numEntries++;
+    }
+
+    return pEntry;
+}
+
+/*============================================================================*/
+/*  RemoveEntry                                                               */
+/*!
+    Remove a reassembly entry and release its resources
+
+    @param[in]
+        pAssembly
+            pointer to the Assembly
+
+    @param[in]
+        pEntry
+            pointer to the AssemblyEntry to remove
+
+==============================================================================*/
+static void RemoveEntry( Assembly *pAssembly, AssemblyEntry *pEntry )
+{
+    AssemblyEntry **ppEntry = &pAssembly->pEntries;
+
+    while( ( *ppEntry != NULL ) && ( *ppEntry != pEntry ) )
+    {
+        ppEntry = &(*ppEntry)->pNext;
+    }
+
+    if( *ppEntry != NULL )
+    {
+        *ppEntry = pEntry->pNext;
+        pAssembly->numEntries--;
+
+        JOB_Free( pEntry->pFirst );
+        free( pEntry->pBuf );
+        free( pEntry );
+    }
+}
+
+/*============================================================================*/
+/*  Expire                                                                    */
+/*!
+    Abandon commands whose parts did not arrive in time
+
+    @param[in]
+        pAssembly
+            pointer to the Assembly
+
+    @param[in]
+        now
+            the current monotonic time (ms)
+
+==============================================================================*/
+static void Expire( Assembly *pAssembly, uint64_t now )
+{
+    AssemblyEntry *pEntry;
+    AssemblyEntry *pNext;
+
+    for( pEntry = pAssembly->pEntries; pEntry != NULL; pEntry = pNext )
+    {
+        pNext = pEntry->pNext;
+
+        if( ( pAssembly->timeoutMs > 0 ) &&
+            ( now - pEntry->started >= pAssembly->timeoutMs ) )
+        {
+            RemoveEntry( pAssembly, pEntry );
+        }
+    }
+}
+
+/*============================================================================*/
+/*  Append                                                                    */
+/*!
+    Append the body of a part to the reassembly buffer
+
+    The Append function grows the reassembly buffer geometrically as
+    required.
+
+    @param[in]
+        pAssembly
+            pointer to the Assembly
+
+    @param[in]
+        pEntry
+            pointer to the AssemblyEntry
+
+    @param[in]
+        pData
+            pointer to the body of the part
+
+    @param[in]
+        length
+            length of the body of the part
+
+    @retval EOK the part was appended
+    @retval EMSGSIZE the command would exceed the maximum length
+    @retval ENOMEM could not grow the buffer
+
+==============================================================================*/
+static int Append( Assembly *pAssembly,
+                   AssemblyEntry *pEntry,
+                   const char *pData,
+                   size_t length )
+{
+    int result = EOK;
+    size_t size;
+    char *p;
+
+    if( pEntry->length + length > pAssembly->maxLength )
+    {
+        result = EMSGSIZE;
+    }
+    else if( pEntry->length + length > pEntry->size )
+    {
+        size = ( pEntry->size > 0 ) ? pEntry->size : ASSEMBLY_INITIAL_SIZE;
+        while( size < pEntry->length + length )
+        {
+            size *= 2;
+        }
+
+        p = realloc( pEntry->pBuf, size );
+        if( p != NULL )
+        {
+            pEntry->pBuf = p;
+            pEntry->size = size;
+        }
+        else
+        {
+            result = ENOMEM;
+        }
+    }
+
+    if( ( result == EOK ) && ( length > 0 ) )
+    {
+        memcpy( &pEntry->pBuf[pEntry->length], pData, length );
+        pEntry->length += length;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  GetNumber                                                                 */
+/*!
+    Get the value of a numeric header of a received message
+
+    @param[in]
+        pJob
+            pointer to the job containing the received message header
+
+    @param[in]
+        property
+            the header property to get
+
+    @retval the value of the header
+    @retval 0 the header is absent or not a number
+
+==============================================================================*/
+static unsigned long GetNumber( Job *pJob, JobProperty property )
+{
+    char buf[16];
+    unsigned long value = 0;
+
+    if( JOB_GetProperty( pJob, property, buf, sizeof( buf ) ) == EOK )
+    {
+        value = strtoul( buf, NULL, 10 );
+    }
+
+    return value;
+}
+
+/*! @}
+ * end of assembly group */
@@ -0,0 +1,501 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup builtin builtin
+ * @brief In-process builtin commands
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file builtin.c
+
+    In-process builtin commands
+
+    The builtin module executes common read-only commands inside the
+    iotexec process, avoiding the cost of creating a process for
+    them.  The builtins produce the same output as the commands they
+    replace:
+
+    - cat <file>... : copy procfs, sysfs or other files to the output
+    - uptime        : the procps-ng (version 4) uptime summary
+
+    A builtin only handles the forms of a command it can reproduce
+    exactly.  Anything else, such as a command with options, shell
+    syntax, or a file which cannot be opened or is not a regular file,
+    is declined and the command is launched as usual, so its behavior
+    (including its error messages and exit status) is unchanged.
+    Regular files, including procfs and sysfs files, never block, so a
+    builtin cannot stall the thread which executes it.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <utmp.h>
+#include "builtin.h"
+#include "launcher.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+#ifndef EOK
+/*! success response */
+#define EOK 0
+#endif
+
+/*! maximum length of a builtin command */
+#define MAX_BUILTIN_LENGTH 512
+
+/*! maximum number of arguments of a builtin command */
+#define MAX_BUILTIN_ARGS 16
+
+/*! wait status of a command which exited with the specified code */
+#define EXIT_STATUS( code ) ( ( code ) << 8 )
+
+/*! function which executes a builtin command */
+typedef int (*BuiltinHandler)( int argc,
+                               char *argv[],
+                               BuiltinOutput output,
+                               void *arg,
+                               int *pStatus );
+
+/*! a builtin command */
+typedef struct _builtin
+{
+    /*! name of the command */
+    const char *name;
+
+    /*! function which executes the command */
+    BuiltinHandler handler;
+
+} Builtin;
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static int Cat( int argc,
+                char *argv[],
+                BuiltinOutput output,
+                void *arg,
+                int *pStatus );
+
+static int Uptime( int argc,
+                   char *argv[],
+                   BuiltinOutput output,
+                   void *arg,
+                   int *pStatus );
+
+static int CountUsers( void );
+
+/*==============================================================================
+        Private file scoped variables
+==============================================================================*/
+
+/*! mutex serializing access to the utmp database */
+static pthread_mutex_t utmpLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*! registry of builtin commands */
+static const Builtin builtins[] =
+{
+    { "cat", Cat },
+    { "uptime", Uptime },
+    { NULL, NULL }
+};
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  BUILTIN_Run                                                               */
+/*!
+    Execute a builtin command
+
+    The BUILTIN_Run function looks up the command name in the builtin
+    registry and executes the builtin, passing its output to the
+    specified output function.
+
+    @param[in]
+        command
+            pointer to the NUL terminated command
+
+    @param[in]
+        output
+            function which receives the command output
+
+    @param[in]
+        arg
+            opaque argument passed to the output function
+
+    @param[out]
+        pStatus
+            pointer to the location to store the wait status of the
+            builtin, as it would be reported by waitpid
+
+    @retval EOK the command was executed by a builtin
+    @retval ENOENT the command is not handled by a builtin
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int BUILTIN_Run( const char *command,
+                 BuiltinOutput output,
+                 void *arg,
+                 int *pStatus )
+{
+    int result = EINVAL;
+    char buf[MAX_BUILTIN_LENGTH];
+    char *argv[MAX_BUILTIN_ARGS + 1];
+    char *saveptr = NULL;
+    char *token;
+    int argc = 0;
+    int i;
+
+    if( ( command != NULL ) &&
+        ( output != NULL ) &&
+        ( pStatus != NULL ) )
+    {
+        result = ENOENT;
+
+        if( ( LAUNCHER_NeedsShell( command ) == false ) &&
+            ( strlen( command ) < sizeof( buf ) ) )
+        {
+            strcpy( buf, command );
+
+            token = strtok_r( buf, " \t", &saveptr );
+            while( ( token != NULL ) && ( argc < MAX_BUILTIN_ARGS ) )
+            {
+                argv[argc++] = token;
+                token = strtok_r( NULL, " \t", &saveptr );
+            }
+
+            argv[argc] = NULL;
+
+            if( ( token == NULL ) && ( argc > 0 ) )
+            {
+                for( i = 0; builtins[i].name != NULL; i++ )
+                {
+                    if( strcmp( argv[0], builtins[i].name ) == 0 )
+                    {
+                        result = builtins[i].handler( argc,
+                                                      argv,
+                                                      output,
+                                                      arg,
+                                                      pStatus );
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  Cat                                                                       */
+/*!
+    Builtin cat command
+
+    The Cat function copies the contents of the specified files to the
+    output.  All the files are opened before any output is produced so
+    the command can be declined if any of them cannot be opened.  The
+    files are opened non-blocking, so opening a FIFO or a device does
+    not wait for it, and the command is declined unless every file is a
+    regular file, since reading anything else could block.
+
+    @param[in]
+        argc
+            number of arguments
+
+    @param[in]
+        argv
+            array of pointers to the arguments
+
+    @param[in]
+        output
+            function which receives the command output
+
+    @param[in]
+        arg
+            opaque argument passed to the output function
+
+    @param[out]
+        pStatus
+            pointer to the location to store the wait status
+
+    @retval EOK the files were copied
+    @retval ENOENT the command cannot be handled by the builtin
+
+==============================================================================*/
+static int Cat( int argc,
+                char *argv[],
+                BuiltinOutput output,
+                void *arg,
+                int *pStatus )
+{
+    int result = EOK;
+    int fds[MAX_BUILTIN_ARGS];
+    struct stat st;
+    char buf[BUFSIZ];
+    int exitCode = 0;
+    ssize_t n;
+    int i;
+
+    for( i = 1; i < argc; i++ )
+    {
+        fds[i] = -1;
+        if( ( result == EOK ) && ( argv[i][0] != '-' ) )
+        {
+            fds[i] = open( argv[i], O_RDONLY | O_NONBLOCK | O_CLOEXEC );
+        }
+
+        if( ( fds[i] != -1 ) &&
+            ( ( fstat( fds[i], &st ) != 0 ) || ( !S_ISREG( st.st_mode ) ) ) )
+        {
+            close( fds[i] );
+            fds[i] = -1;
+        }
+
+        if( fds[i] == -1 )
+        {
+            result = ENOENT;
+        }
+    }
+
+    if( argc < 2 )
+    {
+        /* cat without arguments reads stdin */
+        result = ENOENT;
+    }
+
+    for( i = 1; i < argc; i++ )
+    {
+        if( result == EOK )
+        {
+            while( ( exitCode == 0 ) &&
+                   ( ( n = read( fds[i], buf, sizeof( buf ) ) ) != 0 ) )
+            {
+                if( n > 0 )
+                {
+                    if( output( arg, buf, n ) != EOK )
+                    {
+                        exitCode = 1;
+                    }
+                }
+                else if( errno != EINTR )
+                {
+                    exitCode = 1;
+                }
+            }
+        }
+
+        if( fds[i] != -1 )
+        {
+            close( fds[i] );
+        }
+    }
+
+    *pStatus = EXIT_STATUS( exitCode );
+
+    return result;
+}
+
+/*============================================================================*/
+/*  Uptime                                                                    */
+/*!
+    Builtin uptime command
+
+    The Uptime function produces the procps-ng 4 uptime summary: the
+    current time, the time since boot, the number of logged in users
+    and the load averages.
+
+    @param[in]
+        argc
+            number of arguments
+
+    @param[in]
+        argv
+            array of pointers to the arguments
+
+    @param[in]
+        output
+            function which receives the command output
+
+    @param[in]
+        arg
+            opaque argument passed to the output function
+
+    @param[out]
+        pStatus
+            pointer to the location to store the wait status
+
+    @retval EOK the summary was output
+    @retval ENOENT the command cannot be handled by the builtin
+
+==============================================================================*/
+static int Uptime( int argc,
+                   char *argv[],
+                   BuiltinOutput output,
+                   void *arg,
+                   int *pStatus )
+{
+    int result = ENOENT;
+    char buf[128];
+    double loadavg[3];
+    double uptime = 0.0;
+    struct tm tm;
+    time_t now;
+    FILE *fp;
+    int rc = 0;
+    long days;
+    long hours;
+    long minutes;
+    int users;
+    int n;
+
+    /* uptime takes no arguments */
+    (void)argv;
+
+    fp = ( argc == 1 ) ? fopen( "/proc/uptime", "re" ) : NULL;
+    if( fp != NULL )
+    {
+        rc = fscanf( fp, "%lf", &uptime );
+        fclose( fp );
+    }
+
+    if( ( rc == 1 ) &&
+        ( getloadavg( loadavg, 3 ) == 3 ) )
+    {
+        now = time( NULL );
+        localtime_r( &now, &tm );
+
+        days = (long)uptime / ( 60 * 60 * 24 );
+        minutes = (long)uptime / 60;
+        hours = ( minutes / 60 ) % 24;
+        minutes = minutes % 60;
+        users = CountUsers();
+
+        n = snprintf( buf,
+                      sizeof( buf ),
+                      " %02d:%02d:%02d up ",
+                      tm.tm_hour,
+                      tm.tm_min,
+                      tm.tm_sec );
+
+        if( days > 0 )
+        {
+            n += snprintf( &buf[n],
+                           sizeof( buf ) - n,
+                           "%ld day%s, ",
+                           days,
+                           ( days != 1 ) ? "s" : "" );
+        }
+
+        if( hours > 0 )
+        {
+            n += snprintf( &buf[n],
+                           sizeof( buf ) - n,
+                           "%2ld:%02ld, ",
+                           hours,
+                           minutes );
+        }
+        else
+        {
+            n += snprintf( &buf[n], sizeof( buf ) - n, "%ld min, ", minutes );
+        }
+
+        n += snprintf( &buf[n],
+                       sizeof( buf ) - n,
+                       "%2d %s,  load average: %.2f, %.2f, %.2f\n",
+                       users,
+                       ( users == 1 ) ? "user" : "users",
+                       loadavg[0],
+                       loadavg[1],
+                       loadavg[2] );
+
+        output( arg, buf, strlen( buf ) );
+
+        *pStatus = EXIT_STATUS( 0 );
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  CountUsers                                                                */
+/*!
+    Count the logged in users
+
+    @retval the number of user sessions recorded in utmp
+
+==============================================================================*/
+static int CountUsers( void )
+{
+    struct utmp *pEntry;
+    int count = 0;
+
+    /* the utmp functions are not thread safe */
+    pthread_mutex_lock( &utmpLock );
+
+    setutent();
+
+    while( ( pEntry = getutent() ) != NULL )
+    {
+        if( ( pEntry->ut_type == USER_PROCESS ) &&
+            ( pEntry->ut_user[0] != '\0' ) )
+        {
+            count++;
+        }
+    }
+
+    endutent();
+
+    pthread_mutex_unlock( &utmpLock );
+
+    return count;
+}
+
+/*! @}
+ * end of builtin group */
@@ -0,0 +1,401 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup cache cache
+ * @brief Command result cache
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file cache.c
+
+    Command result cache
+
+    The cache module keeps the most recent output of read-only commands
+    which are polled frequently, such as uptime or df, so a repeated
+    request within the command's time-to-live is answered without
+    executing the command again.
+
+    Only commands listed in the cache configuration file are cached.
+    Each line of the file contains a time-to-live in seconds followed
+    by the exact command string:
+
+        # ttl  command
+        5      uptime
+        60     df -h
+
+    The list of cacheable commands is fixed once the file is loaded, so
+    it is searched without locking.  The cached outputs are protected by
+    the cache mutex since they are shared by all the executors.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <pthread.h>
+#include "cache.h"
+#include "response.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+#ifndef EOK
+/*! success response */
+#define EOK 0
+#endif
+
+/*! maximum length of a line in the cache configuration file */
+#define MAX_LINE_LENGTH 512
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static int AddEntry( Cache *pCache, char *line );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  CACHE_Load                                                                */
+/*!
+    Load the list of cacheable commands
+
+    The CACHE_Load function initializes the cache and reads the list of
+    cacheable commands and their time-to-live from the cache
+    configuration file.  Blank lines and lines starting with # are
+    ignored.
+
+    @param[in]
+        pCache
+            pointer to the Cache to initialize
+
+    @param[in]
+        filename
+            pointer to the name of the cache configuration file
+
+    @retval EOK the cache was loaded
+    @retval EINVAL invalid arguments
+    @retval ENOMEM could not allocate a cache entry
+    @retval error as returned by fopen
+
+==============================================================================*/
+int CACHE_Load( Cache *pCache, const char *filename )
+{
+    int result = EINVAL;
+    char line[MAX_LINE_LENGTH];
+    FILE *fp;
+
+    if( ( pCache != NULL ) &&
+        ( filename != NULL ) )
+    {
+        memset( pCache, 0, sizeof( Cache ) );
+        pthread_mutex_init( &pCache->lock, NULL );
+
+        fp = fopen( filename, "re" );
+        if( fp != NULL )
+        {
+            result = EOK;
+
+            while( ( result == EOK ) &&
+                   ( fgets( line, sizeof( line ), fp ) != NULL ) )
+            {
+                result = AddEntry( pCache, line );
+            }
+
+            fclose( fp );
+        }
+        else
+        {
+            result = errno;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  CACHE_Find                                                                */
+/*!
+    Find the cache entry for a command
+
+    @param[in]
+        pCache
+            pointer to the Cache
+
+    @param[in]
+        command
+            pointer to the NUL terminated command
+
+    @retval pointer to the cache entry for the command
+    @retval NULL the command is not cacheable
+
+==============================================================================*/
+CacheEntry *CACHE_Find( Cache *pCache, const char *command )
+{
+    CacheEntry *pEntry = NULL;
+
+    if( ( pCache != NULL ) &&
+        ( command != NULL ) )
+    {
+        for( pEntry = pCache->pEntries;
+             pEntry != NULL;
+             pEntry = pEntry->pNext )
+        {
+            if( strcmp( pEntry->command, command ) == 0 )
+            {
+                break;
+            }
+        }
+    }
+
+    return pEntry;
+}
+
+/*============================================================================*/
+/*  CACHE_Get                                                                 */
+/*!
+    Get the cached output of a command
+
+    The CACHE_Get function returns a copy of the command's cached output
+    if it has not yet expired.  The caller must free the copy.
+
+    @param[in]
+        pCache
+            pointer to the Cache
+
+    @param[in]
+        pEntry
+            pointer to the command's cache entry
+
+    @param[out]
+        ppData
+            pointer to the location to store a pointer to the output
+
+    @param[out]
+        pLength
+            pointer to the location to store the output length
+
+    @retval EOK the cached output was returned
+    @retval ENOENT there is no valid cached output
+    @retval ENOMEM could not allocate the copy of the output
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int CACHE_Get( Cache *pCache,
+               CacheEntry *pEntry,
+               char **ppData,
+               size_t *pLength )
+{
+    int result = EINVAL;
+    char *pData;
+
+    if( ( pCache != NULL ) &&
+        ( pEntry != NULL ) &&
+        ( ppData != NULL ) &&
+        ( pLength != NULL ) )
+    {
+        result = ENOENT;
+
+        pthread_mutex_lock( &pCache->lock );
+
+        if( ( pEntry->pData != NULL ) &&
+            ( RESPONSE_Now() < pEntry->expiry ) )
+        {
+            /* allocate at least one byte for an empty output */
+            pData = malloc( pEntry->length + 1 );
+            if( pData != NULL )
+            {
+                memcpy( pData, pEntry->pData, pEntry->length );
+                *ppData = pData;
+                *pLength = pEntry->length;
+                result = EOK;
+            }
+            else
+            {
+                result = ENOMEM;
+            }
+        }
+
+        pthread_mutex_unlock( &pCache->lock );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  CACHE_Put                                                                 */
+/*!
+    Store the output of a command
+
+    The CACHE_Put function replaces the command's cached output and
+    starts its time-to-live.
+
+    @param[in]
+        pCache
+            pointer to the Cache
+
+    @param[in]
+        pEntry
+            pointer to the command's cache entry
+
+    @param[in]
+        pData
+            pointer to the command output
+
+    @param[in]
+        length
+            length of the command output
+
+    @retval EOK the output was cached
+    @retval E2BIG the output is too large to cache
+    @retval ENOMEM could not allocate memory for the output
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int CACHE_Put( Cache *pCache,
+               CacheEntry *pEntry,
+               const char *pData,
+               size_t length )
+{
+    int result = EINVAL;
+    char *pCopy;
+
+    if( ( pCache != NULL ) &&
+        ( pEntry != NULL ) &&
+        ( pData != NULL ) )
+    {
+        if( length <= CACHE_MAX_OUTPUT )
+        {
+            pCopy = malloc( length + 1 );
+            if( pCopy != NULL )
+            {
+                memcpy( pCopy, pData, length );
+
+                pthread_mutex_lock( &pCache->lock );
+
+                free( pEntry->pData );
+                pEntry->pData = pCopy;
+                pEntry->length = length;
+                pEntry->expiry = RESPONSE_Now() +
+                                 ( (uint64_t)pEntry->ttl * 1000 );
+
+                pthread_mutex_unlock( &pCache->lock );
+
+                result = EOK;
+            }
+            else
+            {
+                result = ENOMEM;
+            }
+        }
+        else
+        {
+            result = E2BIG;
+        }
+    }
+
+    return result;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  AddEntry                                                                  */
+/*!
+    Add a cacheable command from a cache configuration file line
+
+    @param[in]
+        pCache
+            pointer to the Cache
+
+    @param[in]
+        line
+            pointer to the NUL terminated configuration line
+
+    @retval EOK the line was processed
+    @retval ENOMEM could not allocate the cache entry
+
+==============================================================================*/
+static int AddEntry( Cache *pCache, char *line )
+{
+    int result = EOK;
+    CacheEntry *pEntry;
+    unsigned long ttl;
+    char *command;
+    size_t len;
+
+    /* strip trailing white space */
+    len = strlen( line );
+    while( ( len > 0 ) && ( isspace( (unsigned char)line[len - 1] ) ) )
+    {
+        line[--len] = '\0';
+    }
+
+    ttl = strtoul( line, &command, 10 );
+    while( isspace( (unsigned char)*command ) )
+    {
+        command++;
+    }
+
+    if( ( line[0] != '#' ) &&
+        ( command != line ) &&
+        ( ttl > 0 ) &&
+        ( *command != '\0' ) )
+    {
+        pEntry = calloc( 1, sizeof( CacheEntry ) + strlen( command ) + 1 );
+        if( pEntry != NULL )
+        {
+            pEntry->ttl = ttl;
+            strcpy( pEntry->command, command );
+
+            pEntry->pNext = pCache->pEntries;
+            pCache->pEntries = pEntry;
+            pCache->numEntries++;
+        }
+        else
+        {
+            result = ENOMEM;
+        }
+    }
+
+    return result;
+}
+
+/*! @}
+ * end of cache group */
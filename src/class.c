@@ -0,0 +1,1100 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup class class
+ * @brief Command execution classes
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file class.c
+
+    Command execution classes
+
+    The class module isolates the resource usage of commands.  A command
+    with a class header is executed in the named execution class, which
+    limits its CPU bandwidth, memory, io bandwidth, CPU time, and
+    scheduling priorities, so a heavy diagnostic such as a log archive
+    cannot starve the device's primary workload.
+
+    The execution classes are listed in the class configuration file.
+    Each line contains a class name followed by its limits:
+
+        # name  limits
+        bulk    cpu=20 memory=64M io=8:0,1M nice=10 ionice=idle
+        diag    cpu=50 cputime=30
+
+    cpu         CPU bandwidth in percent of one CPU
+    memory      memory limit in bytes, with an optional K, M or G suffix
+    io          read and write bandwidth limit of the major:minor block
+                device in bytes per second, repeated per device
+    cputime     CPU time limit in seconds
+    nice        nice value
+    ionice      io scheduling class: idle, be:level or rt:level
+
+    When a cgroup v2 directory is set up, each class is given a child
+    cgroup of it whose cpu.max, memory.max and io.max enforce the class
+    limits.  Each command is moved into a leaf cgroup of its own under
+    its class cgroup before it is executed, so the class limits are
+    shared by the class's commands, while the memory usage and out of
+    memory kills of a command are accounted to the command alone.  The
+    leaf is named after the command's process identifier and is removed
+    once the command has been reaped.  Without cgroups the memory limit falls back to an
+    address space rlimit, and the CPU and io bandwidth limits are not
+    enforced.  The CPU time limit and the priorities are always applied
+    to the command process itself.
+
+    The classes are fixed once they are set up, so they are searched
+    without locking.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "class.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+#ifndef EOK
+/*! success response */
+#define EOK 0
+#endif
+
+/*! maximum length of a line in the class configuration file */
+#define MAX_LINE_LENGTH 512
+
+/*! maximum length of a cgroup interface file path */
+#define MAX_CGROUP_FILE_LENGTH ( MAX_CGROUP_PATH_LENGTH + 64 )
+
+/*! cgroup which holds iotexec itself when the parent cgroup must be
+    left without processes so its controllers can be enabled */
+#define SERVICE_CGROUP "iotexec"
+
+/*! cpu.max period in microseconds */
+#define CPU_PERIOD_US 100000
+
+/*! ioprio_set target selecting a process */
+#define IOPRIO_WHO_PROCESS 1
+
+/*! shift of the io scheduling class in an io priority */
+#define IOPRIO_CLASS_SHIFT 13
+
+/*! io scheduling classes */
+#define IOPRIO_CLASS_RT 1
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static int AddClass( ClassTable *pTable, char *line );
+static int ParseLimit( ExecClass *pClass, char *limit );
+static int ParseSize( const char *value, uint64_t *pSize );
+static int ParseIoPriority( const char *value, int *pIoPriority );
+static int SetupClass( ClassTable *pTable, ExecClass *pClass );
+static int EnableControllers( ClassTable *pTable );
+static int WriteFile( const char *dir,
+                      const char *name,
+                      const char *file,
+                      const char *value );
+static int SetLimit( int resource, uint64_t value );
+static int JoinLeaf( int cgroupFd );
+static void FormatPid( pid_t pid, char *name );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  CLASS_Load                                                                */
+/*!
+    Load the execution classes
+
+    The CLASS_Load function initializes the class table and reads the
+    execution classes and their limits from the class configuration
+    file.  Blank lines and lines starting with # are ignored.
+
+    @param[in]
+        pTable
+            pointer to the ClassTable to initialize
+
+    @param[in]
+        filename
+            pointer to the name of the class configuration file
+
+    @retval EOK the classes were loaded
+    @retval EINVAL invalid arguments or invalid class definition
+    @retval ENOMEM could not allocate a class
+    @retval error as returned by fopen
+
+==============================================================================*/
+int CLASS_Load( ClassTable *pTable, const char *filename )
+{
+    int result = EINVAL;
+    char line[MAX_LINE_LENGTH];
+    FILE *fp;
+
+    if( ( pTable != NULL ) &&
+        ( filename != NULL ) )
+    {
+        memset( pTable, 0, sizeof( ClassTable ) );
+
+        fp = fopen( filename, "re" );
+        if( fp != NULL )
+        {
+            result = EOK;
+
+            while( ( result == EOK ) &&
+                   ( fgets( line, sizeof( line ), fp ) != NULL ) )
+            {
+                result = AddClass( pTable, line );
+            }
+
+            fclose( fp );
+        }
+        else
+        {
+            result = errno;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  CLASS_Setup                                                               */
+/*!
+    Create the cgroups of the execution classes
+
+    The CLASS_Setup function enables the controllers used by the classes
+    in the specified cgroup v2 directory, and creates a child cgroup for
+    each class with its CPU, memory and io limits.  If the directory
+    contains the iotexec process, iotexec is first moved to a child
+    cgroup of its own, since the controllers of a cgroup which contains
+    processes cannot be enabled.  This must be done before any threads
+    are created.
+
+    The directory must be writable by iotexec, for example a cgroup
+    delegated to the service by its init system.  If the cgroups cannot
+    be set up, the classes fall back to the limits which do not need
+    cgroups.
+
+    @param[in]
+        pTable
+            pointer to the loaded ClassTable
+
+    @param[in]
+        cgroupDir
+            pointer to the NUL terminated cgroup v2 directory
+
+    @retval EOK the class cgroups were set up
+    @retval EINVAL invalid arguments
+    @retval ENAMETOOLONG the cgroup directory path is too long
+    @retval error as returned by mkdir, open or write
+
+==============================================================================*/
+int CLASS_Setup( ClassTable *pTable, const char *cgroupDir )
+{
+    int result = EINVAL;
+    ExecClass *pClass;
+
+    if( ( pTable != NULL ) &&
+        ( cgroupDir != NULL ) )
+    {
+        if( strlen( cgroupDir ) < sizeof( pTable->cgroupDir ) )
+        {
+            strcpy( pTable->cgroupDir, cgroupDir );
+            result = EnableControllers( pTable );
+        }
+        else
+        {
+            result = ENAMETOOLONG;
+        }
+
+        for( pClass = pTable->pClasses;
+             ( result == EOK ) && ( pClass != NULL );
+             pClass = pClass->pNext )
+        {
+            result = SetupClass( pTable, pClass );
+        }
+
+        for( pClass = pTable->pClasses;
+             ( result != EOK ) && ( pClass != NULL );
+             pClass = pClass->pNext )
+        {
+            if( pClass->cgroupFd != -1 )
+            {
+                close( pClass->cgroupFd );
+                pClass->cgroupFd = -1;
+            }
+        }
+
+        if( result != EOK )
+        {
+            pTable->cgroupDir[0] = '\0';
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  CLASS_Find                                                                */
+/*!
+    Find an execution class
+
+    @param[in]
+        pTable
+            pointer to the ClassTable, or NULL if classes are not used
+
+    @param[in]
+        name
+            pointer to the NUL terminated class name
+
+    @retval pointer to the execution class
+    @retval NULL the class does not exist
+
+==============================================================================*/
+const ExecClass *CLASS_Find( ClassTable *pTable, const char *name )
+{
+    ExecClass *pClass = NULL;
+
+    if( ( pTable != NULL ) &&
+        ( name != NULL ) )
+    {
+        pClass = pTable->pClasses;
+        while( ( pClass != NULL ) &&
+               ( strcmp( pClass->name, name ) != 0 ) )
+        {
+            pClass = pClass->pNext;
+        }
+    }
+
+    return pClass;
+}
+
+/*============================================================================*/
+/*  CLASS_Apply                                                               */
+/*!
+    Apply an execution class to the calling process
+
+    The CLASS_Apply function moves the calling process into a leaf
+    cgroup of its own under the cgroup of its execution class, and sets
+    its rlimits and priorities.  It is called by a forked child before
+    it executes the command, so it only makes async-signal-safe calls.
+
+    @param[in]
+        pClass
+            pointer to the execution class
+
+    @retval EOK the class was applied
+    @retval EINVAL invalid arguments
+    @retval error as returned by mkdirat, openat, write, setrlimit,
+            setpriority or ioprio_set
+
+==============================================================================*/
+int CLASS_Apply( const ExecClass *pClass )
+{
+    int result = EINVAL;
+
+    if( pClass != NULL )
+    {
+        result = EOK;
+
+        if( pClass->cgroupFd != -1 )
+        {
+            result = JoinLeaf( pClass->cgroupFd );
+        }
+
+        if( ( result == EOK ) &&
+            ( pClass->cgroupFd == -1 ) &&
+            ( pClass->memoryMax > 0 ) )
+        {
+            result = SetLimit( RLIMIT_AS, pClass->memoryMax );
+        }
+
+        if( ( result == EOK ) && ( pClass->cpuTime > 0 ) )
+        {
+            result = SetLimit( RLIMIT_CPU, pClass->cpuTime );
+        }
+
+        if( ( result == EOK ) &&
+            ( pClass->hasNice ) &&
+            ( setpriority( PRIO_PROCESS, 0, pClass->nice ) != 0 ) )
+        {
+            result = errno;
+        }
+
+        if( ( result == EOK ) &&
+            ( pClass->ioPriority != -1 ) &&
+            ( syscall( SYS_ioprio_set,
+                       IOPRIO_WHO_PROCESS,
+                       0,
+                       pClass->ioPriority ) != 0 ) )
+        {
+            result = errno;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  CLASS_Release                                                             */
+/*!
+    Remove the leaf cgroup of a reaped command
+
+    The CLASS_Release function removes the leaf cgroup created by
+    CLASS_Apply for a command which has been reaped.  The leaf is left
+    in place if processes started by the command are still running in
+    it.
+
+    @param[in]
+        pClass
+            pointer to the execution class of the command, or NULL
+
+    @param[in]
+        pid
+            process identifier of the reaped command
+
+    @retval EOK the leaf cgroup was removed
+    @retval ENOENT the class has no cgroup
+    @retval error as returned by unlinkat
+
+==============================================================================*/
+int CLASS_Release( const ExecClass *pClass, pid_t pid )
+{
+    int result = ENOENT;
+    char name[16];
+
+    if( ( pClass != NULL ) && ( pClass->cgroupFd != -1 ) )
+    {
+        FormatPid( pid, name );
+        result = ( unlinkat( pClass->cgroupFd, name, AT_REMOVEDIR ) == 0 )
+                    ? EOK
+                    : errno;
+    }
+
+    return result;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  AddClass                                                                  */
+/*!
+    Add an execution class
+
+    The AddClass function parses a line of the class configuration file
+    and adds its execution class to the class table.
+
+    @param[in]
+        pTable
+            pointer to the ClassTable
+
+    @param[in]
+        line
+            pointer to the line to parse.  The line is modified.
+
+    @retval EOK the class was added, or the line was blank or a comment
+    @retval EINVAL invalid class definition
+    @retval EEXIST the class is already defined
+    @retval ENOMEM could not allocate the class
+
+==============================================================================*/
+static int AddClass( ClassTable *pTable, char *line )
+{
+    int result = EOK;
+    ExecClass *pClass;
+    char *saveptr = NULL;
+    char *name;
+    char *limit;
+
+    name = strtok_r( line, " \t\r\n", &saveptr );
+    if( ( name != NULL ) && ( name[0] != '#' ) )
+    {
+        if( ( strlen( name ) >= MAX_CLASS_NAME_LENGTH ) ||
+            ( strcmp( name, SERVICE_CGROUP ) == 0 ) ||
+            ( strchr( name, '/' ) != NULL ) ||
+            ( name[0] == '.' ) )
+        {
+            result = EINVAL;
+        }
+        else if( CLASS_Find( pTable, name ) != NULL )
+        {
+            result = EEXIST;
+        }
+        else
+        {
+            pClass = calloc( 1, sizeof( ExecClass ) );
+            if( pClass != NULL )
+            {
+                strcpy( pClass->name, name );
+                pClass->ioPriority = -1;
+                pClass->cgroupFd = -1;
+
+                while( ( result == EOK ) &&
+                       ( ( limit = strtok_r( NULL,
+                                             " \t\r\n",
+                                             &saveptr ) ) != NULL ) )
+                {
+                    result = ParseLimit( pClass, limit );
+                }
+
+                if( result == EOK )
+                {
+                    pClass->pNext = pTable->pClasses;
+                    pTable->pClasses = pClass;
+                }
+                else
+                {
+                    free( pClass );
+                }
+            }
+            else
+            {
+                result = ENOMEM;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  ParseLimit                                                                */
+/*!
+    Parse a limit of an execution class
+
+    @param[in]
+        pClass
+            pointer to the execution class to update
+
+    @param[in]
+        limit
+            pointer to the NUL terminated name=value limit.  The limit
+            is modified.
+
+    @retval EOK the limit was parsed
+    @retval EINVAL invalid limit
+    @retval E2BIG too many io limits
+
+==============================================================================*/
+static int ParseLimit( ExecClass *pClass, char *limit )
+{
+    int result = EINVAL;
+    char *value;
+    char *rate;
+    char *end;
+    long n;
+    uint64_t size;
+
+    value = strchr( limit, '=' );
+    if( value != NULL )
+    {
+        *value++ = '\0';
+
+        if( strcmp( limit, "cpu" ) == 0 )
+        {
+            n = strtol( value, &end, 10 );
+            if( ( end != value ) && ( *end == '\0' ) && ( n > 0 ) )
+            {
+                pClass->cpuPercent = (unsigned int)n;
+                result = EOK;
+            }
+        }
+        else if( strcmp( limit, "memory" ) == 0 )
+        {
+            result = ParseSize( value, &pClass->memoryMax );
+        }
+        else if( strcmp( limit, "cputime" ) == 0 )
+        {
+            result = ParseSize( value, &pClass->cpuTime );
+        }
+        else if( strcmp( limit, "nice" ) == 0 )
+        {
+            n = strtol( value, &end, 10 );
+            if( ( end != value ) && ( *end == '\0' ) &&
+                ( n >= -20 ) && ( n <= 19 ) )
+            {
+                pClass->nice = (int)n;
+                pClass->hasNice = true;
+                result = EOK;
+            }
+        }
+        else if( strcmp( limit, "ionice" ) == 0 )
+        {
+            result = ParseIoPriority( value, &pClass->ioPriority );
+        }
+        else if( strcmp( limit, "io" ) == 0 )
+        {
+            rate = strchr( value, ',' );
+            if( pClass->numIo >= MAX_CLASS_IO_LIMITS )
+            {
+                result = E2BIG;
+            }
+            else if( ( rate != NULL ) &&
+                     ( rate - value < (long)sizeof( pClass->io[0].device ) ) &&
+                     ( strchr( value, ':' ) != NULL ) )
+            {
+                *rate++ = '\0';
+                result = ParseSize( rate, &size );
+                if( result == EOK )
+                {
+                    strcpy( pClass->io[pClass->numIo].device, value );
+                    pClass->io[pClass->numIo].bps = size;
+                    pClass->numIo++;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  ParseSize                                                                 */
+/*!
+    Parse a size with an optional K, M or G suffix
+
+    @param[in]
+        value
+            pointer to the NUL terminated size
+
+    @param[out]
+        pSize
+            pointer to the location to store the size
+
+    @retval EOK the size was parsed
+    @retval EINVAL invalid or zero size
+
+==============================================================================*/
+static int ParseSize( const char *value, uint64_t *pSize )
+{
+    int result = EINVAL;
+    unsigned long long size;
+    char *end;
+
+    if( isdigit( (unsigned char)value[0] ) )
+    {
+        size = strtoull( value, &end, 10 );
+        switch( toupper( (unsigned char)*end ) )
+        {
+            case 'K':
+                size <<= 10;
+                end++;
+                break;
+
+            case 'M':
+                size <<= 20;
+                end++;
+                break;
+
+            case 'G':
+                size <<= 30;
+                end++;
+                break;
+
+            default:
+                break;
+        }
+
+        if( ( *end == '\0' ) && ( size > 0 ) )
+        {
+            *pSize = size;
+            result = EOK;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  ParseIoPriority                                                           */
+/*!
+    Parse an io scheduling class
+
+    @param[in]
+        value
+            pointer to the NUL terminated io scheduling class: idle,
+            be:level or rt:level, where level is 0 (highest) to 7
+
+    @param[out]
+        pIoPriority
+            pointer to the location to store the io priority
+
+    @retval EOK the io scheduling class was parsed
+    @retval EINVAL invalid io scheduling class
+
+==============================================================================*/
+static int ParseIoPriority( const char *value, int *pIoPriority )
+{
+    int result = EINVAL;
+    int ioClass = 0;
+
+    if( strcmp( value, "idle" ) == 0 )
+    {
+        *pIoPriority = IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT;
+        result = EOK;
+    }
+    else
+    {
+        if( strncmp( value, "be:", 3 ) == 0 )
+        {
+            ioClass = IOPRIO_CLASS_BE;
+        }
+        else if( strncmp( value, "rt:", 3 ) == 0 )
+        {
+            ioClass = IOPRIO_CLASS_RT;
+        }
+
+        if( ( ioClass != 0 ) &&
+            ( value[3] >= '0' ) &&
+            ( value[3] <= '7' ) &&
+            ( value[4] == '\0' ) )
+        {
+            *pIoPriority = ( ioClass << IOPRIO_CLASS_SHIFT ) |
+                           ( value[3] - '0' );
+            result = EOK;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  SetupClass                                                                */
+/*!
+    Create the cgroup of an execution class
+
+    The SetupClass function creates the cgroup of an execution class if
+    it does not already exist, writes its limits, and opens its
+    cgroup.procs file so commands can move themselves into the cgroup.
+    Limits which the class does not set are reset to max, in case the
+    cgroup was left behind by an earlier configuration.
+
+    @param[in]
+        pTable
+            pointer to the ClassTable
+
+    @param[in]
+        pClass
+            pointer to the execution class
+
+    @retval EOK the class cgroup was set up
+    @retval error as returned by mkdir, open or write
+
+==============================================================================*/
+static int SetupClass( ClassTable *pTable, ExecClass *pClass )
+{
+    int result = EOK;
+    char path[MAX_CGROUP_FILE_LENGTH];
+    char value[64];
+    size_t i;
+
+    snprintf( path, sizeof( path ), "%s/%s", pTable->cgroupDir, pClass->name );
+    if( ( mkdir( path, 0755 ) != 0 ) && ( errno != EEXIST ) )
+    {
+        result = errno;
+    }
+
+    if( result == EOK )
+    {
+        if( pClass->cpuPercent > 0 )
+        {
+            snprintf( value,
+                      sizeof( value ),
+                      "%lu %d",
+                      (unsigned long)pClass->cpuPercent *
+                        ( CPU_PERIOD_US / 100 ),
+                      CPU_PERIOD_US );
+        }
+        else
+        {
+            snprintf( value, sizeof( value ), "max %d", CPU_PERIOD_US );
+        }
+
+        result = WriteFile( pTable->cgroupDir, pClass->name, "cpu.max", value );
+    }
+
+    if( result == EOK )
+    {
+        if( pClass->memoryMax > 0 )
+        {
+            snprintf( value,
+                      sizeof( value ),
+                      "%llu",
+                      (unsigned long long)pClass->memoryMax );
+        }
+        else
+        {
+            strcpy( value, "max" );
+        }
+
+        result = WriteFile( pTable->cgroupDir,
+                            pClass->name,
+                            "memory.max",
+                            value );
+    }
+
+    for( i = 0; ( result == EOK ) && ( i < pClass->numIo ); i++ )
+    {
+        snprintf( value,
+                  sizeof( value ),
+                  "%s rbps=%llu wbps=%llu",
+                  pClass->io[i].device,
+                  (unsigned long long)pClass->io[i].bps,
+                  (unsigned long long)pClass->io[i].bps );
+
+        result = WriteFile( pTable->cgroupDir, pClass->name, "io.max", value );
+    }
+
+    if( result == EOK )
+    {
+        /* account the memory of each command's leaf cgroup */
+        result = WriteFile( pTable->cgroupDir,
+                            pClass->name,
+                            "cgroup.subtree_control",
+                            "+memory" );
+    }
+
+    if( result == EOK )
+    {
+        pClass->cgroupFd = open( path, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+        if( pClass->cgroupFd == -1 )
+        {
+            result = errno;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  EnableControllers                                                         */
+/*!
+    Enable the controllers used by the execution classes
+
+    The EnableControllers function enables the cpu and memory
+    controllers, and the io controller if any class has an io limit, for
+    the children of the cgroup directory.  If the cgroup contains
+    processes, iotexec is moved to a child cgroup of its own and the
+    controllers are enabled again.
+
+    @param[in]
+        pTable
+            pointer to the ClassTable
+
+    @retval EOK the controllers were enabled
+    @retval error as returned by mkdir, open or write
+
+==============================================================================*/
+static int EnableControllers( ClassTable *pTable )
+{
+    int result;
+    const char *controllers = "+cpu +memory";
+    char path[MAX_CGROUP_FILE_LENGTH];
+    ExecClass *pClass;
+
+    for( pClass = pTable->pClasses; pClass != NULL; pClass = pClass->pNext )
+    {
+        if( pClass->numIo > 0 )
+        {
+            controllers = "+cpu +memory +io";
+        }
+    }
+
+    result = WriteFile( pTable->cgroupDir,
+                        ".",
+                        "cgroup.subtree_control",
+                        controllers );
+    if( result == EBUSY )
+    {
+        /* a cgroup with processes cannot distribute its resources */
+        snprintf( path,
+                  sizeof( path ),
+                  "%s/%s",
+                  pTable->cgroupDir,
+                  SERVICE_CGROUP );
+
+        result = ( ( mkdir( path, 0755 ) == 0 ) || ( errno == EEXIST ) )
+                    ? WriteFile( pTable->cgroupDir,
+                                 SERVICE_CGROUP,
+                                 "cgroup.procs",
+                                 "0" )
+                    : errno;
+        if( result == EOK )
+        {
+            result = WriteFile( pTable->cgroupDir,
+                                ".",
+                                "cgroup.subtree_control",
+                                controllers );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  WriteFile                                                                 */
+/*!
+    Write a value to a cgroup interface file
+
+    @param[in]
+        dir
+            pointer to the NUL terminated cgroup directory
+
+    @param[in]
+        name
+            pointer to the NUL terminated name of the child cgroup
+
+    @param[in]
+        file
+            pointer to the NUL terminated name of the interface file
+
+    @param[in]
+        value
+            pointer to the NUL terminated value to write
+
+    @retval EOK the value was written
+    @retval error as returned by open or write
+
+==============================================================================*/
+static int WriteFile( const char *dir,
+                      const char *name,
+                      const char *file,
+                      const char *value )
+{
+    int result = EOK;
+    char path[MAX_CGROUP_FILE_LENGTH];
+    size_t len = strlen( value );
+    int fd;
+
+    snprintf( path, sizeof( path ), "%s/%s/%s", dir, name, file );
+
+    fd = open( path, O_WRONLY | O_CLOEXEC );
+    if( fd != -1 )
+    {
+        if( write( fd, value, len ) != (ssize_t)len )
+        {
+            result = errno;
+        }
+
+        close( fd );
+    }
+    else
+    {
+        result = errno;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  SetLimit                                                                  */
+/*!
+    Set a resource limit of the calling process
+
+    The SetLimit function sets the soft and hard limits of a resource,
+    without exceeding the inherited hard limit.  A CPU time limit is
+    given one second of grace between the soft limit, which sends
+    SIGXCPU, and the hard limit, which kills the process.
+
+    @param[in]
+        resource
+            the resource to limit
+
+    @param[in]
+        value
+            the limit
+
+    @retval EOK the limit was set
+    @retval error as returned by getrlimit or setrlimit
+
+==============================================================================*/
+static int SetLimit( int resource, uint64_t value )
+{
+    int result = EOK;
+    struct rlimit rl;
+    rlim_t hard = ( resource == RLIMIT_CPU ) ? value + 1 : value;
+
+    if( getrlimit( resource, &rl ) == 0 )
+    {
+        if( ( rl.rlim_max == RLIM_INFINITY ) || ( hard < rl.rlim_max ) )
+        {
+            rl.rlim_max = hard;
+        }
+
+        rl.rlim_cur = ( value < rl.rlim_max ) ? value : rl.rlim_max;
+
+        if( setrlimit( resource, &rl ) != 0 )
+        {
+            result = errno;
+        }
+    }
+    else
+    {
+        result = errno;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  JoinLeaf                                                                  */
+/*!
+    Move the calling process into a leaf cgroup of its own
+
+    The JoinLeaf function creates a leaf cgroup named after the calling
+    process under a class cgroup, and moves the process into it.  An out
+    of memory kill in the leaf kills every process of the command.  It
+    is called by a forked child, so it only makes async-signal-safe
+    calls.
+
+    @param[in]
+        cgroupFd
+            descriptor of the class cgroup directory
+
+    @retval EOK the process was moved into its leaf cgroup
+    @retval error as returned by mkdirat, openat or write
+
+==============================================================================*/
+static int JoinLeaf( int cgroupFd )
+{
+    int result = EOK;
+    char name[16];
+    char path[48];
+    ssize_t n;
+    int fd;
+
+    FormatPid( getpid(), name );
+
+    if( ( mkdirat( cgroupFd, name, 0755 ) != 0 ) && ( errno != EEXIST ) )
+    {
+        result = errno;
+    }
+
+    if( result == EOK )
+    {
+        strcpy( path, name );
+        strcat( path, "/cgroup.procs" );
+
+        fd = openat( cgroupFd, path, O_WRONLY | O_CLOEXEC );
+        if( fd != -1 )
+        {
+            if( write( fd, "0", 1 ) != 1 )
+            {
+                result = errno;
+            }
+
+            close( fd );
+        }
+        else
+        {
+            result = errno;
+        }
+    }
+
+    if( result == EOK )
+    {
+        strcpy( path, name );
+        strcat( path, "/memory.oom.group" );
+
+        /* best effort: older kernels have no memory.oom.group */
+        fd = openat( cgroupFd, path, O_WRONLY | O_CLOEXEC );
+        if( fd != -1 )
+        {
+            n = write( fd, "1", 1 );
+            (void)n;
+            close( fd );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  FormatPid                                                                 */
+/*!
+    Format a process identifier as a leaf cgroup name
+
+    The FormatPid function formats a process identifier in decimal
+    without using stdio, so it can be called by a forked child.
+
+    @param[in]
+        pid
+            the process identifier
+
+    @param[out]
+        name
+            pointer to a buffer of at least 16 characters to store the
+            NUL terminated name
+
+==============================================================================*/
+static void FormatPid( pid_t pid, char *name )
+{
+    char digits[16];
+    unsigned long value = (unsigned long)pid;
+    size_t n = 0;
+    size_t i;
+
+    do
+    {
+        digits[n++] = (char)( '0' + ( value % 10 ) );
+        value /= 10;
+    } while( ( value > 0 ) && ( n < sizeof( digits ) - 1 ) );
+
+    for( i = 0; i < n; i++ )
+    {
+        name[i] = digits[n - 1 - i];
+    }
+
+    name[n] = '\0';
+}
+
+/*! @}
+ * end of class group */
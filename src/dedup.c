@@ -0,0 +1,366 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup dedup dedup
+ * @brief Duplicate message detection
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file dedup.c
+
+    Duplicate message detection
+
+    The dedup module remembers the message identifiers of recently
+    received commands so that a message which is redelivered by the
+    IoT hub, or sent twice by an operator, is not executed twice.
+
+    The identifiers are kept in a fixed size ring, so the oldest
+    identifier is forgotten when the ring is full, and are indexed by a
+    hash table so each received message is checked in constant time.
+    An identifier is also forgotten once it is older than the
+    de-duplication window.
+
+    The set is used only by the message dispatcher, so it performs no
+    locking.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "dedup.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+#ifndef EOK
+/*! success response */
+#define EOK 0
+#endif
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static size_t Hash( Dedup *pDedup, const char *msgId );
+static int Find( Dedup *pDedup, const char *msgId );
+static void Unlink( Dedup *pDedup, int index );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  DEDUP_Init                                                                */
+/*!
+    Initialize a set of recently received message identifiers
+
+    @param[in]
+        pDedup
+            pointer to the Dedup to initialize
+
+    @param[in]
+        size
+            maximum number of message identifiers to remember
+
+    @param[in]
+        windowMs
+            time in milliseconds for which an identifier is remembered
+
+    @retval EOK the set was initialized
+    @retval EINVAL invalid arguments
+    @retval ENOMEM could not allocate the set
+
+==============================================================================*/
+int DEDUP_Init( Dedup *pDedup, size_t size, unsigned int windowMs )
+{
+    int result = EINVAL;
+    size_t i;
+
+    if( ( pDedup != NULL ) &&
+        ( size > 0 ) )
+    {
+        memset( pDedup, 0, sizeof( Dedup ) );
+        pDedup->size = size;
+        pDedup->windowMs = windowMs;
+
+        /* use at least twice as many buckets as entries */
+        pDedup->numBuckets = 1;
+        while( pDedup->numBuckets < ( size * 2 ) )
+        {
+            pDedup->numBuckets <<= 1;
+        }
+
+        pDedup->pEntries = calloc( size, sizeof( DedupEntry ) );
+        pDedup->pBuckets = malloc( pDedup->numBuckets * sizeof( int ) );
+        if( ( pDedup->pEntries != NULL ) &&
+            ( pDedup->pBuckets != NULL ) )
+        {
+            for( i = 0; i < pDedup->numBuckets; i++ )
+            {
+                pDedup->pBuckets[i] = -1;
+            }
+
+            for( i = 0; i < size; i++ )
+            {
+                pDedup->pEntries[i].next = -1;
+            }
+
+            result = EOK;
+        }
+        else
+        {
+            free( pDedup->pEntries );
+            free( pDedup->pBuckets );
+            memset( pDedup, 0, sizeof( Dedup ) );
+            result = ENOMEM;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  DEDUP_Check                                                               */
+/*!
+    Check if a message has been received recently
+
+    The DEDUP_Check function determines if a message identifier has
+    been received within the de-duplication window.  If it has not, it
+    is remembered so that later copies of the message are detected.
+
+    @param[in]
+        pDedup
+            pointer to the Dedup
+
+    @param[in]
+        msgId
+            pointer to the NUL terminated message identifier
+
+    @param[in]
+        now
+            the current monotonic time in milliseconds
+
+    @retval true the message is a duplicate
+    @retval false the message has not been received recently
+
+==============================================================================*/
+bool DEDUP_Check( Dedup *pDedup, const char *msgId, uint64_t now )
+{
+    bool duplicate = false;
+    DedupEntry *pEntry = NULL;
+    size_t bucket;
+    int index;
+
+    if( ( pDedup != NULL ) &&
+        ( pDedup->pEntries != NULL ) &&
+        ( msgId != NULL ) &&
+        ( msgId[0] != '\0' ) )
+    {
+        bucket = Hash( pDedup, msgId );
+
+        index = Find( pDedup, msgId );
+        if( index != -1 )
+        {
+            pEntry = &pDedup->pEntries[index];
+            duplicate = ( now - pEntry->time ) < pDedup->windowMs;
+            if( duplicate == false )
+            {
+                /* the earlier message is outside the window */
+                pEntry->time = now;
+            }
+        }
+        else
+        {
+            /* replace the oldest entry */
+            index = (int)pDedup->next;
+            pDedup->next = ( pDedup->next + 1 ) % pDedup->size;
+
+            pEntry = &pDedup->pEntries[index];
+            if( pEntry->msgId[0] != '\0' )
+            {
+                Unlink( pDedup, index );
+            }
+
+            strncpy( pEntry->msgId, msgId, sizeof( pEntry->msgId ) - 1 );
+            pEntry->msgId[sizeof( pEntry->msgId ) - 1] = '\0';
+            pEntry->time = now;
+            pEntry->next = pDedup->pBuckets[bucket];
+            pDedup->pBuckets[bucket] = index;
+        }
+    }
+
+    return duplicate;
+}
+
+/*============================================================================*/
+/*  DEDUP_Remove                                                              */
+/*!
+    Forget a recently received message
+
+    The DEDUP_Remove function forgets a message identifier remembered
+    by DEDUP_Check, so that the message is accepted if it is sent
+    again.  It is used when a message is refused without being
+    executed, so its retry is not discarded as a duplicate.
+
+    @param[in]
+        pDedup
+            pointer to the Dedup
+
+    @param[in]
+        msgId
+            pointer to the NUL terminated message identifier
+
+==============================================================================*/
+void DEDUP_Remove( Dedup *pDedup, const char *msgId )
+{
+    DedupEntry *pEntry;
+    int index;
+
+    if( ( pDedup != NULL ) &&
+        ( pDedup->pEntries != NULL ) &&
+        ( msgId != NULL ) &&
+        ( msgId[0] != '\0' ) )
+    {
+        index = Find( pDedup, msgId );
+        if( index != -1 )
+        {
+            Unlink( pDedup, index );
+
+            pEntry = &pDedup->pEntries[index];
+            pEntry->msgId[0] = '\0';
+            pEntry->time = 0;
+        }
+    }
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  Hash                                                                      */
+/*!
+    Calculate the hash bucket of a message identifier
+
+    @param[in]
+        pDedup
+            pointer to the Dedup
+
+    @param[in]
+        msgId
+            pointer to the NUL terminated message identifier
+
+    @retval the index of the message identifier's hash bucket
+
+==============================================================================*/
+static size_t Hash( Dedup *pDedup, const char *msgId )
+{
+    uint32_t hash = 2166136261u;
+
+    /* FNV-1a */
+    while( *msgId != '\0' )
+    {
+        hash ^= (unsigned char)*msgId++;
+        hash *= 16777619u;
+    }
+
+    return hash & ( pDedup->numBuckets - 1 );
+}
+
+/*============================================================================*/
+/*  Find                                                                      */
+/*!
+    Find the entry of a message identifier
+
+    @param[in]
+        pDedup
+            pointer to the Dedup
+
+    @param[in]
+        msgId
+            pointer to the NUL terminated message identifier
+
+    @retval index of the message identifier's entry
+    @retval -1 the message identifier is not remembered
+
+==============================================================================*/
+static int Find( Dedup *pDedup, const char *msgId )
+{
+    int index;
+
+    index = pDedup->pBuckets[Hash( pDedup, msgId )];
+    while( ( index != -1 ) &&
+           ( strcmp( pDedup->pEntries[index].msgId, msgId ) != 0 ) )
+    {
+        index = pDedup->pEntries[index].next;
+    }
+
+    return index;
+}
+
+/*============================================================================*/
+/*  Unlink                                                                    */
+/*!
+    Remove an entry from its hash bucket
+
+    @param[in]
+        pDedup
+            pointer to the Dedup
+
+    @param[in]
+        index
+            index of the entry to remove
+
+==============================================================================*/
+static void Unlink( Dedup *pDedup, int index )
+{
+    DedupEntry *pEntry = &pDedup->pEntries[index];
+    int *pIndex = &pDedup->pBuckets[Hash( pDedup, pEntry->msgId )];
+
+    while( *pIndex != -1 )
+    {
+        if( *pIndex == index )
+        {
+            *pIndex = pEntry->next;
+            break;
+        }
+
+        pIndex = &pDedup->pEntries[*pIndex].next;
+    }
+
+    pEntry->next = -1;
+}
+
+/*! @}
+ * end of dedup group */
@@ -0,0 +1,1933 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup exec exec
+ * @brief Command execution
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file exec.c
+
+    Command execution
+
+    The exec module runs a single received command: it launches the
+    command, forwards its output through the command response, enforces
+    the command's timeout and output limit, and reaps the command.
+
+    The response of every command ends with an empty message whose
+    headers report the command's exit code, wall time and, for spawned
+    commands, its CPU time and peak memory usage.
+
+    The per-command limits are taken from the timeout and maxOutputBytes
+    headers of the received message, falling back to the service wide
+    defaults.  A command which exceeds a limit has its whole process
+    group killed immediately, and the response is completed with a
+    message carrying a terminated header.
+
+    Identical requests which were queued behind the job (its followers)
+    share the command's execution: every response message is also sent
+    with each follower's correlationId.
+
+    The output of a command in the result cache is captured, and stored
+    in the cache if the command succeeds.  EXEC_Cached answers repeated
+    requests for the command from the cache.
+
+    Commands handled by an in-process builtin are completed by
+    EXEC_Start without launching a process.
+
+    When the stderr of commands is captured, it is forwarded with a
+    response of its own, and the response messages are tagged with a
+    stream:stdout or stream:stderr header.  Each stream is coalesced in
+    its own bounded buffer.  Output is only read from the pipes as fast
+    as it can be sent, so a slow uplink holds the command back through
+    the pipes rather than growing iotexec's memory.
+
+    Commands with a session header are executed by the session's warm
+    shell.  A command whose session is busy waits in the session, and
+    is handed back by EXEC_Finish of the command ahead of it.
+
+    Commands with a class header are launched in the named execution
+    class, which isolates their resource usage from the rest of the
+    device.
+
+    Commands with a subscribe:true header are subscriptions: they run
+    until they exit or are cancelled, with no default limits, and their
+    output is delivered in sequenced messages at a bounded rate.
+
+    Commands with a chunked:true header send their stdout in numbered
+    fixed size chunks, which are spooled so the lost chunks can be sent
+    again.  Chunked commands are never shared with followers or answered
+    from the cache, since their chunks are spooled under the messageId
+    of their own request.
+
+    Every launched command is recorded in the in-flight job table while
+    it runs, so it can be reported on, cancelled, or killed when the
+    service shuts down.
+
+    The module can be driven by a blocking loop on a worker thread
+    (EXEC_Run), or incrementally by an event loop using EXEC_Read,
+    EXEC_Timer, EXEC_Timeout and EXEC_EndOutput.
+
+    The latency, output size and failures of every command are recorded
+    in the metrics.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <iotclient/iotclient.h>
+#include "exec.h"
+#include "metrics.h"
+#include "verbose.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+/*! interval used to poll for command exit when pidfd is not available */
+#define EXIT_POLL_MS 10
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static void GetLimits( Exec *pExec );
+static void GetClass( Exec *pExec );
+static int GetTemplate( Exec *pExec );
+static void GetSubscription( Exec *pExec );
+static void GetChunked( Exec *pExec );
+static bool IsSubscription( Job *pJob, const ExecOptions *pOptions );
+static const char *Cancelled( Exec *pExec );
+static void Track( Exec *pExec );
+static bool IsSession( Job *pJob, const ExecOptions *pOptions );
+static bool IsObserved( Exec *pExec );
+static int Launch( Exec *pExec );
+static int LaunchInSession( Exec *pExec );
+static int LaunchTemplate( Exec *pExec );
+static void SetupStderr( Exec *pExec, IOTCLIENT_HANDLE hIoTClient );
+static int ReadStreams( Exec *pExec, char *pBuf, size_t size );
+static void Terminate( Exec *pExec, const char *reason );
+static void UpdateCache( Exec *pExec );
+static int GetExitCode( Exec *pExec );
+static void AddStatusHeaders( Exec *pExec );
+static uint64_t NowUs( void );
+static void NoteOutput( Exec *pExec );
+#ifdef IOTEXEC_METRICS
+static void WaitOutput( Exec *pExec );
+#endif
+static int WriteOutput( void *arg, const char *pData, size_t length );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  EXEC_Start                                                                */
+/*!
+    Start executing a command
+
+    The EXEC_Start function sets up the command response for the job
+    and its followers, determines the command's limits, and launches
+    the command.  A command handled by an in-process builtin is executed
+    to completion instead, and the builtin flag is set.  A session
+    command is written to the session shell, unless the session is
+    busy in which case the job is left waiting in the session and
+    must not be finished or released by the caller.
+
+    @param[in]
+        pExec
+            pointer to the Exec object to initialize
+
+    @param[in]
+        hIoTClient
+            handle to the iotclient connection used to send the response
+
+    @param[in]
+        pJob
+            pointer to the job containing the command to execute
+
+    @param[in]
+        pOptions
+            pointer to the service wide execution options
+
+    @retval EOK the command was launched
+    @retval EINPROGRESS the job is waiting for its session
+    @retval EINVAL invalid arguments
+    @retval ENOTSUP the command could not be executed
+    @retval error as returned by SESSION_Begin or SESSION_Command
+
+==============================================================================*/
+int EXEC_Start( Exec *pExec,
+                IOTCLIENT_HANDLE hIoTClient,
+                Job *pJob,
+                const ExecOptions *pOptions )
+{
+    int result = EINVAL;
+    Job *pFollower;
+    char step[16];
+    uint64_t launchUs = 0;
+
+    if( ( pExec != NULL ) &&
+        ( hIoTClient != NULL ) &&
+        ( pJob != NULL ) &&
+        ( pOptions != NULL ) )
+    {
+        memset( pExec, 0, sizeof( Exec ) );
+        pExec->pJob = pJob;
+        pExec->pOptions = pOptions;
+        pExec->pidfd = -1;
+        pExec->status = -1;
+        pExec->child.pid = -1;
+        pExec->child.fdOut = -1;
+        pExec->child.fdErr = -1;
+
+        if( IsSession( pJob, pOptions ) && ( pJob->fdIn != -1 ) )
+        {
+            /* session commands read /dev/null: end the upload */
+            close( pJob->fdIn );
+            pJob->fdIn = -1;
+        }
+
+        result = IsSession( pJob, pOptions )
+                    ? SESSION_Begin( pOptions->pSessions,
+                                     pJob,
+                                     &pExec->pSession )
+                    : EOK;
+        if( result != EINPROGRESS )
+        {
+            if( VERBOSE( pOptions->verbose ) )
+            {
+                fprintf( stdout, "Processing Command: %s\n", pJob->pBody );
+                if( pJob->msgId[0] != '\0' )
+                {
+                    fprintf( stdout, "MessageID: %s\n", pJob->msgId );
+                }
+            }
+
+            /* build the response headers */
+            RESPONSE_Setup( &pExec->response,
+                            hIoTClient,
+                            pJob,
+                            &pOptions->response );
+
+            for( pFollower = pJob->pFollowers;
+                 pFollower != NULL;
+                 pFollower = pFollower->pNext )
+            {
+                if( VERBOSE( pOptions->verbose ) )
+                {
+                    fprintf( stdout, "Follower: %s\n", pFollower->msgId );
+                }
+
+                RESPONSE_Follow( &pExec->response, pFollower->msgId );
+            }
+
+            pExec->startTime = RESPONSE_Now();
+            pExec->startTimeUs = NowUs();
+            GetSubscription( pExec );
+            GetChunked( pExec );
+            GetLimits( pExec );
+            GetClass( pExec );
+            if( result == EOK )
+            {
+                result = GetTemplate( pExec );
+            }
+
+            if( pJob->step > 0 )
+            {
+                snprintf( step, sizeof( step ), "%u", pJob->step );
+                RESPONSE_AddHeader( &pExec->response, "step", step );
+            }
+
+            if( result == EOK )
+            {
+                launchUs = NowUs();
+                result = ( pExec->pSession != NULL ) ? LaunchInSession( pExec )
+                                                     : Launch( pExec );
+            }
+
+            if( ( result == EOK ) &&
+                ( pExec->builtin == false ) &&
+                ( pExec->pSession == NULL ) )
+            {
+                /* the launch latency grows when the device is loaded */
+                LIMITER_Observe( pOptions->pLimiter, NowUs() - launchUs );
+            }
+
+            if( ( result == EOK ) && ( pExec->child.fdErr != -1 ) )
+            {
+                SetupStderr( pExec, hIoTClient );
+            }
+
+            if( ( result == EOK ) && ( pExec->builtin == false ) )
+            {
+                Track( pExec );
+            }
+
+            if( ( result == EOK ) &&
+                ( pExec->builtin == false ) &&
+                ( pJob->receivedUs != 0 ) )
+            {
+                METRICS_Record( METRICS_RECEIVE_TO_SPAWN,
+                                NowUs() - pJob->receivedUs );
+            }
+            else if( result != EOK )
+            {
+                METRICS_Failure( result );
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  EXEC_Cached                                                               */
+/*!
+    Answer a command from the result cache
+
+    The EXEC_Cached function sends the cached output of a command as
+    the response to the job, if the command is cacheable and its
+    cached output has not expired.  The command is not executed, and
+    the final message of the response has the exitCode 0 of the cached
+    run, a cached:true header, and a wallTimeUs header giving the time
+    taken to send the cached output.  Session commands, subscriptions,
+    template commands and commands which read an uploaded stdin are
+    never answered from the cache.
+
+    @param[in]
+        hIoTClient
+            handle to the iotclient connection used to send the response
+
+    @param[in]
+        pJob
+            pointer to the job containing the command
+
+    @param[in]
+        pOptions
+            pointer to the service wide execution options
+
+    @retval EOK the response was sent from the cache
+    @retval ENOENT the command output is not cached
+    @retval EINVAL invalid arguments
+    @retval error the first error encountered sending the response
+
+==============================================================================*/
+int EXEC_Cached( IOTCLIENT_HANDLE hIoTClient,
+                 Job *pJob,
+                 const ExecOptions *pOptions )
+{
+    int result = EINVAL;
+    CacheEntry *pEntry;
+    Response response;
+    uint64_t startTimeUs = NowUs();
+    char value[32];
+    char *pData;
+    size_t length;
+
+    if( ( hIoTClient != NULL ) &&
+        ( pJob != NULL ) &&
+        ( pOptions != NULL ) )
+    {
+        result = ENOENT;
+
+        pEntry = ( IsSession( pJob, pOptions ) ||
+                   IsSubscription( pJob, pOptions ) ||
+                   ( JOB_HasProperty( pJob, JOB_PROPERTY_TEMPLATE ) ) ||
+                   ( JOB_IsTrue( pJob, JOB_PROPERTY_CHUNKED ) ) ||
+                   ( pOptions->templatesOnly ) ||
+                   ( pJob->fdIn != -1 ) )
+                    ? NULL
+                    : CACHE_Find( pOptions->pCache, pJob->pBody );
+        if( ( pEntry != NULL ) &&
+            ( CACHE_Get( pOptions->pCache,
+                         pEntry,
+                         &pData,
+                         &length ) == EOK ) )
+        {
+            if( VERBOSE( pOptions->verbose ) )
+            {
+                fprintf( stdout, "Cached Command: %s\n", pJob->pBody );
+            }
+
+            RESPONSE_Setup( &response, hIoTClient, pJob, &pOptions->response );
+            RESPONSE_Output( &response, pData, length );
+            RESPONSE_End( &response );
+            RESPONSE_AddHeader( &response, "exitCode", "0" );
+            RESPONSE_AddHeader( &response, "cached", "true" );
+            snprintf( value,
+                      sizeof( value ),
+                      "%llu",
+                      (unsigned long long)( NowUs() - startTimeUs ) );
+            RESPONSE_AddHeader( &response, "wallTimeUs", value );
+            RESPONSE_Write( &response, "", 0 );
+            RESPONSE_Close( &response );
+            free( pData );
+
+            result = response.error;
+
+            METRICS_Count( METRICS_CACHE_HITS, 1 );
+            METRICS_Count( METRICS_BYTES_SENT, response.bytesSent );
+            if( pJob->receivedUs != 0 )
+            {
+                METRICS_Record( METRICS_COMMAND_LATENCY,
+                                NowUs() - pJob->receivedUs );
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  EXEC_Run                                                                  */
+/*!
+    Run a started command to completion
+
+    The EXEC_Run function forwards the output of a started command and
+    waits for it to exit, blocking the calling thread.  A command without
+    limits has its output handed to the response unobserved, otherwise
+    the output is read here so the limits can be enforced and the
+    output captured for the cache.
+
+    @param[in]
+        pExec
+            pointer to the started Exec
+
+    @retval EOK the command output was sent
+    @retval EINVAL invalid arguments
+    @retval error as returned by poll or the response functions
+
+==============================================================================*/
+int EXEC_Run( Exec *pExec )
+{
+    int result = EINVAL;
+    char buf[BUFSIZ];
+    struct pollfd pfd[2];
+    int rc;
+
+    if( pExec != NULL )
+    {
+        if( pExec->builtin )
+        {
+            /* completed by EXEC_Start */
+            result = pExec->response.error;
+        }
+        else if( IsObserved( pExec ) == false )
+        {
+#ifdef IOTEXEC_METRICS
+            WaitOutput( pExec );
+#endif
+            if( pExec->response.pBatch != NULL )
+            {
+                /* coalesce (and compress) the output */
+                result = RESPONSE_Forward( &pExec->response,
+                                           pExec->child.fdOut );
+            }
+            else
+            {
+                result = RESPONSE_Stream( &pExec->response,
+                                          pExec->child.fdOut );
+            }
+
+            /* close the command output stream and reap the command */
+            LAUNCHER_Wait( &pExec->child, &pExec->status );
+        }
+        else
+        {
+            pfd[0].events = POLLIN;
+            pfd[1].events = POLLIN;
+
+            do
+            {
+                /* poll ignores a stream which has ended, or whose
+                   output is held back by its rate */
+                pfd[0].fd = ( pExec->outputEnded ||
+                              RESPONSE_Held( &pExec->response ) )
+                                ? -1
+                                : pExec->child.fdOut;
+                pfd[1].fd = ( pExec->errorEnded ||
+                              RESPONSE_Held( &pExec->errResponse ) )
+                                ? -1
+                                : pExec->child.fdErr;
+
+                rc = poll( pfd, 2, EXEC_Timeout( pExec ) );
+                if( rc > 0 )
+                {
+                    result = EXEC_Read( pExec, buf, sizeof( buf ) );
+                }
+                else if( rc == 0 )
+                {
+                    result = EXEC_Timer( pExec );
+                }
+                else
+                {
+                    result = ( errno == EINTR ) ? EOK : errno;
+                }
+
+            } while( ( result == EOK ) || ( result == EAGAIN ) );
+
+            if( ( result == ENODATA ) ||
+                ( result == ETIMEDOUT ) ||
+                ( result == ECANCELED ) )
+            {
+                result = pExec->response.error;
+            }
+
+            if( EXEC_EndOutput( pExec ) == EBUSY )
+            {
+                EXEC_Wait( pExec );
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  EXEC_Read                                                                 */
+/*!
+    Read a chunk of command output
+
+    The EXEC_Read function performs a single read of the command output
+    and passes it to the command response.  If the command reaches its
+    output limit it is killed.  The output of a session command ends
+    at the session's token rather than at the end of the pipe.  When
+    stderr is forwarded, a read of each stream is performed and the
+    output ends once both streams have ended.  The output of a
+    cancelled command is no longer forwarded.
+
+    @param[in]
+        pExec
+            pointer to the Exec
+
+    @param[in]
+        pBuf
+            pointer to a buffer used when output is not coalesced,
+            or the output is read from a session
+
+    @param[in]
+        size
+            size of the buffer
+
+    @retval EOK output was read
+    @retval EAGAIN no output is available yet
+    @retval ENODATA the end of the command output was reached, or
+            the command was killed for exceeding its output limit, or
+            was cancelled
+    @retval EINVAL invalid arguments
+    @retval error as returned by read
+
+==============================================================================*/
+int EXEC_Read( Exec *pExec, char *pBuf, size_t size )
+{
+    int result = EINVAL;
+    size_t length = 0;
+
+    if( ( pExec != NULL ) &&
+        ( Cancelled( pExec ) != NULL ) )
+    {
+        Terminate( pExec, Cancelled( pExec ) );
+        result = ENODATA;
+    }
+    else if( ( pExec != NULL ) &&
+             ( pExec->pSession != NULL ) )
+    {
+        result = SESSION_Read( pExec->pSession,
+                               pBuf,
+                               size,
+                               &length,
+                               &pExec->status );
+        if( length > 0 )
+        {
+            NoteOutput( pExec );
+            if( WriteOutput( pExec, pBuf, length ) == EFBIG )
+            {
+                Terminate( pExec, "maxOutputBytes" );
+                result = ENODATA;
+            }
+        }
+    }
+    else if( pExec != NULL )
+    {
+        result = pExec->stderrStream
+                    ? ReadStreams( pExec, pBuf, size )
+                    : RESPONSE_ReadBuffer( &pExec->response,
+                                           pExec->child.fdOut,
+                                           pBuf,
+                                           size );
+        if( result == EOK )
+        {
+            NoteOutput( pExec );
+        }
+        else if( result == EFBIG )
+        {
+            Terminate( pExec, "maxOutputBytes" );
+            result = ENODATA;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  EXEC_Timer                                                                */
+/*!
+    Handle the expiry of the command's deadlines
+
+    The EXEC_Timer function sends coalesced output which has reached its
+    flush deadline, and kills the command if it has reached its timeout.
+    The output of a cancelled command is no longer forwarded.
+
+    @param[in]
+        pExec
+            pointer to the Exec
+
+    @retval EOK the command continues
+    @retval ETIMEDOUT the command was killed for exceeding its timeout
+    @retval ECANCELED the command was cancelled
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int EXEC_Timer( Exec *pExec )
+{
+    int result = EINVAL;
+
+    if( ( pExec != NULL ) &&
+        ( Cancelled( pExec ) != NULL ) )
+    {
+        Terminate( pExec, Cancelled( pExec ) );
+        result = ECANCELED;
+    }
+    else if( pExec != NULL )
+    {
+        result = EOK;
+
+        if( RESPONSE_Timeout( &pExec->response ) == 0 )
+        {
+            RESPONSE_Flush( &pExec->response );
+        }
+
+        if( ( pExec->stderrStream ) &&
+            ( RESPONSE_Timeout( &pExec->errResponse ) == 0 ) )
+        {
+            RESPONSE_Flush( &pExec->errResponse );
+        }
+
+        if( ( pExec->killTime != 0 ) &&
+            ( RESPONSE_Now() >= pExec->killTime ) )
+        {
+            Terminate( pExec, "timeout" );
+            result = ETIMEDOUT;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  EXEC_Timeout                                                              */
+/*!
+    Get the time until the command's next deadline
+
+    @param[in]
+        pExec
+            pointer to the Exec
+
+    @retval -1 the command has no pending deadline
+    @retval the number of milliseconds until the next deadline
+
+==============================================================================*/
+int EXEC_Timeout( Exec *pExec )
+{
+    int timeout = -1;
+    uint64_t now;
+    int t;
+
+    if( pExec != NULL )
+    {
+        timeout = RESPONSE_Timeout( &pExec->response );
+
+        if( pExec->stderrStream )
+        {
+            t = RESPONSE_Timeout( &pExec->errResponse );
+            if( ( timeout == -1 ) || ( ( t != -1 ) && ( t < timeout ) ) )
+            {
+                timeout = t;
+            }
+        }
+
+        if( pExec->killTime != 0 )
+        {
+            now = RESPONSE_Now();
+            t = ( now >= pExec->killTime )
+                    ? 0
+                    : (int)( pExec->killTime - now );
+            if( ( timeout == -1 ) || ( t < timeout ) )
+            {
+                timeout = t;
+            }
+        }
+    }
+
+    return timeout;
+}
+
+/*============================================================================*/
+/*  EXEC_EndOutput                                                            */
+/*!
+    Handle the end of the command output
+
+    The EXEC_EndOutput function sends any coalesced output, closes the
+    command output pipe and reaps the command if it has exited.  If the
+    command is still running, a pidfd is opened (where supported) so
+    the caller can wait for it to exit.  A session command is complete
+    at the end of its output, and the session shell keeps running.
+
+    @param[in]
+        pExec
+            pointer to the Exec
+
+    @retval EOK the command has been reaped
+    @retval EBUSY the command is still running
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int EXEC_EndOutput( Exec *pExec )
+{
+    int result = EINVAL;
+
+    if( pExec != NULL )
+    {
+        RESPONSE_Flush( &pExec->response );
+        if( pExec->stderrStream )
+        {
+            RESPONSE_Flush( &pExec->errResponse );
+        }
+
+        /* a command cannot be signalled once it may be reaped */
+        INFLIGHT_Remove( pExec->pOptions->pInflight, &pExec->inflight );
+
+        if( pExec->pSession != NULL )
+        {
+            /* close the duplicate of the session shell's output */
+            close( pExec->child.fdOut );
+            pExec->child.fdOut = -1;
+            result = EOK;
+        }
+        else
+        {
+            result = LAUNCHER_Poll( &pExec->child, &pExec->status );
+            if( result == EBUSY )
+            {
+#ifdef SYS_pidfd_open
+                pExec->pidfd = syscall( SYS_pidfd_open, pExec->child.pid, 0 );
+#endif
+            }
+            else
+            {
+                result = EOK;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  EXEC_Wait                                                                 */
+/*!
+    Wait for a command whose output has ended to exit
+
+    The EXEC_Wait function blocks until the command exits, killing it if
+    it reaches its timeout first.
+
+    @param[in]
+        pExec
+            pointer to the Exec
+
+    @retval EOK the command has been reaped
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int EXEC_Wait( Exec *pExec )
+{
+    int result = EINVAL;
+    struct pollfd pfd;
+    int timeout;
+
+    if( pExec != NULL )
+    {
+        while( ( result = LAUNCHER_Poll( &pExec->child,
+                                         &pExec->status ) ) == EBUSY )
+        {
+            timeout = EXEC_Timeout( pExec );
+            if( pExec->pidfd != -1 )
+            {
+                pfd.fd = pExec->pidfd;
+                pfd.events = POLLIN;
+                if( poll( &pfd, 1, timeout ) == 0 )
+                {
+                    EXEC_Timer( pExec );
+                }
+            }
+            else if( timeout == -1 )
+            {
+                /* nothing to enforce: wait for the command to exit */
+                LAUNCHER_Wait( &pExec->child, &pExec->status );
+                break;
+            }
+            else
+            {
+                usleep( EXIT_POLL_MS * 1000 );
+                EXEC_Timer( pExec );
+            }
+        }
+
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  EXEC_Finish                                                               */
+/*!
+    Complete the execution of a command
+
+    The EXEC_Finish function completes the command response and releases
+    the resources used to execute the command.  The response ends with
+    an empty message carrying the command's status headers, and a
+    terminated header stating the reason if the command was terminated
+    by iotexec.  The output of a cacheable command
+    which completed successfully is stored in the cache.  The job is
+    not released.  The session of a session command is released.  The
+    next step of a sequential batch, or else the next job waiting for
+    the session, is stored in pResume so the caller can execute it.
+
+    @param[in]
+        pExec
+            pointer to the Exec
+
+    @retval EOK the response was completed
+    @retval EINVAL invalid arguments
+    @retval error the first error encountered sending the response
+
+==============================================================================*/
+int EXEC_Finish( Exec *pExec )
+{
+    int result = EINVAL;
+
+    if( pExec != NULL )
+    {
+        if( pExec->stderrStream )
+        {
+            /* the stderr stream ends ahead of the status message */
+            RESPONSE_Close( &pExec->errResponse );
+        }
+
+        UpdateCache( pExec );
+        RESPONSE_End( &pExec->response );
+
+        INFLIGHT_Remove( pExec->pOptions->pInflight, &pExec->inflight );
+        if( pExec->terminated == NULL )
+        {
+            pExec->terminated = Cancelled( pExec );
+        }
+
+        if( pExec->terminated != NULL )
+        {
+            if( VERBOSE( pExec->pOptions->verbose ) )
+            {
+                fprintf( stderr,
+                         "Command terminated (%s): %s\n",
+                         pExec->terminated,
+                         pExec->pJob->pBody );
+            }
+
+            RESPONSE_AddHeader( &pExec->response,
+                                "terminated",
+                                pExec->terminated );
+        }
+
+        AddStatusHeaders( pExec );
+        RESPONSE_Write( &pExec->response, "", 0 );
+
+        RESPONSE_Close( &pExec->response );
+
+        /* the next step of a sequential batch */
+        pExec->pResume = pExec->pJob->pNextStep;
+        pExec->pJob->pNextStep = NULL;
+
+        if( pExec->pidfd != -1 )
+        {
+            close( pExec->pidfd );
+            pExec->pidfd = -1;
+        }
+
+        if( pExec->pSession != NULL )
+        {
+            if( pExec->child.fdOut != -1 )
+            {
+                close( pExec->child.fdOut );
+                pExec->child.fdOut = -1;
+            }
+
+            pExec->pResume = SESSION_End( pExec->pOptions->pSessions,
+                                          pExec->pSession,
+                                          ( pExec->terminated != NULL ),
+                                          pExec->pResume );
+            pExec->pSession = NULL;
+        }
+
+        result = pExec->response.error;
+        if( ( result == EOK ) && ( pExec->stderrStream ) )
+        {
+            result = pExec->errResponse.error;
+        }
+
+        METRICS_Count( METRICS_COMMANDS, 1 );
+        METRICS_Count( METRICS_BYTES_SENT,
+                       pExec->response.bytesSent +
+                       pExec->errResponse.bytesSent );
+        if( pExec->terminated != NULL )
+        {
+            METRICS_Count( METRICS_TERMINATED, 1 );
+        }
+
+        if( pExec->pJob->receivedUs != 0 )
+        {
+            METRICS_Record( METRICS_COMMAND_LATENCY,
+                            NowUs() - pExec->pJob->receivedUs );
+        }
+
+        if( result != EOK )
+        {
+            METRICS_Failure( result );
+        }
+    }
+
+    return result;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  GetLimits                                                                 */
+/*!
+    Determine the limits of a command
+
+    The GetLimits function applies the timeout and maxOutputBytes headers
+    of the received message, or the defaults of the receiver target the
+    message was received for if the headers are not present.  The
+    defaults do not apply to subscriptions, which are expected to run
+    indefinitely.
+
+    @param[in]
+        pExec
+            pointer to the Exec
+
+==============================================================================*/
+static void GetLimits( Exec *pExec )
+{
+    char buf[32];
+    unsigned long timeout = pExec->pOptions->timeout;
+    size_t maxBytes = pExec->pOptions->maxOutputBytes;
+    Job *pJob = pExec->pJob;
+    Receiver *pReceiver;
+
+    pReceiver = RECEIVER_Get( pExec->pOptions->pReceivers, pJob->target );
+    if( pReceiver != NULL )
+    {
+        timeout = pReceiver->timeout;
+        maxBytes = pReceiver->maxOutputBytes;
+    }
+
+    if( pExec->subscription )
+    {
+        timeout = 0;
+        maxBytes = 0;
+    }
+
+    if( JOB_GetProperty( pJob,
+                         JOB_PROPERTY_TIMEOUT,
+                         buf,
+                         sizeof( buf ) ) == EOK )
+    {
+        timeout = strtoul( buf, NULL, 0 );
+    }
+
+    if( JOB_GetProperty( pJob,
+                         JOB_PROPERTY_MAX_OUTPUT_BYTES,
+                         buf,
+                         sizeof( buf ) ) == EOK )
+    {
+        maxBytes = strtoul( buf, NULL, 0 );
+    }
+
+    pExec->killTime = ( timeout > 0 )
+                        ? pExec->startTime + ( timeout * 1000 )
+                        : 0;
+    pExec->response.maxBytes = maxBytes;
+}
+
+/*============================================================================*/
+/*  GetClass                                                                  */
+/*!
+    Determine the execution class of a command
+
+    The GetClass function looks up the execution class named by the
+    class header of the received message, or the default class of the
+    receiver target it was received for.  An unknown class is ignored,
+    as are the classes of session commands, which run in the session's
+    shell.
+
+    @param[in]
+        pExec
+            pointer to the Exec
+
+==============================================================================*/
+static void GetClass( Exec *pExec )
+{
+    char name[MAX_CLASS_NAME_LENGTH];
+    Receiver *pReceiver;
+
+    if( JOB_GetProperty( pExec->pJob,
+                         JOB_PROPERTY_CLASS,
+                         name,
+                         sizeof( name ) ) != EOK )
+    {
+        pReceiver = RECEIVER_Get( pExec->pOptions->pReceivers,
+                                  pExec->pJob->target );
+        if( pReceiver != NULL )
+        {
+            strcpy( name, pReceiver->className );
+        }
+        else
+        {
+            name[0] = '\0';
+        }
+    }
+
+    if( ( pExec->pOptions->pClasses != NULL ) &&
+        ( pExec->pSession == NULL ) &&
+        ( name[0] != '\0' ) )
+    {
+        pExec->pClass = CLASS_Find( pExec->pOptions->pClasses, name );
+        if( ( pExec->pClass == NULL ) && VERBOSE( pExec->pOptions->verbose ) )
+        {
+            fprintf( stderr, "unknown class: %s\n", name );
+        }
+    }
+}
+
+/*============================================================================*/
+/*  GetTemplate                                                               */
+/*!
+    Determine the command template of a command
+
+    The GetTemplate function looks up the command template named by the
+    template header of the received message.  A command naming an
+    unknown template is not executed, nor is a command without a
+    template when only template commands may be executed.  Either is
+    reported in the terminated header of the final status message.
+
+    @param[in]
+        pExec
+            pointer to the Exec
+
+    @retval EOK the command may be executed
+    @retval ENOENT the template does not exist
+    @retval EPERM the command is not a template command
+
+==============================================================================*/
+static int GetTemplate( Exec *pExec )
+{
+    int result = EOK;
+    const ExecOptions *pOptions = pExec->pOptions;
+    char name[MAX_TEMPLATE_NAME_LENGTH];
+
+    if( JOB_HasProperty( pExec->pJob, JOB_PROPERTY_TEMPLATE ) )
+    {
+        if( JOB_GetProperty( pExec->pJob,
+                             JOB_PROPERTY_TEMPLATE,
+                             name,
+                             sizeof( name ) ) == EOK )
+        {
+            pExec->pTemplate = TEMPLATE_Find( pOptions->pTemplates, name );
+        }
+
+        if( pExec->pTemplate == NULL )
+        {
+            pExec->terminated = "unknownTemplate";
+            result = ENOENT;
+        }
+    }
+    else if( pOptions->templatesOnly )
+    {
+        pExec->terminated = "templateRequired";
+        result = EPERM;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  GetSubscription                                                           */
+/*!
+    Determine if a command is a subscription
+
+    The GetSubscription function sets up the response of a command with
+    a subscribe:true header to be sequenced, at the service wide
+    subscription rate or the lower rate of its rate header.  Session
+    commands are never subscriptions.
+
+    @param[in]
+        pExec
+            pointer to the Exec
+
+==============================================================================*/
+static void GetSubscription( Exec *pExec )
+{
+    const ExecOptions *pOptions = pExec->pOptions;
+    unsigned long rate = pOptions->subscriptionRate;
+    unsigned long n;
+    char buf[32];
+
+    if( ( pExec->pSession == NULL ) &&
+        ( IsSubscription( pExec->pJob, pOptions ) ) )
+    {
+        if( JOB_GetProperty( pExec->pJob,
+                             JOB_PROPERTY_RATE,
+                             buf,
+                             sizeof( buf ) ) == EOK )
+        {
+            n = strtoul( buf, NULL, 0 );
+            if( ( n > 0 ) && ( ( rate == 0 ) || ( n < rate ) ) )
+            {
+                rate = n;
+            }
+        }
+
+        pExec->subscription = true;
+        pExec->rate = (unsigned int)rate;
+        RESPONSE_Subscribe( &pExec->response, pExec->rate );
+    }
+}
+
+/*============================================================================*/
+/*  GetChunked                                                                */
+/*!
+    Determine if a command is chunked
+
+    The GetChunked function sets up the response of a command with a
+    chunked:true header to send its output in the service wide chunk
+    size, spooled under the messageId of the request.  Subscriptions
+    are never chunked, since their output is unbounded.
+
+    @param[in]
+        pExec
+            pointer to the Exec
+
+==============================================================================*/
+static void GetChunked( Exec *pExec )
+{
+    const ExecOptions *pOptions = pExec->pOptions;
+    Job *pJob = pExec->pJob;
+
+    if( ( pExec->subscription == false ) &&
+        ( JOB_IsTrue( pJob, JOB_PROPERTY_CHUNKED ) ) )
+    {
+        RESPONSE_Chunk( &pExec->response,
+                        pOptions->response.pSpool,
+                        ( pJob->msgId[0] != '\0' ) ? pJob->msgId : NULL,
+                        pOptions->response.chunkSize );
+    }
+}
+
+/*============================================================================*/
+/*  IsSubscription                                                            */
+/*!
+    Determine if a command is requested as a subscription
+
+    @param[in]
+        pJob
+            pointer to the job containing the command
+
+    @param[in]
+        pOptions
+            pointer to the service wide execution options
+
+    @retval true the command has a subscribe:true header and
+            subscriptions are enabled
+    @retval false the command is not a subscription
+
+==============================================================================*/
+static bool IsSubscription( Job *pJob, const ExecOptions *pOptions )
+{
+    return ( pOptions->pInflight != NULL ) &&
+           ( pOptions->pInflight->maxSubscriptions > 0 ) &&
+           ( JOB_IsTrue( pJob, JOB_PROPERTY_SUBSCRIBE ) );
+}
+
+/*============================================================================*/
+/*  Cancelled                                                                 */
+/*!
+    Determine if a command has been killed by the in-flight job table
+
+    @param[in]
+        pExec
+            pointer to the Exec
+
+    @retval "cancelled" the command was cancelled by a control message
+    @retval "shutdown" the command was killed when the service shut down
+    @retval NULL the command continues
+
+==============================================================================*/
+static const char *Cancelled( Exec *pExec )
+{
+    int cancelled;
+
+    cancelled = __atomic_load_n( &pExec->inflight.cancelled,
+                                 __ATOMIC_ACQUIRE );
+
+    return ( cancelled == INFLIGHT_SHUTDOWN )  ? "shutdown"
+           : ( cancelled == INFLIGHT_CANCELLED ) ? "cancelled"
+           : NULL;
+}
+
+/*============================================================================*/
+/*  Track                                                                     */
+/*!
+    Record a launched command in the in-flight job table
+
+    The Track function records the command so it can be reported on and
+    cancelled.  A command which is refused by the table, because it is
+    a subscription over the limit or the service is shutting down, is
+    terminated.  Commands completed by a builtin are not recorded.
+
+    @param[in]
+        pExec
+            pointer to the Exec of a launched command
+
+==============================================================================*/
+static void Track( Exec *pExec )
+{
+    InflightJob *pInflight = &pExec->inflight;
+    int rc;
+
+    pInflight->msgId = pExec->pJob->msgId;
+    pInflight->cmd = pExec->pJob->pBody;
+    pInflight->pChild = ( pExec->pSession != NULL ) ? &pExec->pSession->child
+                                                    : &pExec->child;
+    pInflight->pid = pInflight->pChild->pid;
+    pInflight->started = time( NULL );
+    pInflight->startTime = pExec->startTime;
+    pInflight->pResponses[0] = &pExec->response;
+    pInflight->pResponses[1] = &pExec->errResponse;
+    pInflight->subscription = pExec->subscription;
+
+    rc = INFLIGHT_Add( pExec->pOptions->pInflight, pInflight );
+    if( rc == EBUSY )
+    {
+        Terminate( pExec, "maxSubscriptions" );
+    }
+    else if( rc == ESHUTDOWN )
+    {
+        Terminate( pExec, "shutdown" );
+    }
+}
+
+/*============================================================================*/
+/*  IsSession                                                                 */
+/*!
+    Determine if a command is executed in a shell session
+
+    @param[in]
+        pJob
+            pointer to the job containing the command
+
+    @param[in]
+        pOptions
+            pointer to the service wide execution options
+
+    @retval true the command has a session header and sessions are enabled
+    @retval false the command is launched on its own, or is a template
+            command, or only template commands may be executed
+
+==============================================================================*/
+static bool IsSession( Job *pJob, const ExecOptions *pOptions )
+{
+    return ( pOptions->pSessions != NULL ) &&
+           ( pOptions->templatesOnly == false ) &&
+           ( pJob->session[0] != '\0' ) &&
+           ( JOB_HasProperty( pJob, JOB_PROPERTY_TEMPLATE ) == false );
+}
+
+/*============================================================================*/
+/*  IsObserved                                                                */
+/*!
+    Determine if the output of a command must be read by iotexec
+
+    @param[in]
+        pExec
+            pointer to the Exec
+
+    @retval true the command has a timeout or an output limit, its
+            output is captured for the cache, is sent to followers, has
+            a stderr stream, or is a subscription or chunked
+    @retval false the command output can be handed to the response
+
+==============================================================================*/
+static bool IsObserved( Exec *pExec )
+{
+    return ( pExec->killTime != 0 ) ||
+           ( pExec->stderrStream ) ||
+           ( pExec->response.maxBytes != 0 ) ||
+           ( pExec->response.pCapture != NULL ) ||
+           ( pExec->response.pFollowers != NULL ) ||
+           ( pExec->subscription ) ||
+           ( pExec->response.chunked ) ||
+           ( pExec->pSession != NULL );
+}
+
+/*============================================================================*/
+/*  Launch                                                                    */
+/*!
+    Launch a command
+
+    The Launch function sets up the output capture of a cacheable
+    command, and executes the command with an in-process builtin if
+    possible, or launches it with the selected launcher backend.  A
+    command with a stdin upload is always launched, bypassing the cache
+    and builtins, and its end of the upload pipe is handed to it.  A
+    command with an execution class, a timeout, or a subscription, is
+    also always launched, so its class limits apply or it can be killed
+    or cancelled.  A template command is launched from its template.
+
+    @param[in]
+        pExec
+            pointer to the Exec
+
+    @retval EOK the command was launched or executed by a builtin
+    @retval ENOTSUP the command could not be launched
+    @retval error as returned by LaunchTemplate
+
+==============================================================================*/
+static int Launch( Exec *pExec )
+{
+    int result = ENOTSUP;
+    const ExecOptions *pOptions = pExec->pOptions;
+    Job *pJob = pExec->pJob;
+    char *cmd = pJob->pBody;
+
+    if( pExec->pTemplate != NULL )
+    {
+        result = LaunchTemplate( pExec );
+    }
+    else if( pJob->fdIn != -1 )
+    {
+        /* the command reads its stdin from the upload pipe */
+        if( LAUNCHER_Command( pOptions->backend,
+                              cmd,
+                              pJob->fdIn,
+                              pExec->pClass,
+                              &pExec->child ) == EOK )
+        {
+            result = EOK;
+        }
+
+        close( pJob->fdIn );
+        pJob->fdIn = -1;
+    }
+    else
+    {
+        /* capture the output of cacheable commands */
+        pExec->pCacheEntry = ( pExec->subscription ) ||
+                             ( pExec->response.chunked )
+                                ? NULL
+                                : CACHE_Find( pOptions->pCache, cmd );
+        if( pExec->pCacheEntry != NULL )
+        {
+            RESPONSE_SetCapture( &pExec->response, CACHE_MAX_OUTPUT );
+        }
+
+        if( ( pOptions->builtins ) &&
+            ( pExec->pClass == NULL ) &&
+            ( pExec->killTime == 0 ) &&
+            ( pExec->subscription == false ) &&
+            ( BUILTIN_Run( cmd, WriteOutput, pExec, &pExec->status ) == EOK ) )
+        {
+            /* the command was executed in-process */
+            pExec->builtin = true;
+            result = EOK;
+        }
+        else if( LAUNCHER_Command( pOptions->backend,
+                                   cmd,
+                                   -1,
+                                   pExec->pClass,
+                                   &pExec->child ) == EOK )
+        {
+            result = EOK;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  LaunchInSession                                                           */
+/*!
+    Execute a command in its session shell
+
+    The LaunchInSession function writes the command to the session
+    shell.  The command output is read from a duplicate of the shell's
+    output pipe, so closing the command output leaves the shell intact.
+
+    @param[in]
+        pExec
+            pointer to the Exec which owns a session
+
+    @retval EOK the command was started
+    @retval error as returned by SESSION_Command or fcntl
+
+==============================================================================*/
+static int LaunchInSession( Exec *pExec )
+{
+    int result;
+
+    result = SESSION_Command( pExec->pSession, pExec->pJob->pBody );
+    if( result == EOK )
+    {
+        pExec->child.fdOut = fcntl( pExec->pSession->child.fdOut,
+                                    F_DUPFD_CLOEXEC,
+                                    0 );
+        if( pExec->child.fdOut == -1 )
+        {
+            result = errno;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  LaunchTemplate                                                            */
+/*!
+    Launch a template command
+
+    The LaunchTemplate function builds the argument vector of the
+    command's template from the arguments in the message body, and
+    executes it directly, without the shell or a PATH search.  Invalid
+    arguments are reported in the terminated header of the final
+    status message.  If the command has a stdin upload its end of the
+    upload pipe is handed to it.
+
+    @param[in]
+        pExec
+            pointer to the Exec of a template command
+
+    @retval EOK the command was launched
+    @retval error as returned by TEMPLATE_Expand or LAUNCHER_Argv
+
+==============================================================================*/
+static int LaunchTemplate( Exec *pExec )
+{
+    int result;
+    Job *pJob = pExec->pJob;
+    char buf[TEMPLATE_ARGS_SIZE];
+    char *argv[MAX_TEMPLATE_ARGS + 1];
+
+    result = TEMPLATE_Expand( pExec->pTemplate,
+                              pJob->pBody,
+                              buf,
+                              sizeof( buf ),
+                              argv );
+    if( result == EOK )
+    {
+        result = LAUNCHER_Argv( argv,
+                                pJob->fdIn,
+                                pExec->pClass,
+                                &pExec->child );
+    }
+    else
+    {
+        pExec->terminated = "invalidArguments";
+    }
+
+    if( pJob->fdIn != -1 )
+    {
+        close( pJob->fdIn );
+        pJob->fdIn = -1;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  SetupStderr                                                               */
+/*!
+    Set up the forwarding of a command's stderr stream
+
+    The SetupStderr function builds the response carrying the stderr of
+    a launched command, with the same recipients and output limit as the
+    stdout response, and tags the messages of both responses with the
+    stream they carry.  The stdout pipe is made non-blocking here, and
+    the launcher creates the stderr pipe non-blocking, so each can be
+    read whenever the other is idle.
+
+    @param[in]
+        pExec
+            pointer to the Exec of a command with a stderr pipe
+
+    @param[in]
+        hIoTClient
+            handle to the iotclient connection used to send the response
+
+==============================================================================*/
+static void SetupStderr( Exec *pExec, IOTCLIENT_HANDLE hIoTClient )
+{
+    Job *pJob = pExec->pJob;
+    Job *pFollower;
+    char step[16];
+    int flags;
+
+    RESPONSE_Setup( &pExec->errResponse,
+                    hIoTClient,
+                    pJob,
+                    &pExec->pOptions->response );
+
+    for( pFollower = pJob->pFollowers;
+         pFollower != NULL;
+         pFollower = pFollower->pNext )
+    {
+        RESPONSE_Follow( &pExec->errResponse, pFollower->msgId );
+    }
+
+    if( pJob->step > 0 )
+    {
+        snprintf( step, sizeof( step ), "%u", pJob->step );
+        RESPONSE_AddHeader( &pExec->errResponse, "step", step );
+    }
+
+    RESPONSE_AddHeader( &pExec->response, "stream", "stdout" );
+    RESPONSE_AddHeader( &pExec->errResponse, "stream", "stderr" );
+    pExec->errResponse.maxBytes = pExec->response.maxBytes;
+
+    if( pExec->subscription )
+    {
+        /* each stream is numbered separately */
+        RESPONSE_Subscribe( &pExec->errResponse, pExec->rate );
+    }
+
+    flags = fcntl( pExec->child.fdOut, F_GETFL );
+    fcntl( pExec->child.fdOut, F_SETFL, flags | O_NONBLOCK );
+
+    pExec->stderrStream = true;
+}
+
+/*============================================================================*/
+/*  ReadStreams                                                               */
+/*!
+    Read a chunk of a command's stdout and stderr streams
+
+    The ReadStreams function performs a single non-blocking read of each
+    stream which has not ended.  The pipes of ended streams are left
+    open for EXEC_EndOutput, so an event loop can stop watching them
+    first.
+
+    @param[in]
+        pExec
+            pointer to the Exec of a command with a stderr stream
+
+    @param[in]
+        pBuf
+            pointer to a buffer used when output is not coalesced
+
+    @param[in]
+        size
+            size of the buffer
+
+    @retval EOK output was read
+    @retval EAGAIN no output is available yet
+    @retval EFBIG a stream reached the output limit
+    @retval ENODATA both streams have ended
+    @retval error as returned by read
+
+==============================================================================*/
+static int ReadStreams( Exec *pExec, char *pBuf, size_t size )
+{
+    int result;
+    int rcOut = ENODATA;
+    int rcErr = ENODATA;
+
+    if( pExec->outputEnded == false )
+    {
+        rcOut = RESPONSE_ReadBuffer( &pExec->response,
+                                     pExec->child.fdOut,
+                                     pBuf,
+                                     size );
+        if( ( rcOut != EOK ) && ( rcOut != EAGAIN ) && ( rcOut != EFBIG ) )
+        {
+            pExec->outputEnded = true;
+        }
+    }
+
+    if( pExec->errorEnded == false )
+    {
+        rcErr = RESPONSE_ReadBuffer( &pExec->errResponse,
+                                     pExec->child.fdErr,
+                                     pBuf,
+                                     size );
+        if( ( rcErr != EOK ) && ( rcErr != EAGAIN ) && ( rcErr != EFBIG ) )
+        {
+            pExec->errorEnded = true;
+        }
+    }
+
+    if( ( rcOut == EFBIG ) || ( rcErr == EFBIG ) )
+    {
+        result = EFBIG;
+    }
+    else if( ( pExec->outputEnded ) && ( pExec->errorEnded ) )
+    {
+        result = rcOut;
+    }
+    else if( ( rcOut == EOK ) || ( rcErr == EOK ) )
+    {
+        result = EOK;
+    }
+    else
+    {
+        result = EAGAIN;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  Terminate                                                                 */
+/*!
+    Kill a command which has exceeded one of its limits
+
+    The Terminate function kills the command's process group and
+    records the reason for its termination.
+
+    @param[in]
+        pExec
+            pointer to the Exec
+
+    @param[in]
+        reason
+            the limit which was exceeded
+
+==============================================================================*/
+static void Terminate( Exec *pExec, const char *reason )
+{
+    if( pExec->terminated == NULL )
+    {
+        pExec->terminated = reason;
+    }
+
+    pExec->killTime = 0;
+
+    if( pExec->pSession != NULL )
+    {
+        SESSION_Kill( pExec->pSession );
+    }
+    else
+    {
+        LAUNCHER_Kill( &pExec->child, SIGKILL );
+    }
+}
+
+/*============================================================================*/
+/*  UpdateCache                                                               */
+/*!
+    Store the captured output of a cacheable command
+
+    The UpdateCache function stores the command output in the cache if
+    the command ran to completion with a zero exit status and its whole
+    output was captured and sent.
+
+    @param[in]
+        pExec
+            pointer to the Exec
+
+==============================================================================*/
+static void UpdateCache( Exec *pExec )
+{
+    Response *pResponse = &pExec->response;
+
+    if( ( pExec->pCacheEntry != NULL ) &&
+        ( pResponse->pCapture != NULL ) &&
+        ( pResponse->error == EOK ) &&
+        ( pExec->terminated == NULL ) &&
+        ( pExec->status != -1 ) &&
+        ( WIFEXITED( pExec->status ) ) &&
+        ( WEXITSTATUS( pExec->status ) == 0 ) )
+    {
+        CACHE_Put( pExec->pOptions->pCache,
+                   pExec->pCacheEntry,
+                   pResponse->pCapture,
+                   pResponse->captureLength );
+    }
+}
+
+/*============================================================================*/
+/*  GetExitCode                                                               */
+/*!
+    Get the exit code of a command
+
+    @param[in]
+        pExec
+            pointer to the Exec
+
+    @retval the exit status of the command, or 128 plus the number of
+            the signal which killed it, in the manner of the shell
+    @retval -1 the command was not executed, or could not be reaped
+
+==============================================================================*/
+static int GetExitCode( Exec *pExec )
+{
+    int code = -1;
+
+    if( pExec->status != -1 )
+    {
+        if( WIFEXITED( pExec->status ) )
+        {
+            code = WEXITSTATUS( pExec->status );
+        }
+        else if( WIFSIGNALED( pExec->status ) )
+        {
+            code = 128 + WTERMSIG( pExec->status );
+        }
+    }
+
+    return code;
+}
+
+/*============================================================================*/
+/*  AddStatusHeaders                                                          */
+/*!
+    Add the status of a completed command to the response headers
+
+    The AddStatusHeaders function adds the exitCode and wallTimeUs
+    headers.  For a command reaped by iotexec, the cpuUserUs, cpuSysUs
+    and maxRssKb headers report its resource usage (including any
+    processes it waited for).
+
+    @param[in]
+        pExec
+            pointer to the Exec
+
+==============================================================================*/
+static void AddStatusHeaders( Exec *pExec )
+{
+    Response *pResponse = &pExec->response;
+    struct rusage *pUsage = &pExec->child.usage;
+    char value[32];
+
+    snprintf( value, sizeof( value ), "%d", GetExitCode( pExec ) );
+    RESPONSE_AddHeader( pResponse, "exitCode", value );
+
+    snprintf( value,
+              sizeof( value ),
+              "%llu",
+              (unsigned long long)( NowUs() - pExec->startTimeUs ) );
+    RESPONSE_AddHeader( pResponse, "wallTimeUs", value );
+
+    if( pExec->child.hasUsage )
+    {
+        snprintf( value,
+                  sizeof( value ),
+                  "%llu",
+                  ( (unsigned long long)pUsage->ru_utime.tv_sec * 1000000 ) +
+                  pUsage->ru_utime.tv_usec );
+        RESPONSE_AddHeader( pResponse, "cpuUserUs", value );
+
+        snprintf( value,
+                  sizeof( value ),
+                  "%llu",
+                  ( (unsigned long long)pUsage->ru_stime.tv_sec * 1000000 ) +
+                  pUsage->ru_stime.tv_usec );
+        RESPONSE_AddHeader( pResponse, "cpuSysUs", value );
+
+        snprintf( value, sizeof( value ), "%ld", pUsage->ru_maxrss );
+        RESPONSE_AddHeader( pResponse, "maxRssKb", value );
+    }
+}
+
+/*============================================================================*/
+/*  NowUs                                                                     */
+/*!
+    Get the current monotonic time
+
+    @retval the monotonic time in microseconds
+
+==============================================================================*/
+static uint64_t NowUs( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ( (uint64_t)ts.tv_sec * 1000000 ) + ( ts.tv_nsec / 1000 );
+}
+
+/*============================================================================*/
+/*  NoteOutput                                                                */
+/*!
+    Record the arrival of command output
+
+    The NoteOutput function records the time from launching the command
+    to its first output, the first time it is called for a command.
+
+    @param[in]
+        pExec
+            pointer to the Exec
+
+==============================================================================*/
+static void NoteOutput( Exec *pExec )
+{
+    if( pExec->firstByteUs == 0 )
+    {
+        pExec->firstByteUs = NowUs();
+        METRICS_Record( METRICS_SPAWN_TO_FIRST_BYTE,
+                        pExec->firstByteUs - pExec->startTimeUs );
+    }
+}
+
+#ifdef IOTEXEC_METRICS
+/*============================================================================*/
+/*  WaitOutput                                                                */
+/*!
+    Wait for the first output of an unobserved command
+
+    The output of an unobserved command is handed to the response in a
+    single call, so the WaitOutput function waits for the command output
+    to become readable beforehand to measure the time to its first
+    output.
+
+    @param[in]
+        pExec
+            pointer to the Exec
+
+==============================================================================*/
+static void WaitOutput( Exec *pExec )
+{
+    struct pollfd pfd;
+
+    pfd.fd = pExec->child.fdOut;
+    pfd.events = POLLIN;
+
+    while( ( poll( &pfd, 1, -1 ) == -1 ) && ( errno == EINTR ) )
+    {
+        /* interrupted by a signal */
+    }
+
+    if( pfd.revents & POLLIN )
+    {
+        NoteOutput( pExec );
+    }
+}
+#endif
+
+/*============================================================================*/
+/*  WriteOutput                                                               */
+/*!
+    Send command output which was not read from a pipe by the response
+
+    The WriteOutput function passes the output of a builtin command, or
+    of a session command, to the command response, enforcing the
+    command's output limit.
+
+    @param[in]
+        arg
+            pointer to the Exec
+
+    @param[in]
+        pData
+            pointer to the builtin output
+
+    @param[in]
+        length
+            number of bytes of output
+
+    @retval EOK the output was sent
+    @retval EFBIG the output limit was reached
+    @retval error the first error encountered sending the response
+
+==============================================================================*/
+static int WriteOutput( void *arg, const char *pData, size_t length )
+{
+    Exec *pExec = (Exec *)arg;
+    Response *pResponse = &pExec->response;
+    int result = EOK;
+    size_t remaining;
+
+    if( pResponse->maxBytes > 0 )
+    {
+        remaining = ( pResponse->bytesRead < pResponse->maxBytes )
+                        ? pResponse->maxBytes - pResponse->bytesRead
+                        : 0;
+        if( length > remaining )
+        {
+            length = remaining;
+            pExec->terminated = "maxOutputBytes";
+            result = EFBIG;
+        }
+    }
+
+    if( length > 0 )
+    {
+        RESPONSE_Output( pResponse, pData, length );
+    }
+
+    return ( result == EOK ) ? pResponse->error : result;
+}
+
+/*! @}
+ * end of exec group */
@@ -0,0 +1,687 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+
+/*!
+ * @defgroup inflight inflight
+ * @brief Table of the running commands
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file inflight.c
+
+    Table of the running commands
+
+    The inflight module records every launched command while it runs,
+    so the dispatcher can report on it or stop it with a control
+    message, and so the service can drain its commands when it is
+    terminated.
+
+    Each job is embedded in the Exec which executes it, and is linked
+    into a hash bucket chosen by its messageId, so a job is added,
+    found and removed in constant time without any allocation.  Jobs
+    which share a messageId, such as the steps of a parallel batch,
+    share a bucket and are reported and cancelled together.
+
+    A cancelled job has its whole process group killed, and is flagged
+    so its response is completed with a terminated header.  A job is
+    removed from the table before its command is reaped, so the table
+    can never signal a recycled process identifier.
+
+    The table is shared by the dispatcher, the executors and the
+    termination handler, and is protected by a mutex.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include "inflight.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+#ifndef EOK
+/*! success response */
+#define EOK 0
+#endif
+
+/*! maximum number of command characters reported for a job */
+#define INFLIGHT_MAX_COMMAND 64
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static size_t Hash( const char *msgId );
+static int FormatJob( InflightJob *pJob,
+                      uint64_t now,
+                      char *pBuf,
+                      size_t size,
+                      size_t *pLength );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  INFLIGHT_Init                                                             */
+/*!
+    Initialize the in-flight job table
+
+    @param[in]
+        pTable
+            pointer to the InflightTable to initialize
+
+    @param[in]
+        maxSubscriptions
+            maximum number of running subscriptions, 0 to disable them
+
+    @retval EOK the table was initialized
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int INFLIGHT_Init( InflightTable *pTable, size_t maxSubscriptions )
+{
+    int result = EINVAL;
+
+    if( pTable != NULL )
+    {
+        memset( pTable, 0, sizeof( InflightTable ) );
+        pthread_mutex_init( &pTable->lock, NULL );
+        pthread_cond_init( &pTable->empty, NULL );
+        pTable->maxSubscriptions = maxSubscriptions;
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  INFLIGHT_Add                                                              */
+/*!
+    Record a running command
+
+    The INFLIGHT_Add function links a launched command into the table.
+    The job must have been populated by the caller, and must remain
+    valid until it is removed with INFLIGHT_Remove.
+
+    @param[in]
+        pTable
+            pointer to the InflightTable
+
+    @param[in]
+        pJob
+            pointer to the job to record
+
+    @retval EOK the job was recorded
+    @retval EBUSY the job is a subscription and the maximum number of
+            subscriptions are running
+    @retval ESHUTDOWN the service is shutting down
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int INFLIGHT_Add( InflightTable *pTable, InflightJob *pJob )
+{
+    int result = EINVAL;
+    size_t bucket;
+
+    if( ( pTable != NULL ) &&
+        ( pJob != NULL ) &&
+        ( pJob->msgId != NULL ) &&
+        ( pJob->pChild != NULL ) &&
+        ( pJob->linked == false ) )
+    {
+        pthread_mutex_lock( &pTable->lock );
+
+        if( pTable->closed )
+        {
+            result = ESHUTDOWN;
+        }
+        else if( ( pJob->subscription ) &&
+                 ( pTable->numSubscriptions >= pTable->maxSubscriptions ) )
+        {
+            result = EBUSY;
+        }
+        else
+        {
+            bucket = Hash( pJob->msgId );
+            pJob->pNext = pTable->pBuckets[bucket];
+            pTable->pBuckets[bucket] = pJob;
+            pJob->linked = true;
+
+            pTable->numJobs++;
+            if( pJob->subscription )
+            {
+                pTable->numSubscriptions++;
+            }
+
+            result = EOK;
+        }
+
+        pthread_mutex_unlock( &pTable->lock );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  INFLIGHT_Remove                                                           */
+/*!
+    Remove a command which is about to be reaped
+
+    The INFLIGHT_Remove function removes the job from the table, if it
+    is recorded, so it can no longer be signalled.  It must be called
+    before the command is reaped, and may be called more than once.
+
+    @param[in]
+        pTable
+            pointer to the InflightTable
+
+    @param[in]
+        pJob
+            pointer to the job to remove
+
+==============================================================================*/
+void INFLIGHT_Remove( InflightTable *pTable, InflightJob *pJob )
+{
+    InflightJob **ppJob;
+
+    if( ( pTable != NULL ) &&
+        ( pJob != NULL ) )
+    {
+        pthread_mutex_lock( &pTable->lock );
+
+        if( pJob->linked )
+        {
+            ppJob = &pTable->pBuckets[Hash( pJob->msgId )];
+            while( ( *ppJob != NULL ) && ( *ppJob != pJob ) )
+            {
+                ppJob = &(*ppJob)->pNext;
+            }
+
+            if( *ppJob == pJob )
+            {
+                *ppJob = pJob->pNext;
+            }
+
+            pJob->pNext = NULL;
+            pJob->linked = false;
+
+            pTable->numJobs--;
+            if( pJob->subscription )
+            {
+                pTable->numSubscriptions--;
+            }
+
+            if( pTable->numJobs == 0 )
+            {
+                pthread_cond_broadcast( &pTable->empty );
+            }
+        }
+
+        pthread_mutex_unlock( &pTable->lock );
+    }
+}
+
+/*============================================================================*/
+/*  INFLIGHT_Cancel                                                           */
+/*!
+    Cancel the running commands of a message
+
+    The INFLIGHT_Cancel function kills the process group of each job
+    with the specified message identifier, and flags the job as
+    cancelled.  Its executor completes the response once the command's
+    output closes.
+
+    @param[in]
+        pTable
+            pointer to the InflightTable
+
+    @param[in]
+        msgId
+            pointer to the NUL terminated message identifier of the
+            jobs to cancel
+
+    @retval EOK the jobs were cancelled
+    @retval ENOENT no job with the message identifier is running
+    @retval EINVAL invalid arguments
+    @retval error as returned by LAUNCHER_Kill
+
+==============================================================================*/
+int INFLIGHT_Cancel( InflightTable *pTable, const char *msgId )
+{
+    int result = EINVAL;
+    InflightJob *pJob;
+    int rc;
+
+    if( ( pTable != NULL ) &&
+        ( msgId != NULL ) &&
+        ( msgId[0] != '\0' ) )
+    {
+        result = ENOENT;
+
+        pthread_mutex_lock( &pTable->lock );
+
+        for( pJob = pTable->pBuckets[Hash( msgId )];
+             pJob != NULL;
+             pJob = pJob->pNext )
+        {
+            if( strcmp( pJob->msgId, msgId ) == 0 )
+            {
+                rc = LAUNCHER_Kill( pJob->pChild, SIGKILL );
+                if( rc == EOK )
+                {
+                    __atomic_store_n( &pJob->cancelled,
+                                      INFLIGHT_CANCELLED,
+                                      __ATOMIC_RELEASE );
+                }
+
+                if( result != EOK )
+                {
+                    result = rc;
+                }
+            }
+        }
+
+        pthread_mutex_unlock( &pTable->lock );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  INFLIGHT_Status                                                           */
+/*!
+    Report on the running commands of a message
+
+    The INFLIGHT_Status function writes a line describing each job
+    with the specified message identifier into the buffer.  Each line
+    has the form:
+
+        messageId:<id> pid:<pid> started:<epoch> elapsedMs:<ms>
+        bytesSent:<bytes> [subscription:true] command:<command>
+
+    @param[in]
+        pTable
+            pointer to the InflightTable
+
+    @param[in]
+        msgId
+            pointer to the NUL terminated message identifier
+
+    @param[out]
+        pBuf
+            pointer to the buffer to receive the NUL terminated report
+
+    @param[in]
+        size
+            size of the buffer
+
+    @retval EOK the report was written
+    @retval ENOENT no job with the message identifier is running
+    @retval E2BIG the report was truncated to the whole lines which fit
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int INFLIGHT_Status( InflightTable *pTable,
+                     const char *msgId,
+                     char *pBuf,
+                     size_t size )
+{
+    int result = EINVAL;
+    InflightJob *pJob;
+    uint64_t now = RESPONSE_Now();
+    size_t length = 0;
+    int rc;
+
+    if( ( pTable != NULL ) &&
+        ( msgId != NULL ) &&
+        ( pBuf != NULL ) &&
+        ( size > 0 ) )
+    {
+        result = ENOENT;
+        pBuf[0] = '\0';
+
+        pthread_mutex_lock( &pTable->lock );
+
+        for( pJob = pTable->pBuckets[Hash( msgId )];
+             pJob != NULL;
+             pJob = pJob->pNext )
+        {
+            if( strcmp( pJob->msgId, msgId ) == 0 )
+            {
+                rc = FormatJob( pJob, now, pBuf, size, &length );
+                if( result != E2BIG )
+                {
+                    result = rc;
+                }
+            }
+        }
+
+        pthread_mutex_unlock( &pTable->lock );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  INFLIGHT_List                                                             */
+/*!
+    Report on all the running commands
+
+    The INFLIGHT_List function writes a line describing each running
+    job into the buffer, in the same form as INFLIGHT_Status.
+
+    @param[in]
+        pTable
+            pointer to the InflightTable
+
+    @param[out]
+        pBuf
+            pointer to the buffer to receive the NUL terminated report,
+            which is empty if no jobs are running
+
+    @param[in]
+        size
+            size of the buffer
+
+    @retval EOK the report was written
+    @retval E2BIG the report was truncated to the whole lines which fit
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int INFLIGHT_List( InflightTable *pTable, char *pBuf, size_t size )
+{
+    int result = EINVAL;
+    InflightJob *pJob;
+    uint64_t now = RESPONSE_Now();
+    size_t length = 0;
+    size_t i;
+
+    if( ( pTable != NULL ) &&
+        ( pBuf != NULL ) &&
+        ( size > 0 ) )
+    {
+        result = EOK;
+        pBuf[0] = '\0';
+
+        pthread_mutex_lock( &pTable->lock );
+
+        for( i = 0; i < INFLIGHT_BUCKETS; i++ )
+        {
+            for( pJob = pTable->pBuckets[i];
+                 pJob != NULL;
+                 pJob = pJob->pNext )
+            {
+                if( FormatJob( pJob, now, pBuf, size, &length ) != EOK )
+                {
+                    result = E2BIG;
+                }
+            }
+        }
+
+        pthread_mutex_unlock( &pTable->lock );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  INFLIGHT_Drain                                                            */
+/*!
+    Wait for the running commands to complete
+
+    The INFLIGHT_Drain function closes the table, so commands launched
+    from now on are refused, and waits until all the running jobs have
+    been removed or the timeout expires.
+
+    @param[in]
+        pTable
+            pointer to the InflightTable
+
+    @param[in]
+        timeoutMs
+            maximum time to wait (ms)
+
+    @retval EOK no jobs are running
+    @retval ETIMEDOUT jobs were still running when the timeout expired
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int INFLIGHT_Drain( InflightTable *pTable, unsigned int timeoutMs )
+{
+    int result = EINVAL;
+    struct timespec deadline;
+    int rc = EOK;
+
+    if( pTable != NULL )
+    {
+        clock_gettime( CLOCK_REALTIME, &deadline );
+        deadline.tv_sec += timeoutMs / 1000;
+        deadline.tv_nsec += (long)( timeoutMs % 1000 ) * 1000000L;
+        if( deadline.tv_nsec >= 1000000000L )
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        pthread_mutex_lock( &pTable->lock );
+
+        pTable->closed = true;
+        while( ( pTable->numJobs > 0 ) && ( rc != ETIMEDOUT ) )
+        {
+            rc = pthread_cond_timedwait( &pTable->empty,
+                                         &pTable->lock,
+                                         &deadline );
+        }
+
+        result = ( pTable->numJobs == 0 ) ? EOK : ETIMEDOUT;
+
+        pthread_mutex_unlock( &pTable->lock );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  INFLIGHT_KillAll                                                          */
+/*!
+    Kill all the running commands
+
+    The INFLIGHT_KillAll function kills the process group of every
+    running job, and flags the job as killed by a shutdown.  A job
+    whose command cannot be signalled is terminated when it next
+    produces output.
+
+    @param[in]
+        pTable
+            pointer to the InflightTable
+
+    @retval EOK the jobs were killed
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int INFLIGHT_KillAll( InflightTable *pTable )
+{
+    int result = EINVAL;
+    InflightJob *pJob;
+    size_t i;
+
+    if( pTable != NULL )
+    {
+        pthread_mutex_lock( &pTable->lock );
+
+        for( i = 0; i < INFLIGHT_BUCKETS; i++ )
+        {
+            for( pJob = pTable->pBuckets[i];
+                 pJob != NULL;
+                 pJob = pJob->pNext )
+            {
+                __atomic_store_n( &pJob->cancelled,
+                                  INFLIGHT_SHUTDOWN,
+                                  __ATOMIC_RELEASE );
+                LAUNCHER_Kill( pJob->pChild, SIGKILL );
+            }
+        }
+
+        pthread_mutex_unlock( &pTable->lock );
+
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  Hash                                                                      */
+/*!
+    Select the hash bucket of a message identifier
+
+    The Hash function computes the FNV-1a hash of the message identifier.
+
+    @param[in]
+        msgId
+            pointer to the NUL terminated message identifier
+
+    @retval index of the hash bucket
+
+==============================================================================*/
+static size_t Hash( const char *msgId )
+{
+    uint32_t hash = 2166136261U;
+
+    while( *msgId != '\0' )
+    {
+        hash ^= (unsigned char)*msgId++;
+        hash *= 16777619U;
+    }
+
+    return hash % INFLIGHT_BUCKETS;
+}
+
+/*============================================================================*/
+/*  FormatJob                                                                 */
+/*!
+    Append the description of a job to a report
+
+    The FormatJob function appends a line describing the job to the
+    report, if the whole line fits.  Only the first line of the command
+    is reported, truncated to INFLIGHT_MAX_COMMAND characters.
+
+    @param[in]
+        pJob
+            pointer to the job
+
+    @param[in]
+        now
+            current monotonic time (ms)
+
+    @param[in,out]
+        pBuf
+            pointer to the buffer containing the NUL terminated report
+
+    @param[in]
+        size
+            size of the buffer
+
+    @param[in,out]
+        pLength
+            pointer to the length of the report
+
+    @retval EOK the line was appended
+    @retval E2BIG the line does not fit in the buffer
+
+==============================================================================*/
+static int FormatJob( InflightJob *pJob,
+                      uint64_t now,
+                      char *pBuf,
+                      size_t size,
+                      size_t *pLength )
+{
+    int result = E2BIG;
+    size_t bytesSent = 0;
+    size_t cmdLength;
+    size_t i;
+    int n;
+
+    for( i = 0; i < 2; i++ )
+    {
+        if( pJob->pResponses[i] != NULL )
+        {
+            bytesSent += __atomic_load_n( &pJob->pResponses[i]->bytesSent,
+                                          __ATOMIC_RELAXED );
+        }
+    }
+
+    cmdLength = strcspn( pJob->cmd, "\n" );
+    if( cmdLength > INFLIGHT_MAX_COMMAND )
+    {
+        cmdLength = INFLIGHT_MAX_COMMAND;
+    }
+
+    n = snprintf( &pBuf[*pLength],
+                  size - *pLength,
+                  "messageId:%s pid:%d started:%lld elapsedMs:%llu "
+                  "bytesSent:%zu%s command:%.*s\n",
+                  pJob->msgId,
+                  (int)pJob->pid,
+                  (long long)pJob->started,
+                  (unsigned long long)( now - pJob->startTime ),
+                  bytesSent,
+                  pJob->subscription ? " subscription:true" : "",
+                  (int)cmdLength,
+                  pJob->cmd );
+    if( ( n >= 0 ) && ( (size_t)n < size - *pLength ) )
+    {
+        *pLength += n;
+        result = EOK;
+    }
+    else
+    {
+        /* drop the partial line */
+        pBuf[*pLength] = '\0';
+    }
+
+    return result;
+}
+
+/*! @}
+ * end of inflight group */
@@ -38,6 +38,25 @@ SOFTWARE.
     iotclient library, executes them, and sends the responses back
     using a device-to-cloud message via the iotclient library.
 
+    Received commands are dispatched to a pool of executor workers
+    so independent commands can run concurrently.  Alternatively,
+    commands can be executed by a single threaded event driven reactor.
+
+    Received messages are only traced when iotexec is built with
+    IOTEXEC_TRACE (debug builds) and run with verbose output.  The
+    verbose diagnostics are compiled out of IOTEXEC_QUIET builds.
+
+    Commands are received for the "exec" target, or for each of the
+    targets listed in a receiver configuration file.  The receivers of
+    all the targets feed the same dispatcher, which is serialized so
+    the dispatcher state is shared without further locking.
+
+    The running commands are recorded in an in-flight job table, which
+    answers cancel, status and list control messages.  On SIGTERM or
+    SIGINT the service stops launching commands, waits for the running
+    ones to complete, kills those still running after the drain
+    timeout, and exits once their responses have been sent.
+
 */
 /*============================================================================*/
 
@@ -53,19 +72,134 @@ SOFTWARE.
 #include <syslog.h>
 #include <stdbool.h>
 #include <signal.h>
+#include <semaphore.h>
+#include <pthread.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <iotclient/iotclient.h>
+#include "job.h"
+#include "workers.h"
+#include "launcher.h"
+#include "reactor.h"
+#include "response.h"
+#include "exec.h"
+#include "cache.h"
+#include "class.h"
+#include "dedup.h"
+#include "session.h"
+#include "assembly.h"
+#include "upload.h"
+#include "metrics.h"
+#include "outbox.h"
+#include "inflight.h"
+#include "template.h"
+#include "spool.h"
+#include "limiter.h"
+#include "ratelimit.h"
+#include "receiver.h"
+#include "verbose.h"
 
 /*==============================================================================
         Private definitions
 ==============================================================================*/
 
-/*! Maximum command length */
-#define MAX_MESSAGE_LENGTH  4096
+/*! Default maximum received message length */
+#define DEFAULT_MESSAGE_LENGTH 4096
+
+/*! Default maximum pending commands */
+#define DEFAULT_PENDING_MESSAGES 10
+
+/*! Target of the commands when no receiver configuration file is given */
+#define DEFAULT_TARGET "exec"
+
+/*! Default maximum length of a reassembled multi-part command */
+#define DEFAULT_COMMAND_LENGTH ( 1024 * 1024 )
+
+/*! Time (ms) allowed for all the parts of a multi-part command to arrive */
+#define ASSEMBLY_TIMEOUT_MS ( 60 * 1000 )
+
+/*! Maximum number of commands receiving a stdin upload at the same time */
+#define UPLOAD_MAX_STREAMS 16
+
+/*! Time (ms) after which an unused stdin upload is closed */
+#define UPLOAD_IDLE_MS ( 60 * 1000 )
+
+/*! Time (ms) to wait for a command to read more of its stdin upload */
+#define UPLOAD_WRITE_TIMEOUT_MS ( 30 * 1000 )
+
+/*! Default number of executor workers */
+#define DEFAULT_WORKERS 4
+
+/*! Default number of workers reserved for normal and high priority jobs */
+#define DEFAULT_RESERVED 1
+
+/*! Default de-duplication window in seconds */
+#define DEFAULT_DEDUP_WINDOW 60
+
+/*! Number of recently received message identifiers remembered */
+#define DEDUP_SIZE 256
+
+/*! Default maximum number of shell sessions */
+#define DEFAULT_SESSIONS 8
+
+/*! Default shell session idle timeout in seconds */
+#define DEFAULT_SESSION_IDLE 600
+
+/*! Maximum length of the priority header value */
+#define MAX_PRIORITY_LENGTH 16
+
+/*! Default output coalescing flush deadline (ms) */
+#define DEFAULT_FLUSH_MS 50
+
+/*! Default minimum output size for compressed responses */
+#define DEFAULT_COMPRESS_MIN 512
+
+/*! Default output size after which output coalescing is bypassed */
+#define DEFAULT_DIRECT_THRESHOLD ( 64 * 1024 )
+
+/*! Default memory bound of the asynchronous response queue */
+#define DEFAULT_OUTBOX_BYTES ( 1024 * 1024 )
+
+/*! Default maximum number of running subscriptions */
+#define DEFAULT_SUBSCRIPTIONS 4
+
+/*! Default maximum output messages per second of a subscription */
+#define DEFAULT_SUBSCRIPTION_RATE 4
+
+/*! Default 1 minute load average per CPU above which the adaptive
+    concurrency limit is decreased */
+#define DEFAULT_MAX_LOAD 1.5
+
+/*! Default number of commands an idle originator may send at once */
+#define DEFAULT_BURST 10
+
+/*! Number of originators whose command rate is tracked */
+#define RATELIMIT_SIZE 64
+
+/*! Default size of the chunks of a chunked response */
+#define DEFAULT_CHUNK_SIZE 4096
+
+/*! Default disk bound of the chunked response spool */
+#define DEFAULT_SPOOL_BYTES ( 16 * 1024 * 1024 )
+
+/*! Time (ms) for which a completed chunked response is kept in the spool */
+#define SPOOL_RETENTION_MS ( 5 * 60 * 1000 )
+
+/*! Default time (s) allowed for the running commands to complete on
+    termination */
+#define DEFAULT_DRAIN_TIMEOUT 10
+
+/*! Time (ms) allowed for killed commands to complete on termination */
+#define DRAIN_KILL_MS 2000
 
-/*! Maximum pending commands */
-#define MAX_PENDING_MESSAGES 10
+/*! Time (ms) allowed for queued responses to be sent on termination */
+#define DRAIN_FLUSH_MS 5000
+
+/*! Size of the report sent in reply to a status or list message */
+#define CONTROL_REPORT_SIZE 4096
+
+/*! Maximum length of the chunk list of a resend message */
+#define MAX_CHUNKS_LENGTH 256
 
 /*! iotexec state */
 typedef struct iotexecState
@@ -76,198 +210,1416 @@ typedef struct iotexecState
     /*! verbose flag */
     bool verbose;
 
-} IOTExecState;
+    /*! path of the metrics socket, or NULL if metrics are not served */
+    const char *metricsPath;
+
+    /*! memory bound of the asynchronous response queue, 0 to send
+        responses synchronously */
+    size_t outboxBytes;
+
+    /*! directory for responses spilled from the response queue, or NULL */
+    const char *spillDir;
+
+    /*! asynchronous response sender */
+    Outbox outbox;
+
+    /*! maximum received message length */
+    size_t maxMessageLength;
+
+    /*! maximum number of pending received messages and queued commands */
+    size_t maxPending;
+
+    /*! receiver configuration file, or NULL to receive for DEFAULT_TARGET */
+    const char *receiverFile;
+
+    /*! receivers of the command targets */
+    ReceiverTable receivers;
+
+    /*! serializes the dispatch of the messages of the receivers */
+    pthread_mutex_t dispatch;
+
+    /*! maximum length of a reassembled multi-part command */
+    size_t maxCommandLength;
+
+    /*! multi-part command reassembly */
+    Assembly assembly;
+
+    /*! stdin upload streams */
+    UploadTable uploads;
+
+    /*! number of executor workers */
+    size_t numWorkers;
+
+    /*! number of workers reserved for normal and high priority jobs */
+    size_t reserved;
+
+    /*! CPU or memory pressure (%) above which the concurrency is
+        reduced, 0 for a fixed concurrency */
+    double maxPressure;
+
+    /*! load average per CPU above which the concurrency is reduced */
+    double maxLoad;
+
+    /*! adaptive concurrency limiter */
+    Limiter limiter;
+
+    /*! command execution options */
+    ExecOptions execOptions;
+
+    /*! command result cache */
+    Cache cache;
+
+    /*! execution classes */
+    ClassTable classes;
+
+    /*! command templates */
+    TemplateTable templates;
+
+    /*! cgroup v2 directory of the execution classes, or NULL */
+    const char *cgroupDir;
+
+    /*! directory of the chunked response spool, or NULL */
+    const char *spoolDir;
+
+    /*! disk bound of the chunked response spool */
+    size_t spoolBytes;
+
+    /*! chunked response spool */
+    Spool spool;
+
+    /*! de-duplication window in seconds, 0 to disable */
+    unsigned int dedupWindow;
+
+    /*! recently received message identifiers */
+    Dedup dedup;
+
+    /*! commands per second allowed to each originator, 0 for no limit */
+    double rate;
+
+    /*! number of commands an idle originator may send at once */
+    double burst;
+
+    /*! per-originator command rate limit */
+    RateLimit rateLimit;
+
+    /*! maximum number of shell sessions, 0 to disable sessions */
+    size_t maxSessions;
+
+    /*! shell session idle timeout in seconds, 0 for none */
+    unsigned int sessionIdle;
+
+    /*! shell sessions */
+    SessionTable sessions;
+
+    /*! maximum number of running subscriptions, 0 to disable them */
+    size_t maxSubscriptions;
+
+    /*! running commands */
+    InflightTable inflight;
+
+    /*! time (s) allowed for the running commands to complete on
+        termination, 0 to kill them immediately */
+    unsigned int drainTimeout;
+
+    /*! posted by the termination handler to start draining */
+    sem_t terminate;
+
+    /*! executor worker pool */
+    WorkerPool workerPool;
+
+    /*! use the event driven reactor instead of the worker pool */
+    bool useReactor;
+
+    /*! event driven reactor */
+    Reactor reactor;
+
+} IOTExecState;
+
+/*==============================================================================
+        Private file scoped variables
+==============================================================================*/
+
+/*! iotexec application State object */
+IOTExecState state;
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+int main(int argc, char **argv);
+static int ProcessOptions( int argC, char *argV[], IOTExecState *pState );
+static void usage( char *cmdname );
+static int ProcessMessages(IOTExecState *pState);
+static int RunReactor( IOTExecState *pState );
+static void *DispatchThread( void *arg );
+static int ProcessMessage( Receiver *pReceiver, void *arg );
+static void SetupReceivers( IOTExecState *pState );
+static size_t GetQueueDepth( IOTExecState *pState );
+static IOTCLIENT_HANDLE GetConnection( IOTExecState *pState, Job *pJob );
+static int QueueJob( IOTExecState *pState, Job *pJob );
+static int ProcessControl( IOTExecState *pState, Job *pJob );
+static int Resend( IOTExecState *pState,
+                   Job *pJob,
+                   const char *msgId,
+                   unsigned long *pCount,
+                   unsigned long *pTotal );
+static int SubmitJob( IOTExecState *pState, Job *pJob );
+static void Busy( IOTExecState *pState,
+                  Job *pJob,
+                  const char *reason,
+                  unsigned long retryMs );
+static int SubmitBatch( IOTExecState *pState, Job *pJob, bool *pQueued );
+static int ExecuteJob( IOTCLIENT_HANDLE hIoTClient,
+                       Job *pJob,
+                       Job **ppResume,
+                       void *arg );
+static int ProcessCommand( IOTExecState *pState,
+                           IOTCLIENT_HANDLE hIoTClient,
+                           Job *pJob,
+                           Job **ppResume );
+static void SetupTerminationHandler( void );
+static void TerminationHandler( int signum, siginfo_t *info, void *ptr );
+static void *TerminationThread( void *arg );
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  main                                                                      */
+/*!
+    Main entry point for the iotsend application
+
+    @param[in]
+        argc
+            number of arguments on the command line
+            (including the command itself)
+
+    @param[in]
+        argv
+            array of pointers to the command line arguments
+
+    @return none
+
+==============================================================================*/
+int main(int argc, char **argv)
+{
+    int result = EINVAL;
+
+    state.maxMessageLength = DEFAULT_MESSAGE_LENGTH;
+    state.maxPending = DEFAULT_PENDING_MESSAGES;
+    state.maxCommandLength = DEFAULT_COMMAND_LENGTH;
+    state.numWorkers = DEFAULT_WORKERS;
+    state.reserved = DEFAULT_RESERVED;
+    state.maxLoad = DEFAULT_MAX_LOAD;
+    state.dedupWindow = DEFAULT_DEDUP_WINDOW;
+    state.burst = DEFAULT_BURST;
+    state.maxSessions = DEFAULT_SESSIONS;
+    state.sessionIdle = DEFAULT_SESSION_IDLE;
+    state.maxSubscriptions = DEFAULT_SUBSCRIPTIONS;
+    state.execOptions.subscriptionRate = DEFAULT_SUBSCRIPTION_RATE;
+    state.drainTimeout = DEFAULT_DRAIN_TIMEOUT;
+    state.execOptions.response.flushMs = DEFAULT_FLUSH_MS;
+    state.execOptions.response.compressMin = DEFAULT_COMPRESS_MIN;
+    state.execOptions.response.directThreshold = DEFAULT_DIRECT_THRESHOLD;
+    state.execOptions.response.chunkSize = DEFAULT_CHUNK_SIZE;
+    state.spoolBytes = DEFAULT_SPOOL_BYTES;
+
+    /* process the command line options */
+    ProcessOptions( argc, argv, &state );
+    state.execOptions.verbose = state.verbose;
+
+    SetupReceivers( &state );
+    pthread_mutex_init( &state.dispatch, NULL );
+
+    if( ( state.execOptions.pClasses != NULL ) &&
+        ( state.cgroupDir != NULL ) )
+    {
+        /* before any threads are created */
+        result = CLASS_Setup( &state.classes, state.cgroupDir );
+        if( result != EOK )
+        {
+            fprintf( stderr,
+                     "Failed to set up class cgroups in %s: %s\n",
+                     state.cgroupDir,
+                     strerror( result ) );
+        }
+    }
+
+    if( state.dedupWindow > 0 )
+    {
+        DEDUP_Init( &state.dedup, DEDUP_SIZE, state.dedupWindow * 1000 );
+    }
+
+    if( ( state.rate > 0.0 ) &&
+        ( RATELIMIT_Init( &state.rateLimit,
+                          RATELIMIT_SIZE,
+                          state.rate,
+                          state.burst ) != EOK ) )
+    {
+        fprintf( stderr, "Failed to set up the rate limit\n" );
+        state.rate = 0.0;
+    }
+
+    if( SESSION_Init( &state.sessions,
+                      state.maxSessions,
+                      state.sessionIdle ) == EOK )
+    {
+        state.execOptions.pSessions = &state.sessions;
+    }
+
+    if( INFLIGHT_Init( &state.inflight, state.maxSubscriptions ) == EOK )
+    {
+        state.execOptions.pInflight = &state.inflight;
+    }
+
+    if( ( state.maxPressure > 0.0 ) &&
+        ( LIMITER_Init( &state.limiter,
+                        state.numWorkers,
+                        state.maxLoad,
+                        state.maxPressure ) == EOK ) )
+    {
+        state.execOptions.pLimiter = &state.limiter;
+    }
+
+    if( state.spoolDir != NULL )
+    {
+        result = SPOOL_Init( &state.spool,
+                             state.spoolDir,
+                             state.spoolBytes,
+                             SPOOL_RETENTION_MS );
+        if( result == EOK )
+        {
+            state.execOptions.response.pSpool = &state.spool;
+        }
+        else
+        {
+            fprintf( stderr,
+                     "Failed to set up the response spool in %s: %s\n",
+                     state.spoolDir,
+                     strerror( result ) );
+        }
+    }
+
+    ASSEMBLY_Init( &state.assembly,
+                   state.maxCommandLength,
+                   ASSEMBLY_TIMEOUT_MS );
+
+    UPLOAD_Init( &state.uploads,
+                 UPLOAD_MAX_STREAMS,
+                 UPLOAD_IDLE_MS,
+                 UPLOAD_WRITE_TIMEOUT_MS );
+
+    if( state.metricsPath != NULL )
+    {
+        result = METRICS_Listen( state.metricsPath );
+        if( result != EOK )
+        {
+            fprintf( stderr,
+                     "Failed to serve metrics on %s: %s\n",
+                     state.metricsPath,
+                     strerror( result ) );
+        }
+    }
+
+    if( ( state.outboxBytes == 0 ) && ( state.spillDir != NULL ) )
+    {
+        state.outboxBytes = DEFAULT_OUTBOX_BYTES;
+    }
+
+    if( state.outboxBytes > 0 )
+    {
+        result = OUTBOX_Create( &state.outbox,
+                                state.outboxBytes,
+                                state.spillDir,
+                                state.verbose );
+        if( result == EOK )
+        {
+            state.execOptions.response.pOutbox = &state.outbox;
+        }
+        else
+        {
+            fprintf( stderr,
+                     "Failed to start the response sender: %s\n",
+                     strerror( result ) );
+        }
+    }
+
+    /* set up a graceful termination handler */
+    SetupTerminationHandler();
+
+    state.hIoTClient = IOTCLIENT_Create();
+    if ( state.hIoTClient != NULL )
+    {
+        IOTCLIENT_SetVerbose( state.hIoTClient, state.verbose );
+
+        /* create the cloud-to-device message receivers */
+        result = RECEIVER_Open( &state.receivers,
+                                state.hIoTClient,
+                                state.verbose );
+        if( result == EOK )
+        {
+            if( state.useReactor )
+            {
+                result = RunReactor( &state );
+            }
+            else
+            {
+                ProcessMessages( &state );
+            }
+
+            RECEIVER_Close( &state.receivers );
+        }
+        else
+        {
+            fprintf( stderr,
+                     "Failed to create the receivers: %s\n",
+                     strerror( result ) );
+        }
+
+        IOTCLIENT_Close( state.hIoTClient );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  SetupReceivers                                                            */
+/*!
+    Set up the receivers of the command targets
+
+    The SetupReceivers function loads the receivers from the receiver
+    configuration file, or sets up a single receiver for DEFAULT_TARGET
+    if there is none or it cannot be loaded.  The settings which the
+    file does not give are taken from the command line options.
+
+    @param[in]
+        pState
+            pointer to the IOTExecState
+
+==============================================================================*/
+static void SetupReceivers( IOTExecState *pState )
+{
+    Receiver defaults;
+    int result = ENOENT;
+
+    memset( &defaults, 0, sizeof( Receiver ) );
+    defaults.maxPending = pState->maxPending;
+    defaults.maxMessageLength = pState->maxMessageLength;
+    defaults.priority = JOB_PRIORITY_NORMAL;
+    defaults.timeout = pState->execOptions.timeout;
+    defaults.maxOutputBytes = pState->execOptions.maxOutputBytes;
+
+    RECEIVER_Init( &pState->receivers, &defaults );
+
+    if( pState->receiverFile != NULL )
+    {
+        result = RECEIVER_Load( &pState->receivers, pState->receiverFile );
+        if( result != EOK )
+        {
+            fprintf( stderr,
+                     "cannot load receiver file: %s: %s\n",
+                     pState->receiverFile,
+                     strerror( result ) );
+            RECEIVER_Init( &pState->receivers, &defaults );
+        }
+    }
+
+    if( result != EOK )
+    {
+        RECEIVER_Add( &pState->receivers, DEFAULT_TARGET );
+    }
+
+    pState->execOptions.pReceivers = &pState->receivers;
+}
+
+/*============================================================================*/
+/*  GetQueueDepth                                                             */
+/*!
+    Get the depth of the job queue
+
+    The job queue holds the queued commands of every receiver target,
+    so its depth is the sum of the queue shares of the targets.
+
+    @param[in]
+        pState
+            pointer to the IOTExecState
+
+    @retval the maximum number of commands in the job queue
+
+==============================================================================*/
+static size_t GetQueueDepth( IOTExecState *pState )
+{
+    size_t depth = 0;
+    size_t i;
+
+    for( i = 0; i < pState->receivers.count; i++ )
+    {
+        depth += pState->receivers.receivers[i].maxPending;
+    }
+
+    return ( depth > 0 ) ? depth : pState->maxPending;
+}
+
+/*============================================================================*/
+/*  ProcessMessages                                                           */
+/*!
+    Process cloud-to-device command messages
+
+    The ProcessMessages function starts the executor worker pool, with
+    the worker and queue shares of each receiver target, and then acts
+    as the dispatcher, waiting for received cloud-to-device commands and
+    handing them to the workers for execution.
+
+    @param[in]
+        pState
+            pointer to the IOTExecState
+
+    @retval EINVAL invalid arguments
+    @retval error as returned from WORKERS_Create or RECEIVER_Run
+
+==============================================================================*/
+static int ProcessMessages(IOTExecState *pState)
+{
+    int result = EINVAL;
+    size_t i;
+
+    if( pState != NULL )
+    {
+        result = WORKERS_Create( &pState->workerPool,
+                                 pState->numWorkers,
+                                 GetQueueDepth( pState ),
+                                 pState->reserved,
+                                 pState->execOptions.pLimiter,
+                                 ExecuteJob,
+                                 pState,
+                                 pState->verbose );
+        if( result == EOK )
+        {
+            for( i = 0; i < pState->receivers.count; i++ )
+            {
+                WORKERS_SetShare( &pState->workerPool,
+                                  i,
+                                  pState->receivers.receivers[i].workers,
+                                  pState->receivers.receivers[i].maxPending );
+            }
+
+            result = RECEIVER_Run( &pState->receivers,
+                                   ProcessMessage,
+                                   pState );
+        }
+        else
+        {
+            fprintf( stderr,
+                     "Failed to create workers: %s\n",
+                     strerror( result ) );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RunReactor                                                                */
+/*!
+    Process cloud-to-device command messages using the reactor
+
+    The RunReactor function creates the event driven reactor, with the
+    command and queue shares of each receiver target, and starts a
+    dispatcher thread to feed it with received cloud-to-device commands.
+    The calling thread then runs the reactor event loop.
+
+    @param[in]
+        pState
+            pointer to the IOTExecState
+
+    @retval EINVAL invalid arguments
+    @retval error as returned from REACTOR_Create or REACTOR_Run
+
+==============================================================================*/
+static int RunReactor( IOTExecState *pState )
+{
+    int result = EINVAL;
+    pthread_t dispatcher;
+    size_t i;
+
+    if( pState != NULL )
+    {
+        result = REACTOR_Create( &pState->reactor,
+                                 pState->numWorkers,
+                                 GetQueueDepth( pState ),
+                                 pState->reserved,
+                                 &pState->execOptions );
+        if( result == EOK )
+        {
+            for( i = 0; i < pState->receivers.count; i++ )
+            {
+                REACTOR_SetShare( &pState->reactor,
+                                  i,
+                                  pState->receivers.receivers[i].workers,
+                                  pState->receivers.receivers[i].maxPending );
+            }
+
+            result = pthread_create( &dispatcher,
+                                     NULL,
+                                     DispatchThread,
+                                     pState );
+            if( result == EOK )
+            {
+                result = REACTOR_Run( &pState->reactor );
+            }
+        }
+
+        if( result != EOK )
+        {
+            fprintf( stderr,
+                     "Failed to run reactor: %s\n",
+                     strerror( result ) );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  DispatchThread                                                            */
+/*!
+    Reactor dispatcher thread
+
+    The DispatchThread function waits for the cloud-to-device commands
+    received for each target and submits them to the reactor.
+
+    @param[in]
+        arg
+            pointer to the IOTExecState
+
+    @retval NULL
+
+==============================================================================*/
+static void *DispatchThread( void *arg )
+{
+    IOTExecState *pState = (IOTExecState *)arg;
+
+    if( pState != NULL )
+    {
+        RECEIVER_Run( &pState->receivers, ProcessMessage, pState );
+    }
+
+    return NULL;
+}
+
+/*============================================================================*/
+/*  ProcessMessage                                                            */
+/*!
+    Process a cloud-to-device command message
+
+    The ProcessMessage function waits for a cloud-to-device message
+    received for a target, copies it into a job, and queues the job
+    for execution by the executor worker pool or the reactor.  The parts of a
+    multi-part command are held until the whole command has been
+    received.  Messages whose messageId was received within the
+    de-duplication window are discarded, stdin upload data is
+    written to the command it is addressed to, and control messages
+    are answered from the in-flight job table.  The messages of the
+    receivers are dispatched one at a time.
+
+    @param[in]
+        pReceiver
+            pointer to the receiver of the target
+
+    @param[in]
+        arg
+            pointer to the IOTExecState
+
+    @retval EOK message was queued for execution or stored as a part
+    @retval EALREADY the message is a duplicate and was discarded
+    @retval EINVAL invalid arguments
+    @retval EMSGSIZE message is too large, or its messageId too long,
+            to be processed
+    @retval ENOMEM could not allocate memory for the job
+    @retval error as returned from ASSEMBLY_Add, UPLOAD_Add or QueueJob
+
+==============================================================================*/
+static int ProcessMessage( Receiver *pReceiver, void *arg )
+{
+    IOTExecState *pState = (IOTExecState *)arg;
+    int result = EINVAL;
+    char *pHeader;
+    char *pBody;
+    size_t headerLength = 0;
+    size_t bodyLength = 0;
+    Job *pJob;
+    int rc;
+
+    if ( ( pState != NULL ) &&
+         ( pReceiver != NULL ) )
+    {
+        /* wait for a cloud-to-device message */
+        result = IOTCLIENT_Receive( pReceiver->hIoTClient,
+                                    &pHeader,
+                                    &pBody,
+                                    &headerLength,
+                                    &bodyLength );
+        if( result == EOK )
+        {
+            pthread_mutex_lock( &pState->dispatch );
+
+            METRICS_Count( METRICS_MESSAGES, 1 );
+
+#ifdef IOTEXEC_TRACE
+            if( VERBOSE( pState->verbose ) )
+            {
+                fprintf( stdout,
+                         "header (%zu): %.*s\nbody (%zu): %.*s\n",
+                         headerLength,
+                         (int)headerLength,
+                         pHeader,
+                         bodyLength,
+                         (int)bodyLength,
+                         ( pBody != NULL ) ? pBody : "" );
+            }
+#endif
+
+            if ( ( pBody != NULL ) &&
+                 ( headerLength + bodyLength < pReceiver->maxMessageLength ) )
+            {
+                /* take a copy of the message since the receive buffer
+                   is re-used by the next IOTCLIENT_Receive */
+                pJob = JOB_New( pHeader, headerLength, pBody, bodyLength );
+                if( pJob != NULL )
+                {
+                    pJob->target = pReceiver->index;
+
+                    /* try to get the 'messageID' property */
+                    rc = JOB_GetProperty( pJob,
+                                          JOB_PROPERTY_MESSAGE_ID,
+                                          pJob->msgId,
+                                          sizeof( pJob->msgId ) );
+                    if( rc == E2BIG )
+                    {
+                        /* the response could not be correlated */
+                        JOB_Free( pJob );
+                        pJob = NULL;
+                        result = EMSGSIZE;
+                    }
+                    else if( rc != EOK )
+                    {
+                        pJob->msgId[0] = '\0';
+                    }
+
+                    if( pJob != NULL )
+                    {
+                        /* reassemble multi-part commands */
+                        result = ASSEMBLY_Add( &pState->assembly,
+                                               &pJob,
+                                               RESPONSE_Now() );
+                    }
+
+                    if( ( pJob != NULL ) &&
+                        ( DEDUP_Check( &pState->dedup,
+                                       pJob->msgId,
+                                       RESPONSE_Now() ) ) )
+                    {
+                        /* redelivered or repeated message */
+                        JOB_Free( pJob );
+                        pJob = NULL;
+                        result = EALREADY;
+                    }
+
+                    if( pJob != NULL )
+                    {
+                        /* answer cancel, status and list messages */
+                        rc = ProcessControl( pState, pJob );
+                        if( rc != ENOMSG )
+                        {
+                            result = rc;
+                            JOB_Free( pJob );
+                            pJob = NULL;
+                        }
+                    }
+
+                    if( pJob != NULL )
+                    {
+                        /* stream uploaded data into a command's stdin */
+                        result = UPLOAD_Add( &pState->uploads,
+                                             &pJob,
+                                             RESPONSE_Now() );
+                    }
+
+                    if( pJob != NULL )
+                    {
+                        result = QueueJob( pState, pJob );
+                    }
+                    else if( result == EINPROGRESS )
+                    {
+                        /* more parts are expected */
+                        result = EOK;
+                    }
+                }
+                else
+                {
+                    result = ENOMEM;
+                }
+            }
+            else
+            {
+                result = EMSGSIZE;
+            }
+
+            pthread_mutex_unlock( &pState->dispatch );
+        }
+
+        if( result == EALREADY )
+        {
+            METRICS_Count( METRICS_DUPLICATES, 1 );
+        }
+        else if( result != EOK )
+        {
+            METRICS_Failure( result );
+        }
+
+        if( VERBOSE( pState->verbose ) && ( result != EOK ) )
+        {
+            fprintf(stderr, "ProcessMessage: %s\n", strerror(result));
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  ProcessControl                                                            */
+/*!
+    Answer a control message
+
+    The ProcessControl function answers the control messages which act
+    on the in-flight job table:
+
+    - a cancel:<messageId> message kills the commands started by the
+      named message, and is answered with a cancelled:true header, or
+      cancelled:false if no such command could be killed.  The
+      cancelled command's own response ends with a terminated:cancelled
+      header.
+    - a status:<messageId> message is answered with a running:true or
+      running:false header, and a report line for each running command
+      started by the named message.
+    - a list:true message is answered with a report line for every
+      running command.
+    - a resend:<messageId> message sends the spooled chunks of the
+      named message's chunked response again, each with a resent:true
+      header.  An optional chunks header such as 3,7-9 selects the
+      chunks to send.  The message is answered with a resent header
+      holding the number of chunks sent, and a total header once the
+      chunked response is complete.
+
+    A report which does not fit in the reply is truncated to whole
+    lines, and the reply carries a truncated:true header.
+
+    @param[in]
+        pState
+            pointer to the IOTExecState
+
+    @param[in]
+        pJob
+            pointer to the received message
+
+    @retval EOK the control message was answered
+    @retval ENOMSG the message is not a control message
+    @retval error as returned by RESPONSE_Init or RESPONSE_Write
+
+==============================================================================*/
+static int ProcessControl( IOTExecState *pState, Job *pJob )
+{
+    int result = ENOMSG;
+    InflightTable *pTable = pState->execOptions.pInflight;
+    char target[MAX_MSGID_LENGTH];
+    char report[CONTROL_REPORT_SIZE];
+    const char *name = NULL;
+    const char *value = NULL;
+    bool control = true;
+    Response response;
+    unsigned long count = 0;
+    unsigned long total = 0;
+    char resent[24];
+    char chunks[24];
+    int rc = EOK;
+
+    report[0] = '\0';
+
+    if( JOB_GetProperty( pJob,
+                         JOB_PROPERTY_CANCEL,
+                         target,
+                         sizeof( target ) ) == EOK )
+    {
+        rc = INFLIGHT_Cancel( pTable, target );
+        name = "cancelled";
+        value = ( rc == EOK ) ? "true" : "false";
+    }
+    else if( JOB_GetProperty( pJob,
+                              JOB_PROPERTY_STATUS,
+                              target,
+                              sizeof( target ) ) == EOK )
+    {
+        rc = INFLIGHT_Status( pTable, target, report, sizeof( report ) );
+        name = "running";
+        value = ( ( rc == EOK ) || ( rc == E2BIG ) ) ? "true" : "false";
+    }
+    else if( JOB_IsTrue( pJob, JOB_PROPERTY_LIST ) )
+    {
+        target[0] = '\0';
+        rc = INFLIGHT_List( pTable, report, sizeof( report ) );
+    }
+    else if( JOB_GetProperty( pJob,
+                              JOB_PROPERTY_RESEND,
+                              target,
+                              sizeof( target ) ) == EOK )
+    {
+        rc = Resend( pState, pJob, target, &count, &total );
+        snprintf( resent, sizeof( resent ), "%lu", count );
+        name = "resent";
+        value = resent;
+    }
+    else
+    {
+        control = false;
+    }
+
+    if( control )
+    {
+        if( VERBOSE( pState->verbose ) )
+        {
+            fprintf( stdout,
+                     "Control %s %s: %s\n",
+                     ( name != NULL ) ? name : "list",
+                     target,
+                     strerror( rc ) );
+        }
+
+        result = RESPONSE_Init( &response,
+                                GetConnection( pState, pJob ),
+                                ( pJob->msgId[0] != '\0' ) ? pJob->msgId
+                                                           : NULL );
+        if( result == EOK )
+        {
+            response.pOutbox = pState->execOptions.response.pOutbox;
+            if( name != NULL )
+            {
+                RESPONSE_AddHeader( &response, name, value );
+            }
+
+            if( rc == E2BIG )
+            {
+                RESPONSE_AddHeader( &response, "truncated", "true" );
+            }
+
+            if( total > 0 )
+            {
+                snprintf( chunks, sizeof( chunks ), "%lu", total );
+                RESPONSE_AddHeader( &response, "total", chunks );
+            }
+
+            result = RESPONSE_Write( &response, report, strlen( report ) );
+            RESPONSE_Close( &response );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  Resend                                                                    */
+/*!
+    Send the spooled chunks of a chunked response again
+
+    The Resend function sends the chunks of the spooled response to the
+    named message which are selected by the chunks header of the resend
+    message, or all of its chunks if it has none.  The chunks are sent
+    with the correlationId of the original request.
+
+    @param[in]
+        pState
+            pointer to the IOTExecState
+
+    @param[in]
+        pJob
+            pointer to the resend message
+
+    @param[in]
+        msgId
+            pointer to the NUL terminated messageId of the original request
+
+    @param[out]
+        pCount
+            pointer to the location to store the number of chunks sent
+
+    @param[out]
+        pTotal
+            pointer to the location to store the number of chunks of a
+            complete response, or 0 if it is still running
+
+    @retval EOK the chunks were sent
+    @retval ENOENT the response is not spooled
+    @retval error as returned by RESPONSE_Init or RESPONSE_Resend
+
+==============================================================================*/
+static int Resend( IOTExecState *pState,
+                   Job *pJob,
+                   const char *msgId,
+                   unsigned long *pCount,
+                   unsigned long *pTotal )
+{
+    int result;
+    char chunks[MAX_CHUNKS_LENGTH];
+    Response response;
+
+    *pCount = 0;
+    *pTotal = 0;
+
+    result = RESPONSE_Init( &response, GetConnection( pState, pJob ), msgId );
+    if( result == EOK )
+    {
+        response.pOutbox = pState->execOptions.response.pOutbox;
+        RESPONSE_AddHeader( &response, "resent", "true" );
+
+        result = RESPONSE_Resend( &response,
+                                  pState->execOptions.response.pSpool,
+                                  msgId,
+                                  ( JOB_GetProperty( pJob,
+                                                     JOB_PROPERTY_CHUNKS,
+                                                     chunks,
+                                                     sizeof( chunks ) ) == EOK )
+                                    ? chunks
+                                    : NULL,
+                                  pCount,
+                                  pTotal );
+        RESPONSE_Close( &response );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  QueueJob                                                                  */
+/*!
+    Queue a received command for execution
+
+    The QueueJob function reads the scheduling headers of a received
+    command and submits it to the executor.  Commands with a valid
+    result in the result cache are answered immediately from the cache.
+    A command whose originator has exceeded its rate is answered with a
+    busy:rateLimited response instead.  The message identifier of a
+    command which is refused with a busy response, and of which nothing
+    was queued, is forgotten by the de-duplication set, so the command
+    is accepted when it is sent again.
+
+    @param[in]
+        pState
+            pointer to the IOTExecState
+
+    @param[in]
+        pJob
+            pointer to the received command, which is owned by the
+            executor or released on return
+
+    @retval EOK the command was queued for execution
+    @retval EBUSY the command was refused with a busy response
+    @retval error as returned from SubmitJob or SubmitBatch
+
+==============================================================================*/
+static int QueueJob( IOTExecState *pState, Job *pJob )
+{
+    int result;
+    char priority[MAX_PRIORITY_LENGTH];
+    char msgId[MAX_MSGID_LENGTH];
+    unsigned long retryMs = 0;
+    Receiver *pReceiver;
+    bool queued = false;
+    int rc;
+
+    /* the job may be released before its refusal is known */
+    strcpy( msgId, pJob->msgId );
+
+    /* try to get the 'session' property */
+    rc = JOB_GetProperty( pJob,
+                          JOB_PROPERTY_SESSION,
+                          pJob->session,
+                          sizeof( pJob->session ) );
+    if( rc != EOK )
+    {
+        pJob->session[0] = '\0';
+    }
+
+    /* the target's priority applies without a 'priority' property */
+    pReceiver = RECEIVER_Get( &pState->receivers, pJob->target );
+    if( pReceiver != NULL )
+    {
+        pJob->priority = pReceiver->priority;
+    }
+
+    /* try to get the 'priority' property */
+    rc = JOB_GetProperty( pJob,
+                          JOB_PROPERTY_PRIORITY,
+                          priority,
+                          sizeof( priority ) );
+    if( ( rc == EOK ) &&
+        ( JOB_ParsePriority( priority,
+                             &pJob->priority ) != EOK ) &&
+        VERBOSE( pState->verbose ) )
+    {
+        fprintf( stderr, "unknown priority: %s\n", priority );
+    }
+
+    /* identify the originator for admission control */
+    if( ( JOB_GetProperty( pJob,
+                           JOB_PROPERTY_USER_ID,
+                           pJob->originator,
+                           sizeof( pJob->originator ) ) != EOK ) &&
+        ( JOB_GetProperty( pJob,
+                           JOB_PROPERTY_SOURCE,
+                           pJob->originator,
+                           sizeof( pJob->originator ) ) != EOK ) )
+    {
+        pJob->originator[0] = '\0';
+    }
+
+    /* latencies are measured from here */
+    pJob->receivedUs = METRICS_Now();
+
+    /* queue received message for execution */
+    if( ( pState->rate > 0.0 ) &&
+        ( RATELIMIT_Take( &pState->rateLimit,
+                          pJob->originator,
+                          RESPONSE_Now(),
+                          &retryMs ) == false ) )
+    {
+        /* the originator has exceeded its rate */
+        Busy( pState, pJob, "rateLimited", retryMs );
+        result = EBUSY;
+    }
+    else if( EXEC_Cached( GetConnection( pState, pJob ),
+                          pJob,
+                          &pState->execOptions ) == EOK )
+    {
+        /* answered from the result cache */
+        JOB_Free( pJob );
+        result = EOK;
+    }
+    else if( JOB_IsTrue( pJob, JOB_PROPERTY_BATCH ) )
+    {
+        /* queue the commands of the batch */
+        result = SubmitBatch( pState, pJob, &queued );
+        pJob = NULL;
+    }
+    else
+    {
+        result = SubmitJob( pState, pJob );
+    }
+
+    if( ( result != EOK ) && ( result != EALREADY ) )
+    {
+        JOB_Free( pJob );
+    }
+
+    if( ( result == EBUSY ) && ( queued == false ) )
+    {
+        /* the command was not executed, so it may be sent again */
+        DEDUP_Remove( &pState->dedup, msgId );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  GetConnection                                                             */
+/*!
+    Get the connection to reply to a message on
+
+    The dispatcher replies to a message on the connection of the
+    receiver it was received on.
+
+    @param[in]
+        pState
+            pointer to the IOTExecState
 
-/*==============================================================================
-        Private file scoped variables
-==============================================================================*/
+    @param[in]
+        pJob
+            pointer to the received message
 
-/*! iotexec application State object */
-IOTExecState state;
+    @retval handle to the iotclient connection
 
-/*==============================================================================
-        Private function declarations
 ==============================================================================*/
+static IOTCLIENT_HANDLE GetConnection( IOTExecState *pState, Job *pJob )
+{
+    Receiver *pReceiver;
 
-int main(int argc, char **argv);
-static int ProcessOptions( int argC, char *argV[], IOTExecState *pState );
-static void usage( char *cmdname );
-static int ProcessMessages(IOTExecState *pState);
-static int ProcessMessage(IOTExecState *pState);
-static int ProcessCommand( IOTExecState *pState,
-                           const char *cmd,
-                           const char *msgId );
-static void SetupTerminationHandler( void );
-static void TerminationHandler( int signum, siginfo_t *info, void *ptr );
+    pReceiver = RECEIVER_Get( &pState->receivers, pJob->target );
 
-/*==============================================================================
-        Private function definitions
-==============================================================================*/
+    return ( ( pReceiver != NULL ) && ( pReceiver->hIoTClient != NULL ) )
+                ? pReceiver->hIoTClient
+                : pState->hIoTClient;
+}
 
 /*============================================================================*/
-/*  main                                                                      */
+/*  SubmitJob                                                                 */
 /*!
-    Main entry point for the iotsend application
+    Queue a job for execution
+
+    The SubmitJob function submits a job to the reactor or the worker
+    pool.  On success the job is owned by the executor.  While the
+    queue, or its target's share of the queue, is full, the caller waits
+    with the dispatch mutex released, so the backlog of one target does
+    not hold up the messages of the other targets.  If the queue fills
+    again before the job is submitted, for example because another
+    receiver was woken by the same free slot, the caller waits again.
+    Only a job whose originator holds its fair share of a full queue is
+    refused, with a busy:queueFull response.
+
+    SubmitJob must be called with the dispatch mutex held, and returns
+    with it held.
 
     @param[in]
-        argc
-            number of arguments on the command line
-            (including the command itself)
+        pState
+            pointer to the IOTExecState
 
     @param[in]
-        argv
-            array of pointers to the command line arguments
+        pJob
+            pointer to the job to submit
 
-    @return none
+    @retval EOK the job was queued
+    @retval error as returned by REACTOR_Wait, WORKERS_Wait,
+            REACTOR_Submit or WORKERS_Submit
 
 ==============================================================================*/
-int main(int argc, char **argv)
+static int SubmitJob( IOTExecState *pState, Job *pJob )
 {
-    int result = EINVAL;
-
-    /* process the command line options */
-    ProcessOptions( argc, argv, &state );
-
-    /* set up an abnormal termination handler */
-    SetupTerminationHandler();
+    int result;
 
-    state.hIoTClient = IOTCLIENT_Create();
-    if ( state.hIoTClient != NULL )
+    do
     {
-        IOTCLIENT_SetVerbose( state.hIoTClient, state.verbose );
+        /* wait for room in the queue without blocking the other targets */
+        pthread_mutex_unlock( &pState->dispatch );
+        result = ( pState->useReactor )
+                    ? REACTOR_Wait( &pState->reactor, pJob )
+                    : WORKERS_Wait( &pState->workerPool, pJob );
+        pthread_mutex_lock( &pState->dispatch );
 
-        /* create a cloud-to-device message receiver */
-        result = IOTCLIENT_CreateReceiver( state.hIoTClient,
-                                           "exec",
-                                           MAX_PENDING_MESSAGES,
-                                           MAX_MESSAGE_LENGTH );
         if( result == EOK )
         {
-            ProcessMessages( &state );
+            result = ( pState->useReactor )
+                        ? REACTOR_Submit( &pState->reactor, pJob )
+                        : WORKERS_Submit( &pState->workerPool, pJob );
         }
 
-        IOTCLIENT_Close( state.hIoTClient );
+    } while( result == EAGAIN );
+
+    if( result == EBUSY )
+    {
+        Busy( pState, pJob, "queueFull", 0 );
     }
 
     return result;
 }
 
 /*============================================================================*/
-/*  ProcessMessages                                                           */
+/*  Busy                                                                      */
 /*!
-    Process cloud-to-device command messages
+    Refuse a command with a busy response
 
-    The ProcessMessages function waits for and processes received
-    cloud-to-device commands.
+    The Busy function answers a command which is refused by admission
+    control with a single response message carrying a busy header with
+    the reason for the refusal, and a retryAfterMs header if the time
+    until the command would be admitted is known.
 
     @param[in]
         pState
             pointer to the IOTExecState
 
+    @param[in]
+        pJob
+            pointer to the refused command
+
+    @param[in]
+        reason
+            pointer to the NUL terminated reason for the refusal
+
+    @param[in]
+        retryMs
+            time in milliseconds until the command would be admitted,
+            0 if unknown
+
 ==============================================================================*/
-static int ProcessMessages(IOTExecState *pState)
+static void Busy( IOTExecState *pState,
+                  Job *pJob,
+                  const char *reason,
+                  unsigned long retryMs )
 {
-    int result = EINVAL;
-    char *pHeader;
-    char *pBody;
-    size_t headerLength;
-    size_t nodyLength;
-    FILE *fp;
+    Response response;
+    char retry[24];
 
-    if( pState != NULL )
+    METRICS_Count( METRICS_BUSY, 1 );
+
+    if( VERBOSE( pState->verbose ) )
+    {
+        fprintf( stdout,
+                 "Busy %s: %s %s\n",
+                 reason,
+                 pJob->originator,
+                 pJob->msgId );
+    }
+
+    if( RESPONSE_Init( &response,
+                       GetConnection( pState, pJob ),
+                       ( pJob->msgId[0] != '\0' ) ? pJob->msgId
+                                                  : NULL ) == EOK )
     {
-        while( true )
+        response.pOutbox = pState->execOptions.response.pOutbox;
+        RESPONSE_AddHeader( &response, "busy", reason );
+        if( retryMs > 0 )
         {
-            result = ProcessMessage(pState);
+            snprintf( retry, sizeof( retry ), "%lu", retryMs );
+            RESPONSE_AddHeader( &response, "retryAfterMs", retry );
         }
-    }
 
-    return result;
+        RESPONSE_Write( &response, "", 0 );
+        RESPONSE_Close( &response );
+    }
 }
 
 /*============================================================================*/
-/*  ProcessMessage                                                            */
+/*  SubmitBatch                                                               */
 /*!
-    Process a cloud-to-device command message
-
-    The ProcessMessage function waits for and processes a received
-    cloud-to-device message.
+    Queue the commands of a batch message for execution
+
+    The SubmitBatch function splits a batch job into one step per
+    command line.  The steps of a sequential batch are queued as a
+    single job which executes each step in turn.  If the batch has
+    a parallel:true header, each step is queued separately so the
+    steps can execute concurrently.  The fair share of the queue is
+    checked once, when the first step is queued: if it is refused the
+    whole batch is refused with a single busy response, and otherwise
+    the later steps wait for room in the queue rather than being
+    refused.  The batch job is released.
 
     @param[in]
         pState
             pointer to the IOTExecState
 
-    @retval EOK message was processed successfully
-    @retval EINVAL invalid arguments
-    @retval EMSGSIZE message is too large and cannot be processed
-    @retval error as returned from ProcessCommand
+    @param[in]
+        pJob
+            pointer to the batch job
+
+    @param[out]
+        pQueued
+            pointer to the location to store true if any command of the
+            batch was queued
+
+    @retval EOK the batch was queued
+    @retval EINVAL the batch is empty or has too many commands
+    @retval error as returned by SubmitJob
 
 ==============================================================================*/
-static int ProcessMessage(IOTExecState *pState)
+static int SubmitBatch( IOTExecState *pState, Job *pJob, bool *pQueued )
 {
     int result = EINVAL;
-    char *pHeader;
-    char *pBody;
-    size_t headerLength = 0;
-    size_t bodyLength = 0;
-    char rxMsgId[64];
-    const char *msgId = NULL;
-    int rc;
+    bool parallel;
+    Job *pStep;
+    Job *pNext;
 
-    if ( pState != NULL )
+    parallel = JOB_IsTrue( pJob, JOB_PROPERTY_PARALLEL );
+    pStep = JOB_SplitBatch( pJob );
+    JOB_Free( pJob );
+
+    if( ( pStep != NULL ) && ( parallel == false ) )
     {
-        /* wait for a cloud-to-device message */
-        result = IOTCLIENT_Receive( pState->hIoTClient,
-                                    &pHeader,
-                                    &pBody,
-                                    &headerLength,
-                                    &bodyLength );
+        result = SubmitJob( pState, pStep );
         if( result == EOK )
         {
-            printf("ProcessMessage!!\n");
-            printf("headerLength = %ld\n", headerLength );
-            printf("header (%ld): %.*s\n",
-                    headerLength,
-                    (int)headerLength,
-                    pHeader );
-
-            printf("body (%ld): %.*s\n",
-                    bodyLength,
-                    (int)bodyLength,
-                    pBody );
-
-            if ( pHeader != NULL )
+            *pQueued = true;
+        }
+        else
+        {
+            JOB_Free( pStep );
+        }
+    }
+    else if( pStep != NULL )
+    {
+        result = EOK;
+
+        while( pStep != NULL )
+        {
+            pNext = pStep->pNextStep;
+            pStep->pNextStep = NULL;
+
+            if( result == EOK )
             {
-                /* try to get the 'messageID' property */
-                rc = IOTCLIENT_GetProperty( pHeader,
-                                            "messageId",
-                                            rxMsgId,
-                                            sizeof( rxMsgId ) );
-                if( rc == EOK )
-                {
-                    printf("messageId = %s\n", rxMsgId );
-                    msgId = rxMsgId;
-                }
+                /* the batch was admitted with its first step */
+                pStep->admitted = *pQueued;
+                result = SubmitJob( pState, pStep );
             }
 
-            if ( ( pBody != NULL ) &&
-                 ( headerLength + bodyLength < MAX_MESSAGE_LENGTH ) )
+            if( result == EOK )
             {
-                /* NUL terminate the message body */
-                pBody[bodyLength] = '\0';
-
-                /* process received message as a command */
-                result = ProcessCommand( pState, pBody, msgId );
+                *pQueued = true;
             }
             else
             {
-                result = EMSGSIZE;
+                /* the step was not queued */
+                JOB_Free( pStep );
             }
+
+            pStep = pNext;
         }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  ExecuteJob                                                                */
+/*!
+    Execute a received command job
+
+    The ExecuteJob function is invoked by an executor worker to
+    process a job taken from the worker pool's job queue.
+
+    @param[in]
+        hIoTClient
+            handle to the worker's iotclient connection
+
+    @param[in]
+        pJob
+            pointer to the job to execute
+
+    @param[out]
+        ppResume
+            pointer to the location to store the job to execute next,
+            or NULL if there is none
+
+    @param[in]
+        arg
+            pointer to the IOTExecState
+
+    @retval EINVAL invalid arguments
+    @retval error as returned from ProcessCommand
+
+==============================================================================*/
+static int ExecuteJob( IOTCLIENT_HANDLE hIoTClient,
+                       Job *pJob,
+                       Job **ppResume,
+                       void *arg )
+{
+    IOTExecState *pState = (IOTExecState *)arg;
+    int result = EINVAL;
 
-        if( pState->verbose && ( result != EOK ) )
+    if( ( pState != NULL ) &&
+        ( pJob != NULL ) )
+    {
+        result = ProcessCommand( pState, hIoTClient, pJob, ppResume );
+        if( VERBOSE( pState->verbose ) &&
+            ( result != EOK ) &&
+            ( result != EINPROGRESS ) )
         {
-            fprintf(stderr, "ProcessMessage: %s\n", strerror(result));
+            fprintf(stderr, "ProcessCommand: %s\n", strerror(result));
         }
     }
 
@@ -280,85 +1632,73 @@ static int ProcessMessage(IOTExecState *pState)
     Process a command and stream the output as a device-to-cloud stream
 
     The ProcessCommand function executes the specified command using
-    popen, and streams the commands output to the cloud as a device-to-cloud
-    message via the IOTCLIENT_Stream function.
+    the selected launcher backend, and streams the commands output to the
+    cloud as a device-to-cloud message via the RESPONSE_Stream function,
+    or via the output coalescing buffer if output coalescing or
+    compression is used.  The command is killed if it exceeds its
+    timeout or output limit.
+
+    A session command whose session is busy is left waiting in the
+    session.  When a session command completes, the next job waiting
+    for the session, or the next step of a sequential batch, is
+    returned to the caller to be executed next.  The job is not freed.
 
     @param[in]
         pState
             pointer to the IOTExecState
 
     @param[in]
-        cmd
-            pointer to the NUL terminated command to execute
+        hIoTClient
+            handle to the iotclient connection used to send the response
+
+    @param[in]
+        pJob
+            pointer to the job containing the command to execute
+
+    @param[out]
+        ppResume
+            pointer to the location to store the job to execute next,
+            or NULL if there is none
 
     @retval EINVAL invalid arguments
     @retval EOK the command was executed and the results streamed successfully
+    @retval EINPROGRESS the job is waiting for its session, which owns it
     @retval ENOTSUP the command could not be executed
-    @retval EBADF could not get the command output file descriptor
-    @retval error as returned from IOTCLIENT_Stream
+    @retval error as returned from EXEC_Run or EXEC_Finish
 
 ==============================================================================*/
 static int ProcessCommand( IOTExecState *pState,
-                           const char *cmd,
-                           const char *msgId )
+                           IOTCLIENT_HANDLE hIoTClient,
+                           Job *pJob,
+                           Job **ppResume )
 {
     int result = EINVAL;
-    FILE *fp;
-    char buf[BUFSIZ];
-    const char *headers = "source:exec\nmessagetype:cmdresp";
-    int fd;
-    size_t n;
+    Exec exec;
+    int rc;
 
     if( ( pState != NULL ) &&
-        ( cmd != NULL ) )
+        ( hIoTClient != NULL ) &&
+        ( pJob != NULL ) &&
+        ( ppResume != NULL ) )
     {
-        if( pState->verbose )
-        {
-            fprintf(stdout, "Processing Command: %s\n", cmd );
-        }
-
-        if( msgId != NULL )
-        {
-            if( pState->verbose )
-            {
-                fprintf(stdout, "MessageID: %s\n", msgId );
-            }
-
-            /* handle correlation idenfifier */
-            /* messsageId -> correlationId */
-            n = snprintf( buf,
-                          BUFSIZ,
-                          "%s\ncorrelationId:%s\n",
-                          headers,
-                          msgId);
-            if( ( n > 0 ) && ( n < BUFSIZ ) )
-            {
-                /* update the headers to include the correlation Id */
-                headers = buf;
-            }
-        }
+        *ppResume = NULL;
 
         /* execute the command */
-        fp = popen( cmd, "r" );
-        if ( fp != NULL )
+        result = EXEC_Start( &exec, hIoTClient, pJob, &pState->execOptions );
+        if( result != EINPROGRESS )
         {
-            /* get the file descriptor for the commands stdout */
-            fd = fileno( fp );
-            if ( fd != -1 )
+            if( result == EOK )
             {
-                result = IOTCLIENT_Stream( pState->hIoTClient, headers, fd );
+                result = EXEC_Run( &exec );
             }
-            else
+
+            rc = EXEC_Finish( &exec );
+            if( result == EOK )
             {
-                result = EBADF;
+                result = rc;
             }
 
-            /* close the command output stream */
-            pclose( fp );
-        }
-        else
-        {
-            result = ENOTSUP;
+            *ppResume = exec.pResume;
         }
     }
 
@@ -385,10 +1725,121 @@ static void usage( char *cmdname )
     if( cmdname != NULL )
     {
         fprintf(stderr,
-                "usage: %s [-v] [-h]\n"
+                "usage: %s [-v] [-h] [-e] [-b] [-E] [-w workers] [-l launcher] "
+                "[-B batchsize] [-F flushms] [-Z compressmin]\n"
+                "       [-D directbytes] [-P pipesize] [-T timeout] "
+                "[-M maxbytes]\n"
+                "       [-R reserved] [-c cachefile] [-W window] "
+                "[-S sessions] [-I idle]\n"
+                "       [-m msgsize] [-q depth] [-L maxcommand] "
+                "[-U metricsock]\n"
+                "       [-a queuebytes] [-s spilldir] [-X classfile] "
+                "[-G cgroupdir]\n"
+                "       [-n subscriptions] [-r rate] [-d drain] "
+                "[-t templatefile] [-x]\n"
+                "       [-K spooldir] [-k spoolbytes] [-C chunksize] "
+                "[-A pressure] [-O maxload]\n"
+                "       [-u userrate] [-N burst] [-g receiverfile]\n"
                 " [-h] : display this help\n"
-                " [-v] : verbose output\n",
-                cmdname );
+                " [-v] : verbose output\n"
+                " [-e] : use the single threaded event driven reactor\n"
+                " [-b] : execute cat and uptime with in-process builtins\n"
+                " [-E] : forward command stderr as a separate stream\n"
+                " [-w] : number of executor workers, or concurrent "
+                "commands with -e (default %d)\n"
+                " [-R] : workers reserved for normal and high priority "
+                "commands (default %d)\n"
+                " [-l] : command launcher: spawn, shell, popen "
+                "(default spawn)\n"
+                " [-B] : coalesce output into messages of up to batchsize "
+                "bytes\n"
+                " [-F] : coalesced output flush deadline in ms "
+                "(default %d)\n"
+                " [-Z] : minimum output size for compressed responses "
+                "(default %d)\n"
+                " [-D] : bypass coalescing after directbytes of output, "
+                "0 to disable (default %d)\n"
+                " [-P] : command output pipe capacity in bytes\n"
+                " [-T] : default command timeout in seconds, "
+                "0 for none (default 0)\n"
+                " [-M] : default command output limit in bytes, "
+                "0 for none (default 0)\n"
+                " [-c] : cache the output of the commands listed "
+                "in cachefile\n"
+                " [-W] : discard repeated messageIds received within "
+                "window seconds,\n"
+                "        0 to disable (default %d)\n"
+                " [-S] : maximum number of warm shell sessions, "
+                "0 to disable (default %d)\n"
+                " [-I] : evict shell sessions idle for idle seconds, "
+                "0 for never (default %d)\n"
+                " [-m] : maximum received message size in bytes "
+                "(default %d)\n"
+                " [-q] : maximum pending messages and queued commands "
+                "(default %d)\n"
+                " [-L] : maximum reassembled multi-part command size "
+                "in bytes (default %d)\n"
+                " [-U] : serve metrics on the Unix socket metricsock\n"
+                " [-a] : send responses from a queue holding up to "
+                "queuebytes in memory\n"
+                " [-s] : spill queued responses to spilldir when the "
+                "queue is full\n"
+                "        (implies -a %d)\n"
+                " [-X] : execute commands in the classes defined "
+                "in classfile\n"
+                " [-G] : isolate the classes with cgroups created "
+                "in cgroupdir\n"
+                " [-n] : maximum number of running subscriptions, "
+                "0 to disable (default %d)\n"
+                " [-r] : maximum output messages per second of a "
+                "subscription,\n"
+                "        0 for no limit (default %d)\n"
+                " [-d] : seconds allowed for running commands to complete "
+                "on termination\n"
+                "        (default %d)\n"
+                " [-t] : execute the command templates defined "
+                "in templatefile\n"
+                " [-x] : only execute template commands\n"
+                " [-K] : spool chunked responses in spooldir so their "
+                "chunks can be resent\n"
+                " [-k] : disk bound of the response spool in bytes "
+                "(default %d)\n"
+                " [-C] : size of the chunks of chunked responses "
+                "(default %d)\n"
+                " [-A] : adapt the concurrency to the load, reducing it "
+                "above pressure %%\n"
+                "        CPU or memory stall time\n"
+                " [-O] : load average per CPU above which the adaptive "
+                "concurrency\n"
+                "        is reduced (default %.1f)\n"
+                " [-u] : maximum commands per second of each userId or "
+                "source,\n"
+                "        0 for no limit (default 0)\n"
+                " [-N] : commands an idle userId or source may send at "
+                "once (default %d)\n"
+                " [-g] : receive commands for the targets defined in "
+                "receiverfile\n"
+                "        (default " DEFAULT_TARGET ")\n",
+                cmdname,
+                DEFAULT_WORKERS,
+                DEFAULT_RESERVED,
+                DEFAULT_FLUSH_MS,
+                DEFAULT_COMPRESS_MIN,
+                DEFAULT_DIRECT_THRESHOLD,
+                DEFAULT_DEDUP_WINDOW,
+                DEFAULT_SESSIONS,
+                DEFAULT_SESSION_IDLE,
+                DEFAULT_MESSAGE_LENGTH,
+                DEFAULT_PENDING_MESSAGES,
+                DEFAULT_COMMAND_LENGTH,
+                DEFAULT_OUTBOX_BYTES,
+                DEFAULT_SUBSCRIPTIONS,
+                DEFAULT_SUBSCRIPTION_RATE,
+                DEFAULT_DRAIN_TIMEOUT,
+                DEFAULT_SPOOL_BYTES,
+                DEFAULT_CHUNK_SIZE,
+                DEFAULT_MAX_LOAD,
+                DEFAULT_BURST );
     }
 }
 
@@ -420,7 +1871,7 @@ static int ProcessOptions( int argC, char *argV[], IOTExecState *pState )
 {
     int c;
     int result = EINVAL;
-    const char *options = "hv";
+    const char *options = "hvebEw:R:l:B:F:Z:D:P:T:M:c:W:S:I:m:q:L:U:a:s:X:G:n:r:d:t:xK:k:C:A:O:u:N:g:";
 
     if( ( pState != NULL ) &&
         ( argV != NULL ) )
@@ -433,6 +1884,234 @@ static int ProcessOptions( int argC, char *argV[], IOTExecState *pState )
                     pState->verbose = true;
                     break;
 
+                case 'e':
+                    pState->useReactor = true;
+                    break;
+
+                case 'b':
+                    pState->execOptions.builtins = true;
+                    break;
+
+                case 'E':
+                    LAUNCHER_SetStderr( true );
+                    break;
+
+                case 'w':
+                    pState->numWorkers = strtoul( optarg, NULL, 0 );
+                    if( ( pState->numWorkers == 0 ) ||
+                        ( pState->numWorkers > MAX_WORKERS ) )
+                    {
+                        fprintf( stderr,
+                                 "workers must be between 1 and %d\n",
+                                 MAX_WORKERS );
+                        pState->numWorkers = DEFAULT_WORKERS;
+                    }
+                    break;
+
+                case 'R':
+                    pState->reserved = strtoul( optarg, NULL, 0 );
+                    break;
+
+                case 'l':
+                    if( LAUNCHER_ParseBackend( optarg,
+                                    &pState->execOptions.backend ) != EOK )
+                    {
+                        fprintf( stderr, "unknown launcher: %s\n", optarg );
+                    }
+                    break;
+
+                case 'B':
+                    pState->execOptions.response.batchSize =
+                                            strtoul( optarg, NULL, 0 );
+                    break;
+
+                case 'F':
+                    pState->execOptions.response.flushMs =
+                                            strtoul( optarg, NULL, 0 );
+                    break;
+
+                case 'Z':
+                    pState->execOptions.response.compressMin =
+                                            strtoul( optarg, NULL, 0 );
+                    break;
+
+                case 'D':
+                    pState->execOptions.response.directThreshold =
+                                            strtoul( optarg, NULL, 0 );
+                    break;
+
+                case 'P':
+                    LAUNCHER_SetPipeSize( atoi( optarg ) );
+                    break;
+
+                case 'T':
+                    pState->execOptions.timeout = strtoul( optarg, NULL, 0 );
+                    break;
+
+                case 'M':
+                    pState->execOptions.maxOutputBytes = strtoul( optarg,
+                                                                  NULL,
+                                                                  0 );
+                    break;
+
+                case 'W':
+                    pState->dedupWindow = strtoul( optarg, NULL, 0 );
+                    break;
+
+                case 'S':
+                    pState->maxSessions = strtoul( optarg, NULL, 0 );
+                    break;
+
+                case 'I':
+                    pState->sessionIdle = strtoul( optarg, NULL, 0 );
+                    break;
+
+                case 'm':
+                    pState->maxMessageLength = strtoul( optarg, NULL, 0 );
+                    if( pState->maxMessageLength == 0 )
+                    {
+                        pState->maxMessageLength = DEFAULT_MESSAGE_LENGTH;
+                    }
+                    break;
+
+                case 'q':
+                    pState->maxPending = strtoul( optarg, NULL, 0 );
+                    if( pState->maxPending == 0 )
+                    {
+                        pState->maxPending = DEFAULT_PENDING_MESSAGES;
+                    }
+                    break;
+
+                case 'L':
+                    pState->maxCommandLength = strtoul( optarg, NULL, 0 );
+                    if( pState->maxCommandLength == 0 )
+                    {
+                        pState->maxCommandLength = DEFAULT_COMMAND_LENGTH;
+                    }
+                    break;
+
+                case 'U':
+                    pState->metricsPath = optarg;
+                    break;
+
+                case 'a':
+                    pState->outboxBytes = strtoul( optarg, NULL, 0 );
+                    break;
+
+                case 's':
+                    pState->spillDir = optarg;
+                    break;
+
+                case 'c':
+                    if( CACHE_Load( &pState->cache, optarg ) == EOK )
+                    {
+                        pState->execOptions.pCache = &pState->cache;
+                    }
+                    else
+                    {
+                        fprintf( stderr,
+                                 "cannot load cache file: %s\n",
+                                 optarg );
+                    }
+                    break;
+
+                case 'X':
+                    result = CLASS_Load( &pState->classes, optarg );
+                    if( result == EOK )
+                    {
+                        pState->execOptions.pClasses = &pState->classes;
+                    }
+                    else
+                    {
+                        fprintf( stderr,
+                                 "cannot load class file: %s: %s\n",
+                                 optarg,
+                                 strerror( result ) );
+                    }
+                    break;
+
+                case 'G':
+                    pState->cgroupDir = optarg;
+                    break;
+
+                case 't':
+                    result = TEMPLATE_Load( &pState->templates, optarg );
+                    if( result == EOK )
+                    {
+                        pState->execOptions.pTemplates = &pState->templates;
+                    }
+                    else
+                    {
+                        fprintf( stderr,
+                                 "cannot load template file: %s: %s\n",
+                                 optarg,
+                                 strerror( result ) );
+                    }
+                    break;
+
+                case 'x':
+                    pState->execOptions.templatesOnly = true;
+                    break;
+
+                case 'K':
+                    pState->spoolDir = optarg;
+                    break;
+
+                case 'A':
+                    pState->maxPressure = strtod( optarg, NULL );
+                    break;
+
+                case 'u':
+                    pState->rate = strtod( optarg, NULL );
+                    break;
+
+                case 'g':
+                    pState->receiverFile = optarg;
+                    break;
+
+                case 'N':
+                    pState->burst = strtod( optarg, NULL );
+                    if( pState->burst < 1.0 )
+                    {
+                        pState->burst = DEFAULT_BURST;
+                    }
+                    break;
+
+                case 'O':
+                    pState->maxLoad = strtod( optarg, NULL );
+                    if( pState->maxLoad <= 0.0 )
+                    {
+                        pState->maxLoad = DEFAULT_MAX_LOAD;
+                    }
+                    break;
+
+                case 'k':
+                    pState->spoolBytes = strtoul( optarg, NULL, 0 );
+                    break;
+
+                case 'C':
+                    pState->execOptions.response.chunkSize =
+                        strtoul( optarg, NULL, 0 );
+                    if( pState->execOptions.response.chunkSize == 0 )
+                    {
+                        pState->execOptions.response.chunkSize =
+                            DEFAULT_CHUNK_SIZE;
+                    }
+                    break;
+
+                case 'n':
+                    pState->maxSubscriptions = strtoul( optarg, NULL, 0 );
+                    break;
+
+                case 'r':
+                    pState->execOptions.subscriptionRate =
+                        strtoul( optarg, NULL, 0 );
+                    break;
+
+                case 'd':
+                    pState->drainTimeout = strtoul( optarg, NULL, 0 );
+                    break;
+
                 case 'h':
                     usage( argV[0] );
                     break;
@@ -450,16 +2129,23 @@ static int ProcessOptions( int argC, char *argV[], IOTExecState *pState )
 /*============================================================================*/
 /*  SetupTerminationHandler                                                   */
 /*!
-    Set up an abnormal termination handler
+    Set up a graceful termination handler
 
-    The SetupTerminationHandler function registers a termination handler
-    function with the kernel in case of an abnormal termination of this
-    process.
+    The SetupTerminationHandler function starts the thread which drains
+    the service when it is terminated, and registers a termination
+    handler function with the kernel to wake it.
 
 ==============================================================================*/
 static void SetupTerminationHandler( void )
 {
     static struct sigaction sigact;
+    pthread_t thread;
+
+    sem_init( &state.terminate, 0, 0 );
+    if( pthread_create( &thread, NULL, TerminationThread, &state ) == EOK )
+    {
+        pthread_detach( thread );
+    }
 
     memset( &sigact, 0, sizeof(sigact) );
 
@@ -473,16 +2159,16 @@ static void SetupTerminationHandler( void )
 /*============================================================================*/
 /*  TerminationHandler                                                        */
 /*!
-    Abnormal termination handler
+    Termination handler
 
-    The TerminationHandler function will be invoked in case of an abnormal
-    termination of this process.  The termination handler closes
-    the connection with the variable server and cleans up its VARFP shared
-    memory.
+    The TerminationHandler function will be invoked when this process is
+    asked to terminate.  The first signal wakes the termination thread
+    to drain the service.  A second signal terminates the process
+    immediately.
 
 @param[in]
     signum
-        The signal which caused the abnormal termination (unused)
+        The signal which caused the termination (unused)
 
 @param[in]
     info
@@ -495,10 +2181,69 @@ static void SetupTerminationHandler( void )
 ==============================================================================*/
 static void TerminationHandler( int signum, siginfo_t *info, void *ptr )
 {
-    syslog( LOG_ERR, "Abnormal termination of iotexec\n" );
-    IOTCLIENT_Close( state.hIoTClient );
+    static volatile sig_atomic_t terminating = 0;
+
+    if( terminating )
+    {
+        _exit( 1 );
+    }
+
+    terminating = 1;
+    sem_post( &state.terminate );
+}
+
+/*============================================================================*/
+/*  TerminationThread                                                         */
+/*!
+    Drain the service when it is terminated
+
+    The TerminationThread function waits for the termination handler,
+    and then stops launching commands and waits up to the drain timeout
+    for the running commands to complete.  Commands still running are
+    killed, and their responses end with a terminated:shutdown header.
+    Once the responses have been sent the connection with the IoT
+    client is closed and the process exits.  Commands which are still
+    queued are not executed.
+
+    @param[in]
+        arg
+            pointer to the IOTExecState
+
+    @retval NULL
+
+==============================================================================*/
+static void *TerminationThread( void *arg )
+{
+    IOTExecState *pState = (IOTExecState *)arg;
+    int result;
+
+    while( sem_wait( &pState->terminate ) != EOK )
+    {
+        /* interrupted */
+    }
+
+    syslog( LOG_INFO, "Draining iotexec\n" );
+
+    result = INFLIGHT_Drain( &pState->inflight, pState->drainTimeout * 1000 );
+    if( result == ETIMEDOUT )
+    {
+        syslog( LOG_WARNING, "Killing commands still running\n" );
+        INFLIGHT_KillAll( &pState->inflight );
+        INFLIGHT_Drain( &pState->inflight, DRAIN_KILL_MS );
+    }
+
+    if( pState->execOptions.response.pOutbox != NULL )
+    {
+        OUTBOX_Flush( pState->execOptions.response.pOutbox, DRAIN_FLUSH_MS );
+    }
+
+    syslog( LOG_INFO, "Termination of iotexec\n" );
+    RECEIVER_Close( &pState->receivers );
+    IOTCLIENT_Close( pState->hIoTClient );
+
+    exit( ( result == EOK ) ? 0 : 1 );
 
-    exit( 1 );
+    return NULL;
 }
 
 /*! @}
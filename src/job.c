@@ -0,0 +1,675 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup job job
+ * @brief Received command job storage
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file job.c
+
+    Received command job storage
+
+    The job module takes a private copy of a received cloud-to-device
+    message so it can outlive the iotclient receive buffer while it
+    waits for, and is processed by, an executor.
+
+    The message header is parsed once, when the job is created, into a
+    fixed table locating the value of each header property which
+    iotexec uses, so the properties can be read without scanning the
+    header again.
+
+    Each job has a scheduling priority, taken from the priority header
+    of the received message, which determines the order in which
+    queued jobs are executed.  A job also records the receiver target
+    its message was received for.
+
+    A job may have followers: identical jobs received while it was
+    waiting to execute, which receive a copy of its response instead of
+    executing the command again.
+
+    A batch message contains one command per line.  It is split into
+    a job for each command (a step), which are executed one after the
+    other, or in parallel.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "job.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+#ifndef EOK
+/*! success response */
+#define EOK 0
+#endif
+
+/*==============================================================================
+        Private file scoped variables
+==============================================================================*/
+
+/*! header names of the properties, indexed by JobProperty */
+static const char *propertyNames[JOB_PROPERTIES] =
+{
+    "messageId",
+    "priority",
+    "session",
+    "timeout",
+    "maxOutputBytes",
+    "acceptEncoding",
+    "class",
+    "subscribe",
+    "rate",
+    "batch",
+    "parallel",
+    "stdin",
+    "input",
+    "eof",
+    "part",
+    "parts",
+    "cancel",
+    "status",
+    "list",
+    "template",
+    "chunked",
+    "resend",
+    "chunks",
+    "userId",
+    "source"
+};
+
+/*! request headers which affect the response to a command */
+static const JobProperty responseHeaders[] =
+{
+    JOB_PROPERTY_ACCEPT_ENCODING,
+    JOB_PROPERTY_TIMEOUT,
+    JOB_PROPERTY_MAX_OUTPUT_BYTES,
+    JOB_PROPERTY_CLASS,
+    JOB_PROPERTY_SUBSCRIBE,
+    JOB_PROPERTY_RATE,
+    JOB_PROPERTY_TEMPLATE
+};
+
+/*! priority header values, indexed by JobPriority */
+static const char *priorityNames[JOB_PRIORITY_LEVELS] =
+{
+    "high",
+    "normal",
+    "low"
+};
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static void ParseHeader( Job *pJob );
+static bool SameValue( Job *pJob, Job *pOther, JobProperty property );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  JOB_New                                                                   */
+/*!
+    Create a new job from a received message
+
+    The JOB_New function allocates a job and copies the received message
+    header and body into it.  Both the header and the body are NUL
+    terminated in the job's storage, and the header properties are
+    parsed.  The job is given normal priority, belongs to the first
+    receiver target, has no stdin upload pipe, and is not counted
+    against its originator by a job queue.
+
+    @param[in]
+        pHeader
+            pointer to the received message header (may be NULL)
+
+    @param[in]
+        headerLength
+            length of the received message header
+
+    @param[in]
+        pBody
+            pointer to the received message body (may be NULL)
+
+    @param[in]
+        bodyLength
+            length of the received message body
+
+    @retval pointer to the new job
+    @retval NULL if the job could not be allocated
+
+==============================================================================*/
+Job *JOB_New( const char *pHeader,
+              size_t headerLength,
+              const char *pBody,
+              size_t bodyLength )
+{
+    Job *pJob;
+
+    if( pHeader == NULL )
+    {
+        headerLength = 0;
+    }
+
+    if( pBody == NULL )
+    {
+        bodyLength = 0;
+    }
+
+    pJob = calloc( 1, sizeof( Job ) + headerLength + bodyLength + 2 );
+    if( pJob != NULL )
+    {
+        pJob->priority = JOB_PRIORITY_NORMAL;
+        pJob->originatorEntry = -1;
+        pJob->fdIn = -1;
+        pJob->pHeader = pJob->data;
+        pJob->headerLength = headerLength;
+        if( headerLength > 0 )
+        {
+            memcpy( pJob->pHeader, pHeader, headerLength );
+        }
+        pJob->pHeader[headerLength] = '\0';
+        ParseHeader( pJob );
+
+        pJob->pBody = &pJob->data[headerLength + 1];
+        pJob->bodyLength = bodyLength;
+        if( bodyLength > 0 )
+        {
+            memcpy( pJob->pBody, pBody, bodyLength );
+        }
+        pJob->pBody[bodyLength] = '\0';
+    }
+
+    return pJob;
+}
+
+/*============================================================================*/
+/*  JOB_Free                                                                  */
+/*!
+    Release a job
+
+    The JOB_Free function releases the storage associated with a job,
+    any followers of the job, and any remaining steps of its batch.
+    The read end of a stdin upload pipe which was not handed to the
+    command is closed, so the uploader sees the command is gone.
+
+    @param[in]
+        pJob
+            pointer to the job to release
+
+==============================================================================*/
+void JOB_Free( Job *pJob )
+{
+    Job *pFollower;
+    Job *pNextStep;
+
+    while( pJob != NULL )
+    {
+        while( ( pFollower = pJob->pFollowers ) != NULL )
+        {
+            pJob->pFollowers = pFollower->pNext;
+            free( pFollower );
+        }
+
+        if( pJob->fdIn != -1 )
+        {
+            close( pJob->fdIn );
+        }
+
+        pNextStep = pJob->pNextStep;
+        free( pJob );
+        pJob = pNextStep;
+    }
+}
+
+/*============================================================================*/
+/*  JOB_GetProperty                                                           */
+/*!
+    Get the value of a header property of a job
+
+    @param[in]
+        pJob
+            pointer to the job
+
+    @param[in]
+        property
+            the property to get
+
+    @param[out]
+        pBuf
+            pointer to a buffer to receive the NUL terminated value
+
+    @param[in]
+        size
+            size of the buffer
+
+    @retval EOK the value was copied into the buffer
+    @retval ENOENT the property is not in the message header
+    @retval E2BIG the value does not fit in the buffer
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int JOB_GetProperty( Job *pJob,
+                     JobProperty property,
+                     char *pBuf,
+                     size_t size )
+{
+    int result = EINVAL;
+    JobValue *pValue;
+
+    if( ( pJob != NULL ) &&
+        ( property < JOB_PROPERTIES ) &&
+        ( pBuf != NULL ) &&
+        ( size > 0 ) )
+    {
+        pValue = &pJob->properties[property];
+        if( pValue->offset == JOB_PROPERTY_ABSENT )
+        {
+            result = ENOENT;
+        }
+        else if( pValue->length >= size )
+        {
+            result = E2BIG;
+        }
+        else
+        {
+            memcpy( pBuf, &pJob->pHeader[pValue->offset], pValue->length );
+            pBuf[pValue->length] = '\0';
+            result = EOK;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  JOB_IsTrue                                                                */
+/*!
+    Determine if a boolean header property of a job is set
+
+    @param[in]
+        pJob
+            pointer to the job
+
+    @param[in]
+        property
+            the property to check
+
+    @retval true the property value is true
+    @retval false the property is absent or not true
+
+==============================================================================*/
+bool JOB_IsTrue( Job *pJob, JobProperty property )
+{
+    bool result = false;
+    JobValue *pValue;
+
+    if( ( pJob != NULL ) &&
+        ( property < JOB_PROPERTIES ) )
+    {
+        pValue = &pJob->properties[property];
+        result = ( pValue->offset != JOB_PROPERTY_ABSENT ) &&
+                 ( pValue->length == 4 ) &&
+                 ( memcmp( &pJob->pHeader[pValue->offset], "true", 4 ) == 0 );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  JOB_HasProperty                                                           */
+/*!
+    Determine if a job's message has a header property
+
+    @param[in]
+        pJob
+            pointer to the job
+
+    @param[in]
+        property
+            the property to check
+
+    @retval true the message has the property
+    @retval false the property is absent
+
+==============================================================================*/
+bool JOB_HasProperty( Job *pJob, JobProperty property )
+{
+    return ( pJob != NULL ) &&
+           ( property < JOB_PROPERTIES ) &&
+           ( pJob->properties[property].offset != JOB_PROPERTY_ABSENT );
+}
+
+/*============================================================================*/
+/*  JOB_ParsePriority                                                         */
+/*!
+    Parse a job priority name
+
+    The JOB_ParsePriority function converts a priority header value
+    (high, normal, or low) to a JobPriority.
+
+    @param[in]
+        name
+            pointer to the priority name
+
+    @param[out]
+        pPriority
+            pointer to the location to store the priority
+
+    @retval EOK the priority was parsed
+    @retval ENOENT unknown priority name
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int JOB_ParsePriority( const char *name, JobPriority *pPriority )
+{
+    int result = EINVAL;
+    int i;
+
+    if( ( name != NULL ) &&
+        ( pPriority != NULL ) )
+    {
+        result = ENOENT;
+
+        for( i = 0; i < JOB_PRIORITY_LEVELS; i++ )
+        {
+            if( strcmp( name, priorityNames[i] ) == 0 )
+            {
+                *pPriority = (JobPriority)i;
+                result = EOK;
+                break;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  JOB_IsSame                                                                */
+/*!
+    Determine if two jobs would produce the same response
+
+    The JOB_IsSame function compares the commands of two jobs, their
+    receiver targets, whose defaults may differ, and the request headers
+    which affect the response.  Commands executed in a
+    shell session are never the same, since each may change the state
+    of the session, and nor are batch steps, commands which read an
+    uploaded stdin, or chunked commands, whose chunks are spooled under
+    the messageId of their own request.
+
+    @param[in]
+        pJob
+            pointer to the first job
+
+    @param[in]
+        pOther
+            pointer to the second job
+
+    @retval true the jobs are identical
+    @retval false the jobs are different
+
+==============================================================================*/
+bool JOB_IsSame( Job *pJob, Job *pOther )
+{
+    bool same = false;
+    size_t i;
+
+    if( ( pJob != NULL ) &&
+        ( pOther != NULL ) &&
+        ( pJob->target == pOther->target ) &&
+        ( pJob->session[0] == '\0' ) &&
+        ( pOther->session[0] == '\0' ) &&
+        ( pJob->step == 0 ) &&
+        ( pOther->step == 0 ) &&
+        ( pJob->fdIn == -1 ) &&
+        ( pOther->fdIn == -1 ) &&
+        ( JOB_IsTrue( pJob, JOB_PROPERTY_CHUNKED ) == false ) &&
+        ( JOB_IsTrue( pOther, JOB_PROPERTY_CHUNKED ) == false ) &&
+        ( pJob->bodyLength == pOther->bodyLength ) &&
+        ( memcmp( pJob->pBody, pOther->pBody, pJob->bodyLength ) == 0 ) )
+    {
+        same = true;
+
+        for( i = 0;
+             ( same == true ) &&
+             ( i < sizeof( responseHeaders ) / sizeof( responseHeaders[0] ) );
+             i++ )
+        {
+            same = SameValue( pJob, pOther, responseHeaders[i] );
+        }
+    }
+
+    return same;
+}
+
+/*============================================================================*/
+/*  JOB_SplitBatch                                                            */
+/*!
+    Split a batch job into a job for each of its commands
+
+    The JOB_SplitBatch function creates a step job for each non-empty
+    line of the batch job's body.  Each step has the header, message
+    identifier, priority and session of the batch job, and its position
+    in the batch.  The steps are linked in order through pNextStep.
+    The batch job itself is not modified.
+
+    @param[in]
+        pJob
+            pointer to the batch job
+
+    @retval pointer to the first step of the batch
+    @retval NULL the batch is empty, has more than MAX_BATCH_STEPS
+            commands, or a step could not be allocated
+
+==============================================================================*/
+Job *JOB_SplitBatch( Job *pJob )
+{
+    Job *pFirst = NULL;
+    Job **ppLast = &pFirst;
+    Job *pStep;
+    unsigned int step = 0;
+    bool ok = true;
+    char *p;
+    size_t length;
+
+    if( pJob != NULL )
+    {
+        p = pJob->pBody;
+
+        while( ( ok == true ) && ( *p != '\0' ) )
+        {
+            length = strcspn( p, "\n" );
+            if( ( length > 0 ) && ( p[length - 1] == '\r' ) )
+            {
+                length--;
+            }
+
+            if( length > 0 )
+            {
+                pStep = ( step < MAX_BATCH_STEPS )
+                            ? JOB_New( pJob->pHeader,
+                                       pJob->headerLength,
+                                       p,
+                                       length )
+                            : NULL;
+                if( pStep != NULL )
+                {
+                    memcpy( pStep->msgId, pJob->msgId, sizeof( pStep->msgId ) );
+                    memcpy( pStep->session,
+                            pJob->session,
+                            sizeof( pStep->session ) );
+                    memcpy( pStep->originator,
+                            pJob->originator,
+                            sizeof( pStep->originator ) );
+                    pStep->priority = pJob->priority;
+                    pStep->target = pJob->target;
+                    pStep->receivedUs = pJob->receivedUs;
+                    pStep->step = ++step;
+
+                    *ppLast = pStep;
+                    ppLast = &pStep->pNextStep;
+                }
+                else
+                {
+                    ok = false;
+                }
+            }
+
+            p += strcspn( p, "\n" );
+            if( *p == '\n' )
+            {
+                p++;
+            }
+        }
+
+        if( ok == false )
+        {
+            JOB_Free( pFirst );
+            pFirst = NULL;
+        }
+    }
+
+    return pFirst;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  ParseHeader                                                               */
+/*!
+    Parse the header properties of a job
+
+    The ParseHeader function makes a single pass over the name:value
+    lines of the job's message header, and records the location of the
+    value of each known property.  The first occurrence of a property
+    is used.
+
+    @param[in]
+        pJob
+            pointer to the job whose header is parsed
+
+==============================================================================*/
+static void ParseHeader( Job *pJob )
+{
+    const char *pLine = pJob->pHeader;
+    const char *pEnd = &pJob->pHeader[pJob->headerLength];
+    const char *pColon;
+    size_t lineLength;
+    size_t nameLength;
+    JobValue *pValue;
+    size_t i;
+
+    for( i = 0; i < JOB_PROPERTIES; i++ )
+    {
+        pJob->properties[i].offset = JOB_PROPERTY_ABSENT;
+        pJob->properties[i].length = 0;
+    }
+
+    while( pLine < pEnd )
+    {
+        lineLength = strcspn( pLine, "\n" );
+        pColon = memchr( pLine, ':', lineLength );
+        if( pColon != NULL )
+        {
+            nameLength = pColon - pLine;
+            for( i = 0; i < JOB_PROPERTIES; i++ )
+            {
+                pValue = &pJob->properties[i];
+                if( ( pValue->offset == JOB_PROPERTY_ABSENT ) &&
+                    ( strlen( propertyNames[i] ) == nameLength ) &&
+                    ( memcmp( propertyNames[i], pLine, nameLength ) == 0 ) )
+                {
+                    pValue->offset = ( pColon + 1 ) - pJob->pHeader;
+                    pValue->length = lineLength - nameLength - 1;
+                    break;
+                }
+            }
+        }
+
+        pLine += lineLength + 1;
+    }
+}
+
+/*============================================================================*/
+/*  SameValue                                                                 */
+/*!
+    Determine if two jobs have the same value of a header property
+
+    An absent property is the same as an empty one.
+
+    @param[in]
+        pJob
+            pointer to the first job
+
+    @param[in]
+        pOther
+            pointer to the second job
+
+    @param[in]
+        property
+            the property to compare
+
+    @retval true the values are the same
+    @retval false the values are different
+
+==============================================================================*/
+static bool SameValue( Job *pJob, Job *pOther, JobProperty property )
+{
+    JobValue *pValue = &pJob->properties[property];
+    JobValue *pOtherValue = &pOther->properties[property];
+    uint32_t length;
+    uint32_t otherLength;
+
+    length = ( pValue->offset != JOB_PROPERTY_ABSENT ) ? pValue->length : 0;
+    otherLength = ( pOtherValue->offset != JOB_PROPERTY_ABSENT )
+                    ? pOtherValue->length
+                    : 0;
+
+    return ( length == otherLength ) &&
+           ( ( length == 0 ) ||
+             ( memcmp( &pJob->pHeader[pValue->offset],
+                       &pOther->pHeader[pOtherValue->offset],
+                       length ) == 0 ) );
+}
+
+/*! @}
+ * end of job group */
@@ -0,0 +1,822 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup jobqueue jobqueue
+ * @brief Priority job queue
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file jobqueue.c
+
+    Priority job queue
+
+    The jobqueue module schedules received jobs for execution.  Jobs are
+    kept in a FIFO per priority level, and the highest priority job is
+    always executed first, so urgent commands jump ahead of queued
+    bulk work.
+
+    Low priority jobs are not allowed to occupy every execution slot:
+    a number of slots are reserved for normal and high priority jobs so
+    they can start immediately even while bulk jobs are running.
+
+    The number of concurrently executing jobs may also be limited, for
+    example by the adaptive concurrency limiter.  Normal and low priority
+    jobs wait in the queue while the limit is reached, but high priority
+    jobs are still executed, so an overloaded device remains reachable.
+
+    High priority jobs are admitted to a full queue, up to twice its
+    normal depth, so they are not held in the iotclient receiver behind
+    a backlog of lower priority jobs.
+
+    A job which is identical to a job already waiting at the same
+    priority is not queued: it becomes a follower of the waiting job
+    and shares its execution and response.
+
+    Jobs of the same priority are shared fairly between their
+    originators: the next job executed is the oldest job of the
+    originator with the fewest executing jobs, so one originator's
+    backlog does not hold back the commands of another.  Once the
+    queue is full, an originator which holds at least its fair share
+    of the queue is refused rather than waiting for a slot.  The jobs
+    of up to JOBQUEUE_MAX_ORIGINATORS originators are tracked, and
+    the jobs of further originators are scheduled as though their
+    originator had none executing.  Each job records the originator
+    entry which counts it, so a job which was not counted is never
+    subtracted from an entry created for its originator later.
+
+    Each receiver target may be given a share of the execution slots,
+    the number of its jobs which may execute at once.  The jobs of a
+    target which is using its share wait in the queue, while the jobs
+    of the other targets are executed.  Each target may also be given a
+    share of the queue, the number of its jobs which may wait, so a
+    target with a backlog does not fill the queue for the others.
+
+    The queue does not perform any locking.  Its owner must serialize
+    access to it.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "jobqueue.h"
+#include "metrics.h"
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static JobOriginator *GetOriginator( JobQueue *pQueue,
+                                     const char *name,
+                                     bool create );
+static JobOriginator *CountedOriginator( JobQueue *pQueue, int entry );
+static Job *Unlink( JobQueue *pQueue, int priority, bool shared );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  JOBQUEUE_Init                                                             */
+/*!
+    Initialize a job queue
+
+    @param[in]
+        pQueue
+            pointer to the JobQueue to initialize
+
+    @param[in]
+        maxDepth
+            maximum number of jobs which can wait in the queue
+
+    @param[in]
+        slots
+            number of jobs which can execute concurrently
+
+    @param[in]
+        reserved
+            number of execution slots reserved for normal and high
+            priority jobs.  At least one slot is always available to
+            low priority jobs.
+
+==============================================================================*/
+void JOBQUEUE_Init( JobQueue *pQueue,
+                    size_t maxDepth,
+                    size_t slots,
+                    size_t reserved )
+{
+    if( pQueue != NULL )
+    {
+        memset( pQueue, 0, sizeof( JobQueue ) );
+        pQueue->maxDepth = maxDepth;
+        pQueue->lowSlots = ( slots > reserved ) ? slots - reserved : 1;
+    }
+}
+
+/*============================================================================*/
+/*  JOBQUEUE_IsFull                                                           */
+/*!
+    Determine if the queue can accept a job
+
+    The JOBQUEUE_IsFull function determines if the queue, or the share
+    of the queue of the job's receiver target, is full.  High priority
+    jobs may use up to twice the normal depth of each.
+
+    @param[in]
+        pQueue
+            pointer to the JobQueue
+
+    @param[in]
+        pJob
+            pointer to the job to be queued
+
+    @retval true the queue cannot accept the job
+    @retval false the job can be queued
+
+==============================================================================*/
+bool JOBQUEUE_IsFull( JobQueue *pQueue, Job *pJob )
+{
+    size_t maxDepth = pQueue->maxDepth;
+    size_t targetDepth = pQueue->targetDepth[pJob->target];
+
+    if( pJob->priority == JOB_PRIORITY_HIGH )
+    {
+        maxDepth *= 2;
+        targetDepth *= 2;
+    }
+
+    return ( pQueue->depth >= maxDepth ) ||
+           ( ( targetDepth > 0 ) &&
+             ( pQueue->targetQueued[pJob->target] >= targetDepth ) );
+}
+
+/*============================================================================*/
+/*  JOBQUEUE_IsOverShare                                                      */
+/*!
+    Determine if a job must be refused to keep the queue fair
+
+    The JOBQUEUE_IsOverShare function determines if the queue is full
+    for a job, and its originator already holds at least an equal share
+    of the queue with the other originators of queued jobs.  A job from
+    the only originator of the queued jobs is never over its share, so
+    it waits for a slot as though the queue was not shared.  Nor is a
+    step of a parallel batch which has already been admitted, so a
+    batch is admitted or refused as a whole.
+
+    @param[in]
+        pQueue
+            pointer to the JobQueue
+
+    @param[in]
+        pJob
+            pointer to the job to be queued
+
+    @retval true the job must be refused
+    @retval false the job may wait for a slot in the queue
+
+==============================================================================*/
+bool JOBQUEUE_IsOverShare( JobQueue *pQueue, Job *pJob )
+{
+    bool over = false;
+    JobOriginator *pOriginator;
+    size_t active = 0;
+    size_t i;
+
+    pOriginator = ( pJob->admitted == false )
+                    ? GetOriginator( pQueue, pJob->originator, false )
+                    : NULL;
+    if( ( pOriginator != NULL ) &&
+        ( pOriginator->queued > 0 ) &&
+        ( JOBQUEUE_IsFull( pQueue, pJob ) ) )
+    {
+        for( i = 0; i < JOBQUEUE_MAX_ORIGINATORS; i++ )
+        {
+            if( pQueue->originators[i].queued > 0 )
+            {
+                active++;
+            }
+        }
+
+        over = ( active > 1 ) &&
+               ( pOriginator->queued * active >= pQueue->depth );
+    }
+
+    return over;
+}
+
+/*============================================================================*/
+/*  JOBQUEUE_Put                                                              */
+/*!
+    Add a job to the tail of the queue for its priority
+
+    The JOBQUEUE_Put function adds a job to the queue, or attaches it as
+    a follower of an identical waiting job.  Only jobs with a message
+    identifier can follow another job, since the response to a follower
+    is identified by its correlationId.
+
+    @param[in]
+        pQueue
+            pointer to the JobQueue
+
+    @param[in]
+        pJob
+            pointer to the job to queue
+
+    @retval true the job is following an identical waiting job
+    @retval false the job was added to the queue
+
+==============================================================================*/
+bool JOBQUEUE_Put( JobQueue *pQueue, Job *pJob )
+{
+    JobPriority priority = pJob->priority;
+    bool joined = false;
+    Job *pWaiting;
+    JobOriginator *pOriginator;
+
+    if( pJob->msgId[0] != '\0' )
+    {
+        for( pWaiting = pQueue->pHead[priority];
+             ( pWaiting != NULL ) && ( joined == false );
+             pWaiting = pWaiting->pNext )
+        {
+            if( JOB_IsSame( pWaiting, pJob ) )
+            {
+                pJob->pNext = pWaiting->pFollowers;
+                pWaiting->pFollowers = pJob;
+                joined = true;
+            }
+        }
+    }
+
+    if( joined == false )
+    {
+        pJob->pNext = NULL;
+        if( pQueue->pTail[priority] != NULL )
+        {
+            pQueue->pTail[priority]->pNext = pJob;
+        }
+        else
+        {
+            pQueue->pHead[priority] = pJob;
+        }
+
+        pQueue->pTail[priority] = pJob;
+        pQueue->depth++;
+        pQueue->targetQueued[pJob->target]++;
+        METRICS_QueueDepth( pQueue->depth );
+
+        pOriginator = GetOriginator( pQueue, pJob->originator, true );
+        if( pOriginator != NULL )
+        {
+            pOriginator->queued++;
+            pJob->originatorEntry = (int)( pOriginator - pQueue->originators );
+        }
+        else
+        {
+            pJob->originatorEntry = -1;
+        }
+    }
+
+    return joined;
+}
+
+/*============================================================================*/
+/*  JOBQUEUE_Get                                                              */
+/*!
+    Take the next job to execute
+
+    The JOBQUEUE_Get function removes the highest priority job from the
+    queue and counts it as executing.  Of the jobs of that priority, the
+    oldest job of the originator with the fewest executing jobs is
+    taken, skipping the jobs of receiver targets which are using their
+    share of the execution slots.  Low priority jobs are only taken
+    while there is an execution slot available to them, and normal and
+    low priority jobs only while the concurrency limit is not reached.
+    The caller must call JOBQUEUE_Done when the job completes.
+
+    @param[in]
+        pQueue
+            pointer to the JobQueue
+
+    @retval pointer to the job removed from the queue
+    @retval NULL there is no job which can be executed
+
+==============================================================================*/
+Job *JOBQUEUE_Get( JobQueue *pQueue )
+{
+    Job *pJob = NULL;
+    size_t running = 0;
+    JobOriginator *pOriginator;
+    int priority;
+
+    for( priority = 0; priority < JOB_PRIORITY_LEVELS; priority++ )
+    {
+        running += pQueue->running[priority];
+    }
+
+    for( priority = 0; priority < JOB_PRIORITY_LEVELS; priority++ )
+    {
+        if( ( priority != JOB_PRIORITY_HIGH ) &&
+            ( pQueue->limit > 0 ) &&
+            ( running >= pQueue->limit ) )
+        {
+            /* the device is too loaded for more jobs */
+            break;
+        }
+
+        if( ( priority == JOB_PRIORITY_LOW ) &&
+            ( pQueue->running[priority] >= pQueue->lowSlots ) )
+        {
+            /* low priority jobs must yield the reserved slots */
+            break;
+        }
+
+        pJob = Unlink( pQueue, priority, true );
+        if( pJob != NULL )
+        {
+            pQueue->running[priority]++;
+            pQueue->targetRunning[pJob->target]++;
+            pOriginator = CountedOriginator( pQueue, pJob->originatorEntry );
+            if( pOriginator != NULL )
+            {
+                if( pOriginator->queued > 0 )
+                {
+                    pOriginator->queued--;
+                }
+
+                pOriginator->running++;
+            }
+
+            break;
+        }
+    }
+
+    return pJob;
+}
+
+/*============================================================================*/
+/*  JOBQUEUE_Resume                                                           */
+/*!
+    Record the execution of a job which was not taken with JOBQUEUE_Get
+
+    The JOBQUEUE_Resume function counts a job which is resumed outside
+    the queue (for example after waiting for its shell session) as
+    running, so its completion can be recorded with JOBQUEUE_Done.
+
+    @param[in]
+        pQueue
+            pointer to the JobQueue
+
+    @param[in]
+        pJob
+            pointer to the resumed job
+
+==============================================================================*/
+void JOBQUEUE_Resume( JobQueue *pQueue, Job *pJob )
+{
+    JobOriginator *pOriginator;
+
+    pQueue->running[pJob->priority]++;
+    pQueue->targetRunning[pJob->target]++;
+
+    pOriginator = GetOriginator( pQueue, pJob->originator, true );
+    if( pOriginator != NULL )
+    {
+        pOriginator->running++;
+        pJob->originatorEntry = (int)( pOriginator - pQueue->originators );
+    }
+    else
+    {
+        pJob->originatorEntry = -1;
+    }
+}
+
+/*============================================================================*/
+/*  JOBQUEUE_SetLimit                                                         */
+/*!
+    Set the concurrency limit
+
+    @param[in]
+        pQueue
+            pointer to the JobQueue
+
+    @param[in]
+        limit
+            maximum number of concurrently executing jobs before normal
+            and low priority jobs are held back, 0 for no limit
+
+    @retval true the limit was raised while jobs are waiting, so a
+            queued job may now be executable
+    @retval false the limit does not release a queued job
+
+==============================================================================*/
+bool JOBQUEUE_SetLimit( JobQueue *pQueue, size_t limit )
+{
+    bool released;
+
+    released = ( pQueue->depth > 0 ) &&
+               ( pQueue->limit > 0 ) &&
+               ( ( limit == 0 ) || ( limit > pQueue->limit ) );
+
+    pQueue->limit = limit;
+    METRICS_ConcurrencyLimit( limit );
+
+    return released;
+}
+
+/*============================================================================*/
+/*  JOBQUEUE_SetShare                                                         */
+/*!
+    Set the share of the execution slots and of the queue of a receiver
+    target
+
+    @param[in]
+        pQueue
+            pointer to the JobQueue
+
+    @param[in]
+        target
+            index of the receiver target
+
+    @param[in]
+        share
+            maximum number of concurrently executing jobs of the target,
+            0 for no limit
+
+    @param[in]
+        depth
+            maximum number of queued jobs of the target, 0 for no limit
+            other than the depth of the queue
+
+==============================================================================*/
+void JOBQUEUE_SetShare( JobQueue *pQueue,
+                        unsigned int target,
+                        size_t share,
+                        size_t depth )
+{
+    if( target < JOB_MAX_TARGETS )
+    {
+        pQueue->share[target] = share;
+        pQueue->targetDepth[target] = depth;
+    }
+}
+
+/*============================================================================*/
+/*  JOBQUEUE_Done                                                             */
+/*!
+    Record the completion of a job taken with JOBQUEUE_Get
+
+    @param[in]
+        pQueue
+            pointer to the JobQueue
+
+    @param[in]
+        pJob
+            pointer to the completed job
+
+    @retval true a queued low priority job, or a job of a target using
+            its share, may now be executable
+    @retval false the completion does not release a low priority slot
+            or a share
+
+==============================================================================*/
+bool JOBQUEUE_Done( JobQueue *pQueue, Job *pJob )
+{
+    JobSlot slot;
+
+    JOBQUEUE_GetSlot( pJob, &slot );
+
+    return JOBQUEUE_Release( pQueue, &slot );
+}
+
+/*============================================================================*/
+/*  JOBQUEUE_GetSlot                                                          */
+/*!
+    Record the execution slot of a job
+
+    The JOBQUEUE_GetSlot function records the fields of a job which are
+    needed to release its execution slot, so the slot can be released
+    with JOBQUEUE_Release after the job has been handed on (for example
+    to its shell session) and may already have been freed.
+
+    @param[in]
+        pJob
+            pointer to the job
+
+    @param[out]
+        pSlot
+            pointer to the location to store the job's execution slot
+
+==============================================================================*/
+void JOBQUEUE_GetSlot( Job *pJob, JobSlot *pSlot )
+{
+    pSlot->priority = pJob->priority;
+    pSlot->target = pJob->target;
+    pSlot->originatorEntry = pJob->originatorEntry;
+}
+
+/*============================================================================*/
+/*  JOBQUEUE_Release                                                          */
+/*!
+    Record the completion of a job from its execution slot
+
+    @param[in]
+        pQueue
+            pointer to the JobQueue
+
+    @param[in]
+        pSlot
+            pointer to the execution slot recorded by JOBQUEUE_GetSlot
+
+    @retval true a queued low priority job, or a job of a target using
+            its share, may now be executable
+    @retval false the completion does not release a low priority slot
+            or a share
+
+==============================================================================*/
+bool JOBQUEUE_Release( JobQueue *pQueue, const JobSlot *pSlot )
+{
+    bool released = false;
+    JobOriginator *pOriginator;
+
+    if( pQueue->running[pSlot->priority] > 0 )
+    {
+        pQueue->running[pSlot->priority]--;
+    }
+
+    if( pQueue->targetRunning[pSlot->target] > 0 )
+    {
+        pQueue->targetRunning[pSlot->target]--;
+    }
+
+    pOriginator = CountedOriginator( pQueue, pSlot->originatorEntry );
+    if( ( pOriginator != NULL ) && ( pOriginator->running > 0 ) )
+    {
+        pOriginator->running--;
+    }
+
+    if( pSlot->priority == JOB_PRIORITY_LOW )
+    {
+        released = ( pQueue->pHead[JOB_PRIORITY_LOW] != NULL );
+    }
+
+    if( ( pQueue->share[pSlot->target] > 0 ) && ( pQueue->depth > 0 ) )
+    {
+        released = true;
+    }
+
+    return released;
+}
+
+/*============================================================================*/
+/*  JOBQUEUE_Remove                                                           */
+/*!
+    Remove a queued job regardless of the execution slots
+
+    The JOBQUEUE_Remove function is used to drain the queue.  The job
+    is not counted as executing.
+
+    @param[in]
+        pQueue
+            pointer to the JobQueue
+
+    @retval pointer to the job removed from the queue
+    @retval NULL the queue is empty
+
+==============================================================================*/
+Job *JOBQUEUE_Remove( JobQueue *pQueue )
+{
+    Job *pJob = NULL;
+    JobOriginator *pOriginator;
+    int priority;
+
+    for( priority = 0; priority < JOB_PRIORITY_LEVELS; priority++ )
+    {
+        pJob = Unlink( pQueue, priority, false );
+        if( pJob != NULL )
+        {
+            pOriginator = CountedOriginator( pQueue, pJob->originatorEntry );
+            if( ( pOriginator != NULL ) && ( pOriginator->queued > 0 ) )
+            {
+                pOriginator->queued--;
+            }
+
+            pJob->originatorEntry = -1;
+
+            break;
+        }
+    }
+
+    return pJob;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  GetOriginator                                                             */
+/*!
+    Find the queued and executing jobs of an originator
+
+    @param[in]
+        pQueue
+            pointer to the JobQueue
+
+    @param[in]
+        name
+            pointer to the NUL terminated originator, empty if anonymous
+
+    @param[in]
+        create
+            true to start tracking the originator if it has no jobs
+
+    @retval pointer to the originator's counts
+    @retval NULL the originator has no jobs, or no more originators
+            can be tracked
+
+==============================================================================*/
+static JobOriginator *GetOriginator( JobQueue *pQueue,
+                                     const char *name,
+                                     bool create )
+{
+    JobOriginator *pOriginator = NULL;
+    JobOriginator *pUnused = NULL;
+    JobOriginator *pEntry;
+    size_t i;
+
+    for( i = 0;
+         ( i < JOBQUEUE_MAX_ORIGINATORS ) && ( pOriginator == NULL );
+         i++ )
+    {
+        pEntry = &pQueue->originators[i];
+        if( ( pEntry->queued == 0 ) && ( pEntry->running == 0 ) )
+        {
+            if( pUnused == NULL )
+            {
+                pUnused = pEntry;
+            }
+        }
+        else if( strcmp( pEntry->name, name ) == 0 )
+        {
+            pOriginator = pEntry;
+        }
+    }
+
+    if( ( pOriginator == NULL ) && ( create ) && ( pUnused != NULL ) )
+    {
+        strcpy( pUnused->name, name );
+        pOriginator = pUnused;
+    }
+
+    return pOriginator;
+}
+
+/*============================================================================*/
+/*  CountedOriginator                                                         */
+/*!
+    Get the originator entry which counts a job
+
+    @param[in]
+        pQueue
+            pointer to the JobQueue
+
+    @param[in]
+        entry
+            index of the originator entry recorded for the job, or -1
+
+    @retval pointer to the originator's counts
+    @retval NULL the job is not counted against its originator
+
+==============================================================================*/
+static JobOriginator *CountedOriginator( JobQueue *pQueue, int entry )
+{
+    return ( ( entry >= 0 ) && ( entry < JOBQUEUE_MAX_ORIGINATORS ) )
+                ? &pQueue->originators[entry]
+                : NULL;
+}
+
+/*============================================================================*/
+/*  Unlink                                                                    */
+/*!
+    Remove the next job of a priority from the queue
+
+    The Unlink function removes the oldest queued job of the originator
+    with the fewest executing jobs.
+
+    @param[in]
+        pQueue
+            pointer to the JobQueue
+
+    @param[in]
+        priority
+            priority of the job to remove
+
+    @param[in]
+        shared
+            true to skip the jobs of receiver targets which are using
+            their share of the execution slots
+
+    @retval pointer to the job removed from the queue
+    @retval NULL there is no queued job of this priority which can be
+            removed
+
+==============================================================================*/
+static Job *Unlink( JobQueue *pQueue, int priority, bool shared )
+{
+    Job *pJob = NULL;
+    Job *pPrev = NULL;
+    Job *pBest = NULL;
+    Job *pBestPrev = NULL;
+    JobOriginator *pOriginator;
+    size_t running;
+    size_t fewest = 0;
+
+    for( pJob = pQueue->pHead[priority];
+         pJob != NULL;
+         pPrev = pJob, pJob = pJob->pNext )
+    {
+        if( ( shared ) &&
+            ( pQueue->share[pJob->target] > 0 ) &&
+            ( pQueue->targetRunning[pJob->target] >=
+                pQueue->share[pJob->target] ) )
+        {
+            /* the job's target is using its share */
+            continue;
+        }
+
+        pOriginator = GetOriginator( pQueue, pJob->originator, false );
+        running = ( pOriginator != NULL ) ? pOriginator->running : 0;
+        if( ( pBest == NULL ) || ( running < fewest ) )
+        {
+            pBest = pJob;
+            pBestPrev = pPrev;
+            fewest = running;
+            if( fewest == 0 )
+            {
+                /* no job is more deserving than the oldest idle one */
+                break;
+            }
+        }
+    }
+
+    pJob = pBest;
+    if( pJob != NULL )
+    {
+        if( pBestPrev != NULL )
+        {
+            pBestPrev->pNext = pJob->pNext;
+        }
+        else
+        {
+            pQueue->pHead[priority] = pJob->pNext;
+        }
+
+        if( pQueue->pTail[priority] == pJob )
+        {
+            pQueue->pTail[priority] = pBestPrev;
+        }
+
+        pJob->pNext = NULL;
+        pQueue->depth--;
+        if( pQueue->targetQueued[pJob->target] > 0 )
+        {
+            pQueue->targetQueued[pJob->target]--;
+        }
+
+        METRICS_QueueDepth( pQueue->depth );
+    }
+
+    return pJob;
+}
+
+/*! @}
+ * end of jobqueue group */
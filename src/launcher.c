@@ -0,0 +1,1170 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup launcher launcher
+ * @brief Command launcher
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file launcher.c
+
+    Command launcher
+
+    The launcher module launches commands with their stdout connected to a
+    pipe.  By default commands are launched with posix_spawn, which on
+    Linux uses a vfork-style clone and so avoids copying the page tables
+    of the iotexec process.  Commands which do not use any shell syntax
+    are executed directly, avoiding the extra /bin/sh hop.
+
+    popen is retained as a fallback backend.
+
+    Commands launched with posix_spawn are placed in their own process
+    group, so the command and any processes it starts can be killed
+    together.
+
+    Commands with an execution class are launched with vfork instead,
+    since the child must move itself into its class cgroup and set its
+    rlimits and priorities before it executes the command, which
+    posix_spawn cannot do.
+
+    The capacity of the command output pipe can be increased so commands
+    with large outputs are not repeatedly blocked on a full pipe, and the
+    output can be consumed in fewer, larger reads.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "launcher.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+/*! maximum number of arguments for a command executed without a shell */
+#define MAX_DIRECT_ARGS 32
+
+/*! maximum length of a command executed without a shell */
+#define MAX_DIRECT_LENGTH 512
+
+/*! characters which require a command to be interpreted by the shell */
+#define SHELL_CHARS "|&;<>()$`\\\"'*?[]#~=%{}!\n"
+
+#ifndef EOK
+/*! success response */
+#define EOK 0
+#endif
+
+/*! the process environment passed to launched commands */
+extern char **environ;
+
+/*==============================================================================
+        Private file scoped variables
+==============================================================================*/
+
+/*! requested command output pipe capacity, 0 for the system default */
+static int pipeSize = 0;
+
+/*! true if the stderr of launched commands is captured */
+static bool captureStderr = false;
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static int SpawnArgv( char * const argv[],
+                      bool search,
+                      int fdIn,
+                      bool captureErr,
+                      const ExecClass *pClass,
+                      Child *pChild );
+static int ForkArgv( char * const argv[],
+                     bool search,
+                     int fdIn,
+                     int fdOut,
+                     int fdErr,
+                     const ExecClass *pClass,
+                     pid_t *pPid );
+static int SpawnDirect( const char *cmd,
+                        int fdIn,
+                        const ExecClass *pClass,
+                        Child *pChild );
+static int SpawnShell( const char *cmd,
+                       int fdIn,
+                       const ExecClass *pClass,
+                       Child *pChild );
+static int SpawnPopen( const char *cmd, Child *pChild );
+static void SetPipeSize( int fd );
+static void ResetSignals( void );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  LAUNCHER_ParseBackend                                                     */
+/*!
+    Convert a launcher backend name to a LauncherBackend
+
+    @param[in]
+        name
+            name of the backend: spawn, shell, or popen
+
+    @param[out]
+        pBackend
+            pointer to the location to store the backend
+
+    @retval EOK the backend name was recognized
+    @retval ENOTSUP unknown backend name
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int LAUNCHER_ParseBackend( const char *name, LauncherBackend *pBackend )
+{
+    int result = EINVAL;
+
+    if( ( name != NULL ) &&
+        ( pBackend != NULL ) )
+    {
+        result = EOK;
+
+        if( strcmp( name, "spawn" ) == 0 )
+        {
+            *pBackend = LAUNCHER_BACKEND_SPAWN;
+        }
+        else if( strcmp( name, "shell" ) == 0 )
+        {
+            *pBackend = LAUNCHER_BACKEND_SHELL;
+        }
+        else if( strcmp( name, "popen" ) == 0 )
+        {
+            *pBackend = LAUNCHER_BACKEND_POPEN;
+        }
+        else
+        {
+            result = ENOTSUP;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  LAUNCHER_SetPipeSize                                                      */
+/*!
+    Set the capacity of command output pipes
+
+    The LAUNCHER_SetPipeSize function sets the capacity requested for the
+    output pipe of subsequently launched commands.  Unprivileged
+    processes are limited to /proc/sys/fs/pipe-max-size.
+
+    @param[in]
+        size
+            pipe capacity in bytes, or 0 for the system default
+
+    @retval EOK the pipe capacity was set
+    @retval EINVAL invalid pipe capacity
+
+==============================================================================*/
+int LAUNCHER_SetPipeSize( int size )
+{
+    int result = EINVAL;
+
+    if( size >= 0 )
+    {
+        pipeSize = size;
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  LAUNCHER_SetStderr                                                        */
+/*!
+    Select whether the stderr of commands is captured
+
+    The LAUNCHER_SetStderr function selects whether subsequently
+    launched commands have their stderr connected to a pipe of its own,
+    or inherit the stderr of iotexec.  Commands launched by popen, and
+    session shells, never have their stderr captured.
+
+    @param[in]
+        capture
+            true to capture the stderr of launched commands
+
+==============================================================================*/
+void LAUNCHER_SetStderr( bool capture )
+{
+    captureStderr = capture;
+}
+
+/*============================================================================*/
+/*  LAUNCHER_Command                                                          */
+/*!
+    Launch a command
+
+    The LAUNCHER_Command function launches the specified command using the
+    selected backend, with its stdout connected to a pipe.  If the
+    posix_spawn backends cannot launch the command, popen is tried
+    as a fallback, unless the command has a stdin descriptor or an
+    execution class which popen cannot apply.  A command with an
+    execution class is launched by the shell if the popen backend is
+    selected.
+
+    @param[in]
+        backend
+            the launcher backend to use
+
+    @param[in]
+        cmd
+            pointer to the NUL terminated command to launch
+
+    @param[in]
+        fdIn
+            descriptor to connect to the command's stdin, or -1 to leave
+            stdin connected to iotexec's
+
+    @param[in]
+        pClass
+            pointer to the execution class of the command, or NULL
+
+    @param[out]
+        pChild
+            pointer to the Child object to populate
+
+    @retval EOK the command was launched
+    @retval EINVAL invalid arguments
+    @retval error as returned by pipe, posix_spawn, vfork, CLASS_Apply,
+            exec or popen
+
+==============================================================================*/
+int LAUNCHER_Command( LauncherBackend backend,
+                      const char *cmd,
+                      int fdIn,
+                      const ExecClass *pClass,
+                      Child *pChild )
+{
+    int result = EINVAL;
+
+    if( ( cmd != NULL ) &&
+        ( pChild != NULL ) )
+    {
+        memset( pChild, 0, sizeof( Child ) );
+        pChild->pid = -1;
+        pChild->fdOut = -1;
+        pChild->fdErr = -1;
+        pChild->fp = NULL;
+
+        switch( backend )
+        {
+            case LAUNCHER_BACKEND_SPAWN:
+                result = LAUNCHER_NeedsShell( cmd )
+                            ? SpawnShell( cmd, fdIn, pClass, pChild )
+                            : SpawnDirect( cmd, fdIn, pClass, pChild );
+                break;
+
+            case LAUNCHER_BACKEND_SHELL:
+                result = SpawnShell( cmd, fdIn, pClass, pChild );
+                break;
+
+            default:
+                result = ( pClass != NULL )
+                            ? SpawnShell( cmd, fdIn, pClass, pChild )
+                            : ENOTSUP;
+                break;
+        }
+
+        if( ( result != EOK ) && ( fdIn == -1 ) && ( pClass == NULL ) )
+        {
+            result = SpawnPopen( cmd, pChild );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  LAUNCHER_Argv                                                             */
+/*!
+    Launch a pre-split argument vector
+
+    The LAUNCHER_Argv function launches an argument vector whose first
+    element is the absolute path of the program, without the shell and
+    without a PATH search, as the leader of its own process group.
+
+    @param[in]
+        argv
+            NULL terminated argument vector
+
+    @param[in]
+        fdIn
+            descriptor to connect to the command's stdin, or -1 to leave
+            stdin connected to iotexec's
+
+    @param[in]
+        pClass
+            pointer to the execution class of the command, or NULL
+
+    @param[out]
+        pChild
+            pointer to the Child object to populate
+
+    @retval EOK the command was launched
+    @retval EINVAL invalid arguments
+    @retval error as returned by SpawnArgv
+
+==============================================================================*/
+int LAUNCHER_Argv( char * const argv[],
+                   int fdIn,
+                   const ExecClass *pClass,
+                   Child *pChild )
+{
+    int result = EINVAL;
+
+    if( ( argv != NULL ) &&
+        ( argv[0] != NULL ) &&
+        ( pChild != NULL ) )
+    {
+        memset( pChild, 0, sizeof( Child ) );
+        pChild->pid = -1;
+        pChild->fdOut = -1;
+        pChild->fdErr = -1;
+        pChild->fp = NULL;
+
+        result = SpawnArgv( argv,
+                            false,
+                            fdIn,
+                            captureStderr,
+                            pClass,
+                            pChild );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  LAUNCHER_Shell                                                            */
+/*!
+    Launch a shell which reads commands from a pipe
+
+    The LAUNCHER_Shell function launches /bin/sh with its stdin connected
+    to an input pipe and its stdout connected to the output pipe, so
+    commands can be written to the shell one at a time.  The shell is
+    the leader of its own process group.
+
+    @param[out]
+        pChild
+            pointer to the Child object to populate
+
+    @param[out]
+        pFdIn
+            pointer to a location to store the write end of the shell's
+            stdin pipe
+
+    @retval EOK the shell was launched
+    @retval EINVAL invalid arguments
+    @retval error as returned by pipe2 or posix_spawn
+
+==============================================================================*/
+int LAUNCHER_Shell( Child *pChild, int *pFdIn )
+{
+    int result = EINVAL;
+    char * const argv[] = { "/bin/sh", NULL };
+    int in[2];
+
+    if( ( pChild != NULL ) &&
+        ( pFdIn != NULL ) )
+    {
+        memset( pChild, 0, sizeof( Child ) );
+        pChild->pid = -1;
+        pChild->fdOut = -1;
+        pChild->fdErr = -1;
+        pChild->fp = NULL;
+
+        if( pipe2( in, O_CLOEXEC ) == 0 )
+        {
+            result = SpawnArgv( argv, false, in[0], false, NULL, pChild );
+
+            /* the read end of the input pipe belongs to the shell */
+            close( in[0] );
+            if( result == EOK )
+            {
+                *pFdIn = in[1];
+            }
+            else
+            {
+                close( in[1] );
+            }
+        }
+        else
+        {
+            result = errno;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  LAUNCHER_Wait                                                             */
+/*!
+    Wait for a launched command to complete
+
+    The LAUNCHER_Wait function closes the command's output pipes and
+    waits for the command to terminate.  The resource usage of a
+    spawned command is collected when it is reaped, and the leaf cgroup
+    of a classed command is removed.
+
+    @param[in]
+        pChild
+            pointer to the launched Child
+
+    @param[out]
+        pStatus
+            pointer to a location to store the wait status (may be NULL)
+
+    @retval EOK the command has terminated
+    @retval EINVAL invalid arguments
+    @retval error as returned by wait4 or pclose
+
+==============================================================================*/
+int LAUNCHER_Wait( Child *pChild, int *pStatus )
+{
+    int result = EINVAL;
+    int status = -1;
+
+    if( pChild != NULL )
+    {
+        result = EOK;
+
+        if( pChild->fp != NULL )
+        {
+            status = pclose( pChild->fp );
+            if( status == -1 )
+            {
+                result = errno;
+            }
+
+            pChild->fp = NULL;
+        }
+        else if( pChild->pid > 0 )
+        {
+            if( pChild->fdOut != -1 )
+            {
+                close( pChild->fdOut );
+            }
+
+            if( pChild->fdErr != -1 )
+            {
+                close( pChild->fdErr );
+            }
+
+            while( wait4( pChild->pid, &status, 0, &pChild->usage ) == -1 )
+            {
+                if( errno != EINTR )
+                {
+                    result = errno;
+                    break;
+                }
+            }
+
+            pChild->hasUsage = ( result == EOK );
+            if( result == EOK )
+            {
+                (void)CLASS_Release( pChild->pClass, pChild->pid );
+            }
+        }
+
+        pChild->pid = -1;
+        pChild->fdOut = -1;
+        pChild->fdErr = -1;
+
+        if( pStatus != NULL )
+        {
+            *pStatus = status;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  LAUNCHER_Poll                                                             */
+/*!
+    Check if a launched command has completed
+
+    The LAUNCHER_Poll function closes the command's output pipes and
+    reaps the command if it has terminated, without blocking, collecting
+    its resource usage and removing its leaf cgroup.  Commands launched
+    with popen cannot be polled, so they are waited for.
+
+    @param[in]
+        pChild
+            pointer to the launched Child
+
+    @param[out]
+        pStatus
+            pointer to a location to store the wait status (may be NULL)
+
+    @retval EOK the command has terminated
+    @retval EBUSY the command is still running
+    @retval EINVAL invalid arguments
+    @retval error as returned by wait4
+
+==============================================================================*/
+int LAUNCHER_Poll( Child *pChild, int *pStatus )
+{
+    int result = EINVAL;
+    int status = -1;
+    pid_t pid;
+
+    if( pChild != NULL )
+    {
+        if( ( pChild->fp != NULL ) || ( pChild->pid <= 0 ) )
+        {
+            result = LAUNCHER_Wait( pChild, pStatus );
+        }
+        else
+        {
+            if( pChild->fdOut != -1 )
+            {
+                close( pChild->fdOut );
+                pChild->fdOut = -1;
+            }
+
+            if( pChild->fdErr != -1 )
+            {
+                close( pChild->fdErr );
+                pChild->fdErr = -1;
+            }
+
+            pid = wait4( pChild->pid, &status, WNOHANG, &pChild->usage );
+            if( pid == 0 )
+            {
+                result = EBUSY;
+            }
+            else
+            {
+                result = ( pid == pChild->pid ) ? EOK : errno;
+                pChild->hasUsage = ( result == EOK );
+                if( result == EOK )
+                {
+                    (void)CLASS_Release( pChild->pClass, pid );
+                }
+
+                pChild->pid = -1;
+
+                if( pStatus != NULL )
+                {
+                    *pStatus = status;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  LAUNCHER_Kill                                                             */
+/*!
+    Send a signal to a launched command
+
+    The LAUNCHER_Kill function sends a signal to the process group of a
+    launched command, so that any processes started by the command also
+    receive the signal.  Commands launched with popen cannot be
+    signalled since their process identifier is not known.
+
+    @param[in]
+        pChild
+            pointer to the launched Child
+
+    @param[in]
+        signum
+            the signal to send
+
+    @retval EOK the signal was sent
+    @retval ENOTSUP the command was launched with popen
+    @retval EINVAL invalid arguments
+    @retval error as returned by kill
+
+==============================================================================*/
+int LAUNCHER_Kill( Child *pChild, int signum )
+{
+    int result = EINVAL;
+
+    if( pChild != NULL )
+    {
+        if( pChild->pid > 0 )
+        {
+            result = EOK;
+
+            if( ( kill( -pChild->pid, signum ) != 0 ) &&
+                ( kill( pChild->pid, signum ) != 0 ) )
+            {
+                result = errno;
+            }
+        }
+        else
+        {
+            result = ENOTSUP;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  LAUNCHER_NeedsShell                                                       */
+/*!
+    Determine if a command must be interpreted by the shell
+
+    The LAUNCHER_NeedsShell function checks the command for shell syntax
+    such as redirection, pipelines, quoting, variable expansion or
+    globbing.  Commands without any shell syntax can be split on
+    whitespace and executed directly.
+
+    @param[in]
+        cmd
+            pointer to the NUL terminated command
+
+    @retval true the command must be run by the shell
+    @retval false the command can be executed directly
+
+==============================================================================*/
+bool LAUNCHER_NeedsShell( const char *cmd )
+{
+    bool result = true;
+
+    if( ( cmd != NULL ) &&
+        ( strlen( cmd ) < MAX_DIRECT_LENGTH ) &&
+        ( strpbrk( cmd, SHELL_CHARS ) == NULL ) )
+    {
+        result = false;
+    }
+
+    return result;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  SpawnArgv                                                                 */
+/*!
+    Launch an argument vector
+
+    The SpawnArgv function creates the output pipe and launches the
+    specified argument vector with its stdout connected to the write
+    end of the pipe.  If requested, a descriptor is connected to the
+    child's stdin, and the child's stderr is connected to a second,
+    non-blocking, pipe.  The child's signal mask is cleared so it does not
+    inherit any signals blocked by the iotexec threads, and the child
+    is made the leader of a new process group.  The argument vector is
+    launched with posix_spawn, or with ForkArgv if it has an execution
+    class.
+
+    @param[in]
+        argv
+            NULL terminated argument vector
+
+    @param[in]
+        search
+            true to search the PATH for argv[0]
+
+    @param[in]
+        fdIn
+            descriptor to connect to the child's stdin, or -1 to leave
+            stdin connected to iotexec's
+
+    @param[in]
+        captureErr
+            true to connect the child's stderr to a pipe, false to leave
+            it connected to iotexec's
+
+    @param[in]
+        pClass
+            pointer to the execution class of the command, or NULL
+
+    @param[out]
+        pChild
+            pointer to the Child object to populate
+
+    @retval EOK the command was launched
+    @retval error as returned by pipe2, posix_spawn or ForkArgv
+
+==============================================================================*/
+static int SpawnArgv( char * const argv[],
+                      bool search,
+                      int fdIn,
+                      bool captureErr,
+                      const ExecClass *pClass,
+                      Child *pChild )
+{
+    int result;
+    int fd[2];
+    int err[2] = { -1, -1 };
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t mask;
+    pid_t pid;
+
+    if( pipe2( fd, O_CLOEXEC ) != 0 )
+    {
+        return errno;
+    }
+
+    if( captureErr && ( pipe2( err, O_CLOEXEC ) != 0 ) )
+    {
+        result = errno;
+        close( fd[0] );
+        close( fd[1] );
+        return result;
+    }
+
+    SetPipeSize( fd[0] );
+
+    if( pClass != NULL )
+    {
+        result = ForkArgv( argv, search, fdIn, fd[1], err[1], pClass, &pid );
+    }
+    else
+    {
+        posix_spawn_file_actions_init( &actions );
+        posix_spawn_file_actions_adddup2( &actions, fd[1], STDOUT_FILENO );
+        if( captureErr )
+        {
+            posix_spawn_file_actions_adddup2( &actions,
+                                              err[1],
+                                              STDERR_FILENO );
+        }
+        if( fdIn != -1 )
+        {
+            posix_spawn_file_actions_adddup2( &actions, fdIn, STDIN_FILENO );
+        }
+
+        sigemptyset( &mask );
+        posix_spawnattr_init( &attr );
+        posix_spawnattr_setsigmask( &attr, &mask );
+        posix_spawnattr_setpgroup( &attr, 0 );
+        posix_spawnattr_setflags( &attr,
+                                  POSIX_SPAWN_SETSIGMASK |
+                                  POSIX_SPAWN_SETPGROUP );
+
+        if( search )
+        {
+            result = posix_spawnp( &pid,
+                                   argv[0],
+                                   &actions,
+                                   &attr,
+                                   argv,
+                                   environ );
+        }
+        else
+        {
+            result = posix_spawn( &pid,
+                                  argv[0],
+                                  &actions,
+                                  &attr,
+                                  argv,
+                                  environ );
+        }
+
+        posix_spawnattr_destroy( &attr );
+        posix_spawn_file_actions_destroy( &actions );
+    }
+
+    /* the write ends of the output pipes belong to the child */
+    close( fd[1] );
+    if( captureErr )
+    {
+        close( err[1] );
+    }
+
+    if( result == EOK )
+    {
+        pChild->pid = pid;
+        pChild->pClass = pClass;
+        pChild->fdOut = fd[0];
+        if( captureErr )
+        {
+            (void)fcntl( err[0], F_SETFL, O_NONBLOCK );
+            pChild->fdErr = err[0];
+        }
+    }
+    else
+    {
+        close( fd[0] );
+        if( captureErr )
+        {
+            close( err[0] );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  ForkArgv                                                                  */
+/*!
+    Launch an argument vector in an execution class
+
+    The ForkArgv function starts a child with vfork, so the page tables
+    of the daemon are not copied.  The child connects its standard
+    descriptors, becomes the leader of a new process group, applies its
+    execution class, clears its signal mask, and executes the argument
+    vector.  The child shares the memory of the calling thread until it
+    executes, so it only makes async-signal-safe system calls, and every
+    signal is blocked across the vfork, with the handlers installed by
+    iotexec reset in the child, so no handler runs in the shared
+    memory.  If the child cannot apply its class or execute the command
+    it stores the error in the shared memory before it exits, so the
+    launch fails as a posix_spawn would.
+
+    @param[in]
+        argv
+            NULL terminated argument vector
+
+    @param[in]
+        search
+            true to search the PATH for argv[0]
+
+    @param[in]
+        fdIn
+            descriptor to connect to the child's stdin, or -1
+
+    @param[in]
+        fdOut
+            descriptor to connect to the child's stdout
+
+    @param[in]
+        fdErr
+            descriptor to connect to the child's stderr, or -1
+
+    @param[in]
+        pClass
+            pointer to the execution class of the command
+
+    @param[out]
+        pPid
+            pointer to the location to store the child's process identifier
+
+    @retval EOK the command was launched
+    @retval error as returned by vfork, CLASS_Apply or exec
+
+==============================================================================*/
+static int ForkArgv( char * const argv[],
+                     bool search,
+                     int fdIn,
+                     int fdOut,
+                     int fdErr,
+                     const ExecClass *pClass,
+                     pid_t *pPid )
+{
+    int result = EOK;
+    volatile int err = EOK;
+    sigset_t all;
+    sigset_t saved;
+    sigset_t none;
+    pid_t pid;
+
+    sigfillset( &all );
+    sigemptyset( &none );
+    pthread_sigmask( SIG_SETMASK, &all, &saved );
+
+    pid = vfork();
+    if( pid == 0 )
+    {
+        ResetSignals();
+        (void)setpgid( 0, 0 );
+
+        err = ( dup2( fdOut, STDOUT_FILENO ) != -1 ) &&
+              ( ( fdErr == -1 ) || ( dup2( fdErr, STDERR_FILENO ) != -1 ) ) &&
+              ( ( fdIn == -1 ) || ( dup2( fdIn, STDIN_FILENO ) != -1 ) )
+                ? CLASS_Apply( pClass )
+                : errno;
+        if( err == EOK )
+        {
+            sigprocmask( SIG_SETMASK, &none, NULL );
+
+            if( search )
+            {
+                execvpe( argv[0], argv, environ );
+            }
+            else
+            {
+                execve( argv[0], argv, environ );
+            }
+
+            err = errno;
+        }
+
+        _exit( 127 );
+    }
+    else if( pid > 0 )
+    {
+        /* the child has executed the command, or failed and exited */
+        if( err != EOK )
+        {
+            while( ( waitpid( pid, NULL, 0 ) == -1 ) && ( errno == EINTR ) );
+            (void)CLASS_Release( pClass, pid );
+            result = err;
+        }
+        else
+        {
+            *pPid = pid;
+        }
+    }
+    else
+    {
+        result = errno;
+    }
+
+    pthread_sigmask( SIG_SETMASK, &saved, NULL );
+
+    return result;
+}
+
+/*============================================================================*/
+/*  SpawnDirect                                                               */
+/*!
+    Launch a command without the shell
+
+    The SpawnDirect function splits a command which contains no shell
+    syntax into an argument vector on whitespace and executes it directly
+    via a PATH search.  If the program cannot be found (for example
+    because it is a shell builtin) the command is passed to the shell.
+
+    @param[in]
+        cmd
+            pointer to the NUL terminated command
+
+    @param[in]
+        fdIn
+            descriptor to connect to the command's stdin, or -1
+
+    @param[in]
+        pClass
+            pointer to the execution class of the command, or NULL
+
+    @param[out]
+        pChild
+            pointer to the Child object to populate
+
+    @retval EOK the command was launched
+    @retval error as returned by SpawnShell
+
+==============================================================================*/
+static int SpawnDirect( const char *cmd,
+                        int fdIn,
+                        const ExecClass *pClass,
+                        Child *pChild )
+{
+    char buf[MAX_DIRECT_LENGTH];
+    char *argv[MAX_DIRECT_ARGS + 1];
+    char *saveptr = NULL;
+    char *arg;
+    int argc = 0;
+    int result = E2BIG;
+
+    strncpy( buf, cmd, sizeof( buf ) - 1 );
+    buf[sizeof( buf ) - 1] = '\0';
+
+    arg = strtok_r( buf, " \t", &saveptr );
+    while( ( arg != NULL ) && ( argc < MAX_DIRECT_ARGS ) )
+    {
+        argv[argc++] = arg;
+        arg = strtok_r( NULL, " \t", &saveptr );
+    }
+
+    argv[argc] = NULL;
+
+    if( ( arg == NULL ) && ( argc > 0 ) )
+    {
+        result = SpawnArgv( argv, true, fdIn, captureStderr, pClass, pChild );
+    }
+
+    if( result != EOK )
+    {
+        result = SpawnShell( cmd, fdIn, pClass, pChild );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  SpawnShell                                                                */
+/*!
+    Launch a command using /bin/sh -c
+
+    @param[in]
+        cmd
+            pointer to the NUL terminated command
+
+    @param[in]
+        fdIn
+            descriptor to connect to the command's stdin, or -1
+
+    @param[in]
+        pClass
+            pointer to the execution class of the command, or NULL
+
+    @param[out]
+        pChild
+            pointer to the Child object to populate
+
+    @retval EOK the command was launched
+    @retval error as returned by SpawnArgv
+
+==============================================================================*/
+static int SpawnShell( const char *cmd,
+                       int fdIn,
+                       const ExecClass *pClass,
+                       Child *pChild )
+{
+    char * const argv[] = { "/bin/sh", "-c", (char *)cmd, NULL };
+
+    return SpawnArgv( argv, false, fdIn, captureStderr, pClass, pChild );
+}
+
+/*============================================================================*/
+/*  SpawnPopen                                                                */
+/*!
+    Launch a command using popen
+
+    @param[in]
+        cmd
+            pointer to the NUL terminated command
+
+    @param[out]
+        pChild
+            pointer to the Child object to populate
+
+    @retval EOK the command was launched
+    @retval EBADF could not get the command output file descriptor
+    @retval error as returned by popen
+
+==============================================================================*/
+static int SpawnPopen( const char *cmd, Child *pChild )
+{
+    int result = EOK;
+
+    pChild->pid = -1;
+    pChild->fp = popen( cmd, "re" );
+    if( pChild->fp != NULL )
+    {
+        pChild->fdOut = fileno( pChild->fp );
+        if( pChild->fdOut != -1 )
+        {
+            SetPipeSize( pChild->fdOut );
+        }
+        else
+        {
+            pclose( pChild->fp );
+            pChild->fp = NULL;
+            result = EBADF;
+        }
+    }
+    else
+    {
+        result = ( errno != 0 ) ? errno : ENOMEM;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  SetPipeSize                                                               */
+/*!
+    Apply the requested capacity to a command output pipe
+
+    Failure to resize the pipe is not an error, the pipe keeps its
+    default capacity.
+
+    @param[in]
+        fd
+            file descriptor of either end of the pipe
+
+==============================================================================*/
+static void SetPipeSize( int fd )
+{
+    if( pipeSize > 0 )
+    {
+        (void)fcntl( fd, F_SETPIPE_SZ, pipeSize );
+    }
+}
+
+/*============================================================================*/
+/*  ResetSignals                                                              */
+/*!
+    Reset the signal handlers of a vforked child
+
+    The ResetSignals function restores the default action of every
+    signal which has a handler, so a signal received by the child
+    before it executes its command cannot run an iotexec handler in
+    the memory it shares with its parent.  Ignored signals stay ignored,
+    as they would across a fork.
+
+==============================================================================*/
+static void ResetSignals( void )
+{
+    struct sigaction sa;
+    int signum;
+
+    for( signum = 1; signum < NSIG; signum++ )
+    {
+        if( ( sigaction( signum, NULL, &sa ) == 0 ) &&
+            ( sa.sa_handler != SIG_DFL ) &&
+            ( sa.sa_handler != SIG_IGN ) )
+        {
+            sa.sa_handler = SIG_DFL;
+            sa.sa_flags = 0;
+            (void)sigaction( signum, &sa, NULL );
+        }
+    }
+}
+
+/*! @}
+ * end of launcher group */
@@ -0,0 +1,447 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup limiter limiter
+ * @brief Adaptive concurrency limiter
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file limiter.c
+
+    Adaptive concurrency limiter
+
+    The limiter module adjusts the number of commands which may execute
+    concurrently to the load of the device.  Once per interval it reads
+    the 1 minute load average, the CPU and memory pressure stall
+    information (PSI) of the kernel, and the average time taken to
+    launch a command over the interval, which grows when the device is
+    short of memory or CPU.
+
+    The limit is adjusted AIMD-style: it grows by one command per
+    interval while the device is not loaded, and is cut by a quarter
+    when the load average per CPU, either pressure, or the launch
+    latency relative to its long term average exceeds its threshold.
+    Since the load average and pressure are averaged over time, the
+    limit is not cut again for a few intervals, to give the signals time
+    to reflect the previous cut.
+
+    Commands beyond the limit wait in the job queue, so once the queue
+    is full further messages are left in the iotclient receiver rather
+    than being executed on an overloaded device.
+
+    The pressure files are absent on kernels without PSI, in which case
+    only the load average and launch latency are used.
+
+    LIMITER_Observe may be called from any thread.  LIMITER_Update and
+    LIMITER_Timeout must be serialized by the owner of the job queue.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "limiter.h"
+#include "response.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+#ifndef EOK
+/*! success response */
+#define EOK 0
+#endif
+
+/*! file holding the system load averages */
+#define LIMITER_LOADAVG "/proc/loadavg"
+
+/*! file holding the CPU pressure stall information */
+#define LIMITER_CPU_PRESSURE "/proc/pressure/cpu"
+
+/*! file holding the memory pressure stall information */
+#define LIMITER_MEMORY_PRESSURE "/proc/pressure/memory"
+
+/*! factor applied to the limit when the device is loaded */
+#define LIMITER_BACKOFF 0.75
+
+/*! number of updates after a decrease during which the limit is not
+    decreased again */
+#define LIMITER_HOLD 3
+
+/*! launch latency relative to its long term average above which the
+    device is loaded */
+#define LIMITER_MAX_LATENCY_RATIO 2.0
+
+/*! weight of the long term average launch latency against a new sample */
+#define LIMITER_BASELINE_WEIGHT 16.0
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static bool IsLoaded( Limiter *pLimiter );
+static double ReadLoad( void );
+static double ReadPressure( const char *path );
+static double GetLatencyRatio( Limiter *pLimiter );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  LIMITER_Init                                                              */
+/*!
+    Initialize an adaptive concurrency limiter
+
+    The limit starts at its maximum, so an idle device executes commands
+    at full concurrency from the start.
+
+    @param[in]
+        pLimiter
+            pointer to the Limiter to initialize
+
+    @param[in]
+        maxLimit
+            highest concurrency limit
+
+    @param[in]
+        maxLoad
+            1 minute load average per CPU above which the limit is
+            decreased
+
+    @param[in]
+        maxPressure
+            CPU or memory pressure (some avg10, in %) above which the
+            limit is decreased
+
+    @retval EOK the limiter was initialized
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int LIMITER_Init( Limiter *pLimiter,
+                  size_t maxLimit,
+                  double maxLoad,
+                  double maxPressure )
+{
+    int result = EINVAL;
+
+    if( ( pLimiter != NULL ) &&
+        ( maxLimit > 0 ) &&
+        ( maxLoad > 0.0 ) &&
+        ( maxPressure > 0.0 ) )
+    {
+        memset( pLimiter, 0, sizeof( Limiter ) );
+        pthread_mutex_init( &pLimiter->lock, NULL );
+        pLimiter->minLimit = 1;
+        pLimiter->maxLimit = maxLimit;
+        pLimiter->limit = (double)maxLimit;
+        pLimiter->maxLoad = maxLoad;
+        pLimiter->maxPressure = maxPressure;
+        pLimiter->cpus = sysconf( _SC_NPROCESSORS_ONLN );
+        if( pLimiter->cpus < 1 )
+        {
+            pLimiter->cpus = 1;
+        }
+
+        pLimiter->nextUpdate = RESPONSE_Now() + LIMITER_INTERVAL_MS;
+
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  LIMITER_Observe                                                           */
+/*!
+    Record the time taken to launch a command
+
+    @param[in]
+        pLimiter
+            pointer to the Limiter, or NULL if the concurrency is fixed
+
+    @param[in]
+        latencyUs
+            time in microseconds taken to launch the command
+
+==============================================================================*/
+void LIMITER_Observe( Limiter *pLimiter, uint64_t latencyUs )
+{
+    if( pLimiter != NULL )
+    {
+        pthread_mutex_lock( &pLimiter->lock );
+        pLimiter->latencySumUs += latencyUs;
+        pLimiter->latencyCount++;
+        pthread_mutex_unlock( &pLimiter->lock );
+    }
+}
+
+/*============================================================================*/
+/*  LIMITER_Update                                                            */
+/*!
+    Update the concurrency limit
+
+    The LIMITER_Update function samples the load of the device once the
+    update interval has elapsed, and increases or decreases the limit
+    accordingly.
+
+    @param[in]
+        pLimiter
+            pointer to the Limiter
+
+    @param[out]
+        pLimit
+            pointer to the location to store the new concurrency limit
+
+    @retval true the limit was updated
+    @retval false the update interval has not elapsed
+
+==============================================================================*/
+bool LIMITER_Update( Limiter *pLimiter, size_t *pLimit )
+{
+    bool updated = false;
+    uint64_t now;
+    bool loaded;
+
+    if( ( pLimiter != NULL ) &&
+        ( pLimit != NULL ) )
+    {
+        now = RESPONSE_Now();
+        if( now >= pLimiter->nextUpdate )
+        {
+            pLimiter->nextUpdate = now + LIMITER_INTERVAL_MS;
+
+            loaded = IsLoaded( pLimiter );
+            if( ( loaded ) && ( pLimiter->hold == 0 ) )
+            {
+                /* multiplicative decrease */
+                pLimiter->limit *= LIMITER_BACKOFF;
+                if( pLimiter->limit < (double)pLimiter->minLimit )
+                {
+                    pLimiter->limit = (double)pLimiter->minLimit;
+                }
+
+                pLimiter->hold = LIMITER_HOLD;
+            }
+            else if( loaded == false )
+            {
+                /* additive increase */
+                pLimiter->limit += 1.0;
+                if( pLimiter->limit > (double)pLimiter->maxLimit )
+                {
+                    pLimiter->limit = (double)pLimiter->maxLimit;
+                }
+            }
+
+            if( pLimiter->hold > 0 )
+            {
+                pLimiter->hold--;
+            }
+
+            *pLimit = (size_t)pLimiter->limit;
+            updated = true;
+        }
+    }
+
+    return updated;
+}
+
+/*============================================================================*/
+/*  LIMITER_Timeout                                                           */
+/*!
+    Get the time remaining until the next update of the limit
+
+    @param[in]
+        pLimiter
+            pointer to the Limiter
+
+    @retval -1 pLimiter is NULL
+    @retval number of milliseconds until the next update
+
+==============================================================================*/
+int LIMITER_Timeout( Limiter *pLimiter )
+{
+    int timeout = -1;
+    uint64_t now;
+
+    if( pLimiter != NULL )
+    {
+        now = RESPONSE_Now();
+        timeout = ( pLimiter->nextUpdate > now )
+                    ? (int)( pLimiter->nextUpdate - now )
+                    : 0;
+    }
+
+    return timeout;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  IsLoaded                                                                  */
+/*!
+    Determine if the device is loaded
+
+    @param[in]
+        pLimiter
+            pointer to the Limiter
+
+    @retval true a load signal exceeds its threshold
+    @retval false the device can execute more commands
+
+==============================================================================*/
+static bool IsLoaded( Limiter *pLimiter )
+{
+    double ratio = GetLatencyRatio( pLimiter );
+
+    return ( ReadLoad() / (double)pLimiter->cpus > pLimiter->maxLoad ) ||
+           ( ReadPressure( LIMITER_CPU_PRESSURE ) > pLimiter->maxPressure ) ||
+           ( ReadPressure( LIMITER_MEMORY_PRESSURE ) >
+                pLimiter->maxPressure ) ||
+           ( ratio > LIMITER_MAX_LATENCY_RATIO );
+}
+
+/*============================================================================*/
+/*  ReadLoad                                                                  */
+/*!
+    Read the 1 minute load average
+
+    @retval the 1 minute load average, or 0 if it cannot be read
+
+==============================================================================*/
+static double ReadLoad( void )
+{
+    double load = 0.0;
+    FILE *fp;
+
+    fp = fopen( LIMITER_LOADAVG, "re" );
+    if( fp != NULL )
+    {
+        if( fscanf( fp, "%lf", &load ) != 1 )
+        {
+            load = 0.0;
+        }
+
+        fclose( fp );
+    }
+
+    return load;
+}
+
+/*============================================================================*/
+/*  ReadPressure                                                              */
+/*!
+    Read a pressure stall information file
+
+    The ReadPressure function reads the share of the last 10 seconds in
+    which some tasks were stalled on the resource.
+
+    @param[in]
+        path
+            pointer to the NUL terminated path of the PSI file
+
+    @retval the some avg10 pressure in %, or 0 if it cannot be read
+
+==============================================================================*/
+static double ReadPressure( const char *path )
+{
+    double pressure = 0.0;
+    FILE *fp;
+
+    fp = fopen( path, "re" );
+    if( fp != NULL )
+    {
+        if( fscanf( fp, "some avg10=%lf", &pressure ) != 1 )
+        {
+            pressure = 0.0;
+        }
+
+        fclose( fp );
+    }
+
+    return pressure;
+}
+
+/*============================================================================*/
+/*  GetLatencyRatio                                                           */
+/*!
+    Compare the launch latency of the interval to its long term average
+
+    The GetLatencyRatio function consumes the launch latency samples of
+    the interval, and folds their average into the long term average.
+
+    @param[in]
+        pLimiter
+            pointer to the Limiter
+
+    @retval the average launch latency of the interval relative to the
+            long term average, or 0 if no command was launched
+
+==============================================================================*/
+static double GetLatencyRatio( Limiter *pLimiter )
+{
+    double ratio = 0.0;
+    double average = 0.0;
+
+    pthread_mutex_lock( &pLimiter->lock );
+
+    if( pLimiter->latencyCount > 0 )
+    {
+        average = (double)pLimiter->latencySumUs /
+                  (double)pLimiter->latencyCount;
+    }
+
+    pLimiter->latencySumUs = 0;
+    pLimiter->latencyCount = 0;
+
+    pthread_mutex_unlock( &pLimiter->lock );
+
+    if( average > 0.0 )
+    {
+        if( pLimiter->baselineUs == 0.0 )
+        {
+            pLimiter->baselineUs = average;
+        }
+
+        ratio = average / pLimiter->baselineUs;
+        pLimiter->baselineUs += ( average - pLimiter->baselineUs ) /
+                                LIMITER_BASELINE_WEIGHT;
+    }
+
+    return ratio;
+}
+
+/*! @}
+ * end of limiter group */
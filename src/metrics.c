@@ -0,0 +1,731 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup metrics metrics
+ * @brief Command execution metrics
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file metrics.c
+
+    Command execution metrics
+
+    The metrics module keeps process wide counters and latency
+    histograms which are updated on the command hot path by the message
+    dispatcher, the executor workers and the reactor.  Each update is a
+    single relaxed atomic add, so no locks are taken and no system calls
+    are made while commands are executed.
+
+    Latencies are recorded in microseconds into histograms with power
+    of 2 bucket bounds, so a sample costs a bit scan rather than a
+    search.  Samples beyond the largest bucket are counted only in the
+    total, which is exported as the +Inf bucket.  Command failures are counted by errno.
+
+    The metrics are exposed in the Prometheus text format through a
+    Unix domain socket.  Each connection to the socket receives a
+    snapshot of the metrics and is then closed, so they can be read
+    with a tool such as socat:
+
+        socat - UNIX-CONNECT:/run/iotexec.sock
+
+    The module is compiled only when IOTEXEC_METRICS is defined.
+    Otherwise the metrics functions are replaced by empty macros.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "metrics.h"
+
+#ifdef IOTEXEC_METRICS
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+#ifndef EOK
+/*! success response */
+#define EOK 0
+#endif
+
+/*! number of histogram buckets: bucket i counts samples below 2^i us */
+#define METRICS_BUCKETS 32
+
+/*! number of errno values counted individually, others are counted as 0 */
+#define METRICS_MAX_ERRNO 160
+
+/*! size of the metrics snapshot buffer */
+#define METRICS_BUFFER_SIZE 16384
+
+/*! latency histogram */
+typedef struct _histogram
+{
+    /*! number of samples in each bucket */
+    uint64_t buckets[METRICS_BUCKETS];
+
+    /*! total of all samples in microseconds */
+    uint64_t sum;
+
+    /*! number of samples */
+    uint64_t count;
+
+} Histogram;
+
+/*! process wide metrics */
+typedef struct _metrics
+{
+    /*! event counters */
+    uint64_t counters[METRICS_COUNTERS];
+
+    /*! latency histograms */
+    Histogram histograms[METRICS_HISTOGRAMS];
+
+    /*! command failures by errno */
+    uint64_t failures[METRICS_MAX_ERRNO];
+
+    /*! number of commands waiting for an execution slot */
+    uint64_t queueDepth;
+
+    /*! largest number of commands which have waited for a slot */
+    uint64_t maxQueueDepth;
+
+    /*! adaptive limit on the number of executing commands, 0 for none */
+    uint64_t concurrencyLimit;
+
+} Metrics;
+
+/*==============================================================================
+        Private file scoped variables
+==============================================================================*/
+
+/*! the process wide metrics */
+static Metrics metrics;
+
+/*! metrics counter names */
+static const char *counterNames[METRICS_COUNTERS] =
+{
+    "iotexec_messages_total",
+    "iotexec_duplicates_total",
+    "iotexec_commands_total",
+    "iotexec_cache_hits_total",
+    "iotexec_terminated_total",
+    "iotexec_bytes_sent_total",
+    "iotexec_send_retries_total",
+    "iotexec_spilled_bytes_total",
+    "iotexec_busy_total"
+};
+
+/*! metrics histogram names */
+static const char *histogramNames[METRICS_HISTOGRAMS] =
+{
+    "iotexec_receive_to_spawn_us",
+    "iotexec_spawn_to_first_byte_us",
+    "iotexec_command_latency_us"
+};
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static void *ServerThread( void *arg );
+static size_t Format( char *buf, size_t size, size_t length,
+                      const char *fmt, ... )
+    __attribute__(( format( printf, 4, 5 ) ));
+static size_t FormatHistogram( char *buf,
+                               size_t size,
+                               size_t length,
+                               MetricsHistogram histogram );
+static uint64_t Load( uint64_t *pValue );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  METRICS_Count                                                             */
+/*!
+    Add to an event counter
+
+    @param[in]
+        counter
+            the counter to increment
+
+    @param[in]
+        n
+            the amount to add to the counter
+
+==============================================================================*/
+void METRICS_Count( MetricsCounter counter, uint64_t n )
+{
+    if( ( counter >= 0 ) && ( counter < METRICS_COUNTERS ) )
+    {
+        __atomic_fetch_add( &metrics.counters[counter], n, __ATOMIC_RELAXED );
+    }
+}
+
+/*============================================================================*/
+/*  METRICS_Record                                                            */
+/*!
+    Record a latency sample
+
+    The METRICS_Record function adds a sample to the histogram bucket
+    for the smallest power of 2 which is larger than the sample.
+
+    @param[in]
+        histogram
+            the histogram which receives the sample
+
+    @param[in]
+        us
+            the sample in microseconds
+
+==============================================================================*/
+void METRICS_Record( MetricsHistogram histogram, uint64_t us )
+{
+    Histogram *pHistogram;
+    int bucket;
+
+    if( ( histogram >= 0 ) && ( histogram < METRICS_HISTOGRAMS ) )
+    {
+        pHistogram = &metrics.histograms[histogram];
+
+        /* index of the highest set bit, plus one */
+        bucket = ( us == 0 ) ? 0 : 64 - __builtin_clzll( us );
+        if( bucket < METRICS_BUCKETS )
+        {
+            __atomic_fetch_add( &pHistogram->buckets[bucket],
+                                1,
+                                __ATOMIC_RELAXED );
+        }
+
+        __atomic_fetch_add( &pHistogram->sum, us, __ATOMIC_RELAXED );
+        __atomic_fetch_add( &pHistogram->count, 1, __ATOMIC_RELAXED );
+    }
+}
+
+/*============================================================================*/
+/*  METRICS_Failure                                                           */
+/*!
+    Count a command failure
+
+    @param[in]
+        error
+            the errno describing the failure
+
+==============================================================================*/
+void METRICS_Failure( int error )
+{
+    if( ( error < 0 ) || ( error >= METRICS_MAX_ERRNO ) )
+    {
+        error = 0;
+    }
+
+    __atomic_fetch_add( &metrics.failures[error], 1, __ATOMIC_RELAXED );
+}
+
+/*============================================================================*/
+/*  METRICS_QueueDepth                                                        */
+/*!
+    Update the number of commands waiting for an execution slot
+
+    @param[in]
+        depth
+            the number of queued commands
+
+==============================================================================*/
+void METRICS_QueueDepth( size_t depth )
+{
+    uint64_t max;
+
+    __atomic_store_n( &metrics.queueDepth, depth, __ATOMIC_RELAXED );
+
+    max = Load( &metrics.maxQueueDepth );
+    while( ( depth > max ) &&
+           ( __atomic_compare_exchange_n( &metrics.maxQueueDepth,
+                                          &max,
+                                          depth,
+                                          true,
+                                          __ATOMIC_RELAXED,
+                                          __ATOMIC_RELAXED ) == false ) )
+    {
+        /* max was updated by the failed exchange */
+    }
+}
+
+/*============================================================================*/
+/*  METRICS_ConcurrencyLimit                                                  */
+/*!
+    Update the adaptive limit on the number of executing commands
+
+    @param[in]
+        limit
+            the concurrency limit, 0 for no limit
+
+==============================================================================*/
+void METRICS_ConcurrencyLimit( size_t limit )
+{
+    __atomic_store_n( &metrics.concurrencyLimit, limit, __ATOMIC_RELAXED );
+}
+
+/*============================================================================*/
+/*  METRICS_Now                                                               */
+/*!
+    Get the monotonic time used for latency samples
+
+    @retval the current monotonic time in microseconds
+
+==============================================================================*/
+uint64_t METRICS_Now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ( (uint64_t)ts.tv_sec * 1000000 ) + ( ts.tv_nsec / 1000 );
+}
+
+/*============================================================================*/
+/*  METRICS_Write                                                             */
+/*!
+    Write a snapshot of the metrics
+
+    The METRICS_Write function formats the metrics in the Prometheus
+    text format and writes them to a file descriptor.  SIGPIPE is
+    blocked on the calling thread during the write so a client which
+    has disconnected is reported as EPIPE instead of terminating
+    iotexec.
+
+    @param[in]
+        fd
+            the file descriptor which receives the metrics
+
+    @retval EOK the metrics were written
+    @retval EINVAL invalid arguments
+    @retval ENOMEM could not allocate the snapshot buffer
+    @retval EIO the file descriptor accepted no more output
+    @retval error as returned by write
+
+==============================================================================*/
+int METRICS_Write( int fd )
+{
+    int result = EINVAL;
+    char *buf;
+    size_t size = METRICS_BUFFER_SIZE;
+    size_t length = 0;
+    size_t offset = 0;
+    sigset_t mask;
+    sigset_t old;
+    struct timespec zero = { 0, 0 };
+    ssize_t n;
+    uint64_t count;
+    int i;
+
+    if( fd != -1 )
+    {
+        buf = malloc( size );
+        if( buf != NULL )
+        {
+            for( i = 0; i < METRICS_COUNTERS; i++ )
+            {
+                length = Format( buf, size, length,
+                                 "# TYPE %s counter\n%s %llu\n",
+                                 counterNames[i],
+                                 counterNames[i],
+                                 (unsigned long long)
+                                    Load( &metrics.counters[i] ) );
+            }
+
+            length = Format( buf, size, length,
+                             "# TYPE iotexec_queue_depth gauge\n"
+                             "iotexec_queue_depth %llu\n"
+                             "# TYPE iotexec_queue_depth_max gauge\n"
+                             "iotexec_queue_depth_max %llu\n"
+                             "# TYPE iotexec_concurrency_limit gauge\n"
+                             "iotexec_concurrency_limit %llu\n",
+                             (unsigned long long)
+                                Load( &metrics.queueDepth ),
+                             (unsigned long long)
+                                Load( &metrics.maxQueueDepth ),
+                             (unsigned long long)
+                                Load( &metrics.concurrencyLimit ) );
+
+            length = Format( buf, size, length,
+                             "# TYPE iotexec_failures_total counter\n" );
+            for( i = 0; i < METRICS_MAX_ERRNO; i++ )
+            {
+                count = Load( &metrics.failures[i] );
+                if( count > 0 )
+                {
+                    length = Format( buf, size, length,
+                                     "iotexec_failures_total"
+                                     "{errno=\"%d\"} %llu\n",
+                                     i,
+                                     (unsigned long long)count );
+                }
+            }
+
+            for( i = 0; i < METRICS_HISTOGRAMS; i++ )
+            {
+                length = FormatHistogram( buf, size, length, i );
+            }
+
+            sigemptyset( &mask );
+            sigaddset( &mask, SIGPIPE );
+            pthread_sigmask( SIG_BLOCK, &mask, &old );
+
+            result = EOK;
+            while( ( offset < length ) && ( result == EOK ) )
+            {
+                n = write( fd, &buf[offset], length - offset );
+                if( n > 0 )
+                {
+                    offset += n;
+                }
+                else if( n == 0 )
+                {
+                    result = EIO;
+                }
+                else if( errno != EINTR )
+                {
+                    result = errno;
+                }
+            }
+
+            if( result == EPIPE )
+            {
+                /* discard the pending SIGPIPE */
+                sigtimedwait( &mask, NULL, &zero );
+            }
+
+            pthread_sigmask( SIG_SETMASK, &old, NULL );
+
+            free( buf );
+        }
+        else
+        {
+            result = ENOMEM;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  METRICS_Listen                                                            */
+/*!
+    Serve the metrics on a Unix domain socket
+
+    The METRICS_Listen function creates a Unix domain stream socket
+    which is readable only by the owner and group of the iotexec
+    process, and starts a thread which writes a snapshot of the metrics
+    to each connection.  A stale socket left at the path is replaced.
+
+    @param[in]
+        path
+            pointer to the NUL terminated path of the socket
+
+    @retval EOK the metrics server was started
+    @retval EINVAL invalid arguments
+    @retval ENAMETOOLONG the path is too long for a socket address
+    @retval error as returned by socket, bind, listen or pthread_create
+
+==============================================================================*/
+int METRICS_Listen( const char *path )
+{
+    int result = EINVAL;
+    struct sockaddr_un addr;
+    pthread_t thread;
+    int *pfd;
+
+    if( path != NULL )
+    {
+        memset( &addr, 0, sizeof( addr ) );
+        addr.sun_family = AF_UNIX;
+
+        pfd = malloc( sizeof( int ) );
+        if( pfd != NULL )
+        {
+            *pfd = -1;
+        }
+
+        if( strlen( path ) >= sizeof( addr.sun_path ) )
+        {
+            result = ENAMETOOLONG;
+        }
+        else if( pfd == NULL )
+        {
+            result = ENOMEM;
+        }
+        else
+        {
+            strcpy( addr.sun_path, path );
+            unlink( path );
+
+            *pfd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+            if( ( *pfd != -1 ) &&
+                ( bind( *pfd,
+                        (struct sockaddr *)&addr,
+                        sizeof( addr ) ) == 0 ) &&
+                ( chmod( path, 0660 ) == 0 ) &&
+                ( listen( *pfd, 4 ) == 0 ) )
+            {
+                result = pthread_create( &thread, NULL, ServerThread, pfd );
+                if( result == EOK )
+                {
+                    pthread_detach( thread );
+                    pfd = NULL;
+                }
+            }
+            else
+            {
+                result = errno;
+            }
+        }
+
+        if( pfd != NULL )
+        {
+            if( *pfd != -1 )
+            {
+                close( *pfd );
+            }
+
+            free( pfd );
+        }
+    }
+
+    return result;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  ServerThread                                                              */
+/*!
+    Metrics server thread
+
+    The ServerThread function accepts connections to the metrics socket
+    and writes a snapshot of the metrics to each one.
+
+    @param[in]
+        arg
+            pointer to the listening socket descriptor, which is
+            owned by the thread
+
+    @retval NULL
+
+==============================================================================*/
+static void *ServerThread( void *arg )
+{
+    int *pfd = (int *)arg;
+    int fd;
+
+    if( pfd != NULL )
+    {
+        while( true )
+        {
+            fd = accept4( *pfd, NULL, NULL, SOCK_CLOEXEC );
+            if( fd != -1 )
+            {
+                METRICS_Write( fd );
+                close( fd );
+            }
+            else if( ( errno != EINTR ) && ( errno != ECONNABORTED ) )
+            {
+                break;
+            }
+        }
+
+        close( *pfd );
+        free( pfd );
+    }
+
+    return NULL;
+}
+
+/*============================================================================*/
+/*  Format                                                                    */
+/*!
+    Append formatted text to the metrics snapshot
+
+    @param[in]
+        buf
+            pointer to the snapshot buffer
+
+    @param[in]
+        size
+            size of the snapshot buffer
+
+    @param[in]
+        length
+            number of bytes already in the buffer
+
+    @param[in]
+        fmt
+            printf style format string
+
+    @retval the new length of the snapshot, which is unchanged if the
+            text does not fit
+
+==============================================================================*/
+static size_t Format( char *buf, size_t size, size_t length,
+                      const char *fmt, ... )
+{
+    va_list args;
+    int n;
+
+    if( length < size )
+    {
+        va_start( args, fmt );
+        n = vsnprintf( &buf[length], size - length, fmt, args );
+        va_end( args );
+
+        if( ( n > 0 ) && ( (size_t)n < size - length ) )
+        {
+            length += n;
+        }
+    }
+
+    return length;
+}
+
+/*============================================================================*/
+/*  FormatHistogram                                                           */
+/*!
+    Append a latency histogram to the metrics snapshot
+
+    The FormatHistogram function writes the cumulative bucket counts,
+    sum and count of a histogram.  Buckets above the largest sample
+    are omitted.
+
+    @param[in]
+        buf
+            pointer to the snapshot buffer
+
+    @param[in]
+        size
+            size of the snapshot buffer
+
+    @param[in]
+        length
+            number of bytes already in the buffer
+
+    @param[in]
+        histogram
+            the histogram to write
+
+    @retval the new length of the snapshot
+
+==============================================================================*/
+static size_t FormatHistogram( char *buf,
+                               size_t size,
+                               size_t length,
+                               MetricsHistogram histogram )
+{
+    Histogram *pHistogram = &metrics.histograms[histogram];
+    const char *name = histogramNames[histogram];
+    uint64_t total = 0;
+    uint64_t count;
+    int last = 0;
+    int i;
+
+    for( i = 0; i < METRICS_BUCKETS; i++ )
+    {
+        if( Load( &pHistogram->buckets[i] ) > 0 )
+        {
+            last = i;
+        }
+    }
+
+    length = Format( buf, size, length, "# TYPE %s histogram\n", name );
+
+    for( i = 0; i <= last; i++ )
+    {
+        total += Load( &pHistogram->buckets[i] );
+        length = Format( buf, size, length,
+                         "%s_bucket{le=\"%llu\"} %llu\n",
+                         name,
+                         ( 1ULL << i ) - 1,
+                         (unsigned long long)total );
+    }
+
+    /* the count may be ahead of the buckets read above */
+    count = Load( &pHistogram->count );
+    length = Format( buf, size, length,
+                     "%s_bucket{le=\"+Inf\"} %llu\n"
+                     "%s_sum %llu\n"
+                     "%s_count %llu\n",
+                     name,
+                     (unsigned long long)( ( count > total ) ? count : total ),
+                     name,
+                     (unsigned long long)Load( &pHistogram->sum ),
+                     name,
+                     (unsigned long long)count );
+
+    return length;
+}
+
+/*============================================================================*/
+/*  Load                                                                      */
+/*!
+    Read a metric which may be updated concurrently
+
+    @param[in]
+        pValue
+            pointer to the metric
+
+    @retval the value of the metric
+
+==============================================================================*/
+static uint64_t Load( uint64_t *pValue )
+{
+    return __atomic_load_n( pValue, __ATOMIC_RELAXED );
+}
+
+#endif
+
+/*! @}
+ * end of metrics group */
@@ -0,0 +1,799 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup outbox outbox
+ * @brief Asynchronous response sender
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file outbox.c
+
+    Asynchronous response sender
+
+    The outbox module decouples sending command responses from executing
+    the commands.  Response messages are copied into a bounded queue
+    and sent in order by a sender thread with its own iotclient
+    connection, so a command completes as soon as its output has been
+    queued, and a slow uplink holds back the queue rather than the
+    executor.
+
+    Messages which fail with a transient error are retried with an
+    exponential backoff.  The queue blocks at the head while a message
+    is retried, so the messages of a response are never reordered.
+
+    The memory held by the queue is bounded.  When it is full, new
+    messages are either appended to a spill file, which is emptied
+    again once the sender has caught up, or the caller waits until the
+    sender has made room.  A single message which is larger than the
+    bound is accepted once the queue is empty.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <iotclient/iotclient.h>
+#include "outbox.h"
+#include "metrics.h"
+#include "verbose.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+#ifndef EOK
+/*! success response */
+#define EOK 0
+#endif
+
+/*! maximum number of attempts to send a message */
+#define OUTBOX_MAX_ATTEMPTS 10
+
+/*! delay (ms) before the first retry of a message */
+#define OUTBOX_RETRY_MS 100
+
+/*! maximum delay (ms) between retries of a message */
+#define OUTBOX_MAX_RETRY_MS 5000
+
+/*! maximum length of a spill file path */
+#define OUTBOX_MAX_PATH 256
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static void *SenderThread( void *arg );
+static int SendMessage( Outbox *pOutbox, OutboxMessage *pMessage );
+static int Spill( Outbox *pOutbox,
+                  OutboxMessage *pMessage,
+                  const char *headers,
+                  const char *pData );
+static int OpenSpillFile( const char *spillDir );
+static int WriteAt( int fd, const char *pData, size_t length, off_t offset );
+static int ReadAt( int fd, char *pData, size_t length, off_t offset );
+static bool IsTransient( int error );
+static void Delay( unsigned int ms );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  OUTBOX_Create                                                             */
+/*!
+    Create the asynchronous response sender
+
+    The OUTBOX_Create function opens the sender's iotclient connection
+    and spill file, and starts the sender thread.
+
+    @param[in]
+        pOutbox
+            pointer to the Outbox to create
+
+    @param[in]
+        maxBytes
+            maximum bytes of messages held in memory
+
+    @param[in]
+        spillDir
+            pointer to the NUL terminated directory of the spill file,
+            or NULL to wait for the sender when the queue is full
+
+    @param[in]
+        verbose
+            true to report messages which could not be sent
+
+    @retval EOK the sender was started
+    @retval EINVAL invalid arguments
+    @retval ENOTCONN the iotclient connection could not be created
+    @retval error as returned by open or pthread_create
+
+==============================================================================*/
+int OUTBOX_Create( Outbox *pOutbox,
+                   size_t maxBytes,
+                   const char *spillDir,
+                   bool verbose )
+{
+    int result = EINVAL;
+
+    if( ( pOutbox != NULL ) &&
+        ( maxBytes > 0 ) )
+    {
+        memset( pOutbox, 0, sizeof( Outbox ) );
+        pOutbox->maxBytes = maxBytes;
+        pOutbox->verbose = verbose;
+        pOutbox->spillFd = -1;
+
+        pthread_mutex_init( &pOutbox->lock, NULL );
+        pthread_cond_init( &pOutbox->ready, NULL );
+        pthread_cond_init( &pOutbox->space, NULL );
+
+        result = EOK;
+        if( spillDir != NULL )
+        {
+            pOutbox->spillFd = OpenSpillFile( spillDir );
+            if( pOutbox->spillFd == -1 )
+            {
+                result = errno;
+            }
+        }
+
+        if( result == EOK )
+        {
+            pOutbox->hIoTClient = IOTCLIENT_Create();
+            if( pOutbox->hIoTClient != NULL )
+            {
+                IOTCLIENT_SetVerbose( pOutbox->hIoTClient, verbose );
+                result = pthread_create( &pOutbox->thread,
+                                         NULL,
+                                         SenderThread,
+                                         pOutbox );
+                if( result != EOK )
+                {
+                    IOTCLIENT_Close( pOutbox->hIoTClient );
+                    pOutbox->hIoTClient = NULL;
+                }
+            }
+            else
+            {
+                result = ENOTCONN;
+            }
+        }
+
+        if( ( result != EOK ) && ( pOutbox->spillFd != -1 ) )
+        {
+            close( pOutbox->spillFd );
+            pOutbox->spillFd = -1;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  OUTBOX_Send                                                               */
+/*!
+    Queue a response message
+
+    The OUTBOX_Send function copies a message into the queue of the
+    sender thread.  If the queue is full the message is written to the
+    spill file, or the caller waits until the sender has made room.
+
+    @param[in]
+        pOutbox
+            pointer to the Outbox
+
+    @param[in]
+        headers
+            pointer to the NUL terminated message headers
+
+    @param[in]
+        pData
+            pointer to the message body
+
+    @param[in]
+        length
+            length of the message body
+
+    @retval EOK the message was queued
+    @retval EINVAL invalid arguments
+    @retval ENOMEM could not allocate the message
+    @retval error as returned by writing the spill file
+
+==============================================================================*/
+int OUTBOX_Send( Outbox *pOutbox,
+                 const char *headers,
+                 const char *pData,
+                 size_t length )
+{
+    int result = EINVAL;
+    OutboxMessage *pMessage = NULL;
+    size_t headerLength;
+    size_t size;
+    bool spill;
+
+    if( ( pOutbox != NULL ) &&
+        ( headers != NULL ) &&
+        ( ( pData != NULL ) || ( length == 0 ) ) )
+    {
+        headerLength = strlen( headers );
+        size = headerLength + 1 + length;
+
+        pthread_mutex_lock( &pOutbox->lock );
+
+        /* wait for room unless the message can be spilled */
+        while( ( pOutbox->bytes > 0 ) &&
+               ( pOutbox->bytes + size > pOutbox->maxBytes ) &&
+               ( pOutbox->spillFd == -1 ) )
+        {
+            pthread_cond_wait( &pOutbox->space, &pOutbox->lock );
+        }
+
+        spill = ( pOutbox->bytes > 0 ) &&
+                ( pOutbox->bytes + size > pOutbox->maxBytes );
+
+        pMessage = malloc( sizeof( OutboxMessage ) + ( spill ? 0 : size ) );
+        if( pMessage != NULL )
+        {
+            pMessage->pNext = NULL;
+            pMessage->headerLength = headerLength;
+            pMessage->length = length;
+            pMessage->offset = -1;
+
+            if( spill )
+            {
+                result = Spill( pOutbox, pMessage, headers, pData );
+            }
+            else
+            {
+                memcpy( pMessage->data, headers, headerLength + 1 );
+                if( length > 0 )
+                {
+                    memcpy( &pMessage->data[headerLength + 1], pData, length );
+                }
+
+                pOutbox->bytes += size;
+                result = EOK;
+            }
+
+            if( result == EOK )
+            {
+                if( pOutbox->pTail != NULL )
+                {
+                    pOutbox->pTail->pNext = pMessage;
+                }
+                else
+                {
+                    pOutbox->pHead = pMessage;
+                }
+
+                pOutbox->pTail = pMessage;
+                pthread_cond_signal( &pOutbox->ready );
+            }
+            else
+            {
+                free( pMessage );
+            }
+        }
+        else
+        {
+            result = ENOMEM;
+        }
+
+        pthread_mutex_unlock( &pOutbox->lock );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  OUTBOX_Flush                                                              */
+/*!
+    Wait for the queued response messages to be sent
+
+    The OUTBOX_Flush function waits until the sender has completed every
+    queued message, including any in the spill file, or until the
+    timeout expires.
+
+    @param[in]
+        pOutbox
+            pointer to the Outbox
+
+    @param[in]
+        timeoutMs
+            maximum time to wait (ms)
+
+    @retval EOK the queue is empty
+    @retval ETIMEDOUT messages were still queued when the timeout expired
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int OUTBOX_Flush( Outbox *pOutbox, unsigned int timeoutMs )
+{
+    int result = EINVAL;
+    struct timespec deadline;
+    int rc = EOK;
+
+    if( pOutbox != NULL )
+    {
+        clock_gettime( CLOCK_REALTIME, &deadline );
+        deadline.tv_sec += timeoutMs / 1000;
+        deadline.tv_nsec += (long)( timeoutMs % 1000 ) * 1000000L;
+        if( deadline.tv_nsec >= 1000000000L )
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        pthread_mutex_lock( &pOutbox->lock );
+
+        while( ( ( pOutbox->bytes > 0 ) || ( pOutbox->numSpilled > 0 ) ) &&
+               ( rc != ETIMEDOUT ) )
+        {
+            rc = pthread_cond_timedwait( &pOutbox->space,
+                                         &pOutbox->lock,
+                                         &deadline );
+        }
+
+        result = ( ( pOutbox->bytes > 0 ) || ( pOutbox->numSpilled > 0 ) )
+                    ? ETIMEDOUT
+                    : EOK;
+
+        pthread_mutex_unlock( &pOutbox->lock );
+    }
+
+    return result;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  SenderThread                                                              */
+/*!
+    Response sender thread
+
+    The SenderThread function sends the queued messages in order, and
+    releases their memory or spill file space once they are sent.
+
+    @param[in]
+        arg
+            pointer to the Outbox
+
+    @retval NULL
+
+==============================================================================*/
+static void *SenderThread( void *arg )
+{
+    Outbox *pOutbox = (Outbox *)arg;
+    OutboxMessage *pMessage;
+    int result;
+
+    while( pOutbox != NULL )
+    {
+        pthread_mutex_lock( &pOutbox->lock );
+        while( pOutbox->pHead == NULL )
+        {
+            pthread_cond_wait( &pOutbox->ready, &pOutbox->lock );
+        }
+
+        pMessage = pOutbox->pHead;
+        pOutbox->pHead = pMessage->pNext;
+        if( pOutbox->pHead == NULL )
+        {
+            pOutbox->pTail = NULL;
+        }
+
+        pthread_mutex_unlock( &pOutbox->lock );
+
+        result = SendMessage( pOutbox, pMessage );
+        if( result != EOK )
+        {
+            METRICS_Failure( result );
+            if( VERBOSE( pOutbox->verbose ) )
+            {
+                fprintf( stderr,
+                         "Response message dropped: %s\n",
+                         strerror( result ) );
+            }
+        }
+
+        pthread_mutex_lock( &pOutbox->lock );
+        if( pMessage->offset != -1 )
+        {
+            pOutbox->numSpilled--;
+            if( pOutbox->numSpilled == 0 )
+            {
+                /* the sender has caught up: empty the spill file */
+                if( ftruncate( pOutbox->spillFd, 0 ) == 0 )
+                {
+                    pOutbox->spillLength = 0;
+                }
+            }
+        }
+        else
+        {
+            pOutbox->bytes -= pMessage->headerLength + 1 + pMessage->length;
+        }
+
+        pthread_cond_broadcast( &pOutbox->space );
+        pthread_mutex_unlock( &pOutbox->lock );
+
+        free( pMessage );
+    }
+
+    return NULL;
+}
+
+/*============================================================================*/
+/*  SendMessage                                                               */
+/*!
+    Send a queued message
+
+    The SendMessage function reads a spilled message back from the spill
+    file, and sends the message, retrying transient errors with an
+    exponential backoff.
+
+    @param[in]
+        pOutbox
+            pointer to the Outbox
+
+    @param[in]
+        pMessage
+            pointer to the message to send
+
+    @retval EOK the message was sent
+    @retval ENOMEM could not allocate memory to read a spilled message
+    @retval error as returned by IOTCLIENT_Send or reading the spill file
+
+==============================================================================*/
+static int SendMessage( Outbox *pOutbox, OutboxMessage *pMessage )
+{
+    int result = EOK;
+    char *pData = pMessage->data;
+    size_t size = pMessage->headerLength + 1 + pMessage->length;
+    unsigned int delay = OUTBOX_RETRY_MS;
+    int attempts = 0;
+
+    if( pMessage->offset != -1 )
+    {
+        pData = malloc( size );
+        result = ( pData != NULL )
+                    ? ReadAt( pOutbox->spillFd, pData, size, pMessage->offset )
+                    : ENOMEM;
+    }
+
+    while( result == EOK )
+    {
+        result = IOTCLIENT_Send( pOutbox->hIoTClient,
+                                 pData,
+                                 &pData[pMessage->headerLength + 1],
+                                 pMessage->length );
+        if( ( result == EOK ) ||
+            ( IsTransient( result ) == false ) ||
+            ( ++attempts == OUTBOX_MAX_ATTEMPTS ) )
+        {
+            break;
+        }
+
+        METRICS_Count( METRICS_RETRIES, 1 );
+        Delay( delay );
+        delay = ( delay * 2 < OUTBOX_MAX_RETRY_MS ) ? delay * 2
+                                                    : OUTBOX_MAX_RETRY_MS;
+        result = EOK;
+    }
+
+    if( pData != pMessage->data )
+    {
+        free( pData );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  Spill                                                                     */
+/*!
+    Append a message to the spill file
+
+    @param[in]
+        pOutbox
+            pointer to the Outbox, which is locked
+
+    @param[in]
+        pMessage
+            pointer to the message, which receives its spill file offset
+
+    @param[in]
+        headers
+            pointer to the NUL terminated message headers
+
+    @param[in]
+        pData
+            pointer to the message body
+
+    @retval EOK the message was spilled
+    @retval error as returned by pwrite
+
+==============================================================================*/
+static int Spill( Outbox *pOutbox,
+                  OutboxMessage *pMessage,
+                  const char *headers,
+                  const char *pData )
+{
+    int result;
+    off_t offset = pOutbox->spillLength;
+
+    result = WriteAt( pOutbox->spillFd,
+                      headers,
+                      pMessage->headerLength + 1,
+                      offset );
+    if( ( result == EOK ) && ( pMessage->length > 0 ) )
+    {
+        result = WriteAt( pOutbox->spillFd,
+                          pData,
+                          pMessage->length,
+                          offset + pMessage->headerLength + 1 );
+    }
+
+    if( result == EOK )
+    {
+        pMessage->offset = offset;
+        pOutbox->spillLength += pMessage->headerLength + 1 + pMessage->length;
+        pOutbox->numSpilled++;
+        METRICS_Count( METRICS_SPILLED, pMessage->length );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  OpenSpillFile                                                             */
+/*!
+    Open an anonymous spill file
+
+    The OpenSpillFile function creates an unnamed temporary file in the
+    spill directory, so its space is released however iotexec exits.
+    If the file system does not support unnamed files, a named file is
+    created and immediately unlinked.
+
+    @param[in]
+        spillDir
+            pointer to the NUL terminated spill directory
+
+    @retval file descriptor of the spill file
+    @retval -1 the spill file could not be created (see errno)
+
+==============================================================================*/
+static int OpenSpillFile( const char *spillDir )
+{
+    char path[OUTBOX_MAX_PATH];
+    int fd;
+
+    fd = open( spillDir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600 );
+    if( ( fd == -1 ) &&
+        ( snprintf( path,
+                    sizeof( path ),
+                    "%s/iotexec-spill-XXXXXX",
+                    spillDir ) < (int)sizeof( path ) ) )
+    {
+        fd = mkostemp( path, O_CLOEXEC );
+        if( fd != -1 )
+        {
+            unlink( path );
+        }
+    }
+
+    return fd;
+}
+
+/*============================================================================*/
+/*  WriteAt                                                                   */
+/*!
+    Write a buffer at a file offset
+
+    @param[in]
+        fd
+            the file descriptor
+
+    @param[in]
+        pData
+            pointer to the data to write
+
+    @param[in]
+        length
+            number of bytes to write
+
+    @param[in]
+        offset
+            offset in the file
+
+    @retval EOK the data was written
+    @retval error as returned by pwrite
+
+==============================================================================*/
+static int WriteAt( int fd, const char *pData, size_t length, off_t offset )
+{
+    int result = EOK;
+    ssize_t n;
+
+    while( ( length > 0 ) && ( result == EOK ) )
+    {
+        n = pwrite( fd, pData, length, offset );
+        if( n > 0 )
+        {
+            pData += n;
+            length -= n;
+            offset += n;
+        }
+        else if( ( n < 0 ) && ( errno != EINTR ) )
+        {
+            result = errno;
+        }
+        else if( n == 0 )
+        {
+            result = ENOSPC;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  ReadAt                                                                    */
+/*!
+    Read a buffer from a file offset
+
+    @param[in]
+        fd
+            the file descriptor
+
+    @param[out]
+        pData
+            pointer to the buffer which receives the data
+
+    @param[in]
+        length
+            number of bytes to read
+
+    @param[in]
+        offset
+            offset in the file
+
+    @retval EOK the data was read
+    @retval EIO the file ended before the data was read
+    @retval error as returned by pread
+
+==============================================================================*/
+static int ReadAt( int fd, char *pData, size_t length, off_t offset )
+{
+    int result = EOK;
+    ssize_t n;
+
+    while( ( length > 0 ) && ( result == EOK ) )
+    {
+        n = pread( fd, pData, length, offset );
+        if( n > 0 )
+        {
+            pData += n;
+            length -= n;
+            offset += n;
+        }
+        else if( ( n < 0 ) && ( errno != EINTR ) )
+        {
+            result = errno;
+        }
+        else if( n == 0 )
+        {
+            result = EIO;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IsTransient                                                               */
+/*!
+    Determine if a send error may succeed when retried
+
+    @param[in]
+        error
+            the error returned by IOTCLIENT_Send
+
+    @retval true the error is transient
+    @retval false the message cannot be sent
+
+==============================================================================*/
+static bool IsTransient( int error )
+{
+    bool transient;
+
+    switch( error )
+    {
+        case EAGAIN:
+        case EINTR:
+        case EBUSY:
+        case ENOBUFS:
+        case ETIMEDOUT:
+        case ECONNREFUSED:
+        case ECONNRESET:
+        case ENOTCONN:
+        case EPIPE:
+        case ENETDOWN:
+        case ENETUNREACH:
+        case EHOSTUNREACH:
+            transient = true;
+            break;
+
+        default:
+            transient = false;
+            break;
+    }
+
+    return transient;
+}
+
+/*============================================================================*/
+/*  Delay                                                                     */
+/*!
+    Wait before retrying a message
+
+    @param[in]
+        ms
+            the delay in milliseconds
+
+==============================================================================*/
+static void Delay( unsigned int ms )
+{
+    struct timespec ts;
+
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = ( ms % 1000 ) * 1000000L;
+
+    while( ( nanosleep( &ts, &ts ) == -1 ) && ( errno == EINTR ) )
+    {
+        /* resume the delay after a signal */
+    }
+}
+
+/*! @}
+ * end of outbox group */
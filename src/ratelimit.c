@@ -0,0 +1,283 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup ratelimit ratelimit
+ * @brief Per-originator command rate limit
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file ratelimit.c
+
+    Per-originator command rate limit
+
+    The ratelimit module limits the rate at which each originator (the
+    userId or source header of a message) may submit commands, so one
+    misbehaving cloud script cannot saturate iotexec and crowd out the
+    operators.  Messages without either header share one anonymous
+    originator.
+
+    Each originator has a token bucket which holds up to burst tokens
+    and is refilled at rate tokens per second.  A command takes a token,
+    and a command whose originator has no token left is refused.
+
+    The buckets of a fixed number of recently seen originators are kept.
+    When a new originator is seen, it takes over the bucket of the
+    originator seen least recently, whose bucket is most likely to have
+    been refilled.
+
+    The rate limit is used only by the message dispatcher, so it
+    performs no locking.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "ratelimit.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+#ifndef EOK
+/*! success response */
+#define EOK 0
+#endif
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static RateBucket *GetBucket( RateLimit *pLimit,
+                              const char *originator,
+                              uint64_t now );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  RATELIMIT_Init                                                            */
+/*!
+    Initialize a per-originator command rate limit
+
+    @param[in]
+        pLimit
+            pointer to the RateLimit to initialize
+
+    @param[in]
+        size
+            number of originators whose token buckets are kept
+
+    @param[in]
+        rate
+            commands per second allowed to each originator
+
+    @param[in]
+        burst
+            number of commands an idle originator may send at once
+
+    @retval EOK the rate limit was initialized
+    @retval EINVAL invalid arguments
+    @retval ENOMEM could not allocate the token buckets
+
+==============================================================================*/
+int RATELIMIT_Init( RateLimit *pLimit,
+                    size_t size,
+                    double rate,
+                    double burst )
+{
+    int result = EINVAL;
+
+    if( ( pLimit != NULL ) &&
+        ( size > 0 ) &&
+        ( rate > 0.0 ) &&
+        ( burst >= 1.0 ) )
+    {
+        memset( pLimit, 0, sizeof( RateLimit ) );
+        pLimit->rate = rate;
+        pLimit->burst = burst;
+
+        pLimit->pBuckets = calloc( size, sizeof( RateBucket ) );
+        if( pLimit->pBuckets != NULL )
+        {
+            pLimit->size = size;
+            result = EOK;
+        }
+        else
+        {
+            result = ENOMEM;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RATELIMIT_Take                                                            */
+/*!
+    Take a token for a command
+
+    The RATELIMIT_Take function refills the token bucket of the command's
+    originator for the time elapsed since it was last used, and takes a
+    token from it.
+
+    @param[in]
+        pLimit
+            pointer to the RateLimit
+
+    @param[in]
+        originator
+            pointer to the NUL terminated originator, empty if anonymous
+
+    @param[in]
+        now
+            current monotonic time in milliseconds
+
+    @param[out]
+        pRetryMs
+            pointer to the location to store the time in milliseconds
+            until the originator's next token, if it has none
+
+    @retval true the command may be executed
+    @retval false the originator has exceeded its rate
+
+==============================================================================*/
+bool RATELIMIT_Take( RateLimit *pLimit,
+                     const char *originator,
+                     uint64_t now,
+                     unsigned long *pRetryMs )
+{
+    bool admitted = true;
+    RateBucket *pBucket;
+
+    if( ( pLimit != NULL ) &&
+        ( originator != NULL ) &&
+        ( pRetryMs != NULL ) )
+    {
+        pBucket = GetBucket( pLimit, originator, now );
+
+        if( now > pBucket->time )
+        {
+            pBucket->tokens += (double)( now - pBucket->time ) *
+                               pLimit->rate / 1000.0;
+            if( pBucket->tokens > pLimit->burst )
+            {
+                pBucket->tokens = pLimit->burst;
+            }
+        }
+
+        pBucket->time = now;
+
+        if( pBucket->tokens >= 1.0 )
+        {
+            pBucket->tokens -= 1.0;
+            *pRetryMs = 0;
+        }
+        else
+        {
+            *pRetryMs = (unsigned long)( ( 1.0 - pBucket->tokens ) *
+                                         1000.0 / pLimit->rate ) + 1;
+            admitted = false;
+        }
+    }
+
+    return admitted;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  GetBucket                                                                 */
+/*!
+    Get the token bucket of an originator
+
+    The GetBucket function finds the token bucket of an originator, or
+    assigns it a full bucket, taking over the bucket of the originator
+    seen least recently if every bucket is used.
+
+    @param[in]
+        pLimit
+            pointer to the RateLimit
+
+    @param[in]
+        originator
+            pointer to the NUL terminated originator
+
+    @param[in]
+        now
+            current monotonic time in milliseconds
+
+    @retval pointer to the originator's token bucket
+
+==============================================================================*/
+static RateBucket *GetBucket( RateLimit *pLimit,
+                              const char *originator,
+                              uint64_t now )
+{
+    RateBucket *pBucket = NULL;
+    RateBucket *pOldest = &pLimit->pBuckets[0];
+    RateBucket *pEntry;
+    size_t i;
+
+    for( i = 0; ( i < pLimit->size ) && ( pBucket == NULL ); i++ )
+    {
+        pEntry = &pLimit->pBuckets[i];
+        if( ( pEntry->used ) &&
+            ( strcmp( pEntry->originator, originator ) == 0 ) )
+        {
+            pBucket = pEntry;
+        }
+        else if( ( pOldest->used ) &&
+                 ( ( pEntry->used == false ) ||
+                   ( pEntry->time < pOldest->time ) ) )
+        {
+            pOldest = pEntry;
+        }
+    }
+
+    if( pBucket == NULL )
+    {
+        pBucket = pOldest;
+        strcpy( pBucket->originator, originator );
+        pBucket->tokens = pLimit->burst;
+        pBucket->time = now;
+        pBucket->used = true;
+    }
+
+    return pBucket;
+}
+
+/*! @}
+ * end of ratelimit group */
@@ -0,0 +1,1078 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup reactor reactor
+ * @brief Event driven command executor
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file reactor.c
+
+    Event driven command executor
+
+    The reactor module executes commands from a single thread.  An epoll
+    instance watches the job queue and the output pipe of every running
+    command, and command output is forwarded to the cloud in chunks as
+    it becomes readable.  This allows many commands to execute
+    concurrently without a thread (and its stack) per command.
+
+    The epoll timeout is set to the earliest deadline of the executing
+    commands: the flush deadline of coalesced output, or the time at
+    which a command reaches its timeout and is killed.
+
+    The pipe of a subscription whose output is held back by its rate is
+    not watched until the held output has been sent.
+
+    With an adaptive concurrency limiter, the limit is updated before
+    queued commands are started, and the epoll timeout is also bounded
+    by its next update while queued commands are held back by it.
+
+    The iotclient library does not expose the file descriptor of its
+    receive queue, so the dispatcher thread blocks in IOTCLIENT_Receive
+    and signals the reactor via an eventfd when it queues a job.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <iotclient/iotclient.h>
+#include "reactor.h"
+#include "exec.h"
+#include "verbose.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+/*! maximum number of events handled per epoll_wait */
+#define MAX_EVENTS 16
+
+/*! a command being executed by the reactor */
+typedef struct _command
+{
+    /*! pointer to the previous executing command */
+    struct _command *pPrev;
+
+    /*! pointer to the next executing command */
+    struct _command *pNext;
+
+    /*! the command execution */
+    Exec exec;
+
+    /*! true while the stdout pipe is not watched for held output */
+    bool outHeld;
+
+    /*! true while the stderr pipe is not watched for held output */
+    bool errHeld;
+
+} Command;
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static Job *GetJob( Reactor *pReactor );
+static void EndJob( Reactor *pReactor, Job *pJob, bool release );
+static void StartCommands( Reactor *pReactor );
+static int StartCommand( Reactor *pReactor, Job *pJob );
+static void HandleOutput( Reactor *pReactor, Command *pCommand );
+static void EndOutput( Reactor *pReactor, Command *pCommand );
+static void HandleExit( Reactor *pReactor, Command *pCommand );
+static void EndCommand( Reactor *pReactor, Command *pCommand );
+static void FinishExec( Reactor *pReactor, Exec *pExec );
+static int GetTimeout( Reactor *pReactor );
+static void HandleTimers( Reactor *pReactor );
+static void UpdateHeld( Reactor *pReactor, Command *pCommand );
+static bool IsRepeated( struct epoll_event *pEvents, int index );
+static bool UpdateLimit( Reactor *pReactor );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  REACTOR_Create                                                            */
+/*!
+    Create a reactor
+
+    The REACTOR_Create function creates the epoll instance and the job
+    queue eventfd, and opens the iotclient connection used to send
+    command responses.
+
+    @param[in]
+        pReactor
+            pointer to the Reactor to initialize
+
+    @param[in]
+        maxCommands
+            maximum number of concurrently executing commands
+
+    @param[in]
+        maxDepth
+            maximum number of jobs which can wait in the queue
+
+    @param[in]
+        reserved
+            number of command slots reserved for normal and high
+            priority jobs
+
+    @param[in]
+        pOptions
+            pointer to the service wide execution options, which must
+            remain valid while the reactor is running
+
+    @retval EOK the reactor was created
+    @retval EINVAL invalid arguments
+    @retval ENOTCONN could not connect to the iothub service
+    @retval error as returned by epoll_create1 or eventfd
+
+==============================================================================*/
+int REACTOR_Create( Reactor *pReactor,
+                    size_t maxCommands,
+                    size_t maxDepth,
+                    size_t reserved,
+                    const ExecOptions *pOptions )
+{
+    int result = EINVAL;
+    struct epoll_event ev;
+
+    if( ( pReactor != NULL ) &&
+        ( pOptions != NULL ) &&
+        ( maxCommands > 0 ) &&
+        ( maxDepth > 0 ) )
+    {
+        memset( pReactor, 0, sizeof( Reactor ) );
+        pthread_mutex_init( &pReactor->lock, NULL );
+        pthread_cond_init( &pReactor->notFull, NULL );
+        pReactor->maxCommands = maxCommands;
+        JOBQUEUE_Init( &pReactor->queue, maxDepth, maxCommands, reserved );
+        pReactor->pOptions = pOptions;
+
+        pReactor->epfd = epoll_create1( EPOLL_CLOEXEC );
+        pReactor->evfd = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+        if( ( pReactor->epfd != -1 ) && ( pReactor->evfd != -1 ) )
+        {
+            /* a NULL pointer identifies the job queue eventfd */
+            memset( &ev, 0, sizeof( ev ) );
+            ev.events = EPOLLIN;
+            ev.data.ptr = NULL;
+            if( epoll_ctl( pReactor->epfd,
+                           EPOLL_CTL_ADD,
+                           pReactor->evfd,
+                           &ev ) == 0 )
+            {
+                pReactor->hIoTClient = IOTCLIENT_Create();
+                if( pReactor->hIoTClient != NULL )
+                {
+                    IOTCLIENT_SetVerbose( pReactor->hIoTClient,
+                                          pOptions->verbose );
+                    result = EOK;
+                }
+                else
+                {
+                    result = ENOTCONN;
+                }
+            }
+            else
+            {
+                result = errno;
+            }
+        }
+        else
+        {
+            result = errno;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  REACTOR_Wait                                                              */
+/*!
+    Wait until the reactor can accept a job
+
+    The REACTOR_Wait function blocks while the job queue, or the share
+    of the queue of the job's receiver target, is full, so unprocessed
+    messages remain queued in the target's iotclient receiver, unless
+    the job's originator holds its fair share of the queue.  The job is
+    not submitted.
+
+    @param[in]
+        pReactor
+            pointer to the Reactor
+
+    @param[in]
+        pJob
+            pointer to the job to be submitted
+
+    @retval EOK the job may be submitted
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int REACTOR_Wait( Reactor *pReactor, Job *pJob )
+{
+    int result = EINVAL;
+
+    if( ( pReactor != NULL ) &&
+        ( pJob != NULL ) )
+    {
+        pthread_mutex_lock( &pReactor->lock );
+
+        while( ( JOBQUEUE_IsFull( &pReactor->queue, pJob ) ) &&
+               ( JOBQUEUE_IsOverShare( &pReactor->queue, pJob ) == false ) )
+        {
+            pthread_cond_wait( &pReactor->notFull, &pReactor->lock );
+        }
+
+        pthread_mutex_unlock( &pReactor->lock );
+
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  REACTOR_Submit                                                            */
+/*!
+    Submit a job to the reactor
+
+    The REACTOR_Submit function adds a job to the reactor's priority job
+    queue and signals the reactor thread.  It may be called from any
+    thread.  It does not block: a job which the queue cannot accept is
+    refused, so the caller should first wait for room with REACTOR_Wait.
+
+    On success the job is owned by the reactor.
+
+    @param[in]
+        pReactor
+            pointer to the Reactor
+
+    @param[in]
+        pJob
+            pointer to the job to submit
+
+    @retval EOK the job was queued
+    @retval EINVAL invalid arguments
+    @retval EAGAIN the queue, or the share of the queue of the job's
+            receiver target, is full, so the caller should wait again
+    @retval EBUSY the queue is full and the job's originator holds its
+            fair share of it, so the job must be refused
+
+==============================================================================*/
+int REACTOR_Submit( Reactor *pReactor, Job *pJob )
+{
+    int result = EINVAL;
+    uint64_t one = 1;
+
+    if( ( pReactor != NULL ) &&
+        ( pJob != NULL ) )
+    {
+        pthread_mutex_lock( &pReactor->lock );
+
+        if( JOBQUEUE_IsOverShare( &pReactor->queue, pJob ) )
+        {
+            result = EBUSY;
+        }
+        else if( JOBQUEUE_IsFull( &pReactor->queue, pJob ) )
+        {
+            result = EAGAIN;
+        }
+        else
+        {
+            JOBQUEUE_Put( &pReactor->queue, pJob );
+            result = EOK;
+        }
+
+        pthread_mutex_unlock( &pReactor->lock );
+
+        /* wake up the reactor thread */
+        if( ( result == EOK ) &&
+            ( write( pReactor->evfd, &one, sizeof( one ) ) != sizeof( one ) ) )
+        {
+            /* the eventfd counter is already non-zero */
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  REACTOR_SetShare                                                          */
+/*!
+    Limit the number of executing, and the number of queued, commands
+    of a receiver target
+
+    @param[in]
+        pReactor
+            pointer to the Reactor
+
+    @param[in]
+        target
+            index of the receiver target
+
+    @param[in]
+        share
+            maximum number of the target's commands executing at once,
+            0 for no limit
+
+    @param[in]
+        depth
+            maximum number of queued commands of the target, 0 for no
+            limit other than the depth of the queue
+
+    @retval EOK the share was set
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int REACTOR_SetShare( Reactor *pReactor,
+                      unsigned int target,
+                      size_t share,
+                      size_t depth )
+{
+    int result = EINVAL;
+
+    if( ( pReactor != NULL ) &&
+        ( target < JOB_MAX_TARGETS ) )
+    {
+        pthread_mutex_lock( &pReactor->lock );
+        JOBQUEUE_SetShare( &pReactor->queue, target, share, depth );
+        pthread_cond_broadcast( &pReactor->notFull );
+        pthread_mutex_unlock( &pReactor->lock );
+
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  REACTOR_Run                                                               */
+/*!
+    Run the reactor
+
+    The REACTOR_Run function runs the reactor event loop.  It starts
+    queued commands while there is capacity for them, and forwards
+    command output to the cloud as it becomes available.
+
+    @param[in]
+        pReactor
+            pointer to the Reactor
+
+    @retval EINVAL invalid arguments
+    @retval error as returned by epoll_wait
+
+==============================================================================*/
+int REACTOR_Run( Reactor *pReactor )
+{
+    int result = EINVAL;
+    struct epoll_event events[MAX_EVENTS];
+    Command *pCommand;
+    uint64_t count;
+    int n;
+    int i;
+
+    if( pReactor != NULL )
+    {
+        while( true )
+        {
+            n = epoll_wait( pReactor->epfd,
+                            events,
+                            MAX_EVENTS,
+                            GetTimeout( pReactor ) );
+            if( n == -1 )
+            {
+                if( errno == EINTR )
+                {
+                    continue;
+                }
+
+                result = errno;
+                break;
+            }
+
+            for( i = 0; i < n; i++ )
+            {
+                pCommand = (Command *)events[i].data.ptr;
+                if( pCommand == NULL )
+                {
+                    /* clear the job queue notification */
+                    if( read( pReactor->evfd,
+                              &count,
+                              sizeof( count ) ) != sizeof( count ) )
+                    {
+                        /* spurious wakeup */
+                    }
+                }
+                else if( IsRepeated( events, i ) )
+                {
+                    /* the command's other pipe was already handled, and
+                       the command may have completed */
+                }
+                else if( pCommand->exec.child.fdOut != -1 )
+                {
+                    HandleOutput( pReactor, pCommand );
+                }
+                else
+                {
+                    HandleExit( pReactor, pCommand );
+                }
+            }
+
+            HandleTimers( pReactor );
+            StartCommands( pReactor );
+        }
+    }
+
+    return result;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  GetJob                                                                    */
+/*!
+    Take the next job to execute from the job queue without blocking
+
+    @param[in]
+        pReactor
+            pointer to the Reactor
+
+    @retval pointer to the job removed from the queue
+    @retval NULL there is no job which can be executed
+
+==============================================================================*/
+static Job *GetJob( Reactor *pReactor )
+{
+    Job *pJob;
+
+    pthread_mutex_lock( &pReactor->lock );
+
+    pJob = JOBQUEUE_Get( &pReactor->queue );
+    if( pJob != NULL )
+    {
+        /* the receivers of several targets may be waiting for room */
+        pthread_cond_broadcast( &pReactor->notFull );
+    }
+
+    pthread_mutex_unlock( &pReactor->lock );
+
+    return pJob;
+}
+
+/*============================================================================*/
+/*  EndJob                                                                    */
+/*!
+    Release the execution slot of a completed job and free the job
+
+    @param[in]
+        pReactor
+            pointer to the Reactor
+
+    @param[in]
+        pJob
+            pointer to the completed job
+
+    @param[in]
+        release
+            true to free the job, false if the job is waiting for its
+            session
+
+==============================================================================*/
+static void EndJob( Reactor *pReactor, Job *pJob, bool release )
+{
+    pthread_mutex_lock( &pReactor->lock );
+    JOBQUEUE_Done( &pReactor->queue, pJob );
+    pthread_mutex_unlock( &pReactor->lock );
+
+    if( release )
+    {
+        JOB_Free( pJob );
+    }
+}
+
+/*============================================================================*/
+/*  StartCommands                                                             */
+/*!
+    Start queued commands
+
+    The StartCommands function launches queued jobs in priority order
+    until there is no job which can be executed, or the maximum
+    number of concurrently executing commands is reached.
+
+    @param[in]
+        pReactor
+            pointer to the Reactor
+
+==============================================================================*/
+static void StartCommands( Reactor *pReactor )
+{
+    Job *pJob;
+    int result;
+
+    UpdateLimit( pReactor );
+
+    while( ( pReactor->numCommands < pReactor->maxCommands ) &&
+           ( ( pJob = GetJob( pReactor ) ) != NULL ) )
+    {
+        result = StartCommand( pReactor, pJob );
+        if( result == EINPROGRESS )
+        {
+            /* the job is owned by its session until it is resumed */
+            EndJob( pReactor, pJob, false );
+        }
+        else if( result != EOK )
+        {
+            if( VERBOSE( pReactor->pOptions->verbose ) )
+            {
+                fprintf( stderr, "StartCommand: %s\n", strerror( result ) );
+            }
+
+            EndJob( pReactor, pJob, true );
+        }
+    }
+}
+
+/*============================================================================*/
+/*  StartCommand                                                              */
+/*!
+    Launch a command and register its output pipe with the reactor
+
+    @param[in]
+        pReactor
+            pointer to the Reactor
+
+    @param[in]
+        pJob
+            pointer to the job to execute
+
+    @retval EOK the command was started and now owns the job, or was
+            completed by a builtin and the job was released
+    @retval EINPROGRESS the job is waiting for its session
+    @retval ENOMEM could not allocate the command
+    @retval error as returned by EXEC_Start or epoll_ctl
+
+==============================================================================*/
+static int StartCommand( Reactor *pReactor, Job *pJob )
+{
+    int result = ENOMEM;
+    Command *pCommand;
+    struct epoll_event ev;
+    int flags;
+    int fd;
+
+    pCommand = calloc( 1, sizeof( Command ) );
+    if( pCommand != NULL )
+    {
+        result = EXEC_Start( &pCommand->exec,
+                             pReactor->hIoTClient,
+                             pJob,
+                             pReactor->pOptions );
+        if( result == EINPROGRESS )
+        {
+            /* the job is waiting for its session */
+            free( pCommand );
+            pCommand = NULL;
+        }
+        else if( ( result == EOK ) && ( pCommand->exec.builtin ) )
+        {
+            /* the command was completed by a builtin */
+            FinishExec( pReactor, &pCommand->exec );
+            free( pCommand );
+            EndJob( pReactor, pJob, true );
+        }
+        else if( result == EOK )
+        {
+            fd = pCommand->exec.child.fdOut;
+            flags = fcntl( fd, F_GETFL );
+            fcntl( fd, F_SETFL, flags | O_NONBLOCK );
+
+            memset( &ev, 0, sizeof( ev ) );
+            ev.events = EPOLLIN;
+            ev.data.ptr = pCommand;
+            if( ( epoll_ctl( pReactor->epfd, EPOLL_CTL_ADD, fd, &ev ) == 0 ) &&
+                ( ( pCommand->exec.child.fdErr == -1 ) ||
+                  ( epoll_ctl( pReactor->epfd,
+                               EPOLL_CTL_ADD,
+                               pCommand->exec.child.fdErr,
+                               &ev ) == 0 ) ) )
+            {
+                pCommand->pNext = pReactor->pCommands;
+                if( pReactor->pCommands != NULL )
+                {
+                    pReactor->pCommands->pPrev = pCommand;
+                }
+
+                pReactor->pCommands = pCommand;
+                pReactor->numCommands++;
+            }
+            else
+            {
+                result = errno;
+                epoll_ctl( pReactor->epfd, EPOLL_CTL_DEL, fd, NULL );
+                LAUNCHER_Wait( &pCommand->exec.child, NULL );
+            }
+        }
+
+        if( ( result != EOK ) && ( pCommand != NULL ) )
+        {
+            FinishExec( pReactor, &pCommand->exec );
+            free( pCommand );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  HandleOutput                                                              */
+/*!
+    Forward readable command output
+
+    The HandleOutput function reads one chunk of available output from
+    a command.  Only one read is performed per event so a chatty command
+    cannot starve the other commands.  When the end of the output is
+    reached, or the command is killed for exceeding its output limit,
+    the command is reaped.  The pipe of a stream which ends before the
+    command's other stream is no longer watched.
+
+    @param[in]
+        pReactor
+            pointer to the Reactor
+
+    @param[in]
+        pCommand
+            pointer to the Command with readable output
+
+==============================================================================*/
+static void HandleOutput( Reactor *pReactor, Command *pCommand )
+{
+    int result;
+
+    result = EXEC_Read( &pCommand->exec,
+                        pReactor->buf,
+                        sizeof( pReactor->buf ) );
+    if( ( result != EOK ) && ( result != EAGAIN ) )
+    {
+        /* end of output */
+        EndOutput( pReactor, pCommand );
+    }
+    else
+    {
+        /* stop an ended pipe waking the reactor while the other
+           stream continues */
+        if( pCommand->exec.outputEnded )
+        {
+            epoll_ctl( pReactor->epfd,
+                       EPOLL_CTL_DEL,
+                       pCommand->exec.child.fdOut,
+                       NULL );
+        }
+
+        if( pCommand->exec.errorEnded )
+        {
+            epoll_ctl( pReactor->epfd,
+                       EPOLL_CTL_DEL,
+                       pCommand->exec.child.fdErr,
+                       NULL );
+        }
+
+        UpdateHeld( pReactor, pCommand );
+    }
+}
+
+/*============================================================================*/
+/*  EndOutput                                                                 */
+/*!
+    Handle the end of a command's output
+
+    The EndOutput function stops watching the command's output pipes and
+    reaps the command.  If the command is still running a pidfd is used
+    to wait for it to exit without blocking the reactor.
+
+    @param[in]
+        pReactor
+            pointer to the Reactor
+
+    @param[in]
+        pCommand
+            pointer to the Command whose output has closed
+
+==============================================================================*/
+static void EndOutput( Reactor *pReactor, Command *pCommand )
+{
+    struct epoll_event ev;
+    bool waiting = false;
+
+    Exec *pExec = &pCommand->exec;
+
+    epoll_ctl( pReactor->epfd, EPOLL_CTL_DEL, pExec->child.fdOut, NULL );
+    if( pExec->child.fdErr != -1 )
+    {
+        epoll_ctl( pReactor->epfd, EPOLL_CTL_DEL, pExec->child.fdErr, NULL );
+    }
+
+    if( EXEC_EndOutput( pExec ) == EBUSY )
+    {
+        if( pExec->pidfd != -1 )
+        {
+            memset( &ev, 0, sizeof( ev ) );
+            ev.events = EPOLLIN;
+            ev.data.ptr = pCommand;
+            waiting = ( epoll_ctl( pReactor->epfd,
+                                   EPOLL_CTL_ADD,
+                                   pExec->pidfd,
+                                   &ev ) == 0 );
+        }
+
+        if( waiting == false )
+        {
+            /* pidfd not supported: wait for the command to exit */
+            EXEC_Wait( pExec );
+        }
+    }
+
+    if( waiting == false )
+    {
+        EndCommand( pReactor, pCommand );
+    }
+}
+
+/*============================================================================*/
+/*  HandleExit                                                                */
+/*!
+    Handle the exit of a command whose output has already closed
+
+    @param[in]
+        pReactor
+            pointer to the Reactor
+
+    @param[in]
+        pCommand
+            pointer to the Command which has exited
+
+==============================================================================*/
+static void HandleExit( Reactor *pReactor, Command *pCommand )
+{
+    epoll_ctl( pReactor->epfd, EPOLL_CTL_DEL, pCommand->exec.pidfd, NULL );
+    LAUNCHER_Wait( &pCommand->exec.child, &pCommand->exec.status );
+    EndCommand( pReactor, pCommand );
+}
+
+/*============================================================================*/
+/*  EndCommand                                                                */
+/*!
+    Release a completed command
+
+    @param[in]
+        pReactor
+            pointer to the Reactor
+
+    @param[in]
+        pCommand
+            pointer to the completed Command
+
+==============================================================================*/
+static void EndCommand( Reactor *pReactor, Command *pCommand )
+{
+    if( pCommand->pPrev != NULL )
+    {
+        pCommand->pPrev->pNext = pCommand->pNext;
+    }
+    else
+    {
+        pReactor->pCommands = pCommand->pNext;
+    }
+
+    if( pCommand->pNext != NULL )
+    {
+        pCommand->pNext->pPrev = pCommand->pPrev;
+    }
+
+    FinishExec( pReactor, &pCommand->exec );
+    EndJob( pReactor, pCommand->exec.pJob, true );
+    free( pCommand );
+
+    pReactor->numCommands--;
+}
+
+/*============================================================================*/
+/*  FinishExec                                                                */
+/*!
+    Complete the execution of a command and resume its session
+
+    The FinishExec function completes the command response.  If a job
+    was waiting for the command's session, it is started.
+
+    @param[in]
+        pReactor
+            pointer to the Reactor
+
+    @param[in]
+        pExec
+            pointer to the Exec to complete
+
+==============================================================================*/
+static void FinishExec( Reactor *pReactor, Exec *pExec )
+{
+    Job *pJob;
+
+    EXEC_Finish( pExec );
+
+    pJob = pExec->pResume;
+    if( pJob != NULL )
+    {
+        pthread_mutex_lock( &pReactor->lock );
+        JOBQUEUE_Resume( &pReactor->queue, pJob );
+        pthread_mutex_unlock( &pReactor->lock );
+
+        if( StartCommand( pReactor, pJob ) != EOK )
+        {
+            EndJob( pReactor, pJob, true );
+        }
+    }
+}
+
+/*============================================================================*/
+/*  GetTimeout                                                                */
+/*!
+    Get the epoll timeout
+
+    The GetTimeout function calculates the time until the earliest
+    deadline of the executing commands, or the next update of the
+    concurrency limit if queued commands are held back by it.
+
+    @param[in]
+        pReactor
+            pointer to the Reactor
+
+    @retval -1 no command has a pending deadline
+    @retval the number of milliseconds until the earliest deadline
+
+==============================================================================*/
+static int GetTimeout( Reactor *pReactor )
+{
+    Command *pCommand;
+    int timeout = ( UpdateLimit( pReactor ) )
+                    ? LIMITER_Timeout( pReactor->pOptions->pLimiter )
+                    : -1;
+    int t;
+
+    for( pCommand = pReactor->pCommands;
+         pCommand != NULL;
+         pCommand = pCommand->pNext )
+    {
+        t = EXEC_Timeout( &pCommand->exec );
+        if( ( t != -1 ) && ( ( timeout == -1 ) || ( t < timeout ) ) )
+        {
+            timeout = t;
+        }
+    }
+
+    return timeout;
+}
+
+/*============================================================================*/
+/*  HandleTimers                                                              */
+/*!
+    Handle commands which have reached a deadline
+
+    The HandleTimers function sends coalesced output which has reached
+    its flush deadline, and kills commands which have reached their
+    timeout.  The output of a killed command is no longer forwarded.
+    The pipes of commands whose held output was sent are watched again.
+
+    @param[in]
+        pReactor
+            pointer to the Reactor
+
+==============================================================================*/
+static void HandleTimers( Reactor *pReactor )
+{
+    Command *pCommand;
+    Command *pNext;
+    int rc;
+
+    for( pCommand = pReactor->pCommands;
+         pCommand != NULL;
+         pCommand = pNext )
+    {
+        pNext = pCommand->pNext;
+
+        rc = ( EXEC_Timeout( &pCommand->exec ) == 0 )
+                ? EXEC_Timer( &pCommand->exec )
+                : EOK;
+        if( ( ( rc == ETIMEDOUT ) || ( rc == ECANCELED ) ) &&
+            ( pCommand->exec.child.fdOut != -1 ) )
+        {
+            EndOutput( pReactor, pCommand );
+        }
+        else if( pCommand->exec.child.fdOut != -1 )
+        {
+            UpdateHeld( pReactor, pCommand );
+        }
+    }
+}
+
+/*============================================================================*/
+/*  UpdateHeld                                                                */
+/*!
+    Stop or resume watching the pipes of a command with held output
+
+    The UpdateHeld function stops watching an output pipe while its
+    response holds back a full coalescing buffer, since the level
+    triggered pipe would otherwise wake the reactor continuously, and
+    resumes watching it once the buffer has been sent.
+
+    @param[in]
+        pReactor
+            pointer to the Reactor
+
+    @param[in]
+        pCommand
+            pointer to the Command with output pipes
+
+==============================================================================*/
+static void UpdateHeld( Reactor *pReactor, Command *pCommand )
+{
+    Exec *pExec = &pCommand->exec;
+    struct epoll_event ev;
+    bool held;
+
+    memset( &ev, 0, sizeof( ev ) );
+    ev.data.ptr = pCommand;
+
+    held = RESPONSE_Held( &pExec->response );
+    if( ( held != pCommand->outHeld ) && ( pExec->outputEnded == false ) )
+    {
+        ev.events = held ? 0 : EPOLLIN;
+        epoll_ctl( pReactor->epfd, EPOLL_CTL_MOD, pExec->child.fdOut, &ev );
+        pCommand->outHeld = held;
+    }
+
+    held = pExec->stderrStream && RESPONSE_Held( &pExec->errResponse );
+    if( ( held != pCommand->errHeld ) && ( pExec->errorEnded == false ) )
+    {
+        ev.events = held ? 0 : EPOLLIN;
+        epoll_ctl( pReactor->epfd, EPOLL_CTL_MOD, pExec->child.fdErr, &ev );
+        pCommand->errHeld = held;
+    }
+}
+
+/*============================================================================*/
+/*  IsRepeated                                                                */
+/*!
+    Determine if an event is for a command already handled in this batch
+
+    A command with a stderr stream has both output pipes registered, so
+    a single epoll_wait can report it twice.  Each HandleOutput reads
+    both pipes, and may complete and free the command, so only the
+    first event for a command is handled.
+
+    @param[in]
+        pEvents
+            pointer to the events returned by epoll_wait
+
+    @param[in]
+        index
+            index of the event to check
+
+    @retval true an earlier event in the batch is for the same command
+    @retval false this is the first event for the command
+
+==============================================================================*/
+static bool IsRepeated( struct epoll_event *pEvents, int index )
+{
+    bool repeated = false;
+    int i;
+
+    for( i = 0; ( i < index ) && ( repeated == false ); i++ )
+    {
+        repeated = ( pEvents[i].data.ptr == pEvents[index].data.ptr );
+    }
+
+    return repeated;
+}
+
+/*============================================================================*/
+/*  UpdateLimit                                                               */
+/*!
+    Update the concurrency limit of the job queue
+
+    The UpdateLimit function applies the adaptive concurrency limit to
+    the job queue once it is due to be updated.
+
+    @param[in]
+        pReactor
+            pointer to the Reactor
+
+    @retval true commands are waiting in the queue, so the limit must
+            be updated again once it is due
+    @retval false there is no limiter, or no command is waiting
+
+==============================================================================*/
+static bool UpdateLimit( Reactor *pReactor )
+{
+    Limiter *pLimiter = pReactor->pOptions->pLimiter;
+    bool waiting = false;
+    size_t limit;
+
+    if( pLimiter != NULL )
+    {
+        pthread_mutex_lock( &pReactor->lock );
+
+        if( LIMITER_Update( pLimiter, &limit ) )
+        {
+            JOBQUEUE_SetLimit( &pReactor->queue, limit );
+        }
+
+        waiting = ( pReactor->queue.depth > 0 );
+
+        pthread_mutex_unlock( &pReactor->lock );
+    }
+
+    return waiting;
+}
+
+/*! @}
+ * end of reactor group */
@@ -0,0 +1,667 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup receiver receiver
+ * @brief Cloud-to-device message receivers
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file receiver.c
+
+    Cloud-to-device message receivers
+
+    The receiver module lets one iotexec instance serve several targets
+    (service names), such as exec, diag and logs, instead of running a
+    copy of the daemon for each command domain.  Each target has its
+    own iotclient receiver, with its own queue depth and maximum
+    message length, and its own defaults for the commands received for
+    it.
+
+    The receivers are listed in the receiver configuration file.  Each
+    line contains a target followed by its settings:
+
+        # target  settings
+        exec      workers=3
+        diag      queue=4 workers=1 priority=high timeout=30
+        logs      queue=2 length=1024 workers=1 maxOutputBytes=1048576
+
+    queue           maximum number of pending received messages
+    length          maximum received message length
+    workers         maximum number of the target's commands executing
+                    at once, its share of the executor workers
+    priority        priority of commands without a priority header
+    timeout         timeout of commands without a timeout header
+    maxOutputBytes  output limit of commands without a maxOutputBytes
+                    header
+    class           execution class of commands without a class header
+
+    Settings which are not given are taken from the iotexec options.
+
+    The iotclient receive call waits on a single connection, so the
+    first receiver uses the connection of iotexec itself and each other
+    receiver has its own connection and receive thread.  The receivers
+    all hand their messages to the same dispatcher, worker pool or
+    reactor, result cache and in-flight job table.
+
+    The receivers are fixed once they are opened, so they are used
+    without locking.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include "receiver.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+#ifndef EOK
+/*! success response */
+#define EOK 0
+#endif
+
+/*! maximum length of a line in the receiver configuration file */
+#define MAX_LINE_LENGTH 512
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static int AddReceiver( ReceiverTable *pTable, char *line );
+static int ParseSetting( Receiver *pReceiver, char *setting );
+static int ParseNumber( const char *value, unsigned long *pNumber );
+static void *ReceiveThread( void *arg );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  RECEIVER_Init                                                             */
+/*!
+    Initialize a receiver table
+
+    @param[in]
+        pTable
+            pointer to the ReceiverTable to initialize
+
+    @param[in]
+        pDefaults
+            pointer to the settings of a receiver which are not given
+            in its definition
+
+==============================================================================*/
+void RECEIVER_Init( ReceiverTable *pTable, const Receiver *pDefaults )
+{
+    if( ( pTable != NULL ) &&
+        ( pDefaults != NULL ) )
+    {
+        memset( pTable, 0, sizeof( ReceiverTable ) );
+        pTable->defaults = *pDefaults;
+        pTable->defaults.hIoTClient = NULL;
+        pTable->defaults.connected = false;
+    }
+}
+
+/*============================================================================*/
+/*  RECEIVER_Load                                                             */
+/*!
+    Load the receivers
+
+    The RECEIVER_Load function reads the receiver targets and their
+    settings from the receiver configuration file.  Blank lines and
+    lines starting with # are ignored.
+
+    @param[in]
+        pTable
+            pointer to the initialized ReceiverTable
+
+    @param[in]
+        filename
+            pointer to the name of the receiver configuration file
+
+    @retval EOK the receivers were loaded
+    @retval EINVAL invalid arguments or invalid receiver definition
+    @retval ENOENT the file defines no receivers
+    @retval error as returned by fopen or RECEIVER_Add
+
+==============================================================================*/
+int RECEIVER_Load( ReceiverTable *pTable, const char *filename )
+{
+    int result = EINVAL;
+    char line[MAX_LINE_LENGTH];
+    FILE *fp;
+
+    if( ( pTable != NULL ) &&
+        ( filename != NULL ) )
+    {
+        fp = fopen( filename, "re" );
+        if( fp != NULL )
+        {
+            result = EOK;
+
+            while( ( result == EOK ) &&
+                   ( fgets( line, sizeof( line ), fp ) != NULL ) )
+            {
+                result = AddReceiver( pTable, line );
+            }
+
+            fclose( fp );
+
+            if( ( result == EOK ) && ( pTable->count == 0 ) )
+            {
+                result = ENOENT;
+            }
+        }
+        else
+        {
+            result = errno;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RECEIVER_Add                                                              */
+/*!
+    Add a receiver with the default settings
+
+    @param[in]
+        pTable
+            pointer to the ReceiverTable
+
+    @param[in]
+        target
+            pointer to the NUL terminated target of the receiver
+
+    @retval EOK the receiver was added
+    @retval EINVAL invalid arguments or target
+    @retval EEXIST the target already has a receiver
+    @retval E2BIG the table already holds JOB_MAX_TARGETS receivers
+
+==============================================================================*/
+int RECEIVER_Add( ReceiverTable *pTable, const char *target )
+{
+    int result = EINVAL;
+    Receiver *pReceiver;
+    size_t i;
+
+    if( ( pTable != NULL ) &&
+        ( target != NULL ) &&
+        ( target[0] != '\0' ) &&
+        ( strlen( target ) < MAX_TARGET_LENGTH ) )
+    {
+        result = EOK;
+
+        for( i = 0; ( i < pTable->count ) && ( result == EOK ); i++ )
+        {
+            if( strcmp( pTable->receivers[i].target, target ) == 0 )
+            {
+                result = EEXIST;
+            }
+        }
+
+        if( ( result == EOK ) && ( pTable->count >= JOB_MAX_TARGETS ) )
+        {
+            result = E2BIG;
+        }
+
+        if( result == EOK )
+        {
+            pReceiver = &pTable->receivers[pTable->count];
+            *pReceiver = pTable->defaults;
+            strcpy( pReceiver->target, target );
+            pReceiver->index = pTable->count++;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RECEIVER_Get                                                              */
+/*!
+    Get a receiver
+
+    @param[in]
+        pTable
+            pointer to the ReceiverTable, or NULL
+
+    @param[in]
+        index
+            index of the receiver, as recorded in its jobs
+
+    @retval pointer to the receiver
+    @retval NULL there is no such receiver
+
+==============================================================================*/
+Receiver *RECEIVER_Get( ReceiverTable *pTable, unsigned int index )
+{
+    Receiver *pReceiver = NULL;
+
+    if( ( pTable != NULL ) &&
+        ( index < pTable->count ) )
+    {
+        pReceiver = &pTable->receivers[index];
+    }
+
+    return pReceiver;
+}
+
+/*============================================================================*/
+/*  RECEIVER_Open                                                             */
+/*!
+    Create the iotclient receivers
+
+    The RECEIVER_Open function creates the iotclient receiver of each
+    target.  The first receiver uses the given connection, and the
+    others connect to the iothub service themselves.
+
+    @param[in]
+        pTable
+            pointer to the ReceiverTable
+
+    @param[in]
+        hIoTClient
+            iotclient connection of the first receiver
+
+    @param[in]
+        verbose
+            verbose flag applied to the connections of the other
+            receivers
+
+    @retval EOK the receivers were created
+    @retval EINVAL invalid arguments, or the table has no receivers
+    @retval ENOTCONN a receiver could not connect to the iothub service
+    @retval error as returned by IOTCLIENT_CreateReceiver
+
+==============================================================================*/
+int RECEIVER_Open( ReceiverTable *pTable,
+                   IOTCLIENT_HANDLE hIoTClient,
+                   bool verbose )
+{
+    int result = EINVAL;
+    Receiver *pReceiver;
+    size_t i;
+
+    if( ( pTable != NULL ) &&
+        ( pTable->count > 0 ) &&
+        ( hIoTClient != NULL ) )
+    {
+        result = EOK;
+
+        for( i = 0; ( i < pTable->count ) && ( result == EOK ); i++ )
+        {
+            pReceiver = &pTable->receivers[i];
+            if( i == 0 )
+            {
+                pReceiver->hIoTClient = hIoTClient;
+            }
+            else
+            {
+                pReceiver->hIoTClient = IOTCLIENT_Create();
+                pReceiver->connected = ( pReceiver->hIoTClient != NULL );
+            }
+
+            if( pReceiver->hIoTClient == NULL )
+            {
+                result = ENOTCONN;
+            }
+            else
+            {
+                if( pReceiver->connected )
+                {
+                    IOTCLIENT_SetVerbose( pReceiver->hIoTClient, verbose );
+                }
+
+                result = IOTCLIENT_CreateReceiver( pReceiver->hIoTClient,
+                                                   pReceiver->target,
+                                                   pReceiver->maxPending,
+                                                   pReceiver->maxMessageLength );
+            }
+        }
+
+        if( result != EOK )
+        {
+            RECEIVER_Close( pTable );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RECEIVER_Run                                                              */
+/*!
+    Receive and dispatch the messages of every target
+
+    The RECEIVER_Run function starts a receive thread for each receiver
+    other than the first, and then receives the messages of the first
+    on the calling thread.  Each thread invokes the handler for its
+    receiver until the process exits.  The handler is invoked from
+    several threads at once when there is more than one receiver.
+
+    @param[in]
+        pTable
+            pointer to the opened ReceiverTable
+
+    @param[in]
+        handler
+            function invoked to receive and dispatch each message
+
+    @param[in]
+        arg
+            opaque argument passed to the handler
+
+    @retval EINVAL invalid arguments
+    @retval error as returned by pthread_create
+
+==============================================================================*/
+int RECEIVER_Run( ReceiverTable *pTable, ReceiverHandler handler, void *arg )
+{
+    int result = EINVAL;
+    Receiver *pReceiver;
+    size_t i;
+
+    if( ( pTable != NULL ) &&
+        ( pTable->count > 0 ) &&
+        ( handler != NULL ) )
+    {
+        result = EOK;
+
+        for( i = 0; ( i < pTable->count ) && ( result == EOK ); i++ )
+        {
+            pReceiver = &pTable->receivers[i];
+            pReceiver->handler = handler;
+            pReceiver->arg = arg;
+
+            if( i > 0 )
+            {
+                result = pthread_create( &pReceiver->thread,
+                                         NULL,
+                                         ReceiveThread,
+                                         pReceiver );
+            }
+        }
+
+        if( result == EOK )
+        {
+            ReceiveThread( &pTable->receivers[0] );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RECEIVER_Close                                                            */
+/*!
+    Close the connections created by the receivers
+
+    The connection of the first receiver, which was given to
+    RECEIVER_Open, is not closed.
+
+    @param[in]
+        pTable
+            pointer to the ReceiverTable
+
+==============================================================================*/
+void RECEIVER_Close( ReceiverTable *pTable )
+{
+    Receiver *pReceiver;
+    size_t i;
+
+    if( pTable != NULL )
+    {
+        for( i = 0; i < pTable->count; i++ )
+        {
+            pReceiver = &pTable->receivers[i];
+            if( pReceiver->connected )
+            {
+                IOTCLIENT_Close( pReceiver->hIoTClient );
+                pReceiver->connected = false;
+            }
+
+            pReceiver->hIoTClient = NULL;
+        }
+    }
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  AddReceiver                                                               */
+/*!
+    Add a receiver from a line of the receiver configuration file
+
+    @param[in]
+        pTable
+            pointer to the ReceiverTable
+
+    @param[in]
+        line
+            pointer to the line to parse.  The line is modified.
+
+    @retval EOK the receiver was added, or the line was blank or a comment
+    @retval EINVAL invalid receiver definition
+    @retval error as returned by RECEIVER_Add
+
+==============================================================================*/
+static int AddReceiver( ReceiverTable *pTable, char *line )
+{
+    int result = EOK;
+    Receiver *pReceiver;
+    char *saveptr = NULL;
+    char *target;
+    char *setting;
+
+    target = strtok_r( line, " \t\r\n", &saveptr );
+    if( ( target != NULL ) && ( target[0] != '#' ) )
+    {
+        result = RECEIVER_Add( pTable, target );
+        if( result == EOK )
+        {
+            pReceiver = &pTable->receivers[pTable->count - 1];
+
+            while( ( result == EOK ) &&
+                   ( ( setting = strtok_r( NULL,
+                                           " \t\r\n",
+                                           &saveptr ) ) != NULL ) )
+            {
+                result = ParseSetting( pReceiver, setting );
+            }
+
+            if( result != EOK )
+            {
+                /* discard the receiver */
+                pTable->count--;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  ParseSetting                                                              */
+/*!
+    Parse a setting of a receiver
+
+    @param[in]
+        pReceiver
+            pointer to the receiver to update
+
+    @param[in]
+        setting
+            pointer to the NUL terminated name=value setting.  The
+            setting is modified.
+
+    @retval EOK the setting was parsed
+    @retval EINVAL invalid setting
+
+==============================================================================*/
+static int ParseSetting( Receiver *pReceiver, char *setting )
+{
+    int result = EINVAL;
+    unsigned long n = 0;
+    char *value;
+
+    value = strchr( setting, '=' );
+    if( value != NULL )
+    {
+        *value++ = '\0';
+
+        if( strcmp( setting, "priority" ) == 0 )
+        {
+            result = ( JOB_ParsePriority( value,
+                                          &pReceiver->priority ) == EOK )
+                        ? EOK
+                        : EINVAL;
+        }
+        else if( strcmp( setting, "class" ) == 0 )
+        {
+            if( strlen( value ) < sizeof( pReceiver->className ) )
+            {
+                strcpy( pReceiver->className, value );
+                result = EOK;
+            }
+        }
+        else if( ParseNumber( value, &n ) == EOK )
+        {
+            if( ( strcmp( setting, "queue" ) == 0 ) && ( n > 0 ) )
+            {
+                pReceiver->maxPending = n;
+                result = EOK;
+            }
+            else if( ( strcmp( setting, "length" ) == 0 ) && ( n > 0 ) )
+            {
+                pReceiver->maxMessageLength = n;
+                result = EOK;
+            }
+            else if( strcmp( setting, "workers" ) == 0 )
+            {
+                pReceiver->workers = n;
+                result = EOK;
+            }
+            else if( strcmp( setting, "timeout" ) == 0 )
+            {
+                pReceiver->timeout = (unsigned int)n;
+                result = EOK;
+            }
+            else if( strcmp( setting, "maxOutputBytes" ) == 0 )
+            {
+                pReceiver->maxOutputBytes = n;
+                result = EOK;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  ParseNumber                                                               */
+/*!
+    Parse a non-negative decimal number
+
+    @param[in]
+        value
+            pointer to the NUL terminated number
+
+    @param[out]
+        pNumber
+            pointer to the location to store the number
+
+    @retval EOK the number was parsed
+    @retval EINVAL invalid number
+
+==============================================================================*/
+static int ParseNumber( const char *value, unsigned long *pNumber )
+{
+    int result = EINVAL;
+    unsigned long n;
+    char *end;
+
+    if( ( value[0] >= '0' ) && ( value[0] <= '9' ) )
+    {
+        errno = 0;
+        n = strtoul( value, &end, 10 );
+        if( ( *end == '\0' ) && ( errno == 0 ) )
+        {
+            *pNumber = n;
+            result = EOK;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  ReceiveThread                                                             */
+/*!
+    Receive the messages of a target
+
+    The ReceiveThread function invokes the receiver's handler to
+    receive and dispatch each message for its target.
+
+    @param[in]
+        arg
+            pointer to the Receiver
+
+    @retval NULL
+
+==============================================================================*/
+static void *ReceiveThread( void *arg )
+{
+    Receiver *pReceiver = (Receiver *)arg;
+
+    if( pReceiver != NULL )
+    {
+        while( true )
+        {
+            pReceiver->handler( pReceiver, pReceiver->arg );
+        }
+    }
+
+    return NULL;
+}
+
+/*! @}
+ * end of receiver group */
@@ -0,0 +1,2115 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup response response
+ * @brief Command response output
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file response.c
+
+    Command response output
+
+    The response module builds the device-to-cloud response headers for
+    a command, mapping the received messageId to the correlationId, and
+    sends the command output to the cloud via the iotclient library.
+    The headers are copied from a preformatted template which is only
+    completed with the correlationId, and their length is tracked so
+    headers are appended and sequenced without rescanning them.
+
+    A chunked response sends its output in fixed size chunks numbered by
+    seq headers, each with the byte offset of the chunk, and its final
+    status message carries the total number of chunks.  The chunks are
+    kept in the spool, so the lost chunks of a response can be sent
+    again without executing the command again.
+
+    Output can optionally be coalesced into batches, so commands which
+    emit many small writes are sent in fewer, larger messages.  A batch
+    is sent when it is full, or when its oldest byte has waited for the
+    flush deadline, which bounds the latency added by batching.
+
+    When the request carries an acceptEncoding header, output larger than
+    the compression threshold is sent as a single streaming deflate or
+    gzip stream spread over the response messages, each of which carries
+    a contentEncoding header.  Outputs smaller than the threshold are sent
+    uncompressed.
+
+    Output which needs neither coalescing nor compression is handed to
+    the iotclient library as a file descriptor, so it never passes
+    through an iotexec buffer.  Bulk output is detected by the amount
+    read, after which the remainder of the output is handed over in
+    the same way.
+
+    When an asynchronous sender is configured, every message is queued
+    for its sender thread instead, and output which would have been
+    handed to the iotclient library is read and queued in messages of
+    RESPONSE_DEFAULT_BATCH_SIZE bytes.  Errors sending a queued message
+    are reported by the sender rather than by the response.
+
+    The response of a subscription numbers its messages with a seq
+    header, and sends its output at a bounded rate.  A full coalescing
+    buffer is held until the rate allows it to be sent, and the command
+    output is not read meanwhile, so a chatty subscription is throttled
+    through its pipe.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#ifdef IOTEXEC_ZLIB
+#include <zlib.h>
+#endif
+#include <iotclient/iotclient.h>
+#include "response.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+/*! headers included in every command response */
+#define RESPONSE_HEADERS "source:exec\nmessagetype:cmdresp\n"
+
+/*! response header template, completed by the request's messageId */
+#define RESPONSE_TEMPLATE RESPONSE_HEADERS "correlationId:"
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static int Send( Response *pResponse,
+                 const char *headers,
+                 const char *pData,
+                 size_t length );
+static int QueueStream( Response *pResponse, int fd );
+static int SendBatch( Response *pResponse, bool final );
+static bool IsBulk( Response *pResponse );
+static size_t LimitRead( Response *pResponse, size_t len );
+static int CheckEnd( int fd );
+static void Capture( Response *pResponse, const char *pData, size_t len );
+static size_t FormatHeaders( char *headers, size_t size, const char *msgId );
+static int AppendHeader( char *headers,
+                         size_t size,
+                         size_t *pLength,
+                         const char *name,
+                         const char *value );
+static const char *Sequence( const char *headers,
+                             size_t length,
+                             const char *seq,
+                             const char *offset,
+                             char *pBuf,
+                             size_t size );
+static int ResendChunk( void *arg,
+                        unsigned long seq,
+                        size_t offset,
+                        const char *pData,
+                        size_t length );
+static ResponseEncoding GetEncoding( Job *pJob );
+static int StartCompression( Response *pResponse );
+static int Compress( Response *pResponse, bool final );
+static void EndCompression( Response *pResponse );
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  RESPONSE_Init                                                             */
+/*!
+    Initialize a command response
+
+    The RESPONSE_Init function prepares the response headers.  If a
+    message identifier is provided it is included in the headers as
+    the correlationId so the message originator can match the response
+    to its request.
+
+    @param[in]
+        pResponse
+            pointer to the Response to initialize
+
+    @param[in]
+        hIoTClient
+            handle to the iotclient connection used to send the response
+
+    @param[in]
+        msgId
+            pointer to the NUL terminated message identifier, or NULL
+
+    @retval EOK the response was initialized
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int RESPONSE_Init( Response *pResponse,
+                   IOTCLIENT_HANDLE hIoTClient,
+                   const char *msgId )
+{
+    int result = EINVAL;
+
+    if( ( pResponse != NULL ) &&
+        ( hIoTClient != NULL ) )
+    {
+        pResponse->hIoTClient = hIoTClient;
+        pResponse->pOutbox = NULL;
+        pResponse->bytesSent = 0;
+        pResponse->bytesRead = 0;
+        pResponse->directThreshold = 0;
+        pResponse->maxBytes = 0;
+        pResponse->error = EOK;
+        pResponse->pBatch = NULL;
+        pResponse->batchSize = 0;
+        pResponse->batchLength = 0;
+        pResponse->flushMs = 0;
+        pResponse->flushTime = 0;
+        pResponse->encoding = RESPONSE_ENCODING_NONE;
+        pResponse->compressMin = 0;
+        pResponse->compressing = false;
+        pResponse->pZStream = NULL;
+        pResponse->pZBuf = NULL;
+        pResponse->zBufSize = 0;
+        pResponse->pCapture = NULL;
+        pResponse->captureSize = 0;
+        pResponse->captureLength = 0;
+        pResponse->captureOverflow = false;
+        pResponse->pFollowers = NULL;
+        pResponse->sequenced = false;
+        pResponse->seq = 0;
+        pResponse->intervalMs = 0;
+        pResponse->nextSendTime = 0;
+        pResponse->chunked = false;
+        pResponse->chunkSize = 0;
+        pResponse->pSpool = NULL;
+        pResponse->pSpoolEntry = NULL;
+
+        pResponse->headerLength = FormatHeaders( pResponse->headers,
+                                                 sizeof( pResponse->headers ),
+                                                 msgId );
+
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RESPONSE_Setup                                                            */
+/*!
+    Set up the response for a received command
+
+    The RESPONSE_Setup function initializes the response for the
+    specified job, correlating it with the job's messageId, and applies
+    the service wide output coalescing and compression options.
+    Compression is only used if the request asked for it with an
+    acceptEncoding header.
+
+    @param[in]
+        pResponse
+            pointer to the Response to set up
+
+    @param[in]
+        hIoTClient
+            handle to the iotclient connection used to send the response
+
+    @param[in]
+        pJob
+            pointer to the job the response is for
+
+    @param[in]
+        pOptions
+            pointer to the service wide response options
+
+    @retval EOK the response was set up
+    @retval EINVAL invalid arguments
+    @retval error as returned by RESPONSE_SetBatch
+
+==============================================================================*/
+int RESPONSE_Setup( Response *pResponse,
+                    IOTCLIENT_HANDLE hIoTClient,
+                    Job *pJob,
+                    const ResponseOptions *pOptions )
+{
+    int result = EINVAL;
+    const char *msgId;
+    size_t batchSize;
+
+    if( ( pJob != NULL ) &&
+        ( pOptions != NULL ) )
+    {
+        msgId = ( pJob->msgId[0] != '\0' ) ? pJob->msgId : NULL;
+        result = RESPONSE_Init( pResponse, hIoTClient, msgId );
+        if( result == EOK )
+        {
+            pResponse->pOutbox = pOptions->pOutbox;
+            pResponse->encoding = GetEncoding( pJob );
+            pResponse->compressMin = pOptions->compressMin;
+            pResponse->directThreshold = pOptions->directThreshold;
+
+            batchSize = pOptions->batchSize;
+            if( ( batchSize == 0 ) &&
+                ( pResponse->encoding != RESPONSE_ENCODING_NONE ) )
+            {
+                /* compression requires a coalescing buffer */
+                batchSize = RESPONSE_DEFAULT_BATCH_SIZE;
+            }
+
+            if( batchSize > 0 )
+            {
+                result = RESPONSE_SetBatch( pResponse,
+                                            batchSize,
+                                            pOptions->flushMs );
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RESPONSE_AddHeader                                                        */
+/*!
+    Add a header to the response
+
+    The RESPONSE_AddHeader function appends a name:value header to the
+    response headers, and to the headers of each follower.  It only
+    affects messages sent after it is called.
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+    @param[in]
+        name
+            pointer to the NUL terminated header name
+
+    @param[in]
+        value
+            pointer to the NUL terminated header value
+
+    @retval EOK the header was added
+    @retval E2BIG there is no room for the header
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int RESPONSE_AddHeader( Response *pResponse,
+                        const char *name,
+                        const char *value )
+{
+    int result = EINVAL;
+    ResponseFollower *pFollower;
+
+    if( ( pResponse != NULL ) &&
+        ( name != NULL ) &&
+        ( value != NULL ) )
+    {
+        result = AppendHeader( pResponse->headers,
+                               sizeof( pResponse->headers ),
+                               &pResponse->headerLength,
+                               name,
+                               value );
+
+        for( pFollower = pResponse->pFollowers;
+             pFollower != NULL;
+             pFollower = pFollower->pNext )
+        {
+            AppendHeader( pFollower->headers,
+                          sizeof( pFollower->headers ),
+                          &pFollower->headerLength,
+                          name,
+                          value );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RESPONSE_Follow                                                           */
+/*!
+    Add a recipient to the response
+
+    The RESPONSE_Follow function adds another request which shares this
+    response.  Every message of the response is also sent with the
+    follower's correlationId.  Followers must be added before any
+    output is sent, and cannot receive output handed to
+    RESPONSE_Stream.
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+    @param[in]
+        msgId
+            pointer to the message identifier of the follower
+
+    @retval EOK the follower was added
+    @retval ENOMEM could not allocate the follower
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int RESPONSE_Follow( Response *pResponse, const char *msgId )
+{
+    int result = EINVAL;
+    ResponseFollower *pFollower;
+
+    if( ( pResponse != NULL ) &&
+        ( msgId != NULL ) )
+    {
+        pFollower = malloc( sizeof( ResponseFollower ) );
+        if( pFollower != NULL )
+        {
+            pFollower->headerLength = FormatHeaders( pFollower->headers,
+                                                     sizeof( pFollower->headers ),
+                                                     msgId );
+
+            pFollower->pNext = pResponse->pFollowers;
+            pResponse->pFollowers = pFollower;
+            result = EOK;
+        }
+        else
+        {
+            result = ENOMEM;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RESPONSE_Write                                                            */
+/*!
+    Send a chunk of command output
+
+    The RESPONSE_Write function sends a chunk of command output to the
+    cloud as a device-to-cloud message carrying the response headers,
+    and the next sequence number if the response is sequenced.  The
+    chunks of a chunked response also carry their byte offset, and are
+    written to the spool whether or not they could be sent.
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+    @param[in]
+        pData
+            pointer to the output data to send
+
+    @param[in]
+        length
+            number of bytes to send
+
+    @retval EOK the output was sent
+    @retval EINVAL invalid arguments
+    @retval error as returned by IOTCLIENT_Send
+
+==============================================================================*/
+int RESPONSE_Write( Response *pResponse, const char *pData, size_t length )
+{
+    int result = EINVAL;
+    ResponseFollower *pFollower;
+    char headers[RESPONSE_HEADER_SIZE];
+    char seq[24];
+    char offset[24];
+    bool chunk;
+    int rc;
+
+    if( ( pResponse != NULL ) &&
+        ( pData != NULL ) )
+    {
+        chunk = ( pResponse->chunked ) && ( pResponse->sequenced );
+        if( chunk )
+        {
+            snprintf( offset,
+                      sizeof( offset ),
+                      "%zu",
+                      pResponse->seq * pResponse->chunkSize );
+        }
+
+        if( pResponse->sequenced )
+        {
+            snprintf( seq, sizeof( seq ), "%lu", pResponse->seq++ );
+        }
+
+        if( ( chunk ) && ( pResponse->pSpoolEntry != NULL ) )
+        {
+            SPOOL_Write( pResponse->pSpool,
+                         pResponse->pSpoolEntry,
+                         pData,
+                         length );
+        }
+
+        result = Send( pResponse,
+                       Sequence( pResponse->headers,
+                                 pResponse->headerLength,
+                                 pResponse->sequenced ? seq : NULL,
+                                 chunk ? offset : NULL,
+                                 headers,
+                                 sizeof( headers ) ),
+                       pData,
+                       length );
+        if( result == EOK )
+        {
+            pResponse->bytesSent += length;
+        }
+        else if( pResponse->error == EOK )
+        {
+            pResponse->error = result;
+        }
+
+        for( pFollower = pResponse->pFollowers;
+             pFollower != NULL;
+             pFollower = pFollower->pNext )
+        {
+            rc = Send( pResponse,
+                       Sequence( pFollower->headers,
+                                 pFollower->headerLength,
+                                 pResponse->sequenced ? seq : NULL,
+                                 chunk ? offset : NULL,
+                                 headers,
+                                 sizeof( headers ) ),
+                       pData,
+                       length );
+            if( ( rc != EOK ) && ( pResponse->error == EOK ) )
+            {
+                pResponse->error = rc;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RESPONSE_Stream                                                           */
+/*!
+    Stream command output from a file descriptor
+
+    The RESPONSE_Stream function hands the command output file descriptor
+    to the iotclient library which streams the output to the cloud until
+    the end of file is reached.
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+    @param[in]
+        fd
+            the command output file descriptor
+
+    @retval EOK the output was streamed
+    @retval EINVAL invalid arguments
+    @retval error as returned by IOTCLIENT_Stream
+
+==============================================================================*/
+int RESPONSE_Stream( Response *pResponse, int fd )
+{
+    int result = EINVAL;
+
+    if( ( pResponse != NULL ) &&
+        ( fd != -1 ) )
+    {
+        result = ( pResponse->pOutbox != NULL )
+                    ? QueueStream( pResponse, fd )
+                    : IOTCLIENT_Stream( pResponse->hIoTClient,
+                                        pResponse->headers,
+                                        fd );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RESPONSE_SetBatch                                                         */
+/*!
+    Enable output coalescing for a response
+
+    The RESPONSE_SetBatch function allocates an output coalescing buffer
+    for the response.  Output added to the response is held in the
+    buffer until it is full, or until the flush deadline has passed
+    since the oldest byte in the buffer was added.
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+    @param[in]
+        batchSize
+            size of the coalescing buffer in bytes
+
+    @param[in]
+        flushMs
+            maximum time in milliseconds output may be held in the buffer
+
+    @retval EOK output coalescing is enabled
+    @retval EINVAL invalid arguments
+    @retval ENOMEM could not allocate the coalescing buffer
+
+==============================================================================*/
+int RESPONSE_SetBatch( Response *pResponse,
+                       size_t batchSize,
+                       unsigned int flushMs )
+{
+    int result = EINVAL;
+
+    if( ( pResponse != NULL ) &&
+        ( pResponse->pBatch == NULL ) &&
+        ( batchSize > 0 ) )
+    {
+        pResponse->pBatch = malloc( batchSize );
+        if( pResponse->pBatch != NULL )
+        {
+            pResponse->batchSize = batchSize;
+            pResponse->batchLength = 0;
+            pResponse->flushMs = flushMs;
+            result = EOK;
+        }
+        else
+        {
+            result = ENOMEM;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RESPONSE_Read                                                             */
+/*!
+    Read command output into the coalescing buffer
+
+    The RESPONSE_Read function performs a single read from the command
+    output file descriptor directly into the free space of the response's
+    coalescing buffer.  The buffer is sent if it becomes full.  Send
+    errors are recorded in the response rather than returned, so the
+    caller keeps draining the output and the command is not blocked
+    on a full pipe.  A full buffer held by the response's rate is not
+    read into until it has been sent.
+
+    If the response has an output limit, no more than the limit is read.
+
+    @param[in]
+        pResponse
+            pointer to the Response with output coalescing enabled
+
+    @param[in]
+        fd
+            the command output file descriptor
+
+    @retval EOK output was read
+    @retval EAGAIN no output is available on a non-blocking descriptor,
+            or the coalescing buffer is held
+    @retval ENODATA the end of the command output was reached
+    @retval EFBIG the output limit has been reached
+    @retval EINVAL invalid arguments
+    @retval error as returned by read
+
+==============================================================================*/
+int RESPONSE_Read( Response *pResponse, int fd )
+{
+    int result = EINVAL;
+    size_t len;
+    ssize_t n;
+
+    if( ( pResponse != NULL ) &&
+        ( pResponse->pBatch != NULL ) &&
+        ( fd != -1 ) )
+    {
+        if( RESPONSE_Held( pResponse ) )
+        {
+            return EAGAIN;
+        }
+
+        len = LimitRead( pResponse,
+                         pResponse->batchSize - pResponse->batchLength );
+        if( len == 0 )
+        {
+            return CheckEnd( fd );
+        }
+
+        n = read( fd, &pResponse->pBatch[pResponse->batchLength], len );
+        if( n > 0 )
+        {
+            if( pResponse->batchLength == 0 )
+            {
+                /* first byte in the batch starts the flush deadline */
+                pResponse->flushTime = RESPONSE_Now() + pResponse->flushMs;
+            }
+
+            Capture( pResponse, &pResponse->pBatch[pResponse->batchLength], n );
+            pResponse->batchLength += n;
+            pResponse->bytesRead += n;
+            if( ( pResponse->batchLength == pResponse->batchSize ) &&
+                ( RESPONSE_Now() >= pResponse->nextSendTime ) )
+            {
+                RESPONSE_Flush( pResponse );
+            }
+
+            result = EOK;
+        }
+        else if( n == 0 )
+        {
+            result = ENODATA;
+        }
+        else
+        {
+            result = ( errno == EINTR ) ? EAGAIN : errno;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RESPONSE_SetCapture                                                       */
+/*!
+    Keep a copy of the command output
+
+    The RESPONSE_SetCapture function allocates a buffer which receives
+    a copy of the command output read through RESPONSE_Read or
+    RESPONSE_ReadBuffer.  If the output does not fit in the buffer,
+    the capture is abandoned and captureOverflow is set.  The capture
+    buffer is released by RESPONSE_Close.
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+    @param[in]
+        size
+            maximum number of bytes to capture
+
+    @retval EOK output will be captured
+    @retval EINVAL invalid arguments
+    @retval ENOMEM could not allocate the capture buffer
+
+==============================================================================*/
+int RESPONSE_SetCapture( Response *pResponse, size_t size )
+{
+    int result = EINVAL;
+
+    if( ( pResponse != NULL ) &&
+        ( pResponse->pCapture == NULL ) &&
+        ( size > 0 ) )
+    {
+        pResponse->pCapture = malloc( size );
+        if( pResponse->pCapture != NULL )
+        {
+            pResponse->captureSize = size;
+            pResponse->captureLength = 0;
+            pResponse->captureOverflow = false;
+            result = EOK;
+        }
+        else
+        {
+            result = ENOMEM;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RESPONSE_Subscribe                                                        */
+/*!
+    Set up the response of a subscription
+
+    The RESPONSE_Subscribe function numbers every subsequent message of
+    the response with a seq header, starting from 0, and limits the rate
+    at which output messages are sent.  The output of a subscription is
+    always coalesced.  If the response has no coalescing buffer one is
+    allocated, which is flushed once per message interval.  The output
+    is never handed to the iotclient library to be streamed, since those
+    messages could not be numbered.
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+    @param[in]
+        rate
+            maximum number of output messages per second, 0 for no limit
+
+    @retval EOK the response is sequenced
+    @retval EINVAL invalid arguments
+    @retval ENOMEM could not allocate the coalescing buffer
+
+==============================================================================*/
+int RESPONSE_Subscribe( Response *pResponse, unsigned int rate )
+{
+    int result = EINVAL;
+
+    if( pResponse != NULL )
+    {
+        pResponse->sequenced = true;
+        pResponse->seq = 0;
+        pResponse->intervalMs = ( rate > 0 ) ? ( 1000 + rate - 1 ) / rate : 0;
+        pResponse->directThreshold = 0;
+
+        result = ( pResponse->pBatch == NULL )
+                    ? RESPONSE_SetBatch( pResponse,
+                                         RESPONSE_DEFAULT_BATCH_SIZE,
+                                         pResponse->intervalMs )
+                    : EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RESPONSE_Chunk                                                            */
+/*!
+    Set up a chunked response
+
+    The RESPONSE_Chunk function sends the output of the response in
+    chunks of a fixed size, so each chunk starts at offset seq times the
+    chunk size.  Every chunk carries a seq header, starting from 0, and
+    an offset header, and the first message sent after RESPONSE_End
+    carries a total header with the number of chunks.  The output is
+    coalesced into chunks without a flush deadline, and is never
+    compressed or handed to the iotclient library to be streamed,
+    since those messages could not be framed.
+
+    If a spool is provided, the chunks are kept in the spool under the
+    request's messageId so they can be sent again by RESPONSE_Resend.
+    A response which cannot be spooled is still chunked.
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+    @param[in]
+        pSpool
+            pointer to the spool which keeps the chunks, or NULL
+
+    @param[in]
+        msgId
+            pointer to the NUL terminated messageId of the request, or
+            NULL if it has none
+
+    @param[in]
+        chunkSize
+            size of the chunks in bytes
+
+    @retval EOK the response is chunked
+    @retval EINVAL invalid arguments
+    @retval ENOMEM could not allocate the chunk buffer
+
+==============================================================================*/
+int RESPONSE_Chunk( Response *pResponse,
+                    Spool *pSpool,
+                    const char *msgId,
+                    size_t chunkSize )
+{
+    int result = EINVAL;
+
+    if( ( pResponse != NULL ) &&
+        ( chunkSize > 0 ) )
+    {
+        pResponse->encoding = RESPONSE_ENCODING_NONE;
+        pResponse->directThreshold = 0;
+        pResponse->sequenced = true;
+        pResponse->seq = 0;
+        pResponse->chunked = true;
+        pResponse->chunkSize = chunkSize;
+
+        /* the coalescing buffer holds exactly one chunk */
+        free( pResponse->pBatch );
+        pResponse->pBatch = NULL;
+        result = RESPONSE_SetBatch( pResponse, chunkSize, 0 );
+
+        if( ( result == EOK ) &&
+            ( pSpool != NULL ) &&
+            ( msgId != NULL ) &&
+            ( SPOOL_Open( pSpool,
+                          msgId,
+                          chunkSize,
+                          &pResponse->pSpoolEntry ) == EOK ) )
+        {
+            pResponse->pSpool = pSpool;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RESPONSE_Resend                                                           */
+/*!
+    Send spooled chunks of a response again
+
+    The RESPONSE_Resend function sends the requested chunks of the
+    spooled response to a message again, each with its original seq
+    and offset headers.  The response must be initialized with the
+    messageId of the original request, so the chunks carry its
+    correlationId.
+
+    @param[in]
+        pResponse
+            pointer to the Response initialized for the original request
+
+    @param[in]
+        pSpool
+            pointer to the spool, or NULL if responses are not spooled
+
+    @param[in]
+        msgId
+            pointer to the NUL terminated messageId of the original request
+
+    @param[in]
+        chunks
+            pointer to the NUL terminated list of chunks, such as 3,7-9,
+            or NULL to send every spooled chunk
+
+    @param[out]
+        pCount
+            pointer to the location to store the number of chunks sent
+
+    @param[out]
+        pTotal
+            pointer to the location to store the number of chunks of a
+            complete response, or 0 if it is still running
+
+    @retval EOK the chunks were sent
+    @retval EINVAL invalid arguments or chunk list
+    @retval ENOENT the response is not spooled
+    @retval error as returned by SPOOL_Resend
+
+==============================================================================*/
+int RESPONSE_Resend( Response *pResponse,
+                     Spool *pSpool,
+                     const char *msgId,
+                     const char *chunks,
+                     unsigned long *pCount,
+                     unsigned long *pTotal )
+{
+    int result = EINVAL;
+
+    if( ( pResponse != NULL ) &&
+        ( pCount != NULL ) &&
+        ( pTotal != NULL ) )
+    {
+        *pCount = 0;
+        *pTotal = 0;
+
+        result = ( pSpool != NULL )
+                    ? SPOOL_Resend( pSpool,
+                                    msgId,
+                                    chunks,
+                                    ResendChunk,
+                                    pResponse,
+                                    pCount,
+                                    pTotal )
+                    : ENOENT;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RESPONSE_Held                                                             */
+/*!
+    Determine if the response is holding back its output
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+    @retval true the coalescing buffer is full and waiting for the
+            response's rate to allow it to be sent
+    @retval false more output can be read
+
+==============================================================================*/
+bool RESPONSE_Held( Response *pResponse )
+{
+    return ( pResponse != NULL ) &&
+           ( pResponse->pBatch != NULL ) &&
+           ( pResponse->batchLength == pResponse->batchSize );
+}
+
+/*============================================================================*/
+/*  RESPONSE_Output                                                           */
+/*!
+    Send command output held in memory
+
+    The RESPONSE_Output function sends output which iotexec already
+    holds or produces itself, rather than reads from a command.  The
+    output passes through the capture buffer, the coalescing buffer and
+    compression exactly as if it had been read from a command.
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+    @param[in]
+        pData
+            pointer to the output to send
+
+    @param[in]
+        length
+            number of bytes of output
+
+    @retval EOK the output was sent or buffered
+    @retval EINVAL invalid arguments
+    @retval error the first error encountered sending the output
+
+==============================================================================*/
+int RESPONSE_Output( Response *pResponse, const char *pData, size_t length )
+{
+    int result = EINVAL;
+    size_t n;
+
+    if( ( pResponse != NULL ) &&
+        ( pData != NULL ) )
+    {
+        pResponse->bytesRead += length;
+        Capture( pResponse, pData, length );
+
+        if( pResponse->pBatch == NULL )
+        {
+            RESPONSE_Write( pResponse, pData, length );
+        }
+
+        while( ( pResponse->pBatch != NULL ) && ( length > 0 ) )
+        {
+            n = pResponse->batchSize - pResponse->batchLength;
+            if( n > length )
+            {
+                n = length;
+            }
+
+            if( pResponse->batchLength == 0 )
+            {
+                pResponse->flushTime = RESPONSE_Now() + pResponse->flushMs;
+            }
+
+            memcpy( &pResponse->pBatch[pResponse->batchLength], pData, n );
+            pResponse->batchLength += n;
+            pData += n;
+            length -= n;
+
+            if( pResponse->batchLength == pResponse->batchSize )
+            {
+                RESPONSE_Flush( pResponse );
+            }
+        }
+
+        result = pResponse->error;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RESPONSE_ReadBuffer                                                       */
+/*!
+    Read command output through a caller supplied buffer
+
+    The RESPONSE_ReadBuffer function performs a single read from the
+    command output file descriptor.  If the response has a coalescing
+    buffer the output is added to it, otherwise the output is read into
+    the caller's buffer and sent immediately.  As with RESPONSE_Read,
+    send errors are recorded in the response, and no more than the
+    response's output limit is read.
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+    @param[in]
+        fd
+            the command output file descriptor
+
+    @param[in]
+        pBuf
+            pointer to a buffer used when output is not coalesced
+
+    @param[in]
+        size
+            size of the buffer
+
+    @retval EOK output was read
+    @retval EAGAIN no output is available on a non-blocking descriptor
+    @retval ENODATA the end of the command output was reached
+    @retval EFBIG the output limit has been reached
+    @retval EINVAL invalid arguments
+    @retval error as returned by read
+
+==============================================================================*/
+int RESPONSE_ReadBuffer( Response *pResponse,
+                         int fd,
+                         char *pBuf,
+                         size_t size )
+{
+    int result = EINVAL;
+    size_t len;
+    ssize_t n;
+
+    if( ( pResponse != NULL ) &&
+        ( pResponse->pBatch != NULL ) )
+    {
+        result = RESPONSE_Read( pResponse, fd );
+    }
+    else if( ( pResponse != NULL ) &&
+             ( pBuf != NULL ) &&
+             ( fd != -1 ) )
+    {
+        len = LimitRead( pResponse, size );
+        if( len == 0 )
+        {
+            return CheckEnd( fd );
+        }
+
+        n = read( fd, pBuf, len );
+        if( n > 0 )
+        {
+            pResponse->bytesRead += n;
+            Capture( pResponse, pBuf, n );
+            RESPONSE_Write( pResponse, pBuf, n );
+            result = EOK;
+        }
+        else if( n == 0 )
+        {
+            result = ENODATA;
+        }
+        else
+        {
+            result = ( errno == EINTR ) ? EAGAIN : errno;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RESPONSE_Flush                                                            */
+/*!
+    Send the contents of the coalescing buffer
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+    @retval EOK the buffered output (if any) was sent
+    @retval EINVAL invalid arguments
+    @retval error as returned by RESPONSE_Write
+
+==============================================================================*/
+int RESPONSE_Flush( Response *pResponse )
+{
+    int result = EINVAL;
+
+    if( pResponse != NULL )
+    {
+        result = SendBatch( pResponse, false );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RESPONSE_Timeout                                                          */
+/*!
+    Get the time remaining until the coalescing buffer must be sent
+
+    The coalescing buffer of a response with a bounded rate is not
+    sent before the rate allows, and the partial chunk of a chunked
+    response is only sent once the output is complete.
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+    @retval -1 there is no output waiting in the coalescing buffer
+    @retval 0 the flush deadline has passed
+    @retval number of milliseconds until the flush deadline
+
+==============================================================================*/
+int RESPONSE_Timeout( Response *pResponse )
+{
+    int timeout = -1;
+    uint64_t deadline;
+    uint64_t now;
+
+    if( ( pResponse != NULL ) &&
+        ( pResponse->pBatch != NULL ) &&
+        ( pResponse->batchLength > 0 ) &&
+        ( pResponse->chunked == false ) )
+    {
+        deadline = ( pResponse->nextSendTime > pResponse->flushTime )
+                    ? pResponse->nextSendTime
+                    : pResponse->flushTime;
+
+        now = RESPONSE_Now();
+        timeout = ( now >= deadline ) ? 0 : (int)( deadline - now );
+    }
+
+    return timeout;
+}
+
+/*============================================================================*/
+/*  RESPONSE_Forward                                                          */
+/*!
+    Forward command output with output coalescing
+
+    The RESPONSE_Forward function reads the command output until the
+    end of file is reached, sending it through the response's coalescing
+    buffer and honoring the flush deadline.  It blocks the calling
+    thread until the command output is closed.
+
+    Once an uncompressed response has read more than the direct
+    threshold, the coalescing buffer is sent and the rest of the output
+    is handed to RESPONSE_Stream.  Bulk output fills every message
+    anyway, so coalescing it only adds a copy.
+
+    @param[in]
+        pResponse
+            pointer to the Response with output coalescing enabled
+
+    @param[in]
+        fd
+            the command output file descriptor
+
+    @retval EOK the output was forwarded
+    @retval EINVAL invalid arguments
+    @retval error as returned by RESPONSE_Read, RESPONSE_Stream or poll
+    @retval error the first error encountered sending the output
+
+==============================================================================*/
+int RESPONSE_Forward( Response *pResponse, int fd )
+{
+    int result = EINVAL;
+    struct pollfd pfd;
+    int rc;
+
+    if( ( pResponse != NULL ) &&
+        ( pResponse->pBatch != NULL ) &&
+        ( fd != -1 ) )
+    {
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+
+        do
+        {
+            rc = poll( &pfd, 1, RESPONSE_Timeout( pResponse ) );
+            if( rc > 0 )
+            {
+                result = RESPONSE_Read( pResponse, fd );
+            }
+            else if( rc == 0 )
+            {
+                RESPONSE_Flush( pResponse );
+                result = EOK;
+            }
+            else
+            {
+                result = ( errno == EINTR ) ? EAGAIN : errno;
+            }
+
+            if( result == EAGAIN )
+            {
+                result = EOK;
+            }
+            else if( ( result == EOK ) && ( IsBulk( pResponse ) ) )
+            {
+                /* hand the rest of the output directly to iotclient */
+                RESPONSE_Flush( pResponse );
+                result = RESPONSE_Stream( pResponse, fd );
+                if( result == EOK )
+                {
+                    result = pResponse->error;
+                }
+
+                break;
+            }
+
+        } while( result == EOK );
+
+        if( result == ENODATA )
+        {
+            RESPONSE_Flush( pResponse );
+            result = pResponse->error;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RESPONSE_End                                                              */
+/*!
+    Complete the output of a response
+
+    The RESPONSE_End function sends any output remaining in the
+    coalescing buffer and completes the compression stream.  Messages
+    written afterwards, such as a final status message, are sent
+    uncoalesced to all the recipients of the response.  A chunked
+    response completes its spool entry, and its later messages are not
+    numbered and carry the total number of chunks.
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+==============================================================================*/
+void RESPONSE_End( Response *pResponse )
+{
+    char total[24];
+
+    if( pResponse != NULL )
+    {
+        SendBatch( pResponse, true );
+        EndCompression( pResponse );
+
+        if( ( pResponse->chunked ) && ( pResponse->sequenced ) )
+        {
+            pResponse->sequenced = false;
+            snprintf( total, sizeof( total ), "%lu", pResponse->seq );
+            RESPONSE_AddHeader( pResponse, "total", total );
+
+            if( pResponse->pSpoolEntry != NULL )
+            {
+                SPOOL_Close( pResponse->pSpool, pResponse->pSpoolEntry );
+                pResponse->pSpoolEntry = NULL;
+            }
+        }
+
+        free( pResponse->pBatch );
+        pResponse->pBatch = NULL;
+        pResponse->batchSize = 0;
+    }
+}
+
+/*============================================================================*/
+/*  RESPONSE_Close                                                            */
+/*!
+    Complete a response
+
+    The RESPONSE_Close function completes the output of the response
+    with RESPONSE_End, and releases the response buffers, including any
+    captured output and the followers.
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+==============================================================================*/
+void RESPONSE_Close( Response *pResponse )
+{
+    ResponseFollower *pFollower;
+
+    if( pResponse != NULL )
+    {
+        RESPONSE_End( pResponse );
+
+        free( pResponse->pCapture );
+        pResponse->pCapture = NULL;
+        pResponse->captureSize = 0;
+
+        while( ( pFollower = pResponse->pFollowers ) != NULL )
+        {
+            pResponse->pFollowers = pFollower->pNext;
+            free( pFollower );
+        }
+    }
+}
+
+/*============================================================================*/
+/*  RESPONSE_Now                                                              */
+/*!
+    Get the current monotonic time
+
+    @retval the current monotonic time in milliseconds
+
+==============================================================================*/
+uint64_t RESPONSE_Now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ( (uint64_t)ts.tv_sec * 1000 ) + ( ts.tv_nsec / 1000000 );
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  Send                                                                      */
+/*!
+    Send a response message
+
+    The Send function sends a message with the iotclient library, or
+    queues it for the asynchronous sender.
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+    @param[in]
+        headers
+            pointer to the NUL terminated message headers
+
+    @param[in]
+        pData
+            pointer to the message body
+
+    @param[in]
+        length
+            length of the message body
+
+    @retval EOK the message was sent or queued
+    @retval error as returned by IOTCLIENT_Send or OUTBOX_Send
+
+==============================================================================*/
+static int Send( Response *pResponse,
+                 const char *headers,
+                 const char *pData,
+                 size_t length )
+{
+    return ( pResponse->pOutbox != NULL )
+            ? OUTBOX_Send( pResponse->pOutbox, headers, pData, length )
+            : IOTCLIENT_Send( pResponse->hIoTClient, headers, pData, length );
+}
+
+/*============================================================================*/
+/*  QueueStream                                                               */
+/*!
+    Queue command output from a file descriptor
+
+    The QueueStream function reads the command output until the end of
+    file and queues it for the asynchronous sender, so the command is
+    not held back by the uplink.
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+    @param[in]
+        fd
+            the command output file descriptor
+
+    @retval EOK the output was queued
+    @retval error as returned by read, poll or RESPONSE_Write
+
+==============================================================================*/
+static int QueueStream( Response *pResponse, int fd )
+{
+    int result = EOK;
+    char buf[RESPONSE_DEFAULT_BATCH_SIZE];
+    struct pollfd pfd;
+    ssize_t n;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    while( result == EOK )
+    {
+        n = read( fd, buf, sizeof( buf ) );
+        if( n > 0 )
+        {
+            result = RESPONSE_Write( pResponse, buf, n );
+        }
+        else if( n == 0 )
+        {
+            break;
+        }
+        else if( errno == EAGAIN )
+        {
+            /* wait for a non-blocking pipe to become readable */
+            if( ( poll( &pfd, 1, -1 ) == -1 ) && ( errno != EINTR ) )
+            {
+                result = errno;
+            }
+        }
+        else if( errno != EINTR )
+        {
+            result = errno;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  SendBatch                                                                 */
+/*!
+    Send the contents of the coalescing buffer
+
+    The SendBatch function sends the output waiting in the coalescing
+    buffer.  The first time output is sent, the response decides whether
+    to compress it: a response which requested compression is compressed
+    only if the first batch reaches the compression threshold.  A
+    chunked response only sends a full chunk, or the last chunk.
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+    @param[in]
+        final
+            true if this is the last output of the response
+
+    @retval EOK the buffered output (if any) was sent
+    @retval error as returned by RESPONSE_Write or Compress
+
+==============================================================================*/
+static int SendBatch( Response *pResponse, bool final )
+{
+    int result = EOK;
+
+    if( ( pResponse->pBatch != NULL ) &&
+        ( ( pResponse->chunked == false ) ||
+          ( final ) ||
+          ( pResponse->batchLength == pResponse->batchSize ) ) )
+    {
+        if( ( pResponse->encoding != RESPONSE_ENCODING_NONE ) &&
+            ( pResponse->compressing == false ) &&
+            ( pResponse->batchLength > 0 ) )
+        {
+            if( ( pResponse->batchLength < pResponse->compressMin ) ||
+                ( StartCompression( pResponse ) != EOK ) )
+            {
+                /* send the response uncompressed */
+                pResponse->encoding = RESPONSE_ENCODING_NONE;
+            }
+        }
+
+        if( pResponse->compressing == true )
+        {
+            result = Compress( pResponse, final );
+        }
+        else if( pResponse->batchLength > 0 )
+        {
+            result = RESPONSE_Write( pResponse,
+                                     pResponse->pBatch,
+                                     pResponse->batchLength );
+        }
+
+        if( ( pResponse->intervalMs > 0 ) && ( pResponse->batchLength > 0 ) )
+        {
+            pResponse->nextSendTime = RESPONSE_Now() + pResponse->intervalMs;
+        }
+
+        pResponse->batchLength = 0;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IsBulk                                                                    */
+/*!
+    Determine if the response output should bypass coalescing
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+    @retval true the output is uncompressed and larger than the
+            direct threshold
+    @retval false the output should continue through the coalescing buffer
+
+==============================================================================*/
+static bool IsBulk( Response *pResponse )
+{
+    return ( pResponse->directThreshold > 0 ) &&
+           ( pResponse->maxBytes == 0 ) &&
+           ( pResponse->bytesRead >= pResponse->directThreshold ) &&
+           ( pResponse->encoding == RESPONSE_ENCODING_NONE );
+}
+
+/*============================================================================*/
+/*  LimitRead                                                                 */
+/*!
+    Limit a read to the response's remaining output allowance
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+    @param[in]
+        len
+            the number of bytes the caller would like to read
+
+    @retval the number of bytes which may be read
+
+==============================================================================*/
+static size_t LimitRead( Response *pResponse, size_t len )
+{
+    size_t remaining;
+
+    if( pResponse->maxBytes > 0 )
+    {
+        remaining = ( pResponse->bytesRead < pResponse->maxBytes )
+                        ? pResponse->maxBytes - pResponse->bytesRead
+                        : 0;
+        if( len > remaining )
+        {
+            len = remaining;
+        }
+    }
+
+    return len;
+}
+
+/*============================================================================*/
+/*  CheckEnd                                                                  */
+/*!
+    Check for the end of output once the output allowance is used
+
+    The CheckEnd function reads one more byte from the command output
+    after the response's output allowance has been used, so a command
+    whose output is exactly the allowance ends normally rather than
+    being reported as exceeding it.  The byte read, if any, is
+    discarded.
+
+    @param[in]
+        fd
+            the command output file descriptor
+
+    @retval ENODATA the end of the command output was reached
+    @retval EFBIG the command has more output than its allowance
+    @retval EAGAIN no output is available on a non-blocking descriptor
+    @retval error as returned by read
+
+==============================================================================*/
+static int CheckEnd( int fd )
+{
+    int result;
+    char c;
+    ssize_t n;
+
+    n = read( fd, &c, sizeof( c ) );
+    if( n > 0 )
+    {
+        result = EFBIG;
+    }
+    else if( n == 0 )
+    {
+        result = ENODATA;
+    }
+    else
+    {
+        result = ( errno == EINTR ) ? EAGAIN : errno;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  Capture                                                                   */
+/*!
+    Copy command output into the capture buffer
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+    @param[in]
+        pData
+            pointer to the command output which was read
+
+    @param[in]
+        len
+            number of bytes of command output
+
+==============================================================================*/
+static void Capture( Response *pResponse, const char *pData, size_t len )
+{
+    if( pResponse->pCapture != NULL )
+    {
+        if( len <= pResponse->captureSize - pResponse->captureLength )
+        {
+            memcpy( &pResponse->pCapture[pResponse->captureLength],
+                    pData,
+                    len );
+            pResponse->captureLength += len;
+        }
+        else
+        {
+            /* the output is too large to keep */
+            free( pResponse->pCapture );
+            pResponse->pCapture = NULL;
+            pResponse->captureOverflow = true;
+        }
+    }
+}
+
+/*============================================================================*/
+/*  FormatHeaders                                                             */
+/*!
+    Build the base response headers
+
+    The FormatHeaders function copies the response header template,
+    completed with the request's message identifier as the
+    correlationId, or the default response headers if the request has
+    no message identifier.  A header buffer of RESPONSE_HEADER_SIZE
+    always has room for a message identifier of MAX_MSGID_LENGTH.
+
+    @param[out]
+        headers
+            pointer to the header buffer
+
+    @param[in]
+        size
+            size of the header buffer
+
+    @param[in]
+        msgId
+            pointer to the request's message identifier, or NULL
+
+    @retval length of the headers
+
+==============================================================================*/
+static size_t FormatHeaders( char *headers, size_t size, const char *msgId )
+{
+    size_t length = sizeof( RESPONSE_HEADERS ) - 1;
+    size_t msgIdLength;
+
+    /* messsageId -> correlationId */
+    msgIdLength = ( msgId != NULL ) ? strlen( msgId ) : 0;
+    if( ( msgId != NULL ) &&
+        ( sizeof( RESPONSE_TEMPLATE ) + msgIdLength + 1 <= size ) )
+    {
+        length = sizeof( RESPONSE_TEMPLATE ) - 1;
+        memcpy( headers, RESPONSE_TEMPLATE, length );
+        memcpy( &headers[length], msgId, msgIdLength );
+        length += msgIdLength;
+        headers[length++] = '\n';
+    }
+    else
+    {
+        /* default headers without a correlation identifier */
+        memcpy( headers, RESPONSE_HEADERS, length );
+    }
+
+    headers[length] = '\0';
+
+    return length;
+}
+
+/*============================================================================*/
+/*  AppendHeader                                                              */
+/*!
+    Append a name:value header to a header buffer
+
+    @param[in,out]
+        headers
+            pointer to the NUL terminated header buffer, whose headers
+            each end with a newline
+
+    @param[in]
+        size
+            size of the header buffer
+
+    @param[in,out]
+        pLength
+            pointer to the length of the headers
+
+    @param[in]
+        name
+            pointer to the NUL terminated header name
+
+    @param[in]
+        value
+            pointer to the NUL terminated header value
+
+    @retval EOK the header was added
+    @retval E2BIG there is no room for the header
+
+==============================================================================*/
+static int AppendHeader( char *headers,
+                         size_t size,
+                         size_t *pLength,
+                         const char *name,
+                         const char *value )
+{
+    int result = E2BIG;
+    size_t length = *pLength;
+    size_t nameLength = strlen( name );
+    size_t valueLength = strlen( value );
+
+    if( length + nameLength + valueLength + 3 <= size )
+    {
+        memcpy( &headers[length], name, nameLength );
+        length += nameLength;
+        headers[length++] = ':';
+        memcpy( &headers[length], value, valueLength );
+        length += valueLength;
+        headers[length++] = '\n';
+        headers[length] = '\0';
+
+        *pLength = length;
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  Sequence                                                                  */
+/*!
+    Add a sequence number and chunk offset to message headers
+
+    @param[in]
+        headers
+            pointer to the NUL terminated message headers
+
+    @param[in]
+        length
+            length of the message headers
+
+    @param[in]
+        seq
+            pointer to the NUL terminated sequence number, or NULL
+
+    @param[in]
+        offset
+            pointer to the NUL terminated chunk offset, or NULL
+
+    @param[in]
+        pBuf
+            pointer to a buffer to receive the sequenced headers
+
+    @param[in]
+        size
+            size of the buffer
+
+    @retval pointer to the headers to send
+
+==============================================================================*/
+static const char *Sequence( const char *headers,
+                             size_t length,
+                             const char *seq,
+                             const char *offset,
+                             char *pBuf,
+                             size_t size )
+{
+    const char *result = headers;
+
+    if( ( seq != NULL ) && ( length < size ) )
+    {
+        memcpy( pBuf, headers, length + 1 );
+        if( ( AppendHeader( pBuf, size, &length, "seq", seq ) == EOK ) &&
+            ( ( offset == NULL ) ||
+              ( AppendHeader( pBuf,
+                              size,
+                              &length,
+                              "offset",
+                              offset ) == EOK ) ) )
+        {
+            result = pBuf;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  ResendChunk                                                               */
+/*!
+    Send a spooled chunk of a response again
+
+    The ResendChunk function is the SpoolSendFn used by RESPONSE_Resend.
+
+    @param[in]
+        arg
+            pointer to the Response initialized for the original request
+
+    @param[in]
+        seq
+            sequence number of the chunk
+
+    @param[in]
+        offset
+            byte offset of the chunk in the response
+
+    @param[in]
+        pData
+            pointer to the chunk
+
+    @param[in]
+        length
+            length of the chunk
+
+    @retval EOK the chunk was sent
+    @retval E2BIG there is no room for the chunk headers
+    @retval error as returned by IOTCLIENT_Send or OUTBOX_Send
+
+==============================================================================*/
+static int ResendChunk( void *arg,
+                        unsigned long seq,
+                        size_t offset,
+                        const char *pData,
+                        size_t length )
+{
+    int result;
+    Response *pResponse = (Response *)arg;
+    char headers[RESPONSE_HEADER_SIZE];
+    const char *pHeaders;
+    char seqValue[24];
+    char offsetValue[24];
+
+    snprintf( seqValue, sizeof( seqValue ), "%lu", seq );
+    snprintf( offsetValue, sizeof( offsetValue ), "%zu", offset );
+
+    pHeaders = Sequence( pResponse->headers,
+                         pResponse->headerLength,
+                         seqValue,
+                         offsetValue,
+                         headers,
+                         sizeof( headers ) );
+    result = ( pHeaders == headers )
+                ? Send( pResponse, pHeaders, pData, length )
+                : E2BIG;
+    if( result == EOK )
+    {
+        pResponse->bytesSent += length;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  GetEncoding                                                               */
+/*!
+    Get the content encoding requested by a command
+
+    The GetEncoding function checks the acceptEncoding header of the
+    received command for a supported content encoding.
+
+    @param[in]
+        pJob
+            pointer to the received job
+
+    @retval the requested content encoding
+
+==============================================================================*/
+static ResponseEncoding GetEncoding( Job *pJob )
+{
+    ResponseEncoding encoding = RESPONSE_ENCODING_NONE;
+#ifdef IOTEXEC_ZLIB
+    char buf[64];
+
+    if( JOB_GetProperty( pJob,
+                         JOB_PROPERTY_ACCEPT_ENCODING,
+                         buf,
+                         sizeof( buf ) ) == EOK )
+    {
+        if( strstr( buf, "gzip" ) != NULL )
+        {
+            encoding = RESPONSE_ENCODING_GZIP;
+        }
+        else if( strstr( buf, "deflate" ) != NULL )
+        {
+            encoding = RESPONSE_ENCODING_DEFLATE;
+        }
+    }
+#else
+    /* no encoding can be accepted without zlib */
+    (void)pJob;
+#endif
+
+    return encoding;
+}
+
+/*============================================================================*/
+/*  StartCompression                                                          */
+/*!
+    Start compressing the response output
+
+    The StartCompression function initializes the compression stream and
+    adds the contentEncoding header to the response.
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+    @retval EOK compression was started
+    @retval ENOTSUP compression is not supported
+    @retval ENOMEM could not allocate the compression state
+
+==============================================================================*/
+static int StartCompression( Response *pResponse )
+{
+    int result = ENOTSUP;
+#ifdef IOTEXEC_ZLIB
+    z_stream *pZ;
+    int windowBits;
+    const char *name;
+
+    if( pResponse->encoding == RESPONSE_ENCODING_GZIP )
+    {
+        /* add 16 to the window bits for a gzip wrapper */
+        windowBits = MAX_WBITS + 16;
+        name = "gzip";
+    }
+    else
+    {
+        windowBits = MAX_WBITS;
+        name = "deflate";
+    }
+
+    result = ENOMEM;
+    pZ = calloc( 1, sizeof( z_stream ) );
+    if( pZ != NULL )
+    {
+        if( deflateInit2( pZ,
+                          Z_DEFAULT_COMPRESSION,
+                          Z_DEFLATED,
+                          windowBits,
+                          8,
+                          Z_DEFAULT_STRATEGY ) == Z_OK )
+        {
+            pResponse->zBufSize = deflateBound( pZ, pResponse->batchSize );
+            pResponse->pZBuf = malloc( pResponse->zBufSize );
+            if( pResponse->pZBuf != NULL )
+            {
+                pResponse->pZStream = pZ;
+                pResponse->compressing = true;
+                RESPONSE_AddHeader( pResponse, "contentEncoding", name );
+                result = EOK;
+            }
+            else
+            {
+                deflateEnd( pZ );
+            }
+        }
+
+        if( result != EOK )
+        {
+            free( pZ );
+        }
+    }
+#else
+    (void)pResponse;
+#endif
+
+    return result;
+}
+
+/*============================================================================*/
+/*  Compress                                                                  */
+/*!
+    Compress and send the coalescing buffer
+
+    The Compress function passes the coalescing buffer through the
+    compression stream and sends the compressed output.  Each batch is
+    sync flushed so the receiver can decompress the output incrementally,
+    and the last batch completes the compression stream.
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+    @param[in]
+        final
+            true if this is the last output of the response
+
+    @retval EOK the output was compressed and sent
+    @retval EIO compression failure
+    @retval error as returned by RESPONSE_Write
+
+==============================================================================*/
+static int Compress( Response *pResponse, bool final )
+{
+    int result = EOK;
+#ifdef IOTEXEC_ZLIB
+    z_stream *pZ = (z_stream *)pResponse->pZStream;
+    size_t n;
+    int rc;
+
+    pZ->next_in = (Bytef *)pResponse->pBatch;
+    pZ->avail_in = pResponse->batchLength;
+
+    do
+    {
+        pZ->next_out = (Bytef *)pResponse->pZBuf;
+        pZ->avail_out = pResponse->zBufSize;
+
+        rc = deflate( pZ, final ? Z_FINISH : Z_SYNC_FLUSH );
+        if( ( rc == Z_STREAM_ERROR ) || ( rc == Z_DATA_ERROR ) )
+        {
+            result = EIO;
+            break;
+        }
+
+        n = pResponse->zBufSize - pZ->avail_out;
+        if( n > 0 )
+        {
+            result = RESPONSE_Write( pResponse, pResponse->pZBuf, n );
+        }
+
+    } while( ( result == EOK ) &&
+             ( ( pZ->avail_out == 0 ) ||
+               ( final &&
+                 ( rc != Z_STREAM_END ) &&
+                 ( rc != Z_BUF_ERROR ) ) ) );
+#else
+    (void)pResponse;
+    (void)final;
+#endif
+
+    return result;
+}
+
+/*============================================================================*/
+/*  EndCompression                                                            */
+/*!
+    Release the compression state of a response
+
+    @param[in]
+        pResponse
+            pointer to the Response
+
+==============================================================================*/
+static void EndCompression( Response *pResponse )
+{
+#ifdef IOTEXEC_ZLIB
+    if( pResponse->pZStream != NULL )
+    {
+        deflateEnd( (z_stream *)pResponse->pZStream );
+        free( pResponse->pZStream );
+    }
+#endif
+
+    free( pResponse->pZBuf );
+    pResponse->pZStream = NULL;
+    pResponse->pZBuf = NULL;
+    pResponse->zBufSize = 0;
+    pResponse->compressing = false;
+}
+
+/*! @}
+ * end of response group */
@@ -0,0 +1,950 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup session session
+ * @brief Persistent shell sessions
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file session.c
+
+    Persistent shell sessions
+
+    The session module keeps a long-lived /bin/sh co-process for each
+    session identifier received in a session header, so back-to-back
+    commands from an operator are dispatched without starting a new
+    shell, and the working directory, environment and shell variables
+    are kept between commands.
+
+    Each command is written to the session shell's stdin, followed by
+    a printf of a token which is unique to the shell, and the command's
+    exit status.  The output of the command is read from the shell's
+    stdout up to the token.  Commands read their stdin from /dev/null,
+    and their stderr is merged into the output.
+
+    The commands of a session are executed one at a time, in the order
+    they were received: a job received while the session is executing
+    another command waits in the session until the command completes.
+
+    A session whose command was killed, or did not run to completion,
+    loses its shell.  The next command of the session starts a new one.
+
+    Idle sessions are evicted when they reach the idle timeout, when a
+    new session is needed and the session table is full, or when the
+    system is low on memory.  Eviction is performed when a command is
+    started in a session.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include "session.h"
+#include "response.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+#ifndef EOK
+/*! success response */
+#define EOK 0
+#endif
+
+/*! system memory is low when less than this percentage is available */
+#define SESSION_MIN_AVAILABLE_PERCENT 10
+
+/*! the first character of the token, which occurs nowhere else in it */
+#define SESSION_TOKEN_START '\036'
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static Session *FindSession( SessionTable *pTable, const char *id );
+static Session *NewSession( SessionTable *pTable, const char *id );
+static void RemoveSession( SessionTable *pTable, Session *pSession );
+static void EvictIdle( SessionTable *pTable, uint64_t now );
+static bool EvictOldest( SessionTable *pTable );
+static bool IsMemoryLow( void );
+static int StartShell( Session *pSession );
+static void StopShell( Session *pSession );
+static int WriteAll( int fd, const char *pData, size_t length );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  SESSION_Init                                                              */
+/*!
+    Initialize the session table
+
+    @param[in]
+        pTable
+            pointer to the SessionTable to initialize
+
+    @param[in]
+        maxSessions
+            maximum number of sessions
+
+    @param[in]
+        idleTimeout
+            time (seconds) after which an idle session is evicted,
+            0 to keep idle sessions until they are needed
+
+    @retval EOK the session table was initialized
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int SESSION_Init( SessionTable *pTable,
+                  size_t maxSessions,
+                  unsigned int idleTimeout )
+{
+    int result = EINVAL;
+
+    if( ( pTable != NULL ) &&
+        ( maxSessions > 0 ) )
+    {
+        memset( pTable, 0, sizeof( SessionTable ) );
+        pthread_mutex_init( &pTable->lock, NULL );
+        pTable->maxSessions = maxSessions;
+        pTable->idleTimeout = idleTimeout;
+
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  SESSION_Begin                                                             */
+/*!
+    Begin the execution of a job in its session
+
+    The SESSION_Begin function finds or creates the session named by
+    the job's session identifier.  If the session is executing another
+    command the job is queued in the session, and is returned by
+    SESSION_End when the session becomes available.  Idle sessions
+    are evicted as required.
+
+    @param[in]
+        pTable
+            pointer to the SessionTable
+
+    @param[in]
+        pJob
+            pointer to the job to execute
+
+    @param[out]
+        ppSession
+            pointer to a location to store the session
+
+    @retval EOK the job owns the session and may be executed
+    @retval EINPROGRESS the job is waiting in the session, which now
+            owns the job
+    @retval ENOSPC the session table is full of busy sessions
+    @retval ENOMEM could not allocate the session
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int SESSION_Begin( SessionTable *pTable, Job *pJob, Session **ppSession )
+{
+    int result = EINVAL;
+    Session *pSession;
+
+    if( ( pTable != NULL ) &&
+        ( pJob != NULL ) &&
+        ( pJob->session[0] != '\0' ) &&
+        ( ppSession != NULL ) )
+    {
+        pthread_mutex_lock( &pTable->lock );
+
+        EvictIdle( pTable, RESPONSE_Now() );
+
+        pSession = FindSession( pTable, pJob->session );
+        if( pSession != NULL )
+        {
+            if( ( pSession->pOwner == NULL ) ||
+                ( pSession->pOwner == pJob ) )
+            {
+                pSession->pOwner = pJob;
+                result = EOK;
+            }
+            else
+            {
+                pJob->pNext = NULL;
+                if( pSession->pTail != NULL )
+                {
+                    pSession->pTail->pNext = pJob;
+                }
+                else
+                {
+                    pSession->pHead = pJob;
+                }
+
+                pSession->pTail = pJob;
+                result = EINPROGRESS;
+            }
+        }
+        else if( ( pTable->numSessions < pTable->maxSessions ) ||
+                 ( EvictOldest( pTable ) ) )
+        {
+            pSession = NewSession( pTable, pJob->session );
+            if( pSession != NULL )
+            {
+                pSession->pOwner = pJob;
+                result = EOK;
+            }
+            else
+            {
+                result = ENOMEM;
+            }
+        }
+        else
+        {
+            result = ENOSPC;
+        }
+
+        pthread_mutex_unlock( &pTable->lock );
+
+        *ppSession = pSession;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  SESSION_Command                                                           */
+/*!
+    Execute a command in a session
+
+    The SESSION_Command function starts the session shell if it is not
+    running, and writes the command to it.  The command is evaluated by
+    the shell so a syntax error does not terminate the session.  The
+    caller must own the session.
+
+    @param[in]
+        pSession
+            pointer to the Session
+
+    @param[in]
+        cmd
+            pointer to the NUL terminated command
+
+    @retval EOK the command was written to the session shell
+    @retval ENOMEM could not allocate the shell input
+    @retval EINVAL invalid arguments
+    @retval error as returned by LAUNCHER_Shell or write
+
+==============================================================================*/
+int SESSION_Command( Session *pSession, const char *cmd )
+{
+    int result = EINVAL;
+    const char *p;
+    char *pInput;
+    size_t length;
+
+    if( ( pSession != NULL ) &&
+        ( cmd != NULL ) )
+    {
+        result = ( pSession->child.pid > 0 ) ? EOK : StartShell( pSession );
+        if( result == EOK )
+        {
+            /* each single quote in the command expands to 4 characters */
+            pInput = malloc( ( strlen( cmd ) * 4 ) + SESSION_TOKEN_LENGTH + 64 );
+            if( pInput != NULL )
+            {
+                length = sprintf( pInput, "command eval '" );
+                for( p = cmd; *p != '\0'; p++ )
+                {
+                    if( *p == '\'' )
+                    {
+                        memcpy( &pInput[length], "'\\''", 4 );
+                        length += 4;
+                    }
+                    else
+                    {
+                        pInput[length++] = *p;
+                    }
+                }
+
+                length += sprintf( &pInput[length],
+                                   "' </dev/null 2>&1; "
+                                   "printf '\\%03o%s:%%d\\n' \"$?\"\n",
+                                   SESSION_TOKEN_START,
+                                   &pSession->token[1] );
+
+                pSession->matched = 0;
+                pSession->codeLength = 0;
+                pSession->complete = false;
+
+                result = WriteAll( pSession->fdIn, pInput, length );
+                free( pInput );
+            }
+            else
+            {
+                result = ENOMEM;
+            }
+
+            if( result != EOK )
+            {
+                StopShell( pSession );
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  SESSION_Read                                                              */
+/*!
+    Read a chunk of command output from a session
+
+    The SESSION_Read function performs a single read of the session
+    shell's output, and copies the command output which precedes the
+    token into the caller's buffer.  Output which may be the start of
+    the token is held back until the following read.  If the session
+    shell exits, it is reaped and its wait status is returned.
+
+    @param[in]
+        pSession
+            pointer to the Session
+
+    @param[in]
+        pBuf
+            pointer to a buffer to receive the command output
+
+    @param[in]
+        size
+            size of the buffer, which must be larger than
+            SESSION_TOKEN_LENGTH
+
+    @param[out]
+        pLength
+            pointer to a location to store the number of bytes of
+            command output
+
+    @param[out]
+        pStatus
+            pointer to a location to store the wait status of the
+            command when its output is complete
+
+    @retval EOK output was read
+    @retval EAGAIN no output is available yet
+    @retval ENODATA the command output is complete
+    @retval EINVAL invalid arguments
+    @retval error as returned by read
+
+==============================================================================*/
+int SESSION_Read( Session *pSession,
+                  char *pBuf,
+                  size_t size,
+                  size_t *pLength,
+                  int *pStatus )
+{
+    int result = EINVAL;
+    size_t length = 0;
+    size_t limit;
+    ssize_t n;
+    ssize_t i;
+    char c;
+
+    if( ( pSession != NULL ) &&
+        ( pBuf != NULL ) &&
+        ( size > SESSION_TOKEN_LENGTH ) &&
+        ( pLength != NULL ) &&
+        ( pStatus != NULL ) )
+    {
+        /* leave room for held back output which was not the token */
+        limit = size - SESSION_TOKEN_LENGTH;
+        if( limit > sizeof( pSession->buf ) )
+        {
+            limit = sizeof( pSession->buf );
+        }
+
+        n = read( pSession->child.fdOut, pSession->buf, limit );
+        if( n > 0 )
+        {
+            result = EOK;
+
+            for( i = 0; ( i < n ) && ( pSession->complete == false ); i++ )
+            {
+                c = pSession->buf[i];
+
+                if( pSession->matched == SESSION_TOKEN_LENGTH )
+                {
+                    /* exit status following the token */
+                    if( c == '\n' )
+                    {
+                        pSession->code[pSession->codeLength] = '\0';
+                        *pStatus = ( atoi( pSession->code ) & 0xFF ) << 8;
+                        pSession->complete = true;
+                    }
+                    else if( ( c >= '0' ) &&
+                             ( c <= '9' ) &&
+                             ( pSession->codeLength < SESSION_MAX_CODE_LENGTH ) )
+                    {
+                        pSession->code[pSession->codeLength++] = c;
+                    }
+                }
+                else if( c == pSession->token[pSession->matched] )
+                {
+                    pSession->matched++;
+                }
+                else
+                {
+                    /* the held back output was not the token */
+                    memcpy( &pBuf[length], pSession->token, pSession->matched );
+                    length += pSession->matched;
+                    pSession->matched = 0;
+
+                    if( c == SESSION_TOKEN_START )
+                    {
+                        pSession->matched = 1;
+                    }
+                    else
+                    {
+                        pBuf[length++] = c;
+                    }
+                }
+            }
+
+            if( pSession->complete )
+            {
+                pSession->lastUsed = RESPONSE_Now();
+                result = ENODATA;
+            }
+        }
+        else if( n == 0 )
+        {
+            /* the session shell has exited */
+            memcpy( &pBuf[length], pSession->token, pSession->matched );
+            length += pSession->matched;
+            pSession->matched = 0;
+
+            LAUNCHER_Wait( &pSession->child, pStatus );
+            StopShell( pSession );
+            result = ENODATA;
+        }
+        else
+        {
+            result = ( errno == EINTR ) ? EAGAIN : errno;
+        }
+
+        *pLength = length;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  SESSION_Kill                                                              */
+/*!
+    Kill the command executing in a session
+
+    The SESSION_Kill function kills the session shell's process group,
+    including the command it is executing.
+
+    @param[in]
+        pSession
+            pointer to the Session
+
+    @retval EOK the session shell was killed
+    @retval EINVAL invalid arguments
+    @retval error as returned by LAUNCHER_Kill
+
+==============================================================================*/
+int SESSION_Kill( Session *pSession )
+{
+    int result = EINVAL;
+
+    if( pSession != NULL )
+    {
+        result = LAUNCHER_Kill( &pSession->child, SIGKILL );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  SESSION_End                                                               */
+/*!
+    End the execution of a job in its session
+
+    The SESSION_End function releases the session owned by a job whose
+    command has completed.  The session shell is stopped if it was
+    discarded, or the command output did not run to completion, since
+    the state of the shell is then unknown.  The session is handed to
+    the specified next job (the next step of a batch) if there is one,
+    or else to the first job waiting for the session, and the new owner
+    is returned so the caller can execute it.  Otherwise an idle
+    session without a shell is removed.
+
+    @param[in]
+        pTable
+            pointer to the SessionTable
+
+    @param[in]
+        pSession
+            pointer to the Session owned by the completed job
+
+    @param[in]
+        discard
+            true to stop the session shell
+
+    @param[in]
+        pNext
+            pointer to a job to execute next in the session ahead of
+            the waiting jobs, or NULL
+
+    @retval pointer to the next job to execute in the session
+    @retval NULL no job is waiting for the session
+
+==============================================================================*/
+Job *SESSION_End( SessionTable *pTable,
+                  Session *pSession,
+                  bool discard,
+                  Job *pNext )
+{
+    Job *pJob = pNext;
+
+    if( ( pTable != NULL ) &&
+        ( pSession != NULL ) )
+    {
+        pthread_mutex_lock( &pTable->lock );
+
+        if( ( discard ) || ( pSession->complete == false ) )
+        {
+            StopShell( pSession );
+        }
+
+        if( ( pJob == NULL ) &&
+            ( ( pJob = pSession->pHead ) != NULL ) )
+        {
+            pSession->pHead = pJob->pNext;
+            if( pSession->pHead == NULL )
+            {
+                pSession->pTail = NULL;
+            }
+
+            pJob->pNext = NULL;
+        }
+
+        pSession->pOwner = pJob;
+        pSession->lastUsed = RESPONSE_Now();
+
+        if( ( pJob == NULL ) && ( pSession->child.pid <= 0 ) )
+        {
+            RemoveSession( pTable, pSession );
+        }
+
+        pthread_mutex_unlock( &pTable->lock );
+    }
+
+    return pJob;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  FindSession                                                               */
+/*!
+    Find a session by its identifier
+
+    @param[in]
+        pTable
+            pointer to the SessionTable
+
+    @param[in]
+        id
+            pointer to the NUL terminated session identifier
+
+    @retval pointer to the session
+    @retval NULL the session does not exist
+
+==============================================================================*/
+static Session *FindSession( SessionTable *pTable, const char *id )
+{
+    Session *pSession = pTable->pSessions;
+
+    while( ( pSession != NULL ) &&
+           ( strcmp( pSession->id, id ) != 0 ) )
+    {
+        pSession = pSession->pNext;
+    }
+
+    return pSession;
+}
+
+/*============================================================================*/
+/*  NewSession                                                                */
+/*!
+    Add a new session to the session table
+
+    The shell of the new session is started by its first command.
+
+    @param[in]
+        pTable
+            pointer to the SessionTable
+
+    @param[in]
+        id
+            pointer to the NUL terminated session identifier
+
+    @retval pointer to the new session
+    @retval NULL the session could not be allocated
+
+==============================================================================*/
+static Session *NewSession( SessionTable *pTable, const char *id )
+{
+    Session *pSession;
+
+    pSession = calloc( 1, sizeof( Session ) );
+    if( pSession != NULL )
+    {
+        strncpy( pSession->id, id, sizeof( pSession->id ) - 1 );
+        pSession->child.pid = -1;
+        pSession->child.fdOut = -1;
+        pSession->child.fdErr = -1;
+        pSession->fdIn = -1;
+        pSession->lastUsed = RESPONSE_Now();
+
+        pSession->pNext = pTable->pSessions;
+        pTable->pSessions = pSession;
+        pTable->numSessions++;
+    }
+
+    return pSession;
+}
+
+/*============================================================================*/
+/*  RemoveSession                                                             */
+/*!
+    Remove a session from the session table
+
+    The RemoveSession function stops the session shell and frees the
+    session.  The session must not be owned by a job.
+
+    @param[in]
+        pTable
+            pointer to the SessionTable
+
+    @param[in]
+        pSession
+            pointer to the Session to remove
+
+==============================================================================*/
+static void RemoveSession( SessionTable *pTable, Session *pSession )
+{
+    Session **ppSession = &pTable->pSessions;
+
+    while( ( *ppSession != NULL ) && ( *ppSession != pSession ) )
+    {
+        ppSession = &(*ppSession)->pNext;
+    }
+
+    if( *ppSession != NULL )
+    {
+        *ppSession = pSession->pNext;
+        pTable->numSessions--;
+
+        StopShell( pSession );
+        free( pSession );
+    }
+}
+
+/*============================================================================*/
+/*  EvictIdle                                                                 */
+/*!
+    Evict idle sessions
+
+    The EvictIdle function removes the idle sessions which have reached
+    the idle timeout, or all the idle sessions if the system is low on
+    memory.
+
+    @param[in]
+        pTable
+            pointer to the SessionTable
+
+    @param[in]
+        now
+            the current monotonic time (ms)
+
+==============================================================================*/
+static void EvictIdle( SessionTable *pTable, uint64_t now )
+{
+    Session *pSession;
+    Session *pNext;
+    bool checked = false;
+    bool memoryLow = false;
+
+    for( pSession = pTable->pSessions; pSession != NULL; pSession = pNext )
+    {
+        pNext = pSession->pNext;
+
+        if( pSession->pOwner == NULL )
+        {
+            if( checked == false )
+            {
+                memoryLow = IsMemoryLow();
+                checked = true;
+            }
+
+            if( ( memoryLow ) ||
+                ( ( pTable->idleTimeout > 0 ) &&
+                  ( now - pSession->lastUsed >=
+                        (uint64_t)pTable->idleTimeout * 1000 ) ) )
+            {
+                RemoveSession( pTable, pSession );
+            }
+        }
+    }
+}
+
+/*============================================================================*/
+/*  EvictOldest                                                               */
+/*!
+    Evict the least recently used idle session
+
+    @param[in]
+        pTable
+            pointer to the SessionTable
+
+    @retval true a session was evicted
+    @retval false all the sessions are busy
+
+==============================================================================*/
+static bool EvictOldest( SessionTable *pTable )
+{
+    Session *pSession;
+    Session *pOldest = NULL;
+
+    for( pSession = pTable->pSessions;
+         pSession != NULL;
+         pSession = pSession->pNext )
+    {
+        if( ( pSession->pOwner == NULL ) &&
+            ( ( pOldest == NULL ) ||
+              ( pSession->lastUsed < pOldest->lastUsed ) ) )
+        {
+            pOldest = pSession;
+        }
+    }
+
+    if( pOldest != NULL )
+    {
+        RemoveSession( pTable, pOldest );
+    }
+
+    return ( pOldest != NULL );
+}
+
+/*============================================================================*/
+/*  IsMemoryLow                                                               */
+/*!
+    Determine if the system is low on memory
+
+    The IsMemoryLow function compares the MemAvailable and MemTotal
+    values reported by /proc/meminfo.
+
+    @retval true less than SESSION_MIN_AVAILABLE_PERCENT of the system
+            memory is available
+    @retval false the system has enough memory, or the memory
+            information is not available
+
+==============================================================================*/
+static bool IsMemoryLow( void )
+{
+    char line[128];
+    unsigned long total = 0;
+    unsigned long available = 0;
+    FILE *fp;
+
+    fp = fopen( "/proc/meminfo", "re" );
+    if( fp != NULL )
+    {
+        while( fgets( line, sizeof( line ), fp ) != NULL )
+        {
+            if( sscanf( line, "MemTotal: %lu", &total ) != 1 )
+            {
+                sscanf( line, "MemAvailable: %lu", &available );
+            }
+        }
+
+        fclose( fp );
+    }
+
+    return ( total > 0 ) &&
+           ( available > 0 ) &&
+           ( available * 100 < total * SESSION_MIN_AVAILABLE_PERCENT );
+}
+
+/*============================================================================*/
+/*  StartShell                                                                */
+/*!
+    Start the shell of a session
+
+    The StartShell function launches the session shell and generates
+    the token which marks the end of each command's output.
+
+    @param[in]
+        pSession
+            pointer to the Session
+
+    @retval EOK the shell was started
+    @retval error as returned by LAUNCHER_Shell
+
+==============================================================================*/
+static int StartShell( Session *pSession )
+{
+    int result;
+    struct timespec ts;
+
+    result = LAUNCHER_Shell( &pSession->child, &pSession->fdIn );
+    if( result == EOK )
+    {
+        clock_gettime( CLOCK_REALTIME, &ts );
+        snprintf( pSession->token,
+                  sizeof( pSession->token ),
+                  "%ciotexec%08lx%08lx",
+                  SESSION_TOKEN_START,
+                  (unsigned long)ts.tv_nsec & 0xFFFFFFFFUL,
+                  ( (unsigned long)pSession->child.pid ^
+                    (unsigned long)(uintptr_t)pSession ) & 0xFFFFFFFFUL );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  StopShell                                                                 */
+/*!
+    Stop the shell of a session
+
+    The StopShell function kills the session shell's process group and
+    reaps the shell.
+
+    @param[in]
+        pSession
+            pointer to the Session
+
+==============================================================================*/
+static void StopShell( Session *pSession )
+{
+    if( pSession->fdIn != -1 )
+    {
+        close( pSession->fdIn );
+        pSession->fdIn = -1;
+    }
+
+    if( pSession->child.pid > 0 )
+    {
+        LAUNCHER_Kill( &pSession->child, SIGKILL );
+        LAUNCHER_Wait( &pSession->child, NULL );
+    }
+
+    pSession->complete = true;
+}
+
+/*============================================================================*/
+/*  WriteAll                                                                  */
+/*!
+    Write a buffer to the session shell's stdin
+
+    The WriteAll function writes the whole buffer to a pipe.  SIGPIPE is
+    blocked on the calling thread during the write so a shell which has
+    exited is reported as EPIPE instead of terminating iotexec.
+
+    @param[in]
+        fd
+            the write end of the pipe
+
+    @param[in]
+        pData
+            pointer to the data to write
+
+    @param[in]
+        length
+            number of bytes to write
+
+    @retval EOK the data was written
+    @retval error as returned by write
+
+==============================================================================*/
+static int WriteAll( int fd, const char *pData, size_t length )
+{
+    int result = EOK;
+    sigset_t mask;
+    sigset_t old;
+    struct timespec zero = { 0, 0 };
+    ssize_t n;
+
+    sigemptyset( &mask );
+    sigaddset( &mask, SIGPIPE );
+    pthread_sigmask( SIG_BLOCK, &mask, &old );
+
+    while( ( result == EOK ) && ( length > 0 ) )
+    {
+        n = write( fd, pData, length );
+        if( n > 0 )
+        {
+            pData += n;
+            length -= n;
+        }
+        else if( errno != EINTR )
+        {
+            result = errno;
+        }
+    }
+
+    if( result == EPIPE )
+    {
+        /* discard the pending SIGPIPE */
+        sigtimedwait( &mask, NULL, &zero );
+    }
+
+    pthread_sigmask( SIG_SETMASK, &old, NULL );
+
+    return result;
+}
+
+/*! @}
+ * end of session group */
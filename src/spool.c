@@ -0,0 +1,877 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup spool spool
+ * @brief Spool of chunked responses
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file spool.c
+
+    Spool of chunked responses
+
+    The spool module keeps a copy of the chunks of recently sent chunked
+    responses, so chunks lost by the uplink can be sent again on request
+    without executing the command again.
+
+    Each response is spooled in an unnamed file in the spool directory,
+    with chunk n at offset n times the chunk size, so a chunk is read
+    back with a single pread.  A complete response is kept for the
+    retention time, and the oldest complete responses are evicted early
+    when the spool runs out of room.  A running response which does not
+    fit is truncated: its later chunks are still sent, but cannot be
+    sent again.
+
+    The spool is shared by all the running commands, so its entries are
+    reference counted: an entry is only released once its writer has
+    completed and no resend is reading it.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "spool.h"
+#include "response.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+#ifndef EOK
+/*! success response */
+#define EOK 0
+#endif
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static int OpenSpoolFile( const char *dir );
+static void Purge( Spool *pSpool, size_t needed, size_t entries );
+static void Evict( Spool *pSpool, SpoolEntry **ppEntry );
+static void Release( SpoolEntry *pEntry );
+static SpoolEntry *Find( Spool *pSpool, const char *msgId );
+static int ParseRange( const char **ppChunks,
+                       unsigned long *pFirst,
+                       unsigned long *pLast );
+static int SendChunk( SpoolEntry *pEntry,
+                      unsigned long seq,
+                      size_t length,
+                      char *pBuf,
+                      SpoolSendFn send,
+                      void *arg );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  SPOOL_Init                                                                */
+/*!
+    Initialize the spool
+
+    @param[in]
+        pSpool
+            pointer to the Spool to initialize
+
+    @param[in]
+        dir
+            pointer to the NUL terminated directory which holds the
+            spool files
+
+    @param[in]
+        maxBytes
+            maximum number of bytes spooled
+
+    @param[in]
+        retentionMs
+            time in milliseconds a complete response is kept
+
+    @retval EOK the spool was initialized
+    @retval EINVAL invalid arguments
+    @retval ENAMETOOLONG the directory path is too long
+
+==============================================================================*/
+int SPOOL_Init( Spool *pSpool,
+                const char *dir,
+                size_t maxBytes,
+                unsigned int retentionMs )
+{
+    int result = EINVAL;
+
+    if( ( pSpool != NULL ) &&
+        ( dir != NULL ) &&
+        ( maxBytes > 0 ) )
+    {
+        memset( pSpool, 0, sizeof( Spool ) );
+
+        if( strlen( dir ) < sizeof( pSpool->dir ) )
+        {
+            strcpy( pSpool->dir, dir );
+            pthread_mutex_init( &pSpool->lock, NULL );
+            pSpool->maxBytes = maxBytes;
+            pSpool->retentionMs = retentionMs;
+            result = EOK;
+        }
+        else
+        {
+            result = ENAMETOOLONG;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  SPOOL_Open                                                                */
+/*!
+    Start spooling a response
+
+    The SPOOL_Open function creates the spool entry which receives the
+    chunks of a response.  Expired responses are evicted first, and if
+    the spool holds its maximum number of responses the oldest complete
+    response is evicted to make room.  The entry belongs to the caller
+    until it is passed to SPOOL_Close.
+
+    @param[in]
+        pSpool
+            pointer to the Spool
+
+    @param[in]
+        msgId
+            pointer to the NUL terminated messageId of the request
+
+    @param[in]
+        chunkSize
+            size of every chunk of the response but the last
+
+    @param[out]
+        ppEntry
+            pointer to the location to store the spool entry
+
+    @retval EOK the response is being spooled
+    @retval EINVAL invalid arguments
+    @retval EBUSY the spool is full of running responses
+    @retval ENOMEM could not allocate the entry
+    @retval error as returned by open
+
+==============================================================================*/
+int SPOOL_Open( Spool *pSpool,
+                const char *msgId,
+                size_t chunkSize,
+                SpoolEntry **ppEntry )
+{
+    int result = EINVAL;
+    SpoolEntry *pEntry;
+
+    if( ( pSpool != NULL ) &&
+        ( msgId != NULL ) &&
+        ( strlen( msgId ) < MAX_MSGID_LENGTH ) &&
+        ( chunkSize > 0 ) &&
+        ( ppEntry != NULL ) )
+    {
+        pthread_mutex_lock( &pSpool->lock );
+
+        Purge( pSpool, 0, 1 );
+        if( pSpool->numEntries < SPOOL_MAX_ENTRIES )
+        {
+            pEntry = calloc( 1, sizeof( SpoolEntry ) );
+            if( pEntry != NULL )
+            {
+                pEntry->fd = OpenSpoolFile( pSpool->dir );
+                if( pEntry->fd != -1 )
+                {
+                    strcpy( pEntry->msgId, msgId );
+                    pEntry->chunkSize = chunkSize;
+                    pEntry->refs = 1;
+
+                    /* newest first, so a repeated messageId finds
+                       its latest response */
+                    pEntry->pNext = pSpool->pEntries;
+                    pSpool->pEntries = pEntry;
+                    pSpool->numEntries++;
+
+                    *ppEntry = pEntry;
+                    result = EOK;
+                }
+                else
+                {
+                    result = errno;
+                    free( pEntry );
+                }
+            }
+            else
+            {
+                result = ENOMEM;
+            }
+        }
+        else
+        {
+            result = EBUSY;
+        }
+
+        pthread_mutex_unlock( &pSpool->lock );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  SPOOL_Write                                                               */
+/*!
+    Spool a chunk of a response
+
+    The SPOOL_Write function appends the next chunk of a response to its
+    spool file.  If the spool has no room for the chunk, complete
+    responses are evicted oldest first, and if there is still no room
+    the response is truncated and its remaining chunks are not spooled.
+
+    @param[in]
+        pSpool
+            pointer to the Spool
+
+    @param[in]
+        pEntry
+            pointer to the entry returned by SPOOL_Open
+
+    @param[in]
+        pData
+            pointer to the chunk
+
+    @param[in]
+        length
+            length of the chunk
+
+    @retval EOK the chunk was spooled
+    @retval EINVAL invalid arguments
+    @retval ENOSPC the response has been truncated
+    @retval error as returned by pwrite
+
+==============================================================================*/
+int SPOOL_Write( Spool *pSpool,
+                 SpoolEntry *pEntry,
+                 const char *pData,
+                 size_t length )
+{
+    int result = EINVAL;
+    ssize_t n;
+    size_t done = 0;
+
+    if( ( pSpool != NULL ) &&
+        ( pEntry != NULL ) &&
+        ( pData != NULL ) )
+    {
+        pthread_mutex_lock( &pSpool->lock );
+
+        if( ( pEntry->truncated == false ) &&
+            ( pSpool->bytes + length > pSpool->maxBytes ) )
+        {
+            Purge( pSpool, length, 0 );
+        }
+
+        if( ( pEntry->truncated ) ||
+            ( pSpool->bytes + length > pSpool->maxBytes ) )
+        {
+            pEntry->truncated = true;
+            result = ENOSPC;
+        }
+        else
+        {
+            result = EOK;
+            while( ( result == EOK ) && ( done < length ) )
+            {
+                n = pwrite( pEntry->fd,
+                            &pData[done],
+                            length - done,
+                            pEntry->length + done );
+                if( n > 0 )
+                {
+                    done += n;
+                }
+                else if( ( n == -1 ) && ( errno != EINTR ) )
+                {
+                    result = errno;
+                }
+            }
+
+            if( result == EOK )
+            {
+                pEntry->length += length;
+                pEntry->numChunks++;
+                pSpool->bytes += length;
+            }
+            else
+            {
+                pEntry->truncated = true;
+            }
+        }
+
+        pthread_mutex_unlock( &pSpool->lock );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  SPOOL_Close                                                               */
+/*!
+    Complete a spooled response
+
+    The SPOOL_Close function marks the response complete, starting its
+    retention time, and releases the caller's reference to the entry.
+
+    @param[in]
+        pSpool
+            pointer to the Spool
+
+    @param[in]
+        pEntry
+            pointer to the entry returned by SPOOL_Open
+
+==============================================================================*/
+void SPOOL_Close( Spool *pSpool, SpoolEntry *pEntry )
+{
+    if( ( pSpool != NULL ) &&
+        ( pEntry != NULL ) )
+    {
+        pthread_mutex_lock( &pSpool->lock );
+
+        pEntry->complete = true;
+        pEntry->expires = RESPONSE_Now() + pSpool->retentionMs;
+        Release( pEntry );
+
+        pthread_mutex_unlock( &pSpool->lock );
+    }
+}
+
+/*============================================================================*/
+/*  SPOOL_Resend                                                              */
+/*!
+    Send spooled chunks of a response again
+
+    The SPOOL_Resend function reads the requested chunks of the latest
+    spooled response to a message, and passes each of them to the send
+    function.  The chunks are listed as comma separated sequence
+    numbers or first-last ranges, for example 3,7-9.  Without a list
+    every spooled chunk is sent.  Chunks which are not spooled, because
+    they have not been sent yet or the response was truncated, are
+    skipped.  The spool lock is not held while chunks are sent.
+
+    @param[in]
+        pSpool
+            pointer to the Spool
+
+    @param[in]
+        msgId
+            pointer to the NUL terminated messageId of the request
+
+    @param[in]
+        chunks
+            pointer to the NUL terminated list of chunks, or NULL for all
+
+    @param[in]
+        send
+            function which sends a chunk
+
+    @param[in]
+        arg
+            argument passed to the send function
+
+    @param[out]
+        pCount
+            pointer to the location to store the number of chunks sent
+
+    @param[out]
+        pTotal
+            pointer to the location to store the number of chunks of a
+            complete response, or 0 if the response is still running
+
+    @retval EOK the chunks were sent
+    @retval EINVAL invalid arguments or chunk list
+    @retval ENOENT the response is not spooled
+    @retval ENOMEM could not allocate the chunk buffer
+    @retval error as returned by pread or the send function
+
+==============================================================================*/
+int SPOOL_Resend( Spool *pSpool,
+                  const char *msgId,
+                  const char *chunks,
+                  SpoolSendFn send,
+                  void *arg,
+                  unsigned long *pCount,
+                  unsigned long *pTotal )
+{
+    int result = EINVAL;
+    SpoolEntry *pEntry = NULL;
+    const char *p;
+    unsigned long numChunks = 0;
+    size_t length = 0;
+    unsigned long first = 0;
+    unsigned long last = 0;
+    unsigned long seq;
+    bool all;
+    char *pBuf = NULL;
+
+    if( ( pSpool != NULL ) &&
+        ( msgId != NULL ) &&
+        ( send != NULL ) &&
+        ( pCount != NULL ) &&
+        ( pTotal != NULL ) )
+    {
+        *pCount = 0;
+        *pTotal = 0;
+
+        /* check the whole list before anything is sent */
+        result = EOK;
+        for( p = chunks; ( p != NULL ) && ( *p != '\0' ) && ( result == EOK ); )
+        {
+            result = ParseRange( &p, &first, &last );
+        }
+
+        if( result == EOK )
+        {
+            pthread_mutex_lock( &pSpool->lock );
+
+            Purge( pSpool, 0, 0 );
+            pEntry = Find( pSpool, msgId );
+            if( pEntry != NULL )
+            {
+                pEntry->refs++;
+                numChunks = pEntry->numChunks;
+                length = pEntry->length;
+                *pTotal = ( pEntry->complete && !pEntry->truncated )
+                            ? numChunks
+                            : 0;
+            }
+
+            pthread_mutex_unlock( &pSpool->lock );
+
+            result = ( pEntry != NULL ) ? EOK : ENOENT;
+        }
+
+        if( ( result == EOK ) && ( numChunks > 0 ) )
+        {
+            pBuf = malloc( pEntry->chunkSize );
+            result = ( pBuf != NULL ) ? EOK : ENOMEM;
+        }
+
+        p = chunks;
+        all = ( p == NULL ) || ( *p == '\0' );
+        while( ( result == EOK ) && ( numChunks > 0 ) )
+        {
+            if( all )
+            {
+                last = numChunks - 1;
+            }
+            else
+            {
+                ParseRange( &p, &first, &last );
+            }
+
+            for( seq = first;
+                 ( result == EOK ) && ( seq <= last ) && ( seq < numChunks );
+                 seq++ )
+            {
+                result = SendChunk( pEntry, seq, length, pBuf, send, arg );
+                if( result == EOK )
+                {
+                    (*pCount)++;
+                }
+            }
+
+            if( ( all ) || ( *p == '\0' ) )
+            {
+                break;
+            }
+        }
+
+        free( pBuf );
+
+        if( pEntry != NULL )
+        {
+            pthread_mutex_lock( &pSpool->lock );
+            Release( pEntry );
+            pthread_mutex_unlock( &pSpool->lock );
+        }
+    }
+
+    return result;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  OpenSpoolFile                                                             */
+/*!
+    Create an unnamed spool file
+
+    The OpenSpoolFile function creates an unnamed temporary file in the
+    spool directory, which is released when it is closed.  On file
+    systems without O_TMPFILE support a named file is created and
+    immediately unlinked.
+
+    @param[in]
+        dir
+            pointer to the NUL terminated spool directory
+
+    @retval file descriptor of the spool file
+    @retval -1 the spool file could not be created (see errno)
+
+==============================================================================*/
+static int OpenSpoolFile( const char *dir )
+{
+    char path[SPOOL_MAX_PATH + 32];
+    int fd;
+
+    fd = open( dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600 );
+    if( fd == -1 )
+    {
+        snprintf( path, sizeof( path ), "%s/iotexec-spool-XXXXXX", dir );
+        fd = mkostemp( path, O_CLOEXEC );
+        if( fd != -1 )
+        {
+            unlink( path );
+        }
+    }
+
+    return fd;
+}
+
+/*============================================================================*/
+/*  Purge                                                                     */
+/*!
+    Evict spooled responses
+
+    The Purge function evicts the complete responses whose retention
+    time has passed, and then evicts the oldest complete responses until
+    the requested number of bytes and entries are free.  Responses in
+    use by a resend are not released until the resend completes.  The
+    spool lock must be held.
+
+    @param[in]
+        pSpool
+            pointer to the Spool
+
+    @param[in]
+        needed
+            number of bytes which must be free
+
+    @param[in]
+        entries
+            number of entries which must be free
+
+==============================================================================*/
+static void Purge( Spool *pSpool, size_t needed, size_t entries )
+{
+    SpoolEntry **ppEntry;
+    SpoolEntry **ppOldest;
+    SpoolEntry *pEntry;
+    uint64_t now = RESPONSE_Now();
+
+    /* expired responses */
+    ppEntry = &pSpool->pEntries;
+    while( ( pEntry = *ppEntry ) != NULL )
+    {
+        if( ( pEntry->complete ) && ( now >= pEntry->expires ) )
+        {
+            Evict( pSpool, ppEntry );
+        }
+        else
+        {
+            ppEntry = &pEntry->pNext;
+        }
+    }
+
+    /* the oldest complete responses, until there is room */
+    while( ( pSpool->bytes + needed > pSpool->maxBytes ) ||
+           ( pSpool->numEntries + entries > SPOOL_MAX_ENTRIES ) )
+    {
+        ppOldest = NULL;
+        for( ppEntry = &pSpool->pEntries;
+             *ppEntry != NULL;
+             ppEntry = &(*ppEntry)->pNext )
+        {
+            if( (*ppEntry)->complete )
+            {
+                ppOldest = ppEntry;
+            }
+        }
+
+        if( ppOldest == NULL )
+        {
+            break;
+        }
+
+        Evict( pSpool, ppOldest );
+    }
+}
+
+/*============================================================================*/
+/*  Evict                                                                     */
+/*!
+    Evict a response from the spool
+
+    The Evict function removes an entry from the spool list and returns
+    its bytes to the spool.  The entry is freed immediately unless a
+    resend is still reading it, in which case the resend frees it.  The
+    spool lock must be held.
+
+    @param[in]
+        pSpool
+            pointer to the Spool
+
+    @param[in]
+        ppEntry
+            pointer to the list link which refers to the entry
+
+==============================================================================*/
+static void Evict( Spool *pSpool, SpoolEntry **ppEntry )
+{
+    SpoolEntry *pEntry = *ppEntry;
+
+    *ppEntry = pEntry->pNext;
+    pEntry->pNext = NULL;
+    pEntry->evicted = true;
+
+    pSpool->bytes -= pEntry->length;
+    pSpool->numEntries--;
+
+    if( pEntry->refs == 0 )
+    {
+        close( pEntry->fd );
+        free( pEntry );
+    }
+}
+
+/*============================================================================*/
+/*  Release                                                                   */
+/*!
+    Release a reference to a spool entry
+
+    The Release function drops the reference held by the writer of a
+    spool entry or by a resend.  An evicted entry is freed when its last
+    reference is dropped.  The spool lock must be held.
+
+    @param[in]
+        pEntry
+            pointer to the spool entry
+
+==============================================================================*/
+static void Release( SpoolEntry *pEntry )
+{
+    if( pEntry->refs > 0 )
+    {
+        pEntry->refs--;
+    }
+
+    if( ( pEntry->evicted ) && ( pEntry->refs == 0 ) )
+    {
+        close( pEntry->fd );
+        free( pEntry );
+    }
+}
+
+/*============================================================================*/
+/*  Find                                                                      */
+/*!
+    Find the latest spooled response to a message
+
+    The spool lock must be held.
+
+    @param[in]
+        pSpool
+            pointer to the Spool
+
+    @param[in]
+        msgId
+            pointer to the NUL terminated messageId of the request
+
+    @retval pointer to the spool entry
+    @retval NULL the response is not spooled
+
+==============================================================================*/
+static SpoolEntry *Find( Spool *pSpool, const char *msgId )
+{
+    SpoolEntry *pEntry = pSpool->pEntries;
+
+    while( ( pEntry != NULL ) &&
+           ( strcmp( pEntry->msgId, msgId ) != 0 ) )
+    {
+        pEntry = pEntry->pNext;
+    }
+
+    return pEntry;
+}
+
+/*============================================================================*/
+/*  ParseRange                                                                */
+/*!
+    Parse a chunk or range of chunks from a chunk list
+
+    @param[in,out]
+        ppChunks
+            pointer to the position in the NUL terminated chunk list,
+            which is advanced past the range and its separator
+
+    @param[out]
+        pFirst
+            pointer to the location to store the first chunk
+
+    @param[out]
+        pLast
+            pointer to the location to store the last chunk
+
+    @retval EOK the range was parsed
+    @retval EINVAL invalid range
+
+==============================================================================*/
+static int ParseRange( const char **ppChunks,
+                       unsigned long *pFirst,
+                       unsigned long *pLast )
+{
+    int result = EINVAL;
+    const char *p = *ppChunks;
+    char *end;
+
+    if( ( *p >= '0' ) && ( *p <= '9' ) )
+    {
+        *pFirst = strtoul( p, &end, 10 );
+        *pLast = *pFirst;
+        if( ( *end == '-' ) && ( end[1] >= '0' ) && ( end[1] <= '9' ) )
+        {
+            *pLast = strtoul( &end[1], &end, 10 );
+        }
+
+        if( ( ( *end == ',' ) || ( *end == '\0' ) ) &&
+            ( *pFirst <= *pLast ) )
+        {
+            *ppChunks = ( *end == ',' ) ? &end[1] : end;
+            result = EOK;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  SendChunk                                                                 */
+/*!
+    Read a spooled chunk and send it
+
+    @param[in]
+        pEntry
+            pointer to the referenced spool entry
+
+    @param[in]
+        seq
+            sequence number of the chunk
+
+    @param[in]
+        length
+            number of bytes of the response which were spooled
+
+    @param[in]
+        pBuf
+            pointer to a buffer of the entry's chunk size
+
+    @param[in]
+        send
+            function which sends the chunk
+
+    @param[in]
+        arg
+            argument passed to the send function
+
+    @retval EOK the chunk was sent
+    @retval EIO the chunk could not be read completely
+    @retval error as returned by pread or the send function
+
+==============================================================================*/
+static int SendChunk( SpoolEntry *pEntry,
+                      unsigned long seq,
+                      size_t length,
+                      char *pBuf,
+                      SpoolSendFn send,
+                      void *arg )
+{
+    int result = EOK;
+    size_t offset = seq * pEntry->chunkSize;
+    size_t size;
+    size_t done = 0;
+    ssize_t n;
+
+    if( offset >= length )
+    {
+        return EIO;
+    }
+
+    size = length - offset;
+    if( size > pEntry->chunkSize )
+    {
+        size = pEntry->chunkSize;
+    }
+
+    while( ( result == EOK ) && ( done < size ) )
+    {
+        n = pread( pEntry->fd, &pBuf[done], size - done, offset + done );
+        if( n > 0 )
+        {
+            done += n;
+        }
+        else if( n == 0 )
+        {
+            result = EIO;
+        }
+        else if( errno != EINTR )
+        {
+            result = errno;
+        }
+    }
+
+    if( result == EOK )
+    {
+        result = send( arg, seq, offset, pBuf, size );
+    }
+
+    return result;
+}
+
+/*! @}
+ * end of spool group */
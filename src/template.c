@@ -0,0 +1,1019 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup template template
+ * @brief Command templates
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file template.c
+
+    Command templates
+
+    The template module executes named, parameterized commands without
+    the shell.  A message with a template header selects a template, and
+    its body holds the template's arguments as name=value pairs
+    separated by whitespace:
+
+        template:journal
+
+        unit=nginx.service lines=100
+
+    The command templates are listed in the template configuration
+    file.  Each line contains a template name, the program to execute
+    and its arguments, in which a {name:type} placeholder is replaced by
+    the value of a parameter:
+
+        # name    program      arguments
+        journal   journalctl   -u {unit} -n {lines:uint:1-10000}
+        ipaddr    ip           addr show {if}
+        ping      ping         -c 1 -W 2 {host} --{mode:enum:quiet|verbose}
+
+    name        letters, digits and ._@:- not starting with - or .
+                (the default type)
+    uint        decimal integer, optionally limited to a min-max range
+    enum        one of the | separated values
+
+    An argument contains at most one placeholder, which may be
+    surrounded by literal text, and a parameter is typed where it first
+    appears.  Arguments never contain whitespace, and a value can only
+    ever form part of a single argument, so it cannot inject options or
+    shell syntax into the command.
+
+    The program is resolved to an absolute path, searching the PATH if
+    it has no directory part, and the arguments are split and their
+    placeholders located when the file is loaded.  Executing a template
+    only validates the argument values and substitutes them, with no
+    shell parsing and no PATH search.
+
+    The templates are fixed once they are loaded, so they are searched
+    without locking.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "template.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+#ifndef EOK
+/*! success response */
+#define EOK 0
+#endif
+
+/*! maximum length of a line in the template configuration file */
+#define MAX_LINE_LENGTH 512
+
+/*! whitespace separating the fields of the configuration file */
+#define FIELD_SEPARATORS " \t\r\n"
+
+/*! whitespace separating the arguments of a template message */
+#define ARG_SEPARATORS " \t\r\n"
+
+/*! characters allowed in a name value besides letters and digits */
+#define NAME_CHARS "._@:-"
+
+/*! PATH searched for template programs when iotexec has none */
+#define DEFAULT_PATH "/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:" \
+                     "/sbin:/bin"
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static int AddTemplate( TemplateTable *pTable, char *line );
+static int AddArg( CommandTemplate *pTemplate, char *arg );
+static int AddParam( CommandTemplate *pTemplate, char *spec, int *pIndex );
+static int ParseType( CommandTemplate *pTemplate,
+                      TemplateParam *pParam,
+                      char *type );
+static char *AddText( CommandTemplate *pTemplate,
+                      const char *text,
+                      size_t length );
+static int ResolvePath( const char *program, char *path, size_t size );
+static bool IsExecutable( const char *path );
+static bool IsParamName( const char *name );
+static int GetValues( const CommandTemplate *pTemplate,
+                      const char *args,
+                      const char *values[],
+                      size_t lengths[] );
+static int CheckValue( const TemplateParam *pParam,
+                       const char *value,
+                       size_t length );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  TEMPLATE_Load                                                             */
+/*!
+    Load the command templates
+
+    The TEMPLATE_Load function initializes the template table and reads
+    the command templates from the template configuration file.  Blank
+    lines and lines starting with # are ignored.
+
+    @param[in]
+        pTable
+            pointer to the TemplateTable to initialize
+
+    @param[in]
+        filename
+            pointer to the name of the template configuration file
+
+    @retval EOK the templates were loaded
+    @retval EINVAL invalid arguments or invalid template definition
+    @retval EEXIST a template is defined twice
+    @retval E2BIG a template has too many arguments or parameters
+    @retval ENOENT a template's program cannot be found
+    @retval ENOMEM could not allocate a template
+    @retval error as returned by fopen
+
+==============================================================================*/
+int TEMPLATE_Load( TemplateTable *pTable, const char *filename )
+{
+    int result = EINVAL;
+    char line[MAX_LINE_LENGTH];
+    FILE *fp;
+
+    if( ( pTable != NULL ) &&
+        ( filename != NULL ) )
+    {
+        memset( pTable, 0, sizeof( TemplateTable ) );
+
+        fp = fopen( filename, "re" );
+        if( fp != NULL )
+        {
+            result = EOK;
+
+            while( ( result == EOK ) &&
+                   ( fgets( line, sizeof( line ), fp ) != NULL ) )
+            {
+                result = AddTemplate( pTable, line );
+            }
+
+            fclose( fp );
+        }
+        else
+        {
+            result = errno;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  TEMPLATE_Find                                                             */
+/*!
+    Find a command template
+
+    @param[in]
+        pTable
+            pointer to the TemplateTable, or NULL if templates are not used
+
+    @param[in]
+        name
+            pointer to the NUL terminated template name
+
+    @retval pointer to the command template
+    @retval NULL the template does not exist
+
+==============================================================================*/
+const CommandTemplate *TEMPLATE_Find( TemplateTable *pTable,
+                                      const char *name )
+{
+    CommandTemplate *pTemplate = NULL;
+
+    if( ( pTable != NULL ) &&
+        ( name != NULL ) )
+    {
+        pTemplate = pTable->pTemplates;
+        while( ( pTemplate != NULL ) &&
+               ( strcmp( pTemplate->name, name ) != 0 ) )
+        {
+            pTemplate = pTemplate->pNext;
+        }
+    }
+
+    return pTemplate;
+}
+
+/*============================================================================*/
+/*  TEMPLATE_Expand                                                           */
+/*!
+    Build the argument vector of a command template
+
+    The TEMPLATE_Expand function validates the name=value arguments of
+    a template message against the template's parameters, and builds
+    the template's argument vector.  Literal arguments point at the
+    template's pre-split text, and the arguments with a substituted
+    value are built in the supplied buffer.  Every parameter must be
+    given exactly one valid value.
+
+    @param[in]
+        pTemplate
+            pointer to the command template
+
+    @param[in]
+        args
+            pointer to the NUL terminated arguments of the message
+
+    @param[out]
+        pBuf
+            pointer to the buffer which receives the substituted
+            arguments
+
+    @param[in]
+        size
+            size of the buffer
+
+    @param[out]
+        argv
+            pointer to an array of at least MAX_TEMPLATE_ARGS + 1
+            pointers which receives the NULL terminated argument vector
+
+    @retval EOK the argument vector was built
+    @retval EINVAL invalid arguments, or an unknown, repeated, missing
+            or invalid parameter value
+    @retval E2BIG the substituted arguments do not fit in the buffer
+
+==============================================================================*/
+int TEMPLATE_Expand( const CommandTemplate *pTemplate,
+                     const char *args,
+                     char *pBuf,
+                     size_t size,
+                     char *argv[] )
+{
+    int result = EINVAL;
+    const char *values[MAX_TEMPLATE_PARAMS];
+    size_t lengths[MAX_TEMPLATE_PARAMS];
+    const TemplateArg *pArg;
+    const char *suffix;
+    size_t suffixLength;
+    size_t used = 0;
+    size_t n;
+    size_t i;
+    int p;
+
+    if( ( pTemplate != NULL ) &&
+        ( args != NULL ) &&
+        ( pBuf != NULL ) &&
+        ( argv != NULL ) )
+    {
+        result = GetValues( pTemplate, args, values, lengths );
+
+        for( i = 0; ( result == EOK ) && ( i < pTemplate->numArgs ); i++ )
+        {
+            pArg = &pTemplate->args[i];
+            p = pArg->param;
+            if( p == -1 )
+            {
+                /* literal arguments are used as they were pre-split */
+                argv[i] = pArg->text;
+            }
+            else
+            {
+                suffix = &pArg->text[pArg->offset];
+                suffixLength = strlen( suffix );
+                n = pArg->offset + lengths[p] + suffixLength + 1;
+                if( used + n <= size )
+                {
+                    argv[i] = &pBuf[used];
+                    memcpy( &pBuf[used], pArg->text, pArg->offset );
+                    used += pArg->offset;
+                    memcpy( &pBuf[used], values[p], lengths[p] );
+                    used += lengths[p];
+                    memcpy( &pBuf[used], suffix, suffixLength + 1 );
+                    used += suffixLength + 1;
+                }
+                else
+                {
+                    result = E2BIG;
+                }
+            }
+        }
+
+        argv[( result == EOK ) ? pTemplate->numArgs : 0] = NULL;
+    }
+
+    return result;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  AddTemplate                                                               */
+/*!
+    Add a command template
+
+    The AddTemplate function parses a line of the template configuration
+    file, resolves the template's program, and adds the template to the
+    template table.
+
+    @param[in]
+        pTable
+            pointer to the TemplateTable
+
+    @param[in]
+        line
+            pointer to the line to parse.  The line is modified.
+
+    @retval EOK the template was added, or the line was blank or a comment
+    @retval EINVAL invalid template definition
+    @retval EEXIST the template is already defined
+    @retval ENOMEM could not allocate the template
+    @retval error as returned by AddArg or ResolvePath
+
+==============================================================================*/
+static int AddTemplate( TemplateTable *pTable, char *line )
+{
+    int result = EOK;
+    CommandTemplate *pTemplate;
+    char *saveptr = NULL;
+    char *name;
+    char *program;
+    char *arg;
+
+    name = strtok_r( line, FIELD_SEPARATORS, &saveptr );
+    if( ( name != NULL ) && ( name[0] != '#' ) )
+    {
+        program = strtok_r( NULL, FIELD_SEPARATORS, &saveptr );
+        if( ( program == NULL ) ||
+            ( strchr( program, '{' ) != NULL ) ||
+            ( strlen( name ) >= MAX_TEMPLATE_NAME_LENGTH ) )
+        {
+            result = EINVAL;
+        }
+        else if( TEMPLATE_Find( pTable, name ) != NULL )
+        {
+            result = EEXIST;
+        }
+        else
+        {
+            pTemplate = calloc( 1, sizeof( CommandTemplate ) );
+            if( pTemplate != NULL )
+            {
+                strcpy( pTemplate->name, name );
+
+                result = ResolvePath( program,
+                                      pTemplate->path,
+                                      sizeof( pTemplate->path ) );
+                if( result == EOK )
+                {
+                    /* argv[0] is the resolved path of the program */
+                    result = AddArg( pTemplate, pTemplate->path );
+                }
+
+                while( ( result == EOK ) &&
+                       ( ( arg = strtok_r( NULL,
+                                           FIELD_SEPARATORS,
+                                           &saveptr ) ) != NULL ) )
+                {
+                    result = AddArg( pTemplate, arg );
+                }
+
+                if( result == EOK )
+                {
+                    pTemplate->pNext = pTable->pTemplates;
+                    pTable->pTemplates = pTemplate;
+                }
+                else
+                {
+                    free( pTemplate );
+                }
+            }
+            else
+            {
+                result = ENOMEM;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  AddArg                                                                    */
+/*!
+    Add an argument to a command template
+
+    The AddArg function stores the literal text of an argument with its
+    placeholder removed, and records the parameter substituted by the
+    placeholder and where its value is inserted.
+
+    @param[in]
+        pTemplate
+            pointer to the command template
+
+    @param[in]
+        arg
+            pointer to the NUL terminated argument.  The argument is
+            modified.
+
+    @retval EOK the argument was added
+    @retval EINVAL the argument has more than one or an invalid
+            placeholder
+    @retval E2BIG too many arguments or parameters, or too much text
+    @retval error as returned by AddParam
+
+==============================================================================*/
+static int AddArg( CommandTemplate *pTemplate, char *arg )
+{
+    int result = E2BIG;
+    TemplateArg *pArg;
+    char *open;
+    char *close;
+
+    if( pTemplate->numArgs < MAX_TEMPLATE_ARGS )
+    {
+        pArg = &pTemplate->args[pTemplate->numArgs];
+        pArg->param = -1;
+        pArg->offset = 0;
+        result = EOK;
+
+        open = strchr( arg, '{' );
+        if( open != NULL )
+        {
+            close = strchr( open, '}' );
+            if( ( close != NULL ) && ( strchr( close, '{' ) == NULL ) )
+            {
+                *close++ = '\0';
+                result = AddParam( pTemplate, &open[1], &pArg->param );
+
+                /* remove the placeholder from the literal text */
+                pArg->offset = open - arg;
+                memmove( open, close, strlen( close ) + 1 );
+            }
+            else
+            {
+                result = EINVAL;
+            }
+        }
+
+        if( result == EOK )
+        {
+            pArg->text = AddText( pTemplate, arg, strlen( arg ) );
+            if( pArg->text != NULL )
+            {
+                pTemplate->numArgs++;
+            }
+            else
+            {
+                result = E2BIG;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  AddParam                                                                  */
+/*!
+    Add a parameter to a command template
+
+    The AddParam function parses a name[:type] placeholder specification
+    and looks up or adds the parameter it refers to.  A parameter which
+    is already defined is referred to by its name alone.
+
+    @param[in]
+        pTemplate
+            pointer to the command template
+
+    @param[in]
+        spec
+            pointer to the NUL terminated placeholder specification.
+            The specification is modified.
+
+    @param[out]
+        pIndex
+            pointer to the location to store the index of the parameter
+
+    @retval EOK the parameter was found or added
+    @retval EINVAL invalid parameter specification
+    @retval E2BIG too many parameters
+    @retval error as returned by ParseType
+
+==============================================================================*/
+static int AddParam( CommandTemplate *pTemplate, char *spec, int *pIndex )
+{
+    int result = EINVAL;
+    TemplateParam *pParam;
+    char *type;
+    size_t i;
+
+    type = strchr( spec, ':' );
+    if( type != NULL )
+    {
+        *type++ = '\0';
+    }
+
+    if( IsParamName( spec ) )
+    {
+        i = 0;
+        while( ( i < pTemplate->numParams ) &&
+               ( strcmp( pTemplate->params[i].name, spec ) != 0 ) )
+        {
+            i++;
+        }
+
+        if( i < pTemplate->numParams )
+        {
+            /* a parameter is typed where it first appears */
+            result = ( type == NULL ) ? EOK : EINVAL;
+        }
+        else if( i >= MAX_TEMPLATE_PARAMS )
+        {
+            result = E2BIG;
+        }
+        else
+        {
+            pParam = &pTemplate->params[i];
+            strcpy( pParam->name, spec );
+            result = ParseType( pTemplate, pParam, type );
+            if( result == EOK )
+            {
+                pTemplate->numParams++;
+            }
+        }
+
+        *pIndex = (int)i;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  ParseType                                                                 */
+/*!
+    Parse the type of a template parameter
+
+    @param[in]
+        pTemplate
+            pointer to the command template
+
+    @param[in,out]
+        pParam
+            pointer to the parameter to update
+
+    @param[in]
+        type
+            pointer to the NUL terminated type[:arg] specification, or
+            NULL for a name.  The specification is modified.
+
+    @retval EOK the type was parsed
+    @retval EINVAL invalid type
+    @retval E2BIG no room for the values of an enum
+
+==============================================================================*/
+static int ParseType( CommandTemplate *pTemplate,
+                      TemplateParam *pParam,
+                      char *type )
+{
+    int result = EINVAL;
+    char *arg = NULL;
+    char *end;
+
+    pParam->type = TEMPLATE_PARAM_NAME;
+    pParam->min = 0;
+    pParam->max = ULONG_MAX;
+    pParam->choices = NULL;
+
+    if( ( type != NULL ) &&
+        ( ( arg = strchr( type, ':' ) ) != NULL ) )
+    {
+        *arg++ = '\0';
+    }
+
+    if( ( type == NULL ) ||
+        ( ( strcmp( type, "name" ) == 0 ) && ( arg == NULL ) ) )
+    {
+        result = EOK;
+    }
+    else if( strcmp( type, "uint" ) == 0 )
+    {
+        pParam->type = TEMPLATE_PARAM_UINT;
+        result = ( arg == NULL ) ? EOK : EINVAL;
+
+        if( ( arg != NULL ) && ( isdigit( (unsigned char)arg[0] ) ) )
+        {
+            pParam->min = strtoul( arg, &end, 10 );
+            if( ( *end == '-' ) && ( isdigit( (unsigned char)end[1] ) ) )
+            {
+                arg = &end[1];
+                pParam->max = strtoul( arg, &end, 10 );
+                if( ( *end == '\0' ) && ( pParam->min <= pParam->max ) )
+                {
+                    result = EOK;
+                }
+            }
+        }
+    }
+    else if( ( strcmp( type, "enum" ) == 0 ) &&
+             ( arg != NULL ) &&
+             ( arg[0] != '\0' ) )
+    {
+        pParam->type = TEMPLATE_PARAM_ENUM;
+        pParam->choices = AddText( pTemplate, arg, strlen( arg ) );
+        result = ( pParam->choices != NULL ) ? EOK : E2BIG;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  AddText                                                                   */
+/*!
+    Store literal text in a command template
+
+    @param[in]
+        pTemplate
+            pointer to the command template
+
+    @param[in]
+        text
+            pointer to the text to store
+
+    @param[in]
+        length
+            length of the text
+
+    @retval pointer to the NUL terminated copy of the text
+    @retval NULL the template's text buffer is full
+
+==============================================================================*/
+static char *AddText( CommandTemplate *pTemplate,
+                      const char *text,
+                      size_t length )
+{
+    char *pText = NULL;
+
+    if( pTemplate->textLength + length < sizeof( pTemplate->text ) )
+    {
+        pText = &pTemplate->text[pTemplate->textLength];
+        memcpy( pText, text, length );
+        pText[length] = '\0';
+        pTemplate->textLength += length + 1;
+    }
+
+    return pText;
+}
+
+/*============================================================================*/
+/*  ResolvePath                                                               */
+/*!
+    Resolve the absolute path of a template's program
+
+    The ResolvePath function checks a program named by an absolute path
+    is executable, or searches the absolute directories of the PATH for
+    a program named without a directory part.  Relative paths are not
+    accepted, since they depend on iotexec's working directory.
+
+    @param[in]
+        program
+            pointer to the NUL terminated program name
+
+    @param[out]
+        path
+            pointer to the buffer which receives the absolute path
+
+    @param[in]
+        size
+            size of the path buffer
+
+    @retval EOK the program was found
+    @retval EINVAL the program is named by a relative path
+    @retval ENAMETOOLONG the program path is too long
+    @retval ENOENT the program was not found or is not executable
+
+==============================================================================*/
+static int ResolvePath( const char *program, char *path, size_t size )
+{
+    int result = ENOENT;
+    const char *dir;
+    const char *end;
+    int n;
+
+    if( strchr( program, '/' ) != NULL )
+    {
+        if( program[0] != '/' )
+        {
+            result = EINVAL;
+        }
+        else if( strlen( program ) >= size )
+        {
+            result = ENAMETOOLONG;
+        }
+        else
+        {
+            strcpy( path, program );
+            result = IsExecutable( path ) ? EOK : ENOENT;
+        }
+    }
+    else
+    {
+        dir = getenv( "PATH" );
+        if( dir == NULL )
+        {
+            dir = DEFAULT_PATH;
+        }
+
+        while( ( result != EOK ) && ( *dir != '\0' ) )
+        {
+            end = strchrnul( dir, ':' );
+            if( dir[0] == '/' )
+            {
+                n = snprintf( path,
+                              size,
+                              "%.*s/%s",
+                              (int)( end - dir ),
+                              dir,
+                              program );
+                if( ( n > 0 ) &&
+                    ( (size_t)n < size ) &&
+                    ( IsExecutable( path ) ) )
+                {
+                    result = EOK;
+                }
+            }
+
+            dir = ( *end == ':' ) ? &end[1] : end;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IsExecutable                                                              */
+/*!
+    Determine if a path names an executable file
+
+    @param[in]
+        path
+            pointer to the NUL terminated path
+
+    @retval true the path is a regular file iotexec may execute
+    @retval false the path is not an executable file
+
+==============================================================================*/
+static bool IsExecutable( const char *path )
+{
+    struct stat st;
+
+    return ( stat( path, &st ) == 0 ) &&
+           ( S_ISREG( st.st_mode ) ) &&
+           ( access( path, X_OK ) == 0 );
+}
+
+/*============================================================================*/
+/*  IsParamName                                                               */
+/*!
+    Determine if a parameter name is valid
+
+    @param[in]
+        name
+            pointer to the NUL terminated parameter name
+
+    @retval true the name is made of letters, digits and _ and fits
+    @retval false the name is invalid
+
+==============================================================================*/
+static bool IsParamName( const char *name )
+{
+    size_t length = strlen( name );
+    bool valid = ( length > 0 ) && ( length < MAX_TEMPLATE_NAME_LENGTH );
+    size_t i;
+
+    for( i = 0; valid && ( i < length ); i++ )
+    {
+        valid = isalnum( (unsigned char)name[i] ) || ( name[i] == '_' );
+    }
+
+    return valid;
+}
+
+/*============================================================================*/
+/*  GetValues                                                                 */
+/*!
+    Get the parameter values of a template message
+
+    The GetValues function splits the arguments of a template message
+    into name=value pairs, and validates the value of each parameter.
+
+    @param[in]
+        pTemplate
+            pointer to the command template
+
+    @param[in]
+        args
+            pointer to the NUL terminated arguments of the message
+
+    @param[out]
+        values
+            array which receives a pointer to the value of each parameter
+
+    @param[out]
+        lengths
+            array which receives the length of each parameter value
+
+    @retval EOK every parameter has a valid value
+    @retval EINVAL a malformed argument, or an unknown, repeated,
+            missing or invalid parameter value
+
+==============================================================================*/
+static int GetValues( const CommandTemplate *pTemplate,
+                      const char *args,
+                      const char *values[],
+                      size_t lengths[] )
+{
+    int result = EOK;
+    const char *token;
+    const char *value;
+    size_t length;
+    size_t nameLength;
+    size_t i;
+
+    for( i = 0; i < pTemplate->numParams; i++ )
+    {
+        values[i] = NULL;
+        lengths[i] = 0;
+    }
+
+    token = &args[strspn( args, ARG_SEPARATORS )];
+    while( ( result == EOK ) && ( *token != '\0' ) )
+    {
+        result = EINVAL;
+
+        length = strcspn( token, ARG_SEPARATORS );
+        value = memchr( token, '=', length );
+        if( value != NULL )
+        {
+            nameLength = value - token;
+            value++;
+
+            i = 0;
+            while( ( i < pTemplate->numParams ) &&
+                   ( ( strlen( pTemplate->params[i].name ) != nameLength ) ||
+                     ( strncmp( pTemplate->params[i].name,
+                                token,
+                                nameLength ) != 0 ) ) )
+            {
+                i++;
+            }
+
+            if( ( i < pTemplate->numParams ) && ( values[i] == NULL ) )
+            {
+                values[i] = value;
+                lengths[i] = length - nameLength - 1;
+                result = CheckValue( &pTemplate->params[i],
+                                     value,
+                                     lengths[i] );
+            }
+        }
+
+        token = &token[length];
+        token = &token[strspn( token, ARG_SEPARATORS )];
+    }
+
+    for( i = 0; ( result == EOK ) && ( i < pTemplate->numParams ); i++ )
+    {
+        if( values[i] == NULL )
+        {
+            result = EINVAL;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  CheckValue                                                                */
+/*!
+    Validate a parameter value against its type
+
+    @param[in]
+        pParam
+            pointer to the template parameter
+
+    @param[in]
+        value
+            pointer to the value, which is not NUL terminated
+
+    @param[in]
+        length
+            length of the value
+
+    @retval EOK the value is valid
+    @retval EINVAL the value is empty, too long, or invalid for the type
+
+==============================================================================*/
+static int CheckValue( const TemplateParam *pParam,
+                       const char *value,
+                       size_t length )
+{
+    bool valid = ( length > 0 ) && ( length < MAX_TEMPLATE_VALUE_LENGTH );
+    char buf[MAX_TEMPLATE_VALUE_LENGTH];
+    const char *choice;
+    size_t choiceLength;
+    unsigned long n;
+    size_t i;
+
+    switch( pParam->type )
+    {
+        case TEMPLATE_PARAM_UINT:
+            for( i = 0; valid && ( i < length ); i++ )
+            {
+                valid = isdigit( (unsigned char)value[i] );
+            }
+
+            if( valid )
+            {
+                memcpy( buf, value, length );
+                buf[length] = '\0';
+                errno = 0;
+                n = strtoul( buf, NULL, 10 );
+                valid = ( errno == 0 ) &&
+                        ( n >= pParam->min ) &&
+                        ( n <= pParam->max );
+            }
+            break;
+
+        case TEMPLATE_PARAM_ENUM:
+            choice = pParam->choices;
+            while( valid && ( *choice != '\0' ) )
+            {
+                choiceLength = strcspn( choice, "|" );
+                if( ( choiceLength == length ) &&
+                    ( memcmp( choice, value, length ) == 0 ) )
+                {
+                    break;
+                }
+
+                choice = &choice[choiceLength];
+                choice = ( *choice == '|' ) ? &choice[1] : choice;
+            }
+
+            valid = valid && ( *choice != '\0' );
+            break;
+
+        default:
+            valid = valid && ( value[0] != '-' ) && ( value[0] != '.' );
+            for( i = 0; valid && ( i < length ); i++ )
+            {
+                valid = isalnum( (unsigned char)value[i] ) ||
+                        ( strchr( NAME_CHARS, value[i] ) != NULL );
+            }
+            break;
+    }
+
+    return valid ? EOK : EINVAL;
+}
+
+/*! @}
+ * end of template group */
@@ -0,0 +1,565 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup upload upload
+ * @brief Stdin upload streams
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file upload.c
+
+    Stdin upload streams
+
+    The upload module streams data sent in cloud-to-device messages
+    into the stdin of a running command, so configuration files and
+    firmware images can be pushed without encoding them into the
+    command or staging them in a temporary file.
+
+    A command with a stdin:true header is given a pipe as its stdin
+    when it is received.  Each following message with an input header
+    holding the messageId of the command has its body written to the
+    pipe, and a message with an eof:true header closes the pipe once
+    its body has been written:
+
+        messageId: 7d4c     stdin: true           cat > /etc/app.conf
+        input: 7d4c                               <data>
+        input: 7d4c         eof: true             <data>
+
+    The data is written by the message dispatcher.  When the pipe is
+    full the dispatcher waits for the command to read from it, so no
+    further messages are received and the sender is held back at the
+    rate the command consumes its input.  A command which does not
+    accept data within the write timeout, or whose stream is unused
+    for the idle time, has its stdin closed.
+
+    The module is used only by the message dispatcher, so it performs
+    no locking.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "upload.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+#ifndef EOK
+/*! success response */
+#define EOK 0
+#endif
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static int Open( UploadTable *pTable, Job *pJob, uint64_t now );
+static int Write( UploadTable *pTable,
+                  Job *pJob,
+                  const char *msgId,
+                  uint64_t now );
+static UploadStream *FindStream( UploadTable *pTable, const char *msgId );
+static void RemoveStream( UploadTable *pTable, UploadStream *pStream );
+static void Expire( UploadTable *pTable, uint64_t now );
+static int WriteAll( UploadTable *pTable,
+                     int fd,
+                     const char *pData,
+                     size_t length );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  UPLOAD_Init                                                               */
+/*!
+    Initialize the stdin upload streams
+
+    @param[in]
+        pTable
+            pointer to the UploadTable to initialize
+
+    @param[in]
+        maxStreams
+            maximum number of open upload streams
+
+    @param[in]
+        idleMs
+            time (ms) after which an unused stream is closed
+
+    @param[in]
+        writeTimeoutMs
+            time (ms) to wait for a command to accept more data
+
+    @retval EOK the UploadTable was initialized
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int UPLOAD_Init( UploadTable *pTable,
+                 size_t maxStreams,
+                 uint64_t idleMs,
+                 uint64_t writeTimeoutMs )
+{
+    int result = EINVAL;
+
+    if( pTable != NULL )
+    {
+        memset( pTable, 0, sizeof( UploadTable ) );
+        pTable->maxStreams = maxStreams;
+        pTable->idleMs = idleMs;
+        pTable->writeTimeoutMs = writeTimeoutMs;
+
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  UPLOAD_Add                                                                */
+/*!
+    Pass a received job through the stdin upload streams
+
+    The UPLOAD_Add function opens an upload stream for a command with a
+    stdin:true header, leaving the job in place with the read end of
+    the stream as its stdin.  A job with an input header is consumed,
+    its body being written to the stream of the command it names.  Any
+    other job is left untouched.
+
+    @param[in]
+        pTable
+            pointer to the UploadTable
+
+    @param[in,out]
+        ppJob
+            pointer to the received job, which is set to NULL if the
+            job was consumed or released
+
+    @param[in]
+        now
+            the current monotonic time (ms)
+
+    @retval EOK the job is a command, or its data was written
+    @retval ENOENT the command named by the input header has no stream
+    @retval ENOSPC too many upload streams are open
+    @retval EALREADY the command already has an upload stream
+    @retval ETIMEDOUT the command did not accept the data in time
+    @retval EPIPE the command has exited
+    @retval EINVAL invalid arguments, or a stdin command has no messageId
+    @retval error as returned by pipe2 or write
+
+==============================================================================*/
+int UPLOAD_Add( UploadTable *pTable, Job **ppJob, uint64_t now )
+{
+    int result = EINVAL;
+    char msgId[MAX_MSGID_LENGTH];
+    Job *pJob;
+
+    if( ( pTable != NULL ) &&
+        ( ppJob != NULL ) &&
+        ( *ppJob != NULL ) )
+    {
+        pJob = *ppJob;
+
+        Expire( pTable, now );
+
+        if( JOB_GetProperty( pJob,
+                             JOB_PROPERTY_INPUT,
+                             msgId,
+                             sizeof( msgId ) ) == EOK )
+        {
+            /* data for the stdin of a command */
+            result = Write( pTable, pJob, msgId, now );
+            JOB_Free( pJob );
+            *ppJob = NULL;
+        }
+        else if( JOB_IsTrue( pJob, JOB_PROPERTY_STDIN ) )
+        {
+            result = Open( pTable, pJob, now );
+            if( result != EOK )
+            {
+                JOB_Free( pJob );
+                *ppJob = NULL;
+            }
+        }
+        else
+        {
+            result = EOK;
+        }
+    }
+
+    return result;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  Open                                                                      */
+/*!
+    Open an upload stream for a command
+
+    The Open function creates the command's stdin pipe.  The read end
+    is stored in the job to be handed to the command when it is
+    launched, and the write end is kept by the stream.  Both ends are
+    close-on-exec so no other command inherits the pipe and holds it
+    open.
+
+    @param[in]
+        pTable
+            pointer to the UploadTable
+
+    @param[in]
+        pJob
+            pointer to the job containing the command
+
+    @param[in]
+        now
+            the current monotonic time (ms)
+
+    @retval EOK the stream was opened
+    @retval EINVAL the command has no messageId
+    @retval EALREADY the command already has an upload stream
+    @retval ENOSPC too many upload streams are open
+    @retval ENOMEM out of memory
+    @retval error as returned by pipe2
+
+==============================================================================*/
+static int Open( UploadTable *pTable, Job *pJob, uint64_t now )
+{
+    int result = EINVAL;
+    UploadStream *pStream;
+    int fd[2];
+
+    if( pJob->msgId[0] == '\0' )
+    {
+        result = EINVAL;
+    }
+    else if( FindStream( pTable, pJob->msgId ) != NULL )
+    {
+        result = EALREADY;
+    }
+    else if( pTable->numStreams >= pTable->maxStreams )
+    {
+        result = ENOSPC;
+    }
+    else if( pipe2( fd, O_CLOEXEC ) != 0 )
+    {
+        result = errno;
+    }
+    else
+    {
+        pStream = calloc( 1, sizeof( UploadStream ) );
+        if( pStream != NULL )
+        {
+            /* the dispatcher must never block indefinitely on a write */
+            (void)fcntl( fd[1], F_SETFL, O_NONBLOCK );
+
+            strcpy( pStream->msgId, pJob->msgId );
+            pStream->fd = fd[1];
+            pStream->lastUsed = now;
+            pJob->fdIn = fd[0];
+
+            pStream->pNext = pTable->pStreams;
+            pTable->pStreams = pStream;
+            pTable->numStreams++;
+
+            result = EOK;
+        }
+        else
+        {
+            close( fd[0] );
+            close( fd[1] );
+            result = ENOMEM;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  Write                                                                     */
+/*!
+    Write uploaded data to the stdin of a command
+
+    The Write function writes the body of a job to the upload stream of
+    the named command.  The stream is closed after the data of a job
+    with an eof:true header, or if the data cannot be written.
+
+    @param[in]
+        pTable
+            pointer to the UploadTable
+
+    @param[in]
+        pJob
+            pointer to the job containing the data
+
+    @param[in]
+        msgId
+            pointer to the NUL terminated messageId of the command
+
+    @param[in]
+        now
+            the current monotonic time (ms)
+
+    @retval EOK the data was written
+    @retval ENOENT the command has no upload stream
+    @retval error as returned by WriteAll
+
+==============================================================================*/
+static int Write( UploadTable *pTable,
+                  Job *pJob,
+                  const char *msgId,
+                  uint64_t now )
+{
+    int result = ENOENT;
+    UploadStream *pStream;
+
+    pStream = FindStream( pTable, msgId );
+    if( pStream != NULL )
+    {
+        result = WriteAll( pTable, pStream->fd, pJob->pBody, pJob->bodyLength );
+        if( ( result != EOK ) || JOB_IsTrue( pJob, JOB_PROPERTY_EOF ) )
+        {
+            RemoveStream( pTable, pStream );
+        }
+        else
+        {
+            pStream->lastUsed = now;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  FindStream                                                                */
+/*!
+    Find the upload stream of a command
+
+    @param[in]
+        pTable
+            pointer to the UploadTable
+
+    @param[in]
+        msgId
+            pointer to the NUL terminated messageId of the command
+
+    @retval pointer to the UploadStream
+    @retval NULL the command has no upload stream
+
+==============================================================================*/
+static UploadStream *FindStream( UploadTable *pTable, const char *msgId )
+{
+    UploadStream *pStream = pTable->pStreams;
+
+    while( ( pStream != NULL ) &&
+           ( strcmp( pStream->msgId, msgId ) != 0 ) )
+    {
+        pStream = pStream->pNext;
+    }
+
+    return pStream;
+}
+
+/*============================================================================*/
+/*  RemoveStream                                                              */
+/*!
+    Close an upload stream
+
+    The RemoveStream function closes the write end of the command's
+    stdin pipe, so the command reads end of file once it has consumed
+    the data already written.
+
+    @param[in]
+        pTable
+            pointer to the UploadTable
+
+    @param[in]
+        pStream
+            pointer to the UploadStream to close
+
+==============================================================================*/
+static void RemoveStream( UploadTable *pTable, UploadStream *pStream )
+{
+    UploadStream **ppStream = &pTable->pStreams;
+
+    while( ( *ppStream != NULL ) && ( *ppStream != pStream ) )
+    {
+        ppStream = &(*ppStream)->pNext;
+    }
+
+    if( *ppStream != NULL )
+    {
+        *ppStream = pStream->pNext;
+        pTable->numStreams--;
+
+        close( pStream->fd );
+        free( pStream );
+    }
+}
+
+/*============================================================================*/
+/*  Expire                                                                    */
+/*!
+    Close upload streams which have not been used recently
+
+    @param[in]
+        pTable
+            pointer to the UploadTable
+
+    @param[in]
+        now
+            the current monotonic time (ms)
+
+==============================================================================*/
+static void Expire( UploadTable *pTable, uint64_t now )
+{
+    UploadStream *pStream;
+    UploadStream *pNext;
+
+    for( pStream = pTable->pStreams; pStream != NULL; pStream = pNext )
+    {
+        pNext = pStream->pNext;
+
+        if( ( pTable->idleMs > 0 ) &&
+            ( now - pStream->lastUsed >= pTable->idleMs ) )
+        {
+            RemoveStream( pTable, pStream );
+        }
+    }
+}
+
+/*============================================================================*/
+/*  WriteAll                                                                  */
+/*!
+    Write a buffer to a command's stdin pipe
+
+    The WriteAll function writes the whole buffer to the non-blocking
+    write end of a pipe, waiting for the command to read from the pipe
+    whenever it is full.  SIGPIPE is blocked on the calling thread
+    during the write so a command which has exited is reported as
+    EPIPE instead of terminating iotexec.
+
+    @param[in]
+        pTable
+            pointer to the UploadTable
+
+    @param[in]
+        fd
+            the write end of the pipe
+
+    @param[in]
+        pData
+            pointer to the data to write
+
+    @param[in]
+        length
+            number of bytes to write
+
+    @retval EOK the data was written
+    @retval ETIMEDOUT the command did not read from the pipe in time
+    @retval error as returned by write or poll
+
+==============================================================================*/
+static int WriteAll( UploadTable *pTable,
+                     int fd,
+                     const char *pData,
+                     size_t length )
+{
+    int result = EOK;
+    struct pollfd pfd;
+    sigset_t mask;
+    sigset_t old;
+    struct timespec zero = { 0, 0 };
+    ssize_t n;
+    int rc;
+
+    sigemptyset( &mask );
+    sigaddset( &mask, SIGPIPE );
+    pthread_sigmask( SIG_BLOCK, &mask, &old );
+
+    pfd.fd = fd;
+    pfd.events = POLLOUT;
+
+    while( ( result == EOK ) && ( length > 0 ) )
+    {
+        n = write( fd, pData, length );
+        if( n > 0 )
+        {
+            pData += n;
+            length -= n;
+        }
+        else if( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) )
+        {
+            /* the pipe is full: wait for the command to catch up */
+            rc = poll( &pfd, 1, (int)pTable->writeTimeoutMs );
+            if( rc == 0 )
+            {
+                result = ETIMEDOUT;
+            }
+            else if( ( rc < 0 ) && ( errno != EINTR ) )
+            {
+                result = errno;
+            }
+        }
+        else if( errno != EINTR )
+        {
+            result = errno;
+        }
+    }
+
+    if( result == EPIPE )
+    {
+        /* discard the pending SIGPIPE */
+        sigtimedwait( &mask, NULL, &zero );
+    }
+
+    pthread_sigmask( SIG_SETMASK, &old, NULL );
+
+    return result;
+}
+
+/*! @}
+ * end of upload group */
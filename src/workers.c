@@ -0,0 +1,640 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup workers workers
+ * @brief Command executor worker pool
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file workers.c
+
+    Command executor worker pool
+
+    The workers module maintains a pool of executor threads which take
+    jobs from a bounded queue filled by the message dispatcher.  This
+    allows independent commands to run in parallel so a single slow
+    command does not stall the commands queued behind it.
+
+    Each worker owns its own iotclient connection so the responses from
+    concurrently executing commands are streamed independently.
+
+    Jobs are taken from the queue in priority order, and low priority
+    jobs are kept out of the worker slots reserved for more urgent
+    commands.
+
+    With an adaptive concurrency limiter, fewer jobs than workers may
+    execute while the device is loaded.  The limit is updated as jobs
+    complete, and by the idle workers while jobs are held back by it.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <iotclient/iotclient.h>
+#include "workers.h"
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static void *WorkerThread( void *arg );
+static Job *GetJob( WorkerPool *pPool );
+static void EndJob( WorkerPool *pPool,
+                    const JobSlot *pSlot,
+                    Job *pJob,
+                    Job *pResume );
+static void WaitLimit( WorkerPool *pPool );
+static void UpdateLimit( WorkerPool *pPool );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  WORKERS_Create                                                            */
+/*!
+    Create a pool of executor workers
+
+    The WORKERS_Create function initializes the job queue and starts
+    the requested number of worker threads.  Each worker is given
+    its own iotclient connection for sending command responses.
+
+    @param[in]
+        pPool
+            pointer to the worker pool to initialize
+
+    @param[in]
+        numWorkers
+            number of worker threads to create (1..MAX_WORKERS)
+
+    @param[in]
+        maxDepth
+            maximum number of jobs which can wait in the queue
+
+    @param[in]
+        reserved
+            number of workers reserved for normal and high priority jobs
+
+    @param[in]
+        pLimiter
+            pointer to the adaptive concurrency limiter, or NULL to
+            execute a job on every worker
+
+    @param[in]
+        handler
+            function invoked by a worker to execute a job
+
+    @param[in]
+        arg
+            opaque argument passed to the handler
+
+    @param[in]
+        verbose
+            verbose flag applied to each worker's iotclient connection
+
+    @retval EOK the worker pool was created
+    @retval EINVAL invalid arguments
+    @retval ENOTCONN a worker could not connect to the iothub service
+    @retval error as returned by pthread_create
+
+==============================================================================*/
+int WORKERS_Create( WorkerPool *pPool,
+                    size_t numWorkers,
+                    size_t maxDepth,
+                    size_t reserved,
+                    Limiter *pLimiter,
+                    WorkerHandler handler,
+                    void *arg,
+                    bool verbose )
+{
+    int result = EINVAL;
+    size_t i;
+    Worker *pWorker;
+
+    if( ( pPool != NULL ) &&
+        ( handler != NULL ) &&
+        ( numWorkers > 0 ) &&
+        ( numWorkers <= MAX_WORKERS ) &&
+        ( maxDepth > 0 ) )
+    {
+        memset( pPool, 0, sizeof( WorkerPool ) );
+        pthread_mutex_init( &pPool->lock, NULL );
+        pthread_cond_init( &pPool->notEmpty, NULL );
+        pthread_cond_init( &pPool->notFull, NULL );
+        JOBQUEUE_Init( &pPool->queue, maxDepth, numWorkers, reserved );
+        pPool->pLimiter = pLimiter;
+        pPool->handler = handler;
+        pPool->arg = arg;
+
+        result = EOK;
+
+        for( i = 0; ( i < numWorkers ) && ( result == EOK ); i++ )
+        {
+            pWorker = &pPool->workers[i];
+            pWorker->pPool = pPool;
+            pWorker->hIoTClient = IOTCLIENT_Create();
+            if( pWorker->hIoTClient != NULL )
+            {
+                IOTCLIENT_SetVerbose( pWorker->hIoTClient, verbose );
+
+                result = pthread_create( &pWorker->thread,
+                                         NULL,
+                                         WorkerThread,
+                                         pWorker );
+                if( result == EOK )
+                {
+                    pPool->numWorkers++;
+                }
+                else
+                {
+                    IOTCLIENT_Close( pWorker->hIoTClient );
+                    pWorker->hIoTClient = NULL;
+                }
+            }
+            else
+            {
+                result = ENOTCONN;
+            }
+        }
+
+        if( result != EOK )
+        {
+            WORKERS_Shutdown( pPool );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  WORKERS_Wait                                                              */
+/*!
+    Wait until the worker pool can accept a job
+
+    The WORKERS_Wait function blocks while the job queue, or the share
+    of the queue of the job's receiver target, is full, so unprocessed
+    messages remain queued in the target's iotclient receiver, unless
+    the job's originator holds its fair share of the queue.  The job is
+    not submitted.
+
+    @param[in]
+        pPool
+            pointer to the worker pool
+
+    @param[in]
+        pJob
+            pointer to the job to be submitted
+
+    @retval EOK the job may be submitted
+    @retval EINVAL invalid arguments
+    @retval ESHUTDOWN the worker pool is shutting down
+
+==============================================================================*/
+int WORKERS_Wait( WorkerPool *pPool, Job *pJob )
+{
+    int result = EINVAL;
+
+    if( ( pPool != NULL ) &&
+        ( pJob != NULL ) )
+    {
+        pthread_mutex_lock( &pPool->lock );
+
+        while( ( JOBQUEUE_IsFull( &pPool->queue, pJob ) ) &&
+               ( JOBQUEUE_IsOverShare( &pPool->queue, pJob ) == false ) &&
+               ( pPool->shutdown == false ) )
+        {
+            pthread_cond_wait( &pPool->notFull, &pPool->lock );
+        }
+
+        result = ( pPool->shutdown == true ) ? ESHUTDOWN : EOK;
+
+        pthread_mutex_unlock( &pPool->lock );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  WORKERS_Submit                                                            */
+/*!
+    Submit a job to the worker pool
+
+    The WORKERS_Submit function appends a job to the job queue for its
+    priority and wakes an idle worker.  It does not block: a job which
+    the queue cannot accept is refused, so the caller should first wait
+    for room with WORKERS_Wait.
+
+    On success the job is owned by the worker pool.
+
+    @param[in]
+        pPool
+            pointer to the worker pool
+
+    @param[in]
+        pJob
+            pointer to the job to submit
+
+    @retval EOK the job was queued
+    @retval EINVAL invalid arguments
+    @retval EAGAIN the queue, or the share of the queue of the job's
+            receiver target, is full, so the caller should wait again
+    @retval EBUSY the queue is full and the job's originator holds its
+            fair share of it, so the job must be refused
+    @retval ESHUTDOWN the worker pool is shutting down
+
+==============================================================================*/
+int WORKERS_Submit( WorkerPool *pPool, Job *pJob )
+{
+    int result = EINVAL;
+
+    if( ( pPool != NULL ) &&
+        ( pJob != NULL ) )
+    {
+        pthread_mutex_lock( &pPool->lock );
+
+        if( pPool->shutdown == true )
+        {
+            result = ESHUTDOWN;
+        }
+        else if( JOBQUEUE_IsOverShare( &pPool->queue, pJob ) )
+        {
+            result = EBUSY;
+        }
+        else if( JOBQUEUE_IsFull( &pPool->queue, pJob ) )
+        {
+            result = EAGAIN;
+        }
+        else
+        {
+            JOBQUEUE_Put( &pPool->queue, pJob );
+
+            pthread_cond_signal( &pPool->notEmpty );
+            result = EOK;
+        }
+
+        pthread_mutex_unlock( &pPool->lock );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  WORKERS_SetShare                                                          */
+/*!
+    Limit the number of workers executing, and the number of queued
+    jobs of, a receiver target
+
+    @param[in]
+        pPool
+            pointer to the worker pool
+
+    @param[in]
+        target
+            index of the receiver target
+
+    @param[in]
+        share
+            maximum number of workers executing the target's jobs at
+            once, 0 for no limit
+
+    @param[in]
+        depth
+            maximum number of queued jobs of the target, 0 for no limit
+            other than the depth of the queue
+
+    @retval EOK the share was set
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int WORKERS_SetShare( WorkerPool *pPool,
+                      unsigned int target,
+                      size_t share,
+                      size_t depth )
+{
+    int result = EINVAL;
+
+    if( ( pPool != NULL ) &&
+        ( target < JOB_MAX_TARGETS ) )
+    {
+        pthread_mutex_lock( &pPool->lock );
+        JOBQUEUE_SetShare( &pPool->queue, target, share, depth );
+        pthread_cond_broadcast( &pPool->notEmpty );
+        pthread_cond_broadcast( &pPool->notFull );
+        pthread_mutex_unlock( &pPool->lock );
+
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  WORKERS_Shutdown                                                          */
+/*!
+    Shut down the worker pool
+
+    The WORKERS_Shutdown function wakes all the workers, waits for them
+    to finish their current job, and discards any jobs which are still
+    queued.
+
+    @param[in]
+        pPool
+            pointer to the worker pool
+
+    @retval EOK the worker pool was shut down
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int WORKERS_Shutdown( WorkerPool *pPool )
+{
+    int result = EINVAL;
+    size_t i;
+    Job *pJob;
+
+    if( pPool != NULL )
+    {
+        pthread_mutex_lock( &pPool->lock );
+        pPool->shutdown = true;
+        pthread_cond_broadcast( &pPool->notEmpty );
+        pthread_cond_broadcast( &pPool->notFull );
+        pthread_mutex_unlock( &pPool->lock );
+
+        for( i = 0; i < pPool->numWorkers; i++ )
+        {
+            pthread_join( pPool->workers[i].thread, NULL );
+            IOTCLIENT_Close( pPool->workers[i].hIoTClient );
+            pPool->workers[i].hIoTClient = NULL;
+        }
+
+        pPool->numWorkers = 0;
+
+        while( ( pJob = JOBQUEUE_Remove( &pPool->queue ) ) != NULL )
+        {
+            JOB_Free( pJob );
+        }
+
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  WorkerThread                                                              */
+/*!
+    Executor worker thread
+
+    The WorkerThread function repeatedly takes a job from the job queue
+    and executes it using the pool's job handler, until the pool is
+    shut down.  A job retained by the handler (EINPROGRESS) is owned by
+    its session and may be freed by another worker at any time, so its
+    execution slot is recorded before the handler is called.  A job
+    resumed by the handler (the next step of a batch, or the next job
+    waiting for a session) is counted as executing and is executed by
+    the same worker.
+
+    @param[in]
+        arg
+            pointer to the Worker
+
+    @retval NULL
+
+==============================================================================*/
+static void *WorkerThread( void *arg )
+{
+    Worker *pWorker = (Worker *)arg;
+    WorkerPool *pPool;
+    Job *pJob;
+    Job *pResume;
+    JobSlot slot;
+    int result;
+
+    if( pWorker != NULL )
+    {
+        pPool = pWorker->pPool;
+
+        pJob = GetJob( pPool );
+        while( pJob != NULL )
+        {
+            JOBQUEUE_GetSlot( pJob, &slot );
+
+            pResume = NULL;
+            result = pPool->handler( pWorker->hIoTClient,
+                                     pJob,
+                                     &pResume,
+                                     pPool->arg );
+
+            EndJob( pPool,
+                    &slot,
+                    ( result != EINPROGRESS ) ? pJob : NULL,
+                    pResume );
+
+            pJob = ( pResume != NULL ) ? pResume : GetJob( pPool );
+        }
+    }
+
+    return NULL;
+}
+
+/*============================================================================*/
+/*  GetJob                                                                    */
+/*!
+    Wait for a job from the job queue
+
+    The GetJob function blocks until a job which may be executed is
+    available in the job queue, or the pool is shut down.  While queued
+    jobs are held back by the concurrency limit, the wait is bounded by
+    the next update of the limit.
+
+    @param[in]
+        pPool
+            pointer to the worker pool
+
+    @retval pointer to the job removed from the queue
+    @retval NULL the pool is shutting down
+
+==============================================================================*/
+static Job *GetJob( WorkerPool *pPool )
+{
+    Job *pJob = NULL;
+
+    pthread_mutex_lock( &pPool->lock );
+
+    UpdateLimit( pPool );
+
+    while( ( pPool->shutdown == false ) &&
+           ( ( pJob = JOBQUEUE_Get( &pPool->queue ) ) == NULL ) )
+    {
+        if( ( pPool->pLimiter != NULL ) && ( pPool->queue.depth > 0 ) )
+        {
+            WaitLimit( pPool );
+        }
+        else
+        {
+            pthread_cond_wait( &pPool->notEmpty, &pPool->lock );
+        }
+    }
+
+    if( pJob != NULL )
+    {
+        /* the receivers of several targets may be waiting for room */
+        pthread_cond_broadcast( &pPool->notFull );
+    }
+
+    pthread_mutex_unlock( &pPool->lock );
+
+    return pJob;
+}
+
+/*============================================================================*/
+/*  EndJob                                                                    */
+/*!
+    Release a completed job
+
+    The EndJob function counts the resumed job as executing, releases
+    the completed job's execution slot, waking the workers if a queued
+    low priority job can now be executed, updates the concurrency
+    limit, and frees the completed job.
+
+    @param[in]
+        pPool
+            pointer to the worker pool
+
+    @param[in]
+        pSlot
+            pointer to the execution slot of the completed job
+
+    @param[in]
+        pJob
+            pointer to the completed job to free, or NULL if the job was
+            retained by the handler
+
+    @param[in]
+        pResume
+            pointer to the job resumed by the handler, or NULL if none
+
+==============================================================================*/
+static void EndJob( WorkerPool *pPool,
+                    const JobSlot *pSlot,
+                    Job *pJob,
+                    Job *pResume )
+{
+    pthread_mutex_lock( &pPool->lock );
+
+    if( pResume != NULL )
+    {
+        JOBQUEUE_Resume( &pPool->queue, pResume );
+    }
+
+    if( JOBQUEUE_Release( &pPool->queue, pSlot ) )
+    {
+        pthread_cond_broadcast( &pPool->notEmpty );
+    }
+
+    UpdateLimit( pPool );
+
+    pthread_mutex_unlock( &pPool->lock );
+
+    if( pJob != NULL )
+    {
+        JOB_Free( pJob );
+    }
+}
+
+/*============================================================================*/
+/*  WaitLimit                                                                 */
+/*!
+    Wait for a job while queued jobs are held back by the concurrency limit
+
+    The WaitLimit function waits for a job to be queued or completed, or
+    until the concurrency limit is due to be updated, and then updates
+    the limit.  It must be called with the pool lock held.
+
+    @param[in]
+        pPool
+            pointer to the worker pool
+
+==============================================================================*/
+static void WaitLimit( WorkerPool *pPool )
+{
+    struct timespec deadline;
+    int timeout = LIMITER_Timeout( pPool->pLimiter );
+
+    clock_gettime( CLOCK_REALTIME, &deadline );
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += ( timeout % 1000 ) * 1000000L;
+    if( deadline.tv_nsec >= 1000000000L )
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_cond_timedwait( &pPool->notEmpty, &pPool->lock, &deadline );
+
+    UpdateLimit( pPool );
+}
+
+/*============================================================================*/
+/*  UpdateLimit                                                               */
+/*!
+    Update the concurrency limit of the job queue
+
+    The UpdateLimit function applies the adaptive concurrency limit to
+    the job queue once it is due to be updated, and wakes the workers
+    if the limit was raised.  It must be called with the pool lock held.
+
+    @param[in]
+        pPool
+            pointer to the worker pool
+
+==============================================================================*/
+static void UpdateLimit( WorkerPool *pPool )
+{
+    size_t limit;
+
+    if( ( LIMITER_Update( pPool->pLimiter, &limit ) ) &&
+        ( JOBQUEUE_SetLimit( &pPool->queue, limit ) ) )
+    {
+        pthread_cond_broadcast( &pPool->notEmpty );
+    }
+}
+
+/*! @}
+ * end of workers group */